@@ -4,4 +4,4 @@
 
 COMPONENT_ADD_INCLUDEDIRS := $(ESP_CODEC_PATH) include
 
-COMPONENT_SRCDIRS := $(ESP_CODEC_PATH)
+COMPONENT_SRCDIRS := $(ESP_CODEC_PATH) src
@@ -28,6 +28,7 @@
 #include "driver/i2c.h"
 #include "driver/gpio.h"
 #include <esp_codec.h>
+#include <codec_reg_cache.h>
 
 /* ES8311 address
  * 0x32:CE=1;0x30:CE=0
@@ -179,6 +180,8 @@ static const struct _coeff_div coeff_div[] = {
 
 static char *TAG = "esp_codec_es8311";
 
+static codec_reg_cache_t es8311_regs;
+
 #define ES_ASSERT(a, format, b, ...) \
     if ((a) != 0) { \
         ESP_LOGE(TAG, format, ##__VA_ARGS__); \
@@ -200,17 +203,12 @@ static esp_err_t es8311_i2c_init(int i2c_port)
     return ret;
 }
 
+/*
+* Writes go to the register cache. They reach the chip with the next es8311_flush().
+*/
 static int es8311_write_reg(uint8_t reg_addr, uint8_t data)
 {
-    int res = 0;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    res |= i2c_master_start(cmd);
-    res |= i2c_master_write_byte(cmd, ES8311_ADDR, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_write_byte(cmd, reg_addr, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_write_byte(cmd, data, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_stop(cmd);
-    res |= i2c_master_cmd_begin(0, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    int res = codec_reg_write(&es8311_regs, reg_addr, data);
     ES_ASSERT(res, "ES8311 Write Reg error reg_addr: 0x%x, data: %d", -1, reg_addr, data);
     ESP_LOGD(TAG, "ES8311 Write reg_addr: 0x%x, data: %d", reg_addr, data);
     return res;
@@ -219,29 +217,21 @@ static int es8311_write_reg(uint8_t reg_addr, uint8_t data)
 static int es8311_read_reg(uint8_t reg_addr)
 {
     uint8_t data;
-    int res = 0;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-
-    res |= i2c_master_start(cmd);
-    res |= i2c_master_write_byte(cmd, ES8311_ADDR, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_write_byte(cmd, reg_addr, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_stop(cmd);
-    res |= i2c_master_cmd_begin(0, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-
-    cmd = i2c_cmd_link_create();
-    res |= i2c_master_start(cmd);
-    res |= i2c_master_write_byte(cmd, ES8311_ADDR | 0x01, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_read_byte(cmd, &data, 0x01 /*NACK_VAL*/);
-    res |= i2c_master_stop(cmd);
-    res |= i2c_master_cmd_begin(0, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-
+    int res = codec_reg_read(&es8311_regs, reg_addr, &data);
     ES_ASSERT(res, "Es8311 Read Reg error", -1);
     ESP_LOGD(TAG, "ES8311 Read reg_addr: 0x%x, data: %d", reg_addr, data);
     return (int)data;
 }
 
+/*
+* send the register writes of an operation to the chip, in one transaction
+*/
+static int es8311_flush(int res)
+{
+    ES_ASSERT(codec_reg_flush(&es8311_regs), "ES8311 flush error", -1);
+    return res;
+}
+
 /*
 * look for the coefficient in coeff_div[] table
 */
@@ -325,6 +315,7 @@ esp_err_t es8311_init(media_hal_config_t *media_hal_conf)
     int coeff;
 
     es8311_i2c_init(ES8311_I2C_PORT); // ESP32 in master mode
+    codec_reg_cache_init(&es8311_regs, ES8311_I2C_PORT, ES8311_ADDR);
 
     ret |= es8311_write_reg(ES8311_CLK_MANAGER_REG01, 0x30);
     ret |= es8311_write_reg(ES8311_CLK_MANAGER_REG02, 0x00);
@@ -414,6 +405,7 @@ esp_err_t es8311_init(media_hal_config_t *media_hal_conf)
     coeff = get_coeff(mclk_fre, sample_fre);
     if (coeff < 0) {
         ESP_LOGE(TAG, "Unable to configure sample rate %dHz with %dHz MCLK", sample_fre, mclk_fre);
+        es8311_flush(ret);
         return ESP_FAIL;
     }
     /*
@@ -507,6 +499,7 @@ esp_err_t es8311_init(media_hal_config_t *media_hal_conf)
     ret |= es8311_write_reg(ES8311_ADC_REG1C, 0x6A);
     ret |= es8311_write_reg(ES8311_DAC_REG37, 0x48);
     ret |= es8311_write_reg(ES8311_DAC_REG32, 0xBF);
+    es8311_flush(ret);
 
     es8311_pa_power(true);
     return ESP_OK;
@@ -566,7 +559,7 @@ esp_err_t es8311_config_format(media_hal_codec_mode_t mode, media_hal_format_t f
     ret |= es8311_write_reg(ES8311_SDPIN_REG09, dac_iface);
     ret |= es8311_write_reg(ES8311_SDPOUT_REG0A, adc_iface);
 
-    return ret;
+    return es8311_flush(ret);
 }
 
 esp_err_t es8311_set_bits_per_sample(media_hal_codec_mode_t mode, media_hal_bit_length_t bits_per_sample)
@@ -595,7 +588,7 @@ esp_err_t es8311_set_bits_per_sample(media_hal_codec_mode_t mode, media_hal_bit_
     ret |= es8311_write_reg(ES8311_SDPIN_REG09, dac_iface);
     ret |= es8311_write_reg(ES8311_SDPOUT_REG0A, adc_iface);
 
-    return ret;
+    return es8311_flush(ret);
 }
 
 esp_err_t es8311_ctrl_state(media_hal_codec_mode_t mode, media_hal_sel_state_t ctrl_state)
@@ -683,14 +676,14 @@ esp_err_t es8311_start(es_module_t mode)
     ret |= es8311_write_reg(ES8311_DAC_REG37, 0x48);
     ret |= es8311_write_reg(ES8311_GP_REG45, 0x00);
 
-    return ret;
+    return es8311_flush(ret);
 }
 
 esp_err_t es8311_stop(es_module_t mode)
 {
     esp_err_t ret = ESP_OK;
     es8311_suspend();
-    return ret;
+    return es8311_flush(ret);
 }
 
 int es8311_set_volume(int volume)
@@ -709,7 +702,7 @@ int es8311_set_volume(int volume)
     int vol = (volume) * 1410 / 1000 + 50;
     ESP_LOGD(TAG, "SET: volume:%d", vol);
     ret = es8311_write_reg(ES8311_DAC_REG32, vol);
-    return ret;
+    return es8311_flush(ret);
 }
 
 int es8311_get_volume(int *volume)
@@ -732,7 +725,7 @@ int es8311_set_mute(int enable)
     int ret = 0;
     ESP_LOGD(TAG, "MUTE:%d", enable);
     es8311_mute(enable);
-    return ret;
+    return es8311_flush(ret);
 }
 
 int es8311_get_mute(int *mute)
@@ -752,7 +745,7 @@ esp_err_t es8311_set_mic_gain(es8311_mic_gain_t gain_db)
     int res = 0;
 
     res = es8311_write_reg(ES8311_ADC_REG16, gain_db); // MIC gain scale
-    return res;
+    return es8311_flush(res);
 }
 
 void es8311_read_all()
@@ -36,6 +36,7 @@ static void media_hal_func_init(media_hal_t* media_hal)
     media_hal->audio_codec_set_mute = es8311_set_mute;
     media_hal->audio_codec_powerup = es8311_powerup;
     media_hal->audio_codec_powerdown = es8311_powerdown;
+    media_hal->volume_slope = 7; /* ~0.7 dB per %: DAC volume register (0.5 dB steps) at volume * 1.41 + 50 */
 }
 
 esp_err_t media_hal_codec_init(media_hal_t *media_hal, media_hal_config_t *media_hal_conf)
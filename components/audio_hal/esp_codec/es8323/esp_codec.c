@@ -26,6 +26,7 @@
 #include "esp_log.h"
 #include "driver/i2c.h"
 #include <esp_codec.h>
+#include <codec_reg_cache.h>
 #include <audio_board.h>
 
 #define TAG "esp_codec_es8323"
@@ -47,6 +48,8 @@
 
 uint8_t curr_vol = 0;
 
+static codec_reg_cache_t es8323_regs;
+
 /**
  * @brief Initialization function for i2c
  */
@@ -68,7 +71,9 @@ static esp_err_t audio_codec_i2c_init(int i2c_master_port)
 /**
  * @brief Write ES8323 register
  *
- * @param slave_add : slave address
+ * The write goes to the register cache. It reaches the chip with the next es8323_flush().
+ *
+ * @param slave_add : slave address (unused, the cache is set up for ES8323_ADDR)
  * @param reg_add    : register address
  * @param data      : data to write
  *
@@ -78,15 +83,7 @@ static esp_err_t audio_codec_i2c_init(int i2c_master_port)
  */
 static esp_err_t es8323_write_reg(uint8_t slave_add, uint8_t reg_add, uint8_t data)
 {
-    int res = 0;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    res |= i2c_master_start(cmd);
-    res |= i2c_master_write_byte(cmd, slave_add, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_write_byte(cmd, reg_add, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_write_byte(cmd, data, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_stop(cmd);
-    res |= i2c_master_cmd_begin(0, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    esp_err_t res = codec_reg_write(&es8323_regs, reg_add, data);
     ES_ASSERT(res, "es8323_write_reg error", -1);
     return res;
 }
@@ -102,27 +99,23 @@ static esp_err_t es8323_write_reg(uint8_t slave_add, uint8_t reg_add, uint8_t da
  */
 static esp_err_t es8323_read_reg(uint8_t reg_add, uint8_t *p_data)
 {
-    uint8_t data;
-    esp_err_t res;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-
-    res  = i2c_master_start(cmd);
-    res |= i2c_master_write_byte(cmd, ES8323_ADDR, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_write_byte(cmd, reg_add, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_stop(cmd);
-    res |= i2c_master_cmd_begin(0, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-
-    cmd = i2c_cmd_link_create();
-    res |= i2c_master_start(cmd);
-    res |= i2c_master_write_byte(cmd, ES8323_ADDR | 0x01, 1 /*ACK_CHECK_EN*/);
-    res |= i2c_master_read_byte(cmd, &data, 0x01/*NACK_VAL*/);
-    res |= i2c_master_stop(cmd);
-    res |= i2c_master_cmd_begin(0, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-
+    esp_err_t res = codec_reg_read(&es8323_regs, reg_add, p_data);
     ES_ASSERT(res, "es8323_read_reg error", -1);
-    *p_data = data;
+    return res;
+}
+
+/**
+ * @brief Send the register writes of an operation to the chip, in one transaction
+ *
+ * @param res : result of the operation so far
+ *
+ * @return
+ *     - (-1)     Error
+ *     - res      Success
+ */
+static esp_err_t es8323_flush(esp_err_t res)
+{
+    ES_ASSERT(codec_reg_flush(&es8323_regs), "es8323_flush error", -1);
     return res;
 }
 
@@ -161,6 +154,29 @@ static esp_err_t es8323_set_adc_dac_volume(media_hal_codec_mode_t mode, float vo
     return res;
 }
 
+/**
+ * @brief Stage the DAC volume (0 ~ 100) and unmute. es8323_control_volume() without the flush.
+ */
+static esp_err_t es8323_set_dac_volume(uint8_t volume)
+{
+    esp_err_t res = 0;
+    curr_vol = volume;
+    uint8_t reg = 0;
+
+    if (volume > 100) {
+        volume = 100;
+    }
+    res = es8323_read_reg(ES8323_DACCONTROL3, &reg);
+    reg = reg & 0xFB;
+    res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL3, reg | (ES8323_DISABLE_MUTE << 2));
+    volume = (volume / 5) + 2;
+    //res  = es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL24, volume);
+    //res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL25, volume);
+    res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL26, volume);
+    res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL27, volume);
+    return res;
+}
+
 esp_err_t es8323_set_state(media_hal_codec_mode_t mode, media_hal_sel_state_t media_hal_state)
 {
     esp_err_t res = 0;
@@ -192,9 +208,9 @@ esp_err_t es8323_set_state(media_hal_codec_mode_t mode, media_hal_sel_state_t me
             */
             res |= es8323_read_reg(ES8323_DACCONTROL24, &reg);
             reg  = reg * 3;
-            res |= es8323_control_volume(reg);
+            res |= es8323_set_dac_volume(reg);
         }
-        return res;
+        return es8323_flush(res);
     }
     if(media_hal_state == MEDIA_HAL_STOP_STATE) {
         if (mode == MEDIA_HAL_CODEC_MODE_LINE_IN) {
@@ -202,11 +218,11 @@ esp_err_t es8323_set_state(media_hal_codec_mode_t mode, media_hal_sel_state_t me
         res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL16, 0x00); // 0x00 audio on LIN1&RIN1,  0x09 LIN2&RIN2
         res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL17, 0x90); // only left DAC to left mixer enable 0db
         res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL20, 0x90); // only right DAC to right mixer enable 0db
-        return res;
+        return es8323_flush(res);
         }
         if (mode == MEDIA_HAL_CODEC_MODE_DECODE || mode == MEDIA_HAL_CODEC_MODE_BOTH) {
             res  = es8323_write_reg(ES8323_ADDR, ES8323_DACPOWER, 0x2c);
-            res |= es8323_control_volume(0);    //Mute
+            res |= es8323_set_dac_volume(0);    //Mute
         }
         if (mode == MEDIA_HAL_CODEC_MODE_ENCODE || mode == MEDIA_HAL_CODEC_MODE_BOTH) {
             res  = es8323_write_reg(ES8323_ADDR, ES8323_ADCPOWER, 0xFF);  //power down adc and line in
@@ -214,9 +230,9 @@ esp_err_t es8323_set_state(media_hal_codec_mode_t mode, media_hal_sel_state_t me
         if (mode == MEDIA_HAL_CODEC_MODE_BOTH) {
             res  = es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL21, 0x9C);  //disable mclk
         }
-        return res;
+        return es8323_flush(res);
     }
-    return res;
+    return es8323_flush(res);
 }
 
 esp_err_t es8323_deinit(int port_num)
@@ -236,14 +252,16 @@ esp_err_t es8323_powerup()
 {
     esp_err_t ret = 0;
     gpio_set_level(GPIO_CODEC_EN, 1);
+    /* The codec may have been powered off: do not trust the cached values */
+    codec_reg_cache_invalidate(&es8323_regs);
     ret = es8323_write_reg(ES8323_ADDR, ES8323_CHIPPOWER, 0x00);  //Power up codec
     ret = es8323_write_reg(ES8323_ADDR, ES8323_ADCPOWER, 0x00);  //Power up adc
-    es8323_control_volume(curr_vol);
+    es8323_set_dac_volume(curr_vol);
     //ret = es8323_write_reg(ES8323_ADDR, ES8323_DACPOWER, 0x2C);  //Power up dac
     //PIN_FUNC_SELECT(PERIPHS_IO_MUX_GPIO0_U, FUNC_GPIO0_CLK_OUT1);
     //SET_PERI_REG_BITS(PIN_CTRL, CLK_OUT1, 0, CLK_OUT1_S);
 
-    return ret;
+    return es8323_flush(ret);
 }
 
 esp_err_t es8323_powerdown()
@@ -253,7 +271,7 @@ esp_err_t es8323_powerdown()
     ret = es8323_write_reg(ES8323_ADDR, ES8323_CHIPPOWER, 0xFF);  //Power down codec
     ret = es8323_write_reg(ES8323_ADDR, ES8323_ADCPOWER, 0xFF);  //Power down adc
     //ret = es8323_write_reg(ES8323_ADDR, ES8323_DACPOWER, 0xC0);  //Power down dac
-    return ret;
+    return es8323_flush(ret);
 }
 
 esp_err_t es8323_init(media_hal_config_t *media_hal_conf)
@@ -279,6 +297,7 @@ esp_err_t es8323_init(media_hal_config_t *media_hal_conf)
     //PIN_FUNC_SELECT(PERIPHS_IO_MUX_GPIO0_U, FUNC_GPIO0_CLK_OUT1);
     //SET_PERI_REG_BITS(PIN_CTRL, CLK_OUT1, 0, CLK_OUT1_S);
     audio_codec_i2c_init(port_num);   //set i2c pin and i2c clock frequency for esp32
+    codec_reg_cache_init(&es8323_regs, 0, ES8323_ADDR);
     res = es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL3, 0x00);  // 0x04 mute/0x00 unmute&ramp;DAC unmute and  disabled digital volume control soft ramp
     /* Chip Control and Power Management */
     res |= es8323_write_reg(ES8323_ADDR, ES8323_CONTROL2, 0x50);
@@ -324,7 +343,7 @@ esp_err_t es8323_init(media_hal_config_t *media_hal_conf)
     }
     //     es8323_write_reg(ES8323_ADDR, ES8323_ADCCONTROL8, 0xC0);
     //res |= es8323_write_reg(ES8323_ADDR, ES8323_ADCCONTROL9,0xC0);
-    return res;
+    return es8323_flush(res);
 }
 
 esp_err_t es8323_config_format(media_hal_codec_mode_t mode, media_hal_format_t fmt)
@@ -341,27 +360,12 @@ esp_err_t es8323_config_format(media_hal_codec_mode_t mode, media_hal_format_t f
         reg = reg & 0xf9;
         res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL1, 0x20);
     }
-    return res;
+    return es8323_flush(res);
 }
 
 esp_err_t es8323_control_volume(uint8_t volume)
 {
-    esp_err_t res = 0;
-    curr_vol = volume;
-    uint8_t reg = 0;
-
-    if (volume > 100) {
-        volume = 100;
-    }
-    res = es8323_read_reg(ES8323_DACCONTROL3, &reg);
-    reg = reg & 0xFB;
-    res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL3, reg | (ES8323_DISABLE_MUTE << 2));
-    volume = (volume / 5) + 2;
-    //res  = es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL24, volume);
-    //res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL25, volume);
-    res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL26, volume);
-    res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL27, volume);
-    return res;
+    return es8323_flush(es8323_set_dac_volume(volume));
 }
 
 esp_err_t es8323_get_volume(uint8_t *volume)
@@ -397,7 +401,7 @@ esp_err_t es8323_set_mute(bool bmute)
         reg = reg & 0xFB;
         res |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL3, reg | (ES8323_DISABLE_MUTE << 2));
     }
-    return res;
+    return es8323_flush(res);
 }
 
 esp_err_t es8323_set_bits_per_sample(media_hal_codec_mode_t mode, media_hal_bit_length_t bits_per_sample)
@@ -467,7 +471,7 @@ esp_err_t es8323_set_bits_per_sample(media_hal_codec_mode_t mode, media_hal_bit_
                 break;
         }
     }
-    return res;
+    return es8323_flush(res);
 }
 
 #if 0
@@ -512,7 +516,7 @@ esp_err_t es8323_set_mic_gain(es8323_mic_gain_t gain)
     int gain_n;
     gain_n = (int)gain / 3;
     ret = es8323_write_reg(ES8323_ADDR, ES8323_ADCCONTROL1, gain_n); //MIC PGA
-    return ret;
+    return es8323_flush(ret);
 }
 
 void es8323_read_all_registers()
@@ -526,7 +530,7 @@ void es8323_read_all_registers()
 
 esp_err_t es8323_write_register(uint8_t reg_add, uint8_t data)
 {
-    return es8323_write_reg(ES8323_ADDR, reg_add, data);
+    return es8323_flush(es8323_write_reg(ES8323_ADDR, reg_add, data));
 }
 
 esp_err_t es8323_set_i2s_clk(media_hal_codec_mode_t media_hal_codec_mode, media_hal_bit_length_t media_hal_bit_length)
@@ -539,5 +543,5 @@ esp_err_t es8323_set_i2s_clk(media_hal_codec_mode_t media_hal_codec_mode, media_
     ret = es8323_set_bits_per_sample(media_hal_codec_mode, media_hal_bit_length);
     ret |= es8323_write_reg(ES8323_ADDR, ES8323_ADCCONTROL5, clk_div);  //ADCFsMode,singel SPEED,RATIO=256
     ret |= es8323_write_reg(ES8323_ADDR, ES8323_DACCONTROL2, clk_div);  //ADCFsMode,singel SPEED,RATIO=256
-    return ret;
+    return es8323_flush(ret);
 }
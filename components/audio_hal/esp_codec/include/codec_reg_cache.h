@@ -0,0 +1,92 @@
+/*
+*
+* Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#pragma once
+
+/**
+ * Shadow register cache for I2C codecs.
+ *
+ * Every register value is kept in RAM: a register is read from the chip only the first time it is used, after that
+ * reads are served from the cache. Writes of a value the register already has are dropped, the others are staged in
+ * order and sent by codec_reg_flush() as a single I2C transaction (one write per register, separated by repeated
+ * STARTs). The codec drivers flush once at the end of every operation.
+ */
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <driver/i2c.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#define CODEC_REG_CACHE_SIZE    256
+/* Staged writes. A full batch is flushed right away. */
+#define CODEC_REG_CACHE_BATCH   64
+
+typedef struct {
+    uint8_t reg;
+    uint8_t val;
+} codec_reg_write_t;
+
+typedef struct {
+    i2c_port_t port;
+    uint8_t addr;                                   /* 8 bit write address */
+    SemaphoreHandle_t lock;
+    uint8_t val[CODEC_REG_CACHE_SIZE];
+    uint32_t valid[CODEC_REG_CACHE_SIZE / 32];      /* val[] is known */
+    codec_reg_write_t batch[CODEC_REG_CACHE_BATCH];
+    int batch_len;
+} codec_reg_cache_t;
+
+/**
+ * @brief   Initialise an empty cache
+ *
+ * @param[in] port  I2C port the codec is on
+ * @param[in] addr  8 bit I2C write address of the codec
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM otherwise.
+ */
+esp_err_t codec_reg_cache_init(codec_reg_cache_t *cache, i2c_port_t port, uint8_t addr);
+
+/**
+ * @brief   Read a register
+ *
+ * Only the first read of a register goes to the chip.
+ */
+esp_err_t codec_reg_read(codec_reg_cache_t *cache, uint8_t reg, uint8_t *val);
+
+/**
+ * @brief   Stage a register write
+ *
+ * The write is dropped if the register already has this value. Staged writes are sent in order by codec_reg_flush().
+ *
+ * @return ESP_OK, or the result of the flush if the batch was full.
+ */
+esp_err_t codec_reg_write(codec_reg_cache_t *cache, uint8_t reg, uint8_t val);
+
+/**
+ * @brief   Send the staged writes in one transaction
+ *
+ * On failure the registers of the batch are dropped from the cache, so that they are read back from the chip the
+ * next time.
+ */
+esp_err_t codec_reg_flush(codec_reg_cache_t *cache);
+
+/**
+ * @brief   Forget all the cached values, e.g. after a reset of the chip
+ */
+void codec_reg_cache_invalidate(codec_reg_cache_t *cache);
@@ -0,0 +1,145 @@
+/*
+*
+* Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <string.h>
+#include <esp_log.h>
+#include <codec_reg_cache.h>
+
+#define TAG "codec_reg_cache"
+
+#define CODEC_REG_TIMEOUT   (1000 / portTICK_RATE_MS)
+
+#define REG_VALID(c, r)     ((c)->valid[(r) >> 5] & (1U << ((r) & 0x1F)))
+#define REG_SET_VALID(c, r) ((c)->valid[(r) >> 5] |= (1U << ((r) & 0x1F)))
+#define REG_CLR_VALID(c, r) ((c)->valid[(r) >> 5] &= ~(1U << ((r) & 0x1F)))
+
+esp_err_t codec_reg_cache_init(codec_reg_cache_t *cache, i2c_port_t port, uint8_t addr)
+{
+    SemaphoreHandle_t lock = cache->lock;
+    memset(cache, 0, sizeof(codec_reg_cache_t));
+    /* Init may be called again by the codec init: keep the lock */
+    cache->lock = lock ? lock : xSemaphoreCreateMutex();
+    if (!cache->lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    cache->port = port;
+    cache->addr = addr;
+    return ESP_OK;
+}
+
+static esp_err_t codec_reg_read_chip(codec_reg_cache_t *cache, uint8_t reg, uint8_t *val)
+{
+    esp_err_t res;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    res  = i2c_master_start(cmd);
+    res |= i2c_master_write_byte(cmd, cache->addr, 1 /*ACK_CHECK_EN*/);
+    res |= i2c_master_write_byte(cmd, reg, 1 /*ACK_CHECK_EN*/);
+    res |= i2c_master_stop(cmd);
+    res |= i2c_master_cmd_begin(cache->port, cmd, CODEC_REG_TIMEOUT);
+    i2c_cmd_link_delete(cmd);
+
+    cmd = i2c_cmd_link_create();
+    res |= i2c_master_start(cmd);
+    res |= i2c_master_write_byte(cmd, cache->addr | 0x01, 1 /*ACK_CHECK_EN*/);
+    res |= i2c_master_read_byte(cmd, val, 0x01 /*NACK_VAL*/);
+    res |= i2c_master_stop(cmd);
+    res |= i2c_master_cmd_begin(cache->port, cmd, CODEC_REG_TIMEOUT);
+    i2c_cmd_link_delete(cmd);
+    return res;
+}
+
+static esp_err_t codec_reg_flush_locked(codec_reg_cache_t *cache)
+{
+    if (cache->batch_len == 0) {
+        return ESP_OK;
+    }
+    esp_err_t res = ESP_OK;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    for (int i = 0; i < cache->batch_len; i++) {
+        /* Repeated START: each register is a complete write, no auto-increment is assumed */
+        res |= i2c_master_start(cmd);
+        res |= i2c_master_write_byte(cmd, cache->addr, 1 /*ACK_CHECK_EN*/);
+        res |= i2c_master_write_byte(cmd, cache->batch[i].reg, 1 /*ACK_CHECK_EN*/);
+        res |= i2c_master_write_byte(cmd, cache->batch[i].val, 1 /*ACK_CHECK_EN*/);
+    }
+    res |= i2c_master_stop(cmd);
+    res |= i2c_master_cmd_begin(cache->port, cmd, CODEC_REG_TIMEOUT);
+    i2c_cmd_link_delete(cmd);
+    if (res != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write %d registers", cache->batch_len);
+        /* We do not know how far the transaction went */
+        for (int i = 0; i < cache->batch_len; i++) {
+            REG_CLR_VALID(cache, cache->batch[i].reg);
+        }
+        res = ESP_FAIL;
+    }
+    cache->batch_len = 0;
+    return res;
+}
+
+esp_err_t codec_reg_read(codec_reg_cache_t *cache, uint8_t reg, uint8_t *val)
+{
+    esp_err_t res = ESP_OK;
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    if (!REG_VALID(cache, reg)) {
+        res = codec_reg_read_chip(cache, reg, &cache->val[reg]);
+        if (res == ESP_OK) {
+            REG_SET_VALID(cache, reg);
+        } else {
+            ESP_LOGE(TAG, "Failed to read register 0x%02x", reg);
+            res = ESP_FAIL;
+        }
+    }
+    *val = cache->val[reg];
+    xSemaphoreGive(cache->lock);
+    return res;
+}
+
+esp_err_t codec_reg_write(codec_reg_cache_t *cache, uint8_t reg, uint8_t val)
+{
+    esp_err_t res = ESP_OK;
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    if (!REG_VALID(cache, reg) || cache->val[reg] != val) {
+        /* Not merged with an earlier write of the same register: sequences like power pulses must reach the chip */
+        cache->batch[cache->batch_len].reg = reg;
+        cache->batch[cache->batch_len].val = val;
+        cache->batch_len++;
+        cache->val[reg] = val;
+        REG_SET_VALID(cache, reg);
+        if (cache->batch_len == CODEC_REG_CACHE_BATCH) {
+            res = codec_reg_flush_locked(cache);
+        }
+    }
+    xSemaphoreGive(cache->lock);
+    return res;
+}
+
+esp_err_t codec_reg_flush(codec_reg_cache_t *cache)
+{
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    esp_err_t res = codec_reg_flush_locked(cache);
+    xSemaphoreGive(cache->lock);
+    return res;
+}
+
+void codec_reg_cache_invalidate(codec_reg_cache_t *cache)
+{
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    memset(cache->valid, 0, sizeof(cache->valid));
+    xSemaphoreGive(cache->lock);
+}
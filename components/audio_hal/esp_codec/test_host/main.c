@@ -0,0 +1,305 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <codec_reg_cache.h>
+#include <host_stubs.h>
+
+#define CODEC_ADDR      0x20
+#define BUS_HZ          100000
+
+/* ES8388 registers used by the volume and mute sequences */
+#define DACCONTROL3     0x19
+#define DACCONTROL24    0x2E
+#define DACCONTROL25    0x2F
+#define DACCONTROL26    0x30
+#define DACCONTROL27    0x31
+
+/* Device model: register file with a write history */
+static uint8_t regs[CODEC_REG_CACHE_SIZE];
+static struct {
+    uint8_t reg;
+    uint8_t val;
+} history[256];
+static int history_len;
+
+static void history_add(int reg, uint8_t val)
+{
+    history[history_len].reg = reg;
+    history[history_len].val = val;
+    history_len = (history_len + 1) % 256;
+}
+
+static int fail(const char *what)
+{
+    printf("Fail\n");
+    printf("%s: transactions %d writes %d reads %d\n", what, i2c_stub.cnt.transactions, i2c_stub.cnt.writes,
+           i2c_stub.cnt.reads);
+    return -1;
+}
+
+static void cache_init(codec_reg_cache_t *cache)
+{
+    for (int i = 0; i < CODEC_REG_CACHE_SIZE; i++) {
+        regs[i] = i ^ 0x5A;
+    }
+    i2c_stub.addr = CODEC_ADDR;
+    i2c_stub.regs = regs;
+    i2c_stub.nregs = CODEC_REG_CACHE_SIZE;
+    i2c_stub.on_write = history_add;
+    codec_reg_cache_init(cache, I2C_NUM_0, CODEC_ADDR);
+    memset(&i2c_stub.cnt, 0, sizeof(i2c_stub.cnt));
+    history_len = 0;
+}
+
+static int test_read()
+{
+    printf("test: reads ....");
+    static codec_reg_cache_t cache;
+    cache_init(&cache);
+    uint8_t val;
+    if (codec_reg_read(&cache, 0x03, &val) != ESP_OK || val != (0x03 ^ 0x5A) || i2c_stub.cnt.reads != 1) {
+        return fail("first read");
+    }
+    regs[0x03] = 0;
+    if (codec_reg_read(&cache, 0x03, &val) != ESP_OK || val != (0x03 ^ 0x5A) || i2c_stub.cnt.transactions != 2) {
+        return fail("cached read");
+    }
+    /* A written register is known without ever being read */
+    codec_reg_write(&cache, 0x04, 0x11);
+    if (codec_reg_read(&cache, 0x04, &val) != ESP_OK || val != 0x11 || i2c_stub.cnt.transactions != 2) {
+        return fail("read staged");
+    }
+    codec_reg_flush(&cache);
+    if (codec_reg_read(&cache, 0x04, &val) != ESP_OK || val != 0x11 || regs[0x04] != 0x11 || i2c_stub.cnt.reads != 1) {
+        return fail("read written");
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_batch()
+{
+    printf("test: batched writes ....");
+    static codec_reg_cache_t cache;
+    cache_init(&cache);
+    /* Power pulse, then a few registers, then the first register again */
+    codec_reg_write(&cache, 0x02, 0xF0);
+    codec_reg_write(&cache, 0x02, 0x00);
+    codec_reg_write(&cache, 0x10, 0x01);
+    codec_reg_write(&cache, 0x11, 0x02);
+    codec_reg_write(&cache, 0x30, 0x03);
+    codec_reg_write(&cache, 0x02, 0x55);
+    if (i2c_stub.cnt.transactions != 0) {
+        return fail("staged");
+    }
+    if (codec_reg_flush(&cache) != ESP_OK || i2c_stub.cnt.transactions != 1 || i2c_stub.cnt.writes != 6) {
+        return fail("flush");
+    }
+    const uint8_t expected[][2] = {{0x02, 0xF0}, {0x02, 0x00}, {0x10, 0x01}, {0x11, 0x02}, {0x30, 0x03}, {0x02, 0x55}};
+    for (int i = 0; i < 6; i++) {
+        if (history[i].reg != expected[i][0] || history[i].val != expected[i][1]) {
+            return fail("order");
+        }
+    }
+    /* Nothing changes: nothing is sent */
+    codec_reg_write(&cache, 0x10, 0x01);
+    codec_reg_write(&cache, 0x02, 0x55);
+    if (codec_reg_flush(&cache) != ESP_OK || i2c_stub.cnt.transactions != 1) {
+        return fail("unchanged");
+    }
+    /* A full batch goes out on its own */
+    for (int i = 0; i <= CODEC_REG_CACHE_BATCH; i++) {
+        codec_reg_write(&cache, 0x80 + i, 0xA0);
+    }
+    if (i2c_stub.cnt.transactions != 2 || i2c_stub.cnt.writes != 6 + CODEC_REG_CACHE_BATCH) {
+        return fail("full batch");
+    }
+    codec_reg_flush(&cache);
+    if (i2c_stub.cnt.transactions != 3 || regs[0x80 + CODEC_REG_CACHE_BATCH] != 0xA0) {
+        return fail("rest of the batch");
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_error()
+{
+    printf("test: bus error ....");
+    static codec_reg_cache_t cache;
+    cache_init(&cache);
+    uint8_t val;
+    codec_reg_read(&cache, 0x07, &val);
+    for (int i = 0; i < 4; i++) {
+        codec_reg_write(&cache, 0x20 + i, 0x40 + i);
+    }
+    /* NACK on the address byte of the third register: the first two were written */
+    i2c_stub.nack_at = 2 * 3 + 1;
+    if (codec_reg_flush(&cache) != ESP_FAIL) {
+        return fail("flush");
+    }
+    memset(&i2c_stub.cnt, 0, sizeof(i2c_stub.cnt));
+    for (int i = 0; i < 4; i++) {
+        if (codec_reg_read(&cache, 0x20 + i, &val) != ESP_OK || val != regs[0x20 + i]) {
+            return fail("read back");
+        }
+    }
+    if (i2c_stub.cnt.reads != 4 || val != (0x23 ^ 0x5A)) {
+        return fail("registers of the batch");
+    }
+    /* The others are still cached */
+    codec_reg_read(&cache, 0x07, &val);
+    if (i2c_stub.cnt.reads != 4) {
+        return fail("other registers");
+    }
+    /* The write is retried */
+    codec_reg_write(&cache, 0x23, 0x43);
+    if (codec_reg_flush(&cache) != ESP_OK || regs[0x23] != 0x43) {
+        return fail("retry");
+    }
+    codec_reg_cache_invalidate(&cache);
+    codec_reg_read(&cache, 0x07, &val);
+    if (i2c_stub.cnt.reads != 5) {
+        return fail("invalidate");
+    }
+    printf("Success\n");
+    return 0;
+}
+
+/* The original drivers: one transaction per write, two per read */
+static void raw_write(uint8_t reg, uint8_t val)
+{
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, CODEC_ADDR, 1);
+    i2c_master_write_byte(cmd, reg, 1);
+    i2c_master_write_byte(cmd, val, 1);
+    i2c_master_stop(cmd);
+    i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
+    i2c_cmd_link_delete(cmd);
+}
+
+static uint8_t raw_read(uint8_t reg)
+{
+    uint8_t val = 0;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, CODEC_ADDR, 1);
+    i2c_master_write_byte(cmd, reg, 1);
+    i2c_master_stop(cmd);
+    i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
+    i2c_cmd_link_delete(cmd);
+    cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, CODEC_ADDR | 0x01, 1);
+    i2c_master_read_byte(cmd, &val, 1);
+    i2c_master_stop(cmd);
+    i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
+    i2c_cmd_link_delete(cmd);
+    return val;
+}
+
+/* es8388_control_volume() and es8388_set_mute() */
+static void volume_raw(uint8_t volume)
+{
+    uint8_t reg = raw_read(DACCONTROL3) & 0xFB;
+    raw_write(DACCONTROL3, reg);
+    raw_write(DACCONTROL24, volume / 3);
+    raw_write(DACCONTROL25, volume / 3);
+    raw_write(DACCONTROL26, 0);
+    raw_write(DACCONTROL27, 0);
+}
+
+static void volume_cached(codec_reg_cache_t *cache, uint8_t volume)
+{
+    uint8_t reg;
+    codec_reg_read(cache, DACCONTROL3, &reg);
+    codec_reg_write(cache, DACCONTROL3, reg & 0xFB);
+    codec_reg_write(cache, DACCONTROL24, volume / 3);
+    codec_reg_write(cache, DACCONTROL25, volume / 3);
+    codec_reg_write(cache, DACCONTROL26, 0);
+    codec_reg_write(cache, DACCONTROL27, 0);
+    codec_reg_flush(cache);
+}
+
+static void mute_raw(bool mute)
+{
+    uint8_t reg = raw_read(DACCONTROL3) & 0xFB;
+    raw_write(DACCONTROL3, reg | (mute << 2));
+}
+
+static void mute_cached(codec_reg_cache_t *cache, bool mute)
+{
+    uint8_t reg;
+    codec_reg_read(cache, DACCONTROL3, &reg);
+    codec_reg_write(cache, DACCONTROL3, (reg & 0xFB) | (mute << 2));
+    codec_reg_flush(cache);
+}
+
+static void bench_print(const char *name, int ops, int raw_transactions, long raw_bits)
+{
+    printf("bench: %-7s %.2f transactions, %4.0f us bus time per call (uncached: %.2f, %4.0f us)\n",
+           name, (double) i2c_stub.cnt.transactions / ops, i2c_stub.cnt.bits * 1e6 / BUS_HZ / ops,
+           (double) raw_transactions / ops, raw_bits * 1e6 / BUS_HZ / ops);
+}
+
+static void bench()
+{
+    static codec_reg_cache_t cache;
+    const int ops = 1000;
+
+    /* Volume steps of a knob, as from the volume keys */
+    cache_init(&cache);
+    for (int i = 0; i < ops; i++) {
+        volume_raw((i * 7) % 101);
+    }
+    int raw_transactions = i2c_stub.cnt.transactions;
+    long raw_bits = i2c_stub.cnt.bits;
+    cache_init(&cache);
+    volume_cached(&cache, 50);
+    memset(&i2c_stub.cnt, 0, sizeof(i2c_stub.cnt));
+    for (int i = 0; i < ops; i++) {
+        volume_cached(&cache, (i * 7) % 101);
+    }
+    bench_print("volume", ops, raw_transactions, raw_bits);
+
+    cache_init(&cache);
+    for (int i = 0; i < ops; i++) {
+        mute_raw(i & 1);
+    }
+    raw_transactions = i2c_stub.cnt.transactions;
+    raw_bits = i2c_stub.cnt.bits;
+    cache_init(&cache);
+    mute_cached(&cache, true);
+    memset(&i2c_stub.cnt, 0, sizeof(i2c_stub.cnt));
+    for (int i = 0; i < ops; i++) {
+        mute_cached(&cache, i & 1);
+    }
+    bench_print("mute", ops, raw_transactions, raw_bits);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+    if (test_read() || test_batch() || test_error()) {
+        return -1;
+    }
+    return 0;
+}
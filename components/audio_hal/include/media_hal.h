@@ -161,6 +161,7 @@ typedef  struct {
     esp_err_t (*audio_codec_powerdown) ();
     void (*volume_change_notify_cb[VOLUME_CHANGE_CB_MAX]) (int volume);
     xSemaphoreHandle media_hal_lock;
+    uint8_t volume_slope;   /* Codec volume change per % of audio_codec_control_volume, in 0.1 dB. 0 if it has none. */
 } media_hal_t;
 
 /**
@@ -226,6 +227,8 @@ esp_err_t media_hal_deregister_volume_change_cb(media_hal_t *media_hal, void (*c
 /**
  * @brief Set voice volume.
  *        @note if volume is 0, mute is enabled
+ *        @note the codec volume is changed in steps of 10%. Volumes in between, and mute, are applied with the
+ *              ramped playback software gain (`media_hal_playback_set_gain`).
  *
  * @param media_hal reference function pointer for selected audio codec
  * @param volume value of volume in percent(%)
@@ -248,6 +251,7 @@ esp_err_t media_hal_get_volume(media_hal_t* media_hal, uint8_t *volume);
 /**
  * @brief Set mute.
  *        @note if volume is 0, mute is enabled
+ *        @note mute and unmute are ramped in software, the codec is not muted.
  *
  * @param media_hal reference function pointer for selected audio codec
  * @param mute bool true - mute
@@ -1,6 +1,7 @@
 // Copyright 2018 Espressif Systems (Shanghai) PTE LTD
 // All rights reserved.
 
+#include <string.h>
 #include <esp_log.h>
 #include "audio_board.h"
 
@@ -28,6 +29,17 @@ SemaphoreHandle_t is31fl3236_led_mux;
 #define I2C_MASTER_RX_BUF_DISABLE   0  /*!< I2C master do not need buffer */
 #define I2C_MASTER_FREQ_HZ    100000   /*!< I2C master clock frequency */
 
+#define IS31FL3236_REG_SHUTDOWN     0x00
+#define IS31FL3236_REG_PWM          0x01    /* 0x01 - 0x24, one per OUT pin */
+#define IS31FL3236_REG_UPDATE       0x25    /* Writing 0x00 latches the PWM and LED control registers */
+#define IS31FL3236_REG_LED_CTRL     0x26    /* 0x26 - 0x49 */
+#define IS31FL3236_REG_GLOBAL_CTRL  0x4A
+#define IS31FL3236_CHANNELS         36
+
+/* The register address auto-increments on writes. Resending up to this many unchanged bytes is cheaper than
+ * another transaction (start, address, register, stop). */
+#define IS31FL3236_MERGE_GAP        4
+
 
 typedef struct {
  //   i2c_bus_handle_t bus;
@@ -43,6 +55,10 @@ typedef struct is31fl3236_led_config {
 static bool is_init_done = false;
 static is31fl3236_led_config_t is31fl3236_led;
 
+/* PWM values last written to the chip, to send only what changed */
+static uint8_t is31fl3236_pwm[IS31FL3236_CHANNELS];
+static bool is31fl3236_pwm_valid;
+
 /**
  * @brief Initialization function for i2c
  */
@@ -89,6 +105,35 @@ static esp_err_t is31fl3236_write_reg(uint8_t slave_add, uint8_t reg_add, uint8_
     return res;
 }
 
+/**
+ * @brief Write consecutive IS31 registers in one transaction
+ *
+ * @param slave_add : slave address
+ * @param reg_add   : first register address
+ * @param data      : data to write, one byte per register
+ * @param len       : number of registers
+ *
+ * @return
+ *     - (-1)  Error
+ *     - (0)   Success
+ */
+static esp_err_t is31fl3236_write_regs(uint8_t slave_add, uint8_t reg_add, uint8_t *data, size_t len)
+{
+    int res = 0;
+    xSemaphoreTake(is31fl3236_led_mux, portMAX_DELAY);
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    res |= i2c_master_start(cmd);
+    res |= i2c_master_write_byte(cmd, slave_add, 1 /*ACK_CHECK_EN*/);
+    res |= i2c_master_write_byte(cmd, reg_add, 1 /*ACK_CHECK_EN*/);
+    res |= i2c_master_write(cmd, data, len, 1 /*ACK_CHECK_EN*/);
+    res |= i2c_master_stop(cmd);
+    res |= i2c_master_cmd_begin(0, cmd, 1000 / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+    xSemaphoreGive(is31fl3236_led_mux);
+    LED_ASSERT(res, "is31fl3236_write_regs error", -1);
+    return res;
+}
+
 /**
  * @brief Read IS31 register
  *
@@ -139,31 +184,65 @@ esp_err_t is31fl3236_init(is31fl3236_led_config_t *led_config)
         ESP_LOGE(TAG, "Could not create semaphore");
         return ESP_FAIL;
     }
-    int i;
-    res = is31fl3236_write_reg(IS31FL3236_ADDRESS, 0x00, 0x01);
-    for( i = 0; i<36; i++) {
-        res |= is31fl3236_write_reg(IS31FL3236_ADDRESS, (0x26 + i), 0x01);
-        //is31fl3236_write_reg(IS31FL3236_ADDRESS, 0x25, 0x00);
-    }
-    res = is31fl3236_write_reg(IS31FL3236_ADDRESS, 0x4A, 0x00);
+    /* Normal operation, all outputs enabled at full current */
+    uint8_t led_ctrl[IS31FL3236_CHANNELS];
+    memset(led_ctrl, 0x01, sizeof(led_ctrl));
+    res = is31fl3236_write_reg(IS31FL3236_ADDRESS, IS31FL3236_REG_SHUTDOWN, 0x01);
+    res |= is31fl3236_write_regs(IS31FL3236_ADDRESS, IS31FL3236_REG_LED_CTRL, led_ctrl, sizeof(led_ctrl));
+    res |= is31fl3236_write_reg(IS31FL3236_ADDRESS, IS31FL3236_REG_GLOBAL_CTRL, 0x00);
+    /* PWM registers keep their values across a soft reset: write all of them with the first frame */
+    is31fl3236_pwm_valid = false;
     return res;
 }
 
+static inline void is31fl3236_set_pwm(uint8_t *pwm, int reg, uint8_t val)
+{
+    int ch = reg - IS31FL3236_REG_PWM;
+    if (ch >= 0 && ch < IS31FL3236_CHANNELS) {
+        pwm[ch] = val;
+    }
+}
+
 void led_driver_set_value(const uint32_t *led_value)
 {
-    int i;
-    uint8_t red_led_val, blue_led_val, green_led_val;
-    for (i = 0; i < is31fl3236_led.num_of_leds; i++) {
-        blue_led_val  = 0xFF & (led_value[i]);
-        green_led_val = 0xFF & (led_value[i] >> 8);
-        red_led_val   = 0xFF & (led_value[i] >> 16);
-        is31fl3236_write_reg(IS31FL3236_ADDRESS, (((i + is31fl3236_led.start_pin) * 3) + led_color_offset[is31fl3236_led.led_order].red), red_led_val);
-        //is31fl3236_write_reg(IS31FL3236_ADDRESS, 0x25, 0x00);
-        is31fl3236_write_reg(IS31FL3236_ADDRESS, (((i + is31fl3236_led.start_pin) * 3) + led_color_offset[is31fl3236_led.led_order].green), green_led_val);
-        //is31fl3236_write_reg(IS31FL3236_ADDRESS, 0x25, 0x00);
-        is31fl3236_write_reg(IS31FL3236_ADDRESS, (((i + is31fl3236_led.start_pin) * 3) + led_color_offset[is31fl3236_led.led_order].blue), blue_led_val);
+    /* PWM registers followed by the update register, so that a burst can run into it */
+    uint8_t frame[IS31FL3236_CHANNELS + 1];
+    memcpy(frame, is31fl3236_pwm, IS31FL3236_CHANNELS);
+    frame[IS31FL3236_CHANNELS] = 0x00;
+
+    struct led_color_offset *offset = &led_color_offset[is31fl3236_led.led_order];
+    for (int i = 0; i < is31fl3236_led.num_of_leds; i++) {
+        int base = (i + is31fl3236_led.start_pin) * 3;
+        is31fl3236_set_pwm(frame, base + offset->red, 0xFF & (led_value[i] >> 16));
+        is31fl3236_set_pwm(frame, base + offset->green, 0xFF & (led_value[i] >> 8));
+        is31fl3236_set_pwm(frame, base + offset->blue, 0xFF & (led_value[i]));
+    }
+
+    int first = 0, last = IS31FL3236_CHANNELS - 1;
+    if (is31fl3236_pwm_valid) {
+        while (first < IS31FL3236_CHANNELS && frame[first] == is31fl3236_pwm[first]) {
+            first++;
+        }
+        if (first == IS31FL3236_CHANNELS) {
+            /* Nothing changed */
+            return;
+        }
+        while (frame[last] == is31fl3236_pwm[last]) {
+            last--;
+        }
+    }
+
+    esp_err_t res;
+    if (IS31FL3236_CHANNELS - 1 - last <= IS31FL3236_MERGE_GAP) {
+        /* Run on into the update register */
+        res = is31fl3236_write_regs(IS31FL3236_ADDRESS, IS31FL3236_REG_PWM + first, frame + first, IS31FL3236_CHANNELS + 1 - first);
+    } else {
+        res = is31fl3236_write_regs(IS31FL3236_ADDRESS, IS31FL3236_REG_PWM + first, frame + first, last - first + 1);
+        res |= is31fl3236_write_reg(IS31FL3236_ADDRESS, IS31FL3236_REG_UPDATE, 0x00);
     }
-    is31fl3236_write_reg(IS31FL3236_ADDRESS, 0x25, 0x00);
+    /* On failure the chip state is unknown: resend everything next time */
+    is31fl3236_pwm_valid = (res == ESP_OK);
+    memcpy(is31fl3236_pwm, frame, IS31FL3236_CHANNELS);
 }
 
 bool led_driver_is_init_done()
@@ -0,0 +1,6 @@
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <driver/i2c.h>
+
+esp_err_t audio_board_i2c_pin_config(int port_num, i2c_config_t *ph);
@@ -0,0 +1,231 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <audio_board.h>
+#include <led_driver.h>
+#include <host_stubs.h>
+
+#define IS31_ADDR       0x78
+#define IS31_CHANNELS   36
+#define IS31_REG_UPDATE 0x25
+#define BUS_HZ          100000
+#define RING_LEDS       12
+
+/* Device model: register file and the PWM values latched by a write to the update register */
+static uint8_t regs[0x50];
+static uint8_t latched[IS31_CHANNELS];
+
+esp_err_t audio_board_i2c_pin_config(int port_num, i2c_config_t *ph)
+{
+    return ESP_OK;
+}
+
+static void latch(int reg, uint8_t val)
+{
+    if (reg == IS31_REG_UPDATE && val == 0x00) {
+        memcpy(latched, regs + 1, IS31_CHANNELS);
+    }
+}
+
+static int fail(const char *what)
+{
+    printf("Fail\n");
+    printf("%s: transactions %d bytes %d\n", what, i2c_stub.cnt.transactions, i2c_stub.cnt.bytes);
+    return -1;
+}
+
+static void driver_init(int leds, int start_pin, led_color_order_t order)
+{
+    led_driver_config_t cfg = {
+        .type = LED_DRIVER_TYPE_ARRAY,
+        .led_order = order,
+        .num_of_leds = leds,
+        .start_gpio_pin = start_pin,
+    };
+    i2c_stub.addr = IS31_ADDR;
+    i2c_stub.regs = regs;
+    i2c_stub.nregs = sizeof(regs);
+    i2c_stub.on_write = latch;
+    led_driver_init(&cfg);
+    memset(&i2c_stub.cnt, 0, sizeof(i2c_stub.cnt));
+}
+
+/* What the chip should show for a frame, computed the way the original per-register driver addressed it */
+static void expected_pwm(uint8_t *pwm, const uint32_t *val, int leds, int start_pin, led_color_order_t order)
+{
+    for (int i = 0; i < leds; i++) {
+        int base = (i + start_pin) * 3 - 1;
+        pwm[base + led_color_offset[order].red] = val[i] >> 16;
+        pwm[base + led_color_offset[order].green] = val[i] >> 8;
+        pwm[base + led_color_offset[order].blue] = val[i];
+    }
+}
+
+static int test_frames()
+{
+    printf("test: random frames ....");
+    srand(1);
+    for (int order = 0; order < LED_ORDER_MAX_PATTERNS; order++) {
+        int start_pin = order % 3;
+        int leds = RING_LEDS - start_pin;
+        driver_init(leds, start_pin, order);
+        uint8_t pwm[IS31_CHANNELS];
+        memcpy(pwm, latched, sizeof(pwm));
+        uint32_t val[RING_LEDS] = {0};
+        for (int f = 0; f < 2000; f++) {
+            /* A few LEDs change per frame, sometimes none, sometimes all */
+            int changes = rand() % (leds + 2);
+            for (int c = 0; c < changes; c++) {
+                val[rand() % leds] = rand() & 0xffffff;
+            }
+            expected_pwm(pwm, val, leds, start_pin, order);
+            led_driver_set_value(val);
+            if (memcmp(pwm, latched, sizeof(pwm)) != 0) {
+                return fail("latched PWM");
+            }
+        }
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_unchanged()
+{
+    printf("test: unchanged and single LED frames ....");
+    driver_init(RING_LEDS, 0, LED_ORDER_RED_GREEN_BLUE);
+    uint32_t val[RING_LEDS] = {0};
+    /* The first frame writes everything: the chip may hold values from before a soft reset */
+    led_driver_set_value(val);
+    if (i2c_stub.cnt.transactions != 1 || i2c_stub.cnt.bytes != 2 + IS31_CHANNELS + 1) {
+        return fail("first frame");
+    }
+    led_driver_set_value(val);
+    if (i2c_stub.cnt.transactions != 1) {
+        return fail("unchanged frame");
+    }
+    /* LED 0: red, green, blue registers, then a separate update */
+    val[0] = 0x102030;
+    led_driver_set_value(val);
+    if (i2c_stub.cnt.transactions != 3 || i2c_stub.cnt.bytes != 39 + 5 + 3 || latched[0] != 0x10 ||
+            latched[2] != 0x30) {
+        return fail("first LED");
+    }
+    /* Last LED: the burst runs on into the update register */
+    val[RING_LEDS - 1] = 0x0000ff;
+    led_driver_set_value(val);
+    if (i2c_stub.cnt.transactions != 4 || i2c_stub.cnt.bytes != 47 + 2 + 2 || latched[IS31_CHANNELS - 1] != 0xff) {
+        return fail("last LED");
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_error()
+{
+    printf("test: bus error ....");
+    driver_init(RING_LEDS, 0, LED_ORDER_GREEN_RED_BLUE);
+    uint32_t val[RING_LEDS] = {0};
+    uint8_t pwm[IS31_CHANNELS] = {0};
+    led_driver_set_value(val);
+    for (int i = 0; i < RING_LEDS; i++) {
+        val[i] = 0x010101 * (i + 1);
+    }
+    /* NACK halfway through the frame */
+    i2c_stub.nack_at = 20;
+    led_driver_set_value(val);
+    /* The frame is sent again in full */
+    memset(&i2c_stub.cnt, 0, sizeof(i2c_stub.cnt));
+    led_driver_set_value(val);
+    expected_pwm(pwm, val, RING_LEDS, 0, LED_ORDER_GREEN_RED_BLUE);
+    if (i2c_stub.cnt.bytes != 2 + IS31_CHANNELS + 1 || memcmp(pwm, latched, sizeof(pwm)) != 0) {
+        return fail("resend");
+    }
+    printf("Success\n");
+    return 0;
+}
+
+/* Bus time of the per-register driver: 3 writes per LED and the update, each start, 3 bytes, stop */
+static double per_register_us(int leds)
+{
+    return (3 * leds + 1) * (2 + 9 * 3) * 1e6 / BUS_HZ;
+}
+
+static void bench_pattern(const char *name, void (*frame)(uint32_t *val, int f), int frames)
+{
+    driver_init(RING_LEDS, 0, LED_ORDER_RED_GREEN_BLUE);
+    uint32_t val[RING_LEDS] = {0};
+    led_driver_set_value(val);
+    memset(&i2c_stub.cnt, 0, sizeof(i2c_stub.cnt));
+    for (int f = 0; f < frames; f++) {
+        frame(val, f);
+        led_driver_set_value(val);
+    }
+    printf("bench: %-9s %.2f transactions, %5.1f bytes, %6.0f us bus time per frame (per-register writes: %d, %.0f us)\n",
+           name, (double) i2c_stub.cnt.transactions / frames, (double) i2c_stub.cnt.bytes / frames,
+           i2c_stub.cnt.bits * 1e6 / BUS_HZ / frames,
+           3 * RING_LEDS + 1, per_register_us(RING_LEDS));
+}
+
+static void frame_spinner(uint32_t *val, int f)
+{
+    memset(val, 0, RING_LEDS * sizeof(uint32_t));
+    val[f % RING_LEDS] = 0x00ffff;
+}
+
+static void frame_breathe(uint32_t *val, int f)
+{
+    int level = f % 64;
+    level = (level < 32) ? level * 8 : (63 - level) * 8;
+    for (int i = 0; i < RING_LEDS; i++) {
+        val[i] = level;
+    }
+}
+
+static void frame_static(uint32_t *val, int f)
+{
+    for (int i = 0; i < RING_LEDS; i++) {
+        val[i] = 0x0000ff;
+    }
+}
+
+static void frame_random(uint32_t *val, int f)
+{
+    for (int i = 0; i < RING_LEDS; i++) {
+        val[i] = rand() & 0xffffff;
+    }
+}
+
+static void bench()
+{
+    bench_pattern("spinner", frame_spinner, 1200);
+    bench_pattern("breathe", frame_breathe, 1200);
+    bench_pattern("static", frame_static, 1200);
+    bench_pattern("random", frame_random, 1200);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+    if (test_frames() || test_unchanged() || test_error()) {
+        return -1;
+    }
+    return 0;
+}
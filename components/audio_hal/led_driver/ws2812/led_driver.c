@@ -16,6 +16,7 @@
 *
 */
 
+#include <string.h>
 #include <esp_log.h>
 #include <driver/rmt.h>
 #include <freertos/FreeRTOS.h>
@@ -39,11 +40,58 @@ static int ledcnt;
 static int led_gpios;
 static uint8_t led_count;
 
-static rmt_item32_t *rmtdata;
+/*
+ * Frames are encoded from a byte -> 8 RMT items table into one of two buffers and handed to the RMT driver without
+ * waiting for the transmit to end. The driver keeps reading from the buffer while sending, so the next frame goes
+ * into the other one. An unchanged frame is not sent again.
+ */
+static rmt_item32_t *rmtdata[2];
+static int rmtdata_cur;
+static bool tx_pending;
+static rmt_item32_t (*ws_lut)[NO_OF_BITS_PER_COLOR];
+static uint8_t *led_sent;
+static bool led_sent_valid;
 
 static SemaphoreHandle_t mux;
 static const char* TAG = "led_driver_ws2812";
 
+static const rmt_item32_t wsOne = {
+    .duration0 = LED_STRIP_RMT_TICKS_BIT_1_HIGH_WS2812,
+    .level0 = 1,
+    .duration1 = LED_STRIP_RMT_TICKS_BIT_1_LOW_WS2812,
+    .level1 = 0,
+};
+
+static const rmt_item32_t wsZero = {
+    .duration0 = LED_STRIP_RMT_TICKS_BIT_0_HIGH_WS2812,
+    .level0 = 1,
+    .duration1 = LED_STRIP_RMT_TICKS_BIT_0_LOW_WS2812,
+    .level1 = 0,
+};
+
+static const rmt_item32_t wsReset = {
+    .duration0 = LED_STRIP_RMT_TICKS_BIT_0_HIGH_WS2812, //50uS
+    .level0 = 1,
+    .duration1 = 5000,
+    .level1 = 0,
+};
+
+static void ws_lut_init()
+{
+    for (int byte = 0; byte < 256; byte++) {
+        int j = 0;
+        for (int mask = 0x80; mask != 0; mask >>= 1) {
+            ws_lut[byte][j++] = (byte & mask) ? wsOne : wsZero;
+        }
+    }
+}
+
+static inline rmt_item32_t *encByte(rmt_item32_t *rmtdata, uint8_t byte)
+{
+    memcpy(rmtdata, ws_lut[byte], sizeof(ws_lut[byte]));
+    return rmtdata + NO_OF_BITS_PER_COLOR;
+}
+
 int leds_init(int cnt, int gpio, int no)
 {
     rmt_config_t rmt_cfg = {
@@ -81,12 +129,22 @@ int leds_init(int cnt, int gpio, int no)
         malloc will allocate the number of bytes required for 
         (number of leds present on GPIO i.e ledcnt * No of colors i.e. R, G, B (3) * no of bits 
         per color i.e intensity in form of uint8_t (8) + 1 (RESET pulse) ) * rmt_item32_t structure)
+        for every channel, twice.
     */
-    rmtdata = malloc((ledcnt * COLORS_RGB * NO_OF_BITS_PER_COLOR + 1) * sizeof(rmt_item32_t));
-    if (rmtdata == NULL) {
-        ESP_LOGE(TAG,"Can't allocate data for %d leds on channel %d\n", ledcnt, 0);
+    for (int i = 0; i < 2; i++) {
+        rmtdata[i] = malloc((ledcnt * COLORS_RGB * NO_OF_BITS_PER_COLOR + 1) * chancnt * sizeof(rmt_item32_t));
+        if (rmtdata[i] == NULL) {
+            ESP_LOGE(TAG,"Can't allocate data for %d leds on channel %d\n", ledcnt, 0);
+            return false;
+        }
+    }
+    ws_lut = malloc(256 * sizeof(*ws_lut));
+    led_sent = malloc(ledcnt * COLORS_RGB * chancnt);
+    if (ws_lut == NULL || led_sent == NULL) {
+        ESP_LOGE(TAG,"Can't allocate encoding table\n");
         return false;
     }
+    ws_lut_init();
     mux = xSemaphoreCreateMutex();
     if (mux == NULL) {
         ESP_LOGE(TAG,"Can't create semaphore\n");
@@ -95,65 +153,42 @@ int leds_init(int cnt, int gpio, int no)
     return true;
 }
 
-static const rmt_item32_t wsOne = {
-    .duration0 = LED_STRIP_RMT_TICKS_BIT_1_HIGH_WS2812,
-    .level0 = 1,
-    .duration1 = LED_STRIP_RMT_TICKS_BIT_1_LOW_WS2812,
-    .level1 = 0,
-};
-
-static const rmt_item32_t wsZero = {
-    .duration0 = LED_STRIP_RMT_TICKS_BIT_0_HIGH_WS2812,
-    .level0 = 1,
-    .duration1 = LED_STRIP_RMT_TICKS_BIT_0_LOW_WS2812,
-    .level1 = 0,
-};
-
-static const rmt_item32_t wsReset = {
-    .duration0 = LED_STRIP_RMT_TICKS_BIT_0_HIGH_WS2812, //50uS
-    .level0 = 1,
-    .duration1 = 5000,
-    .level1 = 0,
-};
-
-static void encByte(rmt_item32_t *rmtdata, uint8_t byte)
+void leds_send(uint8_t *data)
 {
-    int j = 0;
-    for (int mask = 0x80; mask != 0; mask >>= 1) {
-        if (byte & mask) {
-            rmtdata[j++] = wsOne;
-        } else {
-            rmtdata[j++] = wsZero;
+    int frame_len = ledcnt * COLORS_RGB * chancnt;
+    xSemaphoreTake(mux, portMAX_DELAY);
+    if (led_sent_valid && memcmp(led_sent, data, frame_len) == 0) {
+        xSemaphoreGive(mux);
+        return;
+    }
+    memcpy(led_sent, data, frame_len);
+    led_sent_valid = true;
+
+    /* Encode into the buffer that is not being transmitted */
+    int next = !rmtdata_cur;
+    int items_per_chan = ledcnt * COLORS_RGB * NO_OF_BITS_PER_COLOR + 1;
+    for (int chn = 0; chn < chancnt; chn++) {
+        rmt_item32_t *item = rmtdata[next] + chn * items_per_chan;
+        for (int n = 0; n < ledcnt; n++) {
+            item = encByte(item, data[1]); //G
+            item = encByte(item, data[0]); //R
+            item = encByte(item, data[2]); //B
+            data += 3;
         }
+        *item = wsReset;
     }
-}
 
-void leds_send(uint8_t *data)
-{
-    int i = 0;
-    int j = 0;
-    int n = 0;
-    int chn = 0;
-    xSemaphoreTake(mux, portMAX_DELAY);
-    while (chn != chancnt) {
-
-        encByte(&rmtdata[j], data[i + 1]); //G
-        encByte(&rmtdata[j + 8], data[i]); //R            
-        encByte(&rmtdata[j + 16], data[i + 2]); //B
-        j += 8 * 3;
-        i += 3;
-        n++;
-        if (n >= ledcnt) {
-            rmtdata[j++] = wsReset;
-            rmt_write_items(chn, rmtdata, j, false);
-            chn++;
-            n = 0;
-            j = 0;
+    /* Normally long done: frames come every few tens of ms, a 12 LED frame takes less than 0.5 ms to send */
+    if (tx_pending) {
+        for (int chn = 0; chn < chancnt; chn++) {
+            rmt_wait_tx_done(chn, portMAX_DELAY);
         }
     }
-    for (i = 0; i < chancnt; i++) {
-        rmt_wait_tx_done(i, portMAX_DELAY);
+    for (int chn = 0; chn < chancnt; chn++) {
+        rmt_write_items(chn, rmtdata[next] + chn * items_per_chan, items_per_chan, false);
     }
+    rmtdata_cur = next;
+    tx_pending = true;
     xSemaphoreGive(mux);
 }
 
@@ -17,11 +17,13 @@
 */
 
 #include <string.h>
+#include <math.h>
 #include "driver/gpio.h"
 #include "esp_log.h"
 #include <media_hal.h>
 #include <media_hal_codec_init.h>
 #include <media_hal_playback.h>
+#include <audio_pcm.h>
 
 #define HAL_TAG "MEDIA_HAL"
 
@@ -36,6 +38,46 @@ static media_hal_t *media_hal_handle = NULL;
 
 static uint8_t volume_prv; //This currently is needed due to bt case.
 
+/**
+ * The codec volume is only changed in steps of this many percent, rounded up. Volumes in between are reached with
+ * the playback software gain, which ramps without a click and costs no codec (I2C) write.
+ */
+#define MEDIA_HAL_VOLUME_HW_STEP 10
+
+/* Software gain (Q15) for 0 to 9% below the codec volume, on the slope of the codec volume (media_hal_t.volume_slope).
+ * Unity for codecs without a volume control. */
+static int32_t volume_sw_gain[MEDIA_HAL_VOLUME_HW_STEP];
+
+static void media_hal_volume_sw_gain_init(uint8_t volume_slope)
+{
+    for (int i = 0; i < MEDIA_HAL_VOLUME_HW_STEP; i++) {
+        /* 10 ^ (-dB / 20), with volume_slope in 0.1 dB */
+        volume_sw_gain[i] = lrintf(AUDIO_PCM_GAIN_UNITY * powf(10.0f, -(float) (volume_slope * i) / 200.0f));
+    }
+}
+
+static int volume_hw = -1; /* Volume set in the codec. -1 if not known, e.g. after a codec mute, reset or power change. */
+
+/* Set codec volume (in coarse steps) and software gain for `volume`. Call with media_hal_lock taken. */
+static esp_err_t media_hal_apply_volume(media_hal_t *media_hal, uint8_t volume)
+{
+    if (volume == 0) {
+        media_hal_playback_set_gain(0);
+        return ESP_OK;
+    }
+    if (volume > 100) {
+        volume = 100;
+    }
+    int hw = ((volume + MEDIA_HAL_VOLUME_HW_STEP - 1) / MEDIA_HAL_VOLUME_HW_STEP) * MEDIA_HAL_VOLUME_HW_STEP;
+    esp_err_t ret = ESP_OK;
+    if (hw != volume_hw) {
+        ret = media_hal->audio_codec_control_volume(hw);
+        volume_hw = (ret == ESP_OK) ? hw : -1;
+    }
+    media_hal_playback_set_gain(volume_sw_gain[hw - volume]);
+    return ret;
+}
+
 media_hal_t* media_hal_init(media_hal_config_t *media_hal_cfg, media_hal_playback_cfg_t *media_hal_playback_cfg)
 {
     if (!media_hal_handle) {
@@ -51,6 +93,8 @@ media_hal_t* media_hal_init(media_hal_config_t *media_hal_cfg, media_hal_playbac
         assert(media_hal->media_hal_lock);
         xSemaphoreTake(media_hal->media_hal_lock, portMAX_DELAY);
         media_hal_codec_init(media_hal, media_hal_cfg);
+        media_hal_volume_sw_gain_init(media_hal->volume_slope);
+        volume_hw = -1;
         xSemaphoreGive(media_hal->media_hal_lock);
         volume_prv = MEDIA_HAL_VOL_DEFAULT;
         media_hal_handle = media_hal;
@@ -76,6 +120,7 @@ esp_err_t media_hal_deinit(media_hal_t* media_hal)
     esp_err_t ret;
     vSemaphoreDelete(media_hal->media_hal_lock);
     ret = media_hal->audio_codec_deinitialize(media_hal_port_num);
+    volume_hw = -1;
     media_hal->media_hal_lock = NULL;
     free(media_hal);
     media_hal_handle = NULL;
@@ -91,6 +136,8 @@ esp_err_t media_hal_set_state(media_hal_t* media_hal, media_hal_codec_mode_t mod
     xSemaphoreTake(media_hal->media_hal_lock, portMAX_DELAY);
     ESP_LOGI(HAL_TAG, "Codec mode is %d", mode);
     ret = media_hal->audio_codec_set_state(mode, media_hal_state);
+    /* The codec may come back at its own volume */
+    volume_hw = -1;
     xSemaphoreGive(media_hal->media_hal_lock);
     return ret;
 }
@@ -189,11 +236,7 @@ esp_err_t media_hal_control_volume(media_hal_t* media_hal, uint8_t volume)
     volume_prv = volume;
     esp_err_t ret;
     xSemaphoreTake(media_hal->media_hal_lock, portMAX_DELAY);
-    if (volume == 0) {
-        ret = media_hal->audio_codec_set_mute(true);
-    } else {
-        ret = media_hal->audio_codec_control_volume(volume);
-    }
+    ret = media_hal_apply_volume(media_hal, volume);
     xSemaphoreGive(media_hal->media_hal_lock);
     return ret;
 }
@@ -212,10 +255,11 @@ esp_err_t media_hal_set_mute_bt(media_hal_t* media_hal, bool mute)
          */
         xSemaphoreTake(media_hal->media_hal_lock, portMAX_DELAY);
         ret = media_hal->audio_codec_set_mute(true);
+        volume_hw = -1;
         xSemaphoreGive(media_hal->media_hal_lock);
     } else {
         xSemaphoreTake(media_hal->media_hal_lock, portMAX_DELAY);
-        ret = media_hal->audio_codec_control_volume(volume_prv);
+        ret = media_hal_apply_volume(media_hal, volume_prv);
         xSemaphoreGive(media_hal->media_hal_lock);
     }
     return ret;
@@ -237,9 +281,14 @@ esp_err_t media_hal_set_mute(media_hal_t* media_hal, bool mute)
     if (!media_hal) {
         return ESP_FAIL;
     }
-    esp_err_t ret;
+    esp_err_t ret = ESP_OK;
     xSemaphoreTake(media_hal->media_hal_lock, portMAX_DELAY);
-    ret = media_hal->audio_codec_set_mute(mute);
+    /* Ramped in software: the codec keeps its volume */
+    if (mute) {
+        media_hal_playback_set_gain(0);
+    } else {
+        ret = media_hal_apply_volume(media_hal, volume_prv);
+    }
     xSemaphoreGive(media_hal->media_hal_lock);
     return ret;
 }
@@ -290,6 +339,7 @@ esp_err_t media_hal_powerup(media_hal_t* media_hal)
     esp_err_t ret;
     xSemaphoreTake(media_hal->media_hal_lock, portMAX_DELAY);
     ret = media_hal->audio_codec_powerup();
+    volume_hw = -1;
     xSemaphoreGive(media_hal->media_hal_lock);
     return ret;
 }
@@ -302,6 +352,7 @@ esp_err_t media_hal_powerdown(media_hal_t* media_hal)
     esp_err_t ret;
     xSemaphoreTake(media_hal->media_hal_lock, portMAX_DELAY);
     ret = media_hal->audio_codec_powerdown();
+    volume_hw = -1;
     xSemaphoreGive(media_hal->media_hal_lock);
     return ret;
 }
@@ -0,0 +1,146 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/**
+ * Jitter buffer control with clock drift compensation.
+ *
+ * A producer (e.g. the A2DP sink data callback) writes into a ring buffer at the rate of a remote clock, while a
+ * consumer reads from it at the local I2S rate. The two clocks differ by some ppm, so over a long session the ring
+ * slowly fills up until packets are dropped, or drains until the reader underruns. Both are audible.
+ *
+ * audio_jitter sits on the producer side. For every packet it takes the current fill level of the ring, keeps a
+ * smoothed estimate of it and steers it towards `target_frames` by resampling the packet by a tiny ratio (at most
+ * AUDIO_JITTER_MAX_PPM). The latency therefore stays constant around the target, and the correction converges to
+ * the drift between the two clocks.
+ *
+ * The resampler interpolates linearly with a 32 bit fractional phase. At a correction of 0 it copies samples
+ * unchanged.
+ *
+ * Samples are 16 bit, interleaved, 1 or 2 channels. Not thread safe: process() is called from the producer only.
+ * The counters may be updated from other contexts.
+ */
+
+#ifndef _AUDIO_JITTER_H_
+#define _AUDIO_JITTER_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIO_JITTER_MAX_PPM    1000
+
+typedef struct {
+    uint32_t packets;           /* Packets processed */
+    uint32_t dropped;           /* Packets dropped because the ring was full */
+    uint32_t underruns;         /* Times the consumer found less data than it asked for */
+    uint32_t frames_added;      /* Frames added by the correction (producer slower than consumer) */
+    uint32_t frames_removed;    /* Frames removed by the correction (producer faster than consumer) */
+    int32_t fill_frames;        /* Smoothed fill level */
+    int32_t ppm;                /* Current correction. Positive: output is stretched. */
+} audio_jitter_stats_t;
+
+typedef struct {
+    int channels;
+    int target_frames;
+    /* Controller */
+    float fill_avg;
+    float drift_ppm;            /* Integral part: the estimated clock drift */
+    float ppm;
+    uint64_t step;              /* Input frames per output frame, Q32 */
+    /* Resampler */
+    uint64_t phase;             /* Position of the next output frame, Q32. 1.0 is the first input frame. */
+    int16_t last[2];            /* Last input frame of the previous packet */
+    uint64_t frames_in;
+    uint64_t frames_out;
+    audio_jitter_stats_t stats;
+} audio_jitter_t;
+
+/**
+ * @brief   Initialise
+ *
+ * @param[in] jb            Jitter buffer state, owned by the caller
+ * @param[in] channels      1 or 2
+ * @param[in] target_frames Fill level to keep the ring at
+ */
+void audio_jitter_init(audio_jitter_t *jb, int channels, int target_frames);
+
+/**
+ * @brief   Restart after the stream was interrupted (ring flushed, new stream started).
+ *
+ * The drift estimate is kept: it belongs to the pair of clocks, not to the stream. Call audio_jitter_init for a
+ * new peer.
+ */
+void audio_jitter_reset(audio_jitter_t *jb, int target_frames);
+
+/**
+ * @brief   Output frames needed for `in_frames` input frames, at most
+ */
+static inline int audio_jitter_max_out_frames(int in_frames)
+{
+    return in_frames + (int) (((int64_t) in_frames * AUDIO_JITTER_MAX_PPM) / 1000000) + 2;
+}
+
+/**
+ * @brief   Process one packet
+ *
+ * @param[in]  jb           Jitter buffer state
+ * @param[in]  in           Input frames
+ * @param[in]  in_frames    Number of input frames
+ * @param[out] out          Output buffer. Must not overlap `in`.
+ * @param[in]  out_frames   Size of `out` in frames. See audio_jitter_max_out_frames().
+ * @param[in]  fill_frames  Frames currently in the ring, before this packet is written
+ *
+ * @return  Number of frames written to `out`, to be written to the ring
+ */
+int audio_jitter_process(audio_jitter_t *jb, const int16_t *in, int in_frames, int16_t *out, int out_frames,
+                         int fill_frames);
+
+/**
+ * @brief   Count a packet the caller could not write to the ring
+ */
+static inline void audio_jitter_count_drop(audio_jitter_t *jb)
+{
+    jb->stats.dropped++;
+}
+
+/**
+ * @brief   Count a consumer underrun
+ */
+static inline void audio_jitter_count_underrun(audio_jitter_t *jb)
+{
+    jb->stats.underruns++;
+}
+
+/**
+ * @brief   Get the counters
+ */
+void audio_jitter_get_stats(audio_jitter_t *jb, audio_jitter_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AUDIO_JITTER_H_ */
@@ -0,0 +1,121 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/**
+ * Kernels for 16 bit PCM processing.
+ *
+ * Samples are interleaved. `samples` counts individual 16 bit values, `frames` counts samples per channel.
+ * Gains are Q15: AUDIO_PCM_GAIN_UNITY (32768) is 0dB.
+ */
+
+#ifndef _AUDIO_PCM_H_
+#define _AUDIO_PCM_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIO_PCM_GAIN_UNITY    (1 << 15)
+#define AUDIO_PCM_GAIN_MAX      0xffff      /* ~ +6dB. Keeps sample * gain within 32 bits. */
+
+/* A gain moving towards a target, across buffers */
+typedef struct {
+    int32_t gain;       /* Gain reached at the end of the last buffer */
+    int32_t step_max;   /* Max gain change per frame */
+} audio_pcm_gain_ramp_t;
+
+typedef struct {
+    int16_t peak;       /* Max absolute sample value (saturated to INT16_MAX) */
+    int16_t rms;        /* Root mean square of samples */
+} audio_pcm_meter_t;
+
+/**
+ * @brief   Scale samples in place by a constant gain, with saturation.
+ */
+void audio_pcm_gain(int16_t *buf, int samples, int32_t gain);
+
+/**
+ * @brief   Scale frames in place by a gain moving linearly from `gain_start` to `gain_end`.
+ *
+ * Used for click-free mute/unmute and fades. All channels of a frame get the same gain.
+ */
+void audio_pcm_ramp(int16_t *buf, int frames, int channels, int32_t gain_start, int32_t gain_end);
+
+/**
+ * @brief   Start a gain ramp at `gain`. A full scale change (0 to unity) will take `ramp_ms`.
+ */
+void audio_pcm_gain_ramp_init(audio_pcm_gain_ramp_t *ramp, int32_t gain, int sample_rate, int ramp_ms);
+
+/**
+ * @brief   Scale frames in place by a gain moving towards `target`, by at most `step_max` per frame.
+ *
+ * A change carries over buffers and lands exactly on `target`. At a steady unity gain the buffer is not touched.
+ */
+void audio_pcm_gain_ramp_process(audio_pcm_gain_ramp_t *ramp, int16_t *buf, int frames, int channels, int32_t target);
+
+/**
+ * @brief   Duplicate mono frames into stereo. `dst` may be the same as `src`.
+ */
+void audio_pcm_mono_to_stereo(int16_t *dst, const int16_t *src, int frames);
+
+/**
+ * @brief   Average stereo frames into mono. `dst` may be the same as `src`.
+ */
+void audio_pcm_stereo_to_mono(int16_t *dst, const int16_t *src, int frames);
+
+/**
+ * @brief   Expand 16 bit samples to left-justified 32 bit samples. `dst` may be the same as `src`.
+ */
+void audio_pcm_expand_16_to_32(int32_t *dst, const int16_t *src, int samples);
+
+/**
+ * @brief   Accumulate frames into a 32 bit mix buffer with a gain ramp from `gain_start` to `gain_end`.
+ *
+ * Pass the same value for both gains for a constant gain. Use `audio_pcm_saturate_32_to_16` to
+ * convert the mix back once all inputs are accumulated.
+ */
+void audio_pcm_mix_accumulate(int32_t *acc, const int16_t *src, int frames, int channels, int32_t gain_start, int32_t gain_end);
+
+/**
+ * @brief   Saturate 32 bit mix samples to 16 bits. `dst` may alias `src`.
+ */
+void audio_pcm_saturate_32_to_16(int16_t *dst, const int32_t *src, int samples);
+
+/**
+ * @brief   Saturating add of `src` into `dst`.
+ */
+void audio_pcm_mix_sat(int16_t *dst, const int16_t *src, int samples);
+
+/**
+ * @brief   Measure peak and RMS level of samples.
+ */
+void audio_pcm_meter(const int16_t *buf, int samples, audio_pcm_meter_t *meter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AUDIO_PCM_H_ */
@@ -0,0 +1,106 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+/**
+ * Size-class pool allocator for audio buffers.
+ *
+ * Ring buffers, stream buffers, playlist entries and anchor nodes are allocated and freed for every track. Taking
+ * them straight from the heap scatters small, longer lived objects (playlist entries, URIs, anchors) into the holes
+ * left by large buffers, and PSRAM fragments over long uptimes. The pool keeps allocations per region and size class:
+ *  - Up to 256 bytes: blocks are carved out of 2KB slabs, so that small objects stay together instead of splitting
+ *    large free areas.
+ *  - Up to 16KB: classes are 1/4 of a power of 2 apart (at most 25% rounding). Freed blocks are cached, up to a
+ *    small per-region limit, and handed out again before the heap is asked.
+ *  - Larger buffers go to the heap with their exact size. Caching them pins large areas of the heap that nothing
+ *    else can use.
+ *
+ * When the heap cannot satisfy a request, cached blocks and empty slabs are released and the request is retried.
+ *
+ * All memory returned is zeroed.
+ */
+
+#ifndef _AUDIO_POOL_H_
+#define _AUDIO_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    /* Internal SRAM */
+    AUDIO_POOL_INTERNAL = 0,
+    /* SPIRAM if available, like esp_audio_mem_calloc. Internal otherwise. */
+    AUDIO_POOL_EXTERNAL,
+    /* DMA capable internal memory */
+    AUDIO_POOL_DMA,
+    AUDIO_POOL_REGION_MAX,
+} audio_pool_region_t;
+
+typedef struct {
+    uint32_t allocs;            /* audio_pool_alloc calls that succeeded */
+    uint32_t frees;
+    uint32_t reused;            /* Allocations served from a cached block or a slab, without a heap allocation */
+    uint32_t failed;            /* Heap allocations that failed */
+    size_t in_use;              /* Bytes requested by live allocations */
+    size_t held;                /* Bytes taken from the heap: live blocks, slabs and cached blocks */
+    size_t cached;              /* Bytes in freed blocks kept for reuse */
+    size_t peak_held;
+} audio_pool_stats_t;
+
+/**
+ * @brief   Allocate zeroed memory
+ *
+ * @return  Pointer to the memory, NULL on failure. Free it with audio_pool_free.
+ */
+void *audio_pool_alloc(audio_pool_region_t region, size_t size);
+
+/**
+ * @brief   Free memory from audio_pool_alloc. NULL is ignored.
+ */
+void audio_pool_free(void *ptr);
+
+/**
+ * @brief   Return cached blocks and empty slabs to the heap
+ */
+void audio_pool_trim();
+
+/**
+ * @brief   Get the statistics of a region
+ */
+void audio_pool_get_stats(audio_pool_region_t region, audio_pool_stats_t *stats);
+
+/**
+ * @brief   Print the statistics of all regions
+ */
+void audio_pool_print_stats();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AUDIO_POOL_H_ */
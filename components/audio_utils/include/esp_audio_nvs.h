@@ -33,4 +33,8 @@ esp_err_t esp_audio_nvs_set_i8(char *namespace, char *key, int8_t value);
 esp_err_t esp_audio_nvs_get_i8(char *namespace, char *key, int8_t *value);
 esp_err_t esp_audio_nvs_get_u16(char *namespace, char *key, uint16_t *value);
 
+/* Sets are cached and written to flash in batches, a second after the first change (and on esp_restart()).
+ * This writes and commits all pending sets right away. */
+esp_err_t esp_audio_nvs_flush();
+
 #endif /* _ESP_AUDIO_NVS_H_ */
@@ -0,0 +1,142 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include <audio_jitter.h>
+
+/**
+ * Controller tuning.
+ *
+ * Every ppm of correction moves the fill level by about 0.044 frames/s at 44.1kHz, so the loop is slow by nature:
+ * the proportional term settles a fill error in about half a minute, the integral term learns the drift over a few
+ * minutes. The fill level is smoothed over ~64 packets first, as it jumps by a packet on every write and by a
+ * read buffer on every read.
+ */
+#define JITTER_FILL_SMOOTHING   (1.0f / 64)
+#define JITTER_KP               0.5f                /* ppm per frame of error */
+#define JITTER_KI               0.0005f             /* ppm per frame of error, per packet */
+
+#define Q32_ONE                 ((uint64_t) 1 << 32)
+
+static void audio_jitter_set_ppm(audio_jitter_t *jb, float ppm)
+{
+    if (ppm > AUDIO_JITTER_MAX_PPM) {
+        ppm = AUDIO_JITTER_MAX_PPM;
+    } else if (ppm < -AUDIO_JITTER_MAX_PPM) {
+        ppm = -AUDIO_JITTER_MAX_PPM;
+    }
+    jb->ppm = ppm;
+    /* Stretching by `ppm` means reading the input slower, by the same factor */
+    jb->step = (uint64_t) (4294967296.0f / (1.0f + ppm * 1e-6f));
+}
+
+void audio_jitter_reset(audio_jitter_t *jb, int target_frames)
+{
+    jb->target_frames = target_frames;
+    jb->fill_avg = -1;
+    jb->phase = Q32_ONE;
+    jb->last[0] = jb->last[1] = 0;
+    audio_jitter_set_ppm(jb, jb->drift_ppm);
+}
+
+void audio_jitter_init(audio_jitter_t *jb, int channels, int target_frames)
+{
+    memset(jb, 0, sizeof(audio_jitter_t));
+    jb->channels = (channels == 1) ? 1 : 2;
+    audio_jitter_reset(jb, target_frames);
+}
+
+static void audio_jitter_control(audio_jitter_t *jb, int fill_frames)
+{
+    if (jb->fill_avg < 0) {
+        /* First packet after a reset. The ring is still being primed, start from the target. */
+        jb->fill_avg = jb->target_frames;
+    }
+    jb->fill_avg += (fill_frames - jb->fill_avg) * JITTER_FILL_SMOOTHING;
+    float error = jb->target_frames - jb->fill_avg;
+
+    jb->drift_ppm += error * JITTER_KI;
+    if (jb->drift_ppm > AUDIO_JITTER_MAX_PPM) {
+        jb->drift_ppm = AUDIO_JITTER_MAX_PPM;
+    } else if (jb->drift_ppm < -AUDIO_JITTER_MAX_PPM) {
+        jb->drift_ppm = -AUDIO_JITTER_MAX_PPM;
+    }
+    audio_jitter_set_ppm(jb, jb->drift_ppm + error * JITTER_KP);
+}
+
+int audio_jitter_process(audio_jitter_t *jb, const int16_t *in, int in_frames, int16_t *out, int out_frames,
+                         int fill_frames)
+{
+    if (in_frames <= 0) {
+        return 0;
+    }
+    audio_jitter_control(jb, fill_frames);
+
+    const int ch = jb->channels;
+    uint64_t phase = jb->phase;
+    uint64_t step = jb->step;
+    uint64_t end = (uint64_t) in_frames << 32;
+    int n = 0;
+
+    if (step == Q32_ONE && phase == Q32_ONE && in_frames <= out_frames) {
+        /* No correction, in phase: plain copy */
+        memcpy(out, in, in_frames * ch * sizeof(int16_t));
+        n = in_frames;
+    } else {
+        while (phase < end && n < out_frames) {
+            int i = (int) (phase >> 32);
+            int32_t frac = (int32_t) ((uint32_t) phase >> 17);     /* Q15 */
+            const int16_t *a = (i == 0) ? jb->last : &in[(i - 1) * ch];
+            const int16_t *b = &in[i * ch];
+            for (int c = 0; c < ch; c++) {
+                out[n * ch + c] = (int16_t) (a[c] + (((b[c] - a[c]) * frac) >> 15));
+            }
+            n++;
+            phase += step;
+        }
+        phase -= end;
+    }
+    memcpy(jb->last, &in[(in_frames - 1) * ch], ch * sizeof(int16_t));
+    jb->phase = phase;
+
+    jb->frames_in += in_frames;
+    jb->frames_out += n;
+    if (jb->frames_out > jb->frames_in) {
+        jb->stats.frames_added = jb->frames_out - jb->frames_in;
+        jb->stats.frames_removed = 0;
+    } else {
+        jb->stats.frames_added = 0;
+        jb->stats.frames_removed = jb->frames_in - jb->frames_out;
+    }
+    jb->stats.packets++;
+    return n;
+}
+
+void audio_jitter_get_stats(audio_jitter_t *jb, audio_jitter_stats_t *stats)
+{
+    *stats = jb->stats;
+    stats->fill_frames = (int32_t) jb->fill_avg;
+    stats->ppm = (int32_t) jb->ppm;
+}
@@ -0,0 +1,276 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <audio_pcm.h>
+
+/**
+ * Every kernel has a portable C implementation.
+ * On ESP32 saturation uses the `clamps` instruction (common_macros.h).
+ * Host builds (test_host) additionally use SSE2/NEON where it pays off.
+ */
+#if defined(__XTENSA__)
+#include <common_macros.h>
+#define pcm_sat16(x)    esp_saturate16(x)
+#else
+static inline int32_t pcm_sat16(int32_t in)
+{
+    if (in > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (in < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return in;
+}
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PCM_USE_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PCM_USE_NEON
+#endif
+#endif /* __XTENSA__ */
+
+void audio_pcm_gain(int16_t *buf, int samples, int32_t gain)
+{
+    if (gain == AUDIO_PCM_GAIN_UNITY) {
+        return;
+    }
+    for (int i = 0; i < samples; i++) {
+        buf[i] = (int16_t) pcm_sat16((buf[i] * gain) >> 15);
+    }
+}
+
+void audio_pcm_ramp(int16_t *buf, int frames, int channels, int32_t gain_start, int32_t gain_end)
+{
+    if (frames <= 0) {
+        return;
+    }
+    if (gain_start == gain_end) {
+        audio_pcm_gain(buf, frames * channels, gain_start);
+        return;
+    }
+    int32_t gain = gain_start;
+    int32_t step = (gain_end - gain_start) / frames;
+    if (channels == 2) {
+        for (int i = 0; i < frames; i++) {
+            buf[2 * i] = (int16_t) pcm_sat16((buf[2 * i] * gain) >> 15);
+            buf[2 * i + 1] = (int16_t) pcm_sat16((buf[2 * i + 1] * gain) >> 15);
+            gain += step;
+        }
+    } else {
+        for (int i = 0; i < frames; i++) {
+            for (int ch = 0; ch < channels; ch++) {
+                buf[i * channels + ch] = (int16_t) pcm_sat16((buf[i * channels + ch] * gain) >> 15);
+            }
+            gain += step;
+        }
+    }
+}
+
+void audio_pcm_gain_ramp_init(audio_pcm_gain_ramp_t *ramp, int32_t gain, int sample_rate, int ramp_ms)
+{
+    int ramp_frames = (sample_rate > 0 && ramp_ms > 0) ? sample_rate * ramp_ms / 1000 : 1;
+    ramp->gain = gain;
+    ramp->step_max = (AUDIO_PCM_GAIN_UNITY + ramp_frames - 1) / ramp_frames;
+}
+
+void audio_pcm_gain_ramp_process(audio_pcm_gain_ramp_t *ramp, int16_t *buf, int frames, int channels, int32_t target)
+{
+    int32_t gain = ramp->gain;
+    if (__builtin_expect(gain == target, 1)) {
+        audio_pcm_gain(buf, frames * channels, gain);
+        return;
+    }
+    if (frames <= 0) {
+        return;
+    }
+    int32_t diff = target - gain;
+    int32_t step = diff / frames;
+    if (step > ramp->step_max) {
+        step = ramp->step_max;
+    } else if (step < -ramp->step_max) {
+        step = -ramp->step_max;
+    }
+    if (step == 0) {
+        /* Less than one unit per frame left: one unit per frame, then the target */
+        int n = (diff > 0) ? diff : -diff;
+        audio_pcm_ramp(buf, n, channels, gain, target);
+        audio_pcm_gain(buf + n * channels, (frames - n) * channels, target);
+        ramp->gain = target;
+    } else {
+        ramp->gain = gain + step * frames;
+        audio_pcm_ramp(buf, frames, channels, gain, ramp->gain);
+    }
+}
+
+void audio_pcm_mono_to_stereo(int16_t *dst, const int16_t *src, int frames)
+{
+    /* Backwards, so that it works in place */
+    for (int i = frames - 1; i >= 0; i--) {
+        int16_t s = src[i];
+        dst[2 * i] = s;
+        dst[2 * i + 1] = s;
+    }
+}
+
+void audio_pcm_stereo_to_mono(int16_t *dst, const int16_t *src, int frames)
+{
+    for (int i = 0; i < frames; i++) {
+        dst[i] = (int16_t) ((src[2 * i] + src[2 * i + 1]) >> 1);
+    }
+}
+
+void audio_pcm_expand_16_to_32(int32_t *dst, const int16_t *src, int samples)
+{
+    int i = 0;
+    if ((const void *) dst != (const void *) src) {
+#if defined(PCM_USE_SSE2)
+        __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= samples; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+            _mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(zero, v));
+            _mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(zero, v));
+        }
+#elif defined(PCM_USE_NEON)
+        for (; i + 8 <= samples; i += 8) {
+            int16x8_t v = vld1q_s16(src + i);
+            vst1q_s32(dst + i, vshll_n_s16(vget_low_s16(v), 16));
+            vst1q_s32(dst + i + 4, vshll_n_s16(vget_high_s16(v), 16));
+        }
+#endif
+        for (; i < samples; i++) {
+            dst[i] = (int32_t) src[i] << 16;
+        }
+        return;
+    }
+    /* In place: backwards */
+    for (i = samples - 1; i >= 0; i--) {
+        dst[i] = (int32_t) src[i] << 16;
+    }
+}
+
+void audio_pcm_mix_accumulate(int32_t *acc, const int16_t *src, int frames, int channels, int32_t gain_start, int32_t gain_end)
+{
+    int samples = frames * channels;
+    if (gain_start == gain_end) {
+        if (gain_start == AUDIO_PCM_GAIN_UNITY) {
+            for (int i = 0; i < samples; i++) {
+                acc[i] += src[i];
+            }
+        } else {
+            for (int i = 0; i < samples; i++) {
+                acc[i] += (src[i] * gain_start) >> 15;
+            }
+        }
+        return;
+    }
+    if (frames <= 0) {
+        return;
+    }
+    int32_t gain = gain_start;
+    int32_t step = (gain_end - gain_start) / frames;
+    for (int i = 0; i < frames; i++) {
+        for (int ch = 0; ch < channels; ch++) {
+            acc[i * channels + ch] += (src[i * channels + ch] * gain) >> 15;
+        }
+        gain += step;
+    }
+}
+
+void audio_pcm_saturate_32_to_16(int16_t *dst, const int32_t *src, int samples)
+{
+    int i = 0;
+#if defined(PCM_USE_SSE2)
+    for (; i + 8 <= samples; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *) (src + i + 4));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(lo, hi));
+    }
+#elif defined(PCM_USE_NEON)
+    for (; i + 8 <= samples; i += 8) {
+        int32x4_t lo = vld1q_s32(src + i);
+        int32x4_t hi = vld1q_s32(src + i + 4);
+        vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+#endif
+    for (; i < samples; i++) {
+        dst[i] = (int16_t) pcm_sat16(src[i]);
+    }
+}
+
+void audio_pcm_mix_sat(int16_t *dst, const int16_t *src, int samples)
+{
+    int i = 0;
+#if defined(PCM_USE_SSE2)
+    for (; i + 8 <= samples; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_adds_epi16(a, b));
+    }
+#elif defined(PCM_USE_NEON)
+    for (; i + 8 <= samples; i += 8) {
+        vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+    }
+#endif
+    for (; i < samples; i++) {
+        dst[i] = (int16_t) pcm_sat16(dst[i] + src[i]);
+    }
+}
+
+static uint32_t pcm_isqrt(uint64_t x)
+{
+    uint64_t res = 0;
+    uint64_t bit = (uint64_t) 1 << 62;
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (x >= res + bit) {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t) res;
+}
+
+void audio_pcm_meter(const int16_t *buf, int samples, audio_pcm_meter_t *meter)
+{
+    int32_t peak = 0;
+    uint64_t sum_sq = 0;
+    for (int i = 0; i < samples; i++) {
+        int32_t s = buf[i];
+        int32_t a = (s < 0) ? -s : s;
+        if (a > peak) {
+            peak = a;
+        }
+        sum_sq += (uint32_t) (s * s);
+    }
+    meter->peak = (int16_t) pcm_sat16(peak);
+    meter->rms = (samples > 0) ? (int16_t) pcm_sat16(pcm_isqrt(sum_sq / samples)) : 0;
+}
@@ -0,0 +1,381 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sdkconfig.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <audio_pool.h>
+
+#define POOL_MAGIC          0xa5d1
+#define POOL_MAGIC_FREE     0xdead
+#define POOL_SMALL_MAX      256
+#define POOL_SMALL_CLASSES  (POOL_SMALL_MAX / 16)
+#define POOL_LARGE_MAX      (16 * 1024)
+#define POOL_NUM_CLASSES    (POOL_SMALL_CLASSES + 4 * 6)    /* 4 per power of 2, from 256 bytes to 16KB */
+#define POOL_CLASS_DIRECT   0xff
+#define POOL_SLAB_SIZE      2048
+
+static const char *TAG = "[audio_pool]";
+
+/**
+ * Bytes of freed blocks kept for reuse, per region.
+ * Kept small on purpose: cached blocks are holes nobody else can use, and they pin the heap around them.
+ */
+static const size_t pool_cache_max[AUDIO_POOL_REGION_MAX] = {
+    [AUDIO_POOL_INTERNAL] = 16 * 1024,
+    [AUDIO_POOL_EXTERNAL] = 64 * 1024,
+    [AUDIO_POOL_DMA] = 16 * 1024,
+};
+
+static const char *pool_region_names[AUDIO_POOL_REGION_MAX] = {
+    [AUDIO_POOL_INTERNAL] = "internal",
+    [AUDIO_POOL_EXTERNAL] = "external",
+    [AUDIO_POOL_DMA] = "dma",
+};
+
+typedef struct pool_slab pool_slab_t;
+
+/* In front of every block. Its size keeps the returned memory as aligned as malloc's. */
+typedef struct {
+    uint16_t magic;
+    uint8_t region;
+    uint8_t cls;
+    uint32_t size;          /* Requested size */
+    pool_slab_t *slab;      /* Small classes only */
+} __attribute__((aligned(8))) pool_hdr_t;
+
+/* Free blocks are linked through their first word */
+#define POOL_NEXT(hdr)      (*(pool_hdr_t **) ((hdr) + 1))
+
+struct pool_slab {
+    pool_slab_t *next;
+    pool_hdr_t *free;
+    uint16_t used;
+} __attribute__((aligned(8)));
+
+static struct {
+    pool_slab_t *slabs[POOL_SMALL_CLASSES];
+    pool_hdr_t *cache[POOL_NUM_CLASSES];
+    audio_pool_stats_t stats;
+} pool[AUDIO_POOL_REGION_MAX];
+
+/* Only list and stats updates happen with this held. The heap is always called outside of it. */
+static portMUX_TYPE pool_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static int pool_class(size_t size)
+{
+    if (size <= POOL_SMALL_MAX) {
+        return (size + 15) / 16 - 1;
+    }
+    if (size > POOL_LARGE_MAX) {
+        return POOL_CLASS_DIRECT;
+    }
+    /* 2^e <= size - 1 < 2^(e + 1). Round up to a multiple of 2^(e - 2): 5, 6, 7 or 8 of them. */
+    int e = 31 - __builtin_clz((unsigned int) (size - 1));
+    int m = ((size - 1) >> (e - 2)) + 1;
+    return POOL_SMALL_CLASSES + (e - 8) * 4 + (m - 5);
+}
+
+static size_t pool_class_size(int cls)
+{
+    if (cls < POOL_SMALL_CLASSES) {
+        return (cls + 1) * 16;
+    }
+    int i = cls - POOL_SMALL_CLASSES;
+    int e = 8 + i / 4;
+    return (size_t) (5 + i % 4) << (e - 2);
+}
+
+static void *pool_heap_alloc(audio_pool_region_t region, size_t size)
+{
+    switch (region) {
+    case AUDIO_POOL_INTERNAL:
+        return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    case AUDIO_POOL_DMA:
+        return heap_caps_malloc(size, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+    default:
+#if (CONFIG_SPIRAM_SUPPORT && (CONFIG_SPIRAM_USE_CAPS_ALLOC || CONFIG_SPIRAM_USE_MALLOC))
+        return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+        return heap_caps_malloc(size, MALLOC_CAP_8BIT);
+#endif
+    }
+}
+
+/* Called with pool_mux held */
+static void pool_add_held(audio_pool_region_t region, size_t bytes)
+{
+    audio_pool_stats_t *stats = &pool[region].stats;
+    stats->held += bytes;
+    if (stats->held > stats->peak_held) {
+        stats->peak_held = stats->held;
+    }
+}
+
+static pool_hdr_t *pool_slab_get(audio_pool_region_t region, int cls)
+{
+    size_t block_size = sizeof(pool_hdr_t) + pool_class_size(cls);
+    portENTER_CRITICAL(&pool_mux);
+    for (pool_slab_t *slab = pool[region].slabs[cls]; slab; slab = slab->next) {
+        if (slab->free) {
+            pool_hdr_t *hdr = slab->free;
+            slab->free = POOL_NEXT(hdr);
+            slab->used++;
+            pool[region].stats.reused++;
+            portEXIT_CRITICAL(&pool_mux);
+            return hdr;
+        }
+    }
+    portEXIT_CRITICAL(&pool_mux);
+
+    pool_slab_t *slab = pool_heap_alloc(region, POOL_SLAB_SIZE);
+    if (!slab && pool[region].stats.cached) {
+        audio_pool_trim();
+        slab = pool_heap_alloc(region, POOL_SLAB_SIZE);
+    }
+    if (!slab) {
+        return NULL;
+    }
+    /* The first block is handed out, the rest go on the free list */
+    uint8_t *blocks = (uint8_t *) (slab + 1);
+    int count = (POOL_SLAB_SIZE - sizeof(pool_slab_t)) / block_size;
+    slab->free = NULL;
+    for (int i = count - 1; i >= 0; i--) {
+        pool_hdr_t *hdr = (pool_hdr_t *) (blocks + i * block_size);
+        hdr->slab = slab;
+        POOL_NEXT(hdr) = slab->free;
+        slab->free = hdr;
+    }
+    pool_hdr_t *hdr = slab->free;
+    slab->free = POOL_NEXT(hdr);
+    slab->used = 1;
+    portENTER_CRITICAL(&pool_mux);
+    slab->next = pool[region].slabs[cls];
+    pool[region].slabs[cls] = slab;
+    pool_add_held(region, POOL_SLAB_SIZE);
+    portEXIT_CRITICAL(&pool_mux);
+    return hdr;
+}
+
+static void pool_slab_put(audio_pool_region_t region, int cls, pool_hdr_t *hdr)
+{
+    pool_slab_t *slab = hdr->slab;
+    pool_slab_t *release = NULL;
+    portENTER_CRITICAL(&pool_mux);
+    POOL_NEXT(hdr) = slab->free;
+    slab->free = hdr;
+    slab->used--;
+    /* Release empty slabs, but keep one per class */
+    if (slab->used == 0 && !(pool[region].slabs[cls] == slab && slab->next == NULL)) {
+        pool_slab_t **p = &pool[region].slabs[cls];
+        while (*p != slab) {
+            p = &(*p)->next;
+        }
+        *p = slab->next;
+        pool[region].stats.held -= POOL_SLAB_SIZE;
+        release = slab;
+    }
+    portEXIT_CRITICAL(&pool_mux);
+    if (release) {
+        heap_caps_free(release);
+    }
+}
+
+static pool_hdr_t *pool_block_get(audio_pool_region_t region, int cls, size_t size)
+{
+    size_t block_size = sizeof(pool_hdr_t) + ((cls == POOL_CLASS_DIRECT) ? size : pool_class_size(cls));
+    pool_hdr_t *hdr = NULL;
+    if (cls != POOL_CLASS_DIRECT) {
+        portENTER_CRITICAL(&pool_mux);
+        hdr = pool[region].cache[cls];
+        if (hdr) {
+            pool[region].cache[cls] = POOL_NEXT(hdr);
+            pool[region].stats.cached -= block_size;
+            pool[region].stats.reused++;
+        }
+        portEXIT_CRITICAL(&pool_mux);
+        if (hdr) {
+            return hdr;
+        }
+    }
+    hdr = pool_heap_alloc(region, block_size);
+    if (!hdr && pool[region].stats.cached) {
+        /* The cached blocks may be what stands in the way */
+        audio_pool_trim();
+        hdr = pool_heap_alloc(region, block_size);
+    }
+    if (hdr) {
+        hdr->slab = NULL;
+        portENTER_CRITICAL(&pool_mux);
+        pool_add_held(region, block_size);
+        portEXIT_CRITICAL(&pool_mux);
+    }
+    return hdr;
+}
+
+static void pool_block_put(audio_pool_region_t region, int cls, pool_hdr_t *hdr)
+{
+    size_t block_size = sizeof(pool_hdr_t) + ((cls == POOL_CLASS_DIRECT) ? hdr->size : pool_class_size(cls));
+    bool cached = false;
+    portENTER_CRITICAL(&pool_mux);
+    audio_pool_stats_t *stats = &pool[region].stats;
+    if (cls != POOL_CLASS_DIRECT && stats->cached + block_size <= pool_cache_max[region]) {
+        POOL_NEXT(hdr) = pool[region].cache[cls];
+        pool[region].cache[cls] = hdr;
+        stats->cached += block_size;
+        cached = true;
+    } else {
+        stats->held -= block_size;
+    }
+    portEXIT_CRITICAL(&pool_mux);
+    if (!cached) {
+        heap_caps_free(hdr);
+    }
+}
+
+void *audio_pool_alloc(audio_pool_region_t region, size_t size)
+{
+    if (region >= AUDIO_POOL_REGION_MAX || size > UINT32_MAX) {
+        return NULL;
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    int cls = pool_class(size);
+    pool_hdr_t *hdr = (cls < POOL_SMALL_CLASSES) ? pool_slab_get(region, cls) : pool_block_get(region, cls, size);
+    portENTER_CRITICAL(&pool_mux);
+    if (hdr) {
+        pool[region].stats.allocs++;
+        pool[region].stats.in_use += size;
+    } else {
+        pool[region].stats.failed++;
+    }
+    portEXIT_CRITICAL(&pool_mux);
+    if (!hdr) {
+        ESP_LOGE(TAG, "Failed to allocate %d bytes from %s memory", (int) size, pool_region_names[region]);
+        return NULL;
+    }
+    hdr->magic = POOL_MAGIC;
+    hdr->region = region;
+    hdr->cls = cls;
+    hdr->size = size;
+    memset(hdr + 1, 0, size);
+    return hdr + 1;
+}
+
+void audio_pool_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    pool_hdr_t *hdr = (pool_hdr_t *) ptr - 1;
+    if (hdr->magic != POOL_MAGIC || hdr->region >= AUDIO_POOL_REGION_MAX) {
+        ESP_LOGE(TAG, "Invalid free of %p, %s", ptr, (hdr->magic == POOL_MAGIC_FREE) ? "already freed" : "not from the pool");
+        return;
+    }
+    hdr->magic = POOL_MAGIC_FREE;
+    audio_pool_region_t region = hdr->region;
+    int cls = hdr->cls;
+    portENTER_CRITICAL(&pool_mux);
+    pool[region].stats.frees++;
+    pool[region].stats.in_use -= hdr->size;
+    portEXIT_CRITICAL(&pool_mux);
+    if (cls < POOL_SMALL_CLASSES) {
+        pool_slab_put(region, cls, hdr);
+    } else {
+        pool_block_put(region, cls, hdr);
+    }
+}
+
+void audio_pool_trim()
+{
+    for (int region = 0; region < AUDIO_POOL_REGION_MAX; region++) {
+        /* Detach everything there is to release, then free it outside the lock */
+        pool_hdr_t *blocks = NULL;
+        pool_slab_t *slabs = NULL;
+        portENTER_CRITICAL(&pool_mux);
+        for (int cls = POOL_SMALL_CLASSES; cls < POOL_NUM_CLASSES; cls++) {
+            pool_hdr_t *hdr;
+            while ((hdr = pool[region].cache[cls]) != NULL) {
+                pool[region].cache[cls] = POOL_NEXT(hdr);
+                POOL_NEXT(hdr) = blocks;
+                blocks = hdr;
+                pool[region].stats.cached -= sizeof(pool_hdr_t) + pool_class_size(cls);
+                pool[region].stats.held -= sizeof(pool_hdr_t) + pool_class_size(cls);
+            }
+        }
+        for (int cls = 0; cls < POOL_SMALL_CLASSES; cls++) {
+            pool_slab_t **p = &pool[region].slabs[cls];
+            while (*p) {
+                pool_slab_t *slab = *p;
+                if (slab->used == 0) {
+                    *p = slab->next;
+                    slab->next = slabs;
+                    slabs = slab;
+                    pool[region].stats.held -= POOL_SLAB_SIZE;
+                } else {
+                    p = &slab->next;
+                }
+            }
+        }
+        portEXIT_CRITICAL(&pool_mux);
+        while (blocks) {
+            pool_hdr_t *next = POOL_NEXT(blocks);
+            heap_caps_free(blocks);
+            blocks = next;
+        }
+        while (slabs) {
+            pool_slab_t *next = slabs->next;
+            heap_caps_free(slabs);
+            slabs = next;
+        }
+    }
+}
+
+void audio_pool_get_stats(audio_pool_region_t region, audio_pool_stats_t *stats)
+{
+    if (region >= AUDIO_POOL_REGION_MAX || !stats) {
+        return;
+    }
+    portENTER_CRITICAL(&pool_mux);
+    *stats = pool[region].stats;
+    portEXIT_CRITICAL(&pool_mux);
+}
+
+void audio_pool_print_stats()
+{
+    printf("\tRegion\t\tIn use\t\tHeld\t\tCached\t\tPeak held\tAllocs\t\tReused\t\tFailed\n");
+    for (int region = 0; region < AUDIO_POOL_REGION_MAX; region++) {
+        audio_pool_stats_t stats;
+        audio_pool_get_stats(region, &stats);
+        printf("\t%s\t%s%d\t\t%d\t\t%d\t\t%d\t\t%u\t\t%u\t\t%u\n", pool_region_names[region],
+               (strlen(pool_region_names[region]) < 8) ? "\t" : "", (int) stats.in_use, (int) stats.held,
+               (int) stats.cached, (int) stats.peak_held, stats.allocs, stats.reused, stats.failed);
+    }
+}
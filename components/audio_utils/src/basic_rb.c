@@ -34,7 +34,7 @@
 #include <basic_rb.h>
 #include "esp_log.h"
 #include "esp_err.h"
-#include <esp_audio_mem.h>
+#include <audio_pool.h>
 
 static const char *TAG = "[basic_rb]";
 
@@ -66,9 +66,9 @@ rb_handle_t rb_init(const char *name, uint32_t size)
         return NULL;
     }
 
-    r = malloc(sizeof(ringbuf_t));
+    r = audio_pool_alloc(AUDIO_POOL_INTERNAL, sizeof(ringbuf_t));
     assert(r);
-    buf = esp_audio_mem_calloc(1, size);
+    buf = audio_pool_alloc(AUDIO_POOL_EXTERNAL, size);
     assert(buf);
 
     r->type = RB_TYPE_BASIC;
@@ -104,7 +104,7 @@ void rb_cleanup(rb_handle_t handle)
         return;
     }
 
-    free(rb->base);
+    audio_pool_free(rb->base);
     rb->base = NULL;
     vSemaphoreDelete(rb->can_read);
     rb->can_read = NULL;
@@ -112,7 +112,7 @@ void rb_cleanup(rb_handle_t handle)
     rb->can_write = NULL;
     vSemaphoreDelete(rb->lock);
     rb->lock = NULL;
-    free(rb);
+    audio_pool_free(rb);
 }
 
 /*
@@ -30,6 +30,7 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <esp_audio_mem.h>
+#include <audio_pool.h>
 #include <esp_timer.h>
 #include "lwip/sockets.h"
 
@@ -226,6 +227,17 @@ static int heap_trace_cli_handler(int argc, char *argv[])
     return 0;
 }
 
+static int pool_dump_cli_handler(int argc, char *argv[])
+{
+    /* Just to go to the next line */
+    printf("\n");
+    if (argc == 2 && strcmp(argv[1], "trim") == 0) {
+        audio_pool_trim();
+    }
+    audio_pool_print_stats();
+    return 0;
+}
+
 static esp_console_cmd_t diag_cmds[] = {
     {
         .command = "up-time",
@@ -257,6 +269,11 @@ static esp_console_cmd_t diag_cmds[] = {
         .help = "<start|stop> [trace-buf-size]",
         .func = heap_trace_cli_handler,
     },
+    {
+        .command = "pool-dump",
+        .help = "[trim]",
+        .func = pool_dump_cli_handler,
+    },
 };
 
 int diag_register_cli()
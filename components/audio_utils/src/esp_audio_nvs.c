@@ -22,12 +22,26 @@
  *
  */
 
+#include <string.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/timers.h>
+#include <freertos/semphr.h>
 #include <nvs.h>
+#include <esp_system.h>
 #include <esp_audio_nvs.h>
 
+/* Values are cached in RAM. Sets are committed in one batch, this long after the first change, on
+ * esp_audio_nvs_flush() and on esp_restart(). Clean entries are evicted least recently used first. */
+#define ESP_AUDIO_NVS_CACHE_ENTRIES     8
+#define ESP_AUDIO_NVS_MAX_NAMESPACES    4
+#define ESP_AUDIO_NVS_COMMIT_DELAY_MS   1000
+
+enum esp_audio_nvs_type {
+    I8,
+    U16,
+};
+
 struct esp_audio_nvs_params {
     const char *namespace;
     const char *key;
@@ -35,14 +49,119 @@ struct esp_audio_nvs_params {
     enum {
         GET,
         SET,
+        FLUSH,
     } op;
-    enum {
-        I8,
-        U16,
-    } type;
+    enum esp_audio_nvs_type type;
     TaskHandle_t calling_task_handle;
 };
 
+struct esp_audio_nvs_entry {
+    char namespace[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t type;
+    bool valid;
+    bool dirty;
+    uint32_t last_use;
+    union {
+        int8_t i8;
+        uint16_t u16;
+    } value;
+};
+
+static struct {
+    SemaphoreHandle_t lock;
+    TimerHandle_t commit_timer;
+    struct esp_audio_nvs_entry entries[ESP_AUDIO_NVS_CACHE_ENTRIES];
+    /* Handles are opened once, in the timer task, and kept open */
+    struct {
+        char namespace[NVS_KEY_NAME_MAX_SIZE];
+        nvs_handle_t handle;
+    } handles[ESP_AUDIO_NVS_MAX_NAMESPACES];
+    int num_handles;
+    bool commit_pending;
+    TaskHandle_t timer_task;
+    uint32_t use_counter;
+} an;
+
+static portMUX_TYPE an_init_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* Timer task only */
+static esp_err_t esp_audio_nvs_get_handle(const char *namespace, nvs_handle_t *handle)
+{
+    for (int i = 0; i < an.num_handles; i++) {
+        if (strcmp(an.handles[i].namespace, namespace) == 0) {
+            *handle = an.handles[i].handle;
+            return ESP_OK;
+        }
+    }
+    esp_err_t err = nvs_open(namespace, NVS_READWRITE, handle);
+    if (err == ESP_OK && an.num_handles < ESP_AUDIO_NVS_MAX_NAMESPACES) {
+        strncpy(an.handles[an.num_handles].namespace, namespace, NVS_KEY_NAME_MAX_SIZE - 1);
+        an.handles[an.num_handles].handle = *handle;
+        an.num_handles++;
+    }
+    return err;
+}
+
+static void esp_audio_nvs_put_handle(nvs_handle_t handle)
+{
+    for (int i = 0; i < an.num_handles; i++) {
+        if (an.handles[i].handle == handle) {
+            return;
+        }
+    }
+    /* Did not fit the handle cache */
+    nvs_close(handle);
+}
+
+/* Timer task: write all dirty values, one commit per namespace */
+static esp_err_t esp_audio_nvs_flush_fn()
+{
+    nvs_handle_t committed[ESP_AUDIO_NVS_CACHE_ENTRIES];
+    int num_committed = 0;
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(an.lock, portMAX_DELAY);
+    an.commit_pending = false;
+    for (int i = 0; i < ESP_AUDIO_NVS_CACHE_ENTRIES; i++) {
+        struct esp_audio_nvs_entry *e = &an.entries[i];
+        nvs_handle_t handle;
+        if (!e->dirty) {
+            continue;
+        }
+        e->dirty = false;
+        if (esp_audio_nvs_get_handle(e->namespace, &handle) != ESP_OK) {
+            e->valid = false;
+            ret = ESP_FAIL;
+            continue;
+        }
+        esp_err_t err = (e->type == I8) ? nvs_set_i8(handle, e->key, e->value.i8) : nvs_set_u16(handle, e->key, e->value.u16);
+        if (err != ESP_OK) {
+            /* Forget it: the next get will show what is actually in flash */
+            e->valid = false;
+            ret = ESP_FAIL;
+        }
+        int j;
+        for (j = 0; j < num_committed && committed[j] != handle; j++);
+        if (j == num_committed) {
+            committed[num_committed++] = handle;
+        }
+    }
+    for (int j = 0; j < num_committed; j++) {
+        if (nvs_commit(committed[j]) != ESP_OK) {
+            ret = ESP_FAIL;
+        }
+        esp_audio_nvs_put_handle(committed[j]);
+    }
+    xSemaphoreGive(an.lock);
+    return ret;
+}
+
+static void esp_audio_nvs_commit_cb(TimerHandle_t timer)
+{
+    an.timer_task = xTaskGetCurrentTaskHandle();
+    esp_audio_nvs_flush_fn();
+}
+
 static void esp_audio_nvs_timer_cb(void *arg, uint32_t arg_len)
 {
     struct esp_audio_nvs_params *params = (struct esp_audio_nvs_params *)arg;
@@ -50,15 +169,19 @@ static void esp_audio_nvs_timer_cb(void *arg, uint32_t arg_len)
     uint32_t ret = 0;
     nvs_handle_t handle;
 
-    nvs_open_mode mode = params->op == GET ? NVS_READONLY : NVS_READWRITE;
-    err = nvs_open(params->namespace, mode, &handle);
+    an.timer_task = xTaskGetCurrentTaskHandle();
+    if (params->op == FLUSH) {
+        err = esp_audio_nvs_flush_fn();
+        goto done;
+    }
+    err = esp_audio_nvs_get_handle(params->namespace, &handle);
     if (err != ESP_OK) {
         goto done;
     }
 
     if (params->op == SET) {
         if (params->type == I8) {
-            err = nvs_set_i8(handle, params->key, (int8_t)params->value);
+            err = nvs_set_i8(handle, params->key, (int8_t)(intptr_t)params->value);
         }
         nvs_commit(handle);
     } else if (params->op == GET) {
@@ -69,13 +192,79 @@ static void esp_audio_nvs_timer_cb(void *arg, uint32_t arg_len)
         }
     }
 
-    nvs_close(handle);
+    esp_audio_nvs_put_handle(handle);
 
 done:
     ret = err == ESP_OK ? 0 : 1;
     xTaskNotify(params->calling_task_handle, ret, eSetValueWithOverwrite);
 }
 
+static void esp_audio_nvs_shutdown_handler();
+
+static esp_err_t esp_audio_nvs_cache_init()
+{
+    if (an.lock) {
+        return ESP_OK;
+    }
+    SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+    TimerHandle_t commit_timer = xTimerCreate("audio_nvs_commit", pdMS_TO_TICKS(ESP_AUDIO_NVS_COMMIT_DELAY_MS), pdFALSE, NULL,
+                                              esp_audio_nvs_commit_cb);
+    if (!lock || !commit_timer) {
+        if (lock) {
+            vSemaphoreDelete(lock);
+        }
+        if (commit_timer) {
+            xTimerDelete(commit_timer, portMAX_DELAY);
+        }
+        return ESP_FAIL;
+    }
+    portENTER_CRITICAL(&an_init_mux);
+    if (!an.lock) {
+        an.commit_timer = commit_timer;
+        an.lock = lock;
+        lock = NULL;
+    }
+    portEXIT_CRITICAL(&an_init_mux);
+    if (lock) {
+        /* Someone else initialised it first */
+        vSemaphoreDelete(lock);
+        xTimerDelete(commit_timer, portMAX_DELAY);
+    } else {
+        esp_register_shutdown_handler(esp_audio_nvs_shutdown_handler);
+    }
+    return ESP_OK;
+}
+
+/* Called with the lock held. With `alloc`, a missing key takes a free entry, or the least recently used one that
+ * is not dirty. NULL if all are dirty. */
+static struct esp_audio_nvs_entry *esp_audio_nvs_find(const char *namespace, const char *key, enum esp_audio_nvs_type type, bool alloc)
+{
+    struct esp_audio_nvs_entry *victim = NULL;
+    for (int i = 0; i < ESP_AUDIO_NVS_CACHE_ENTRIES; i++) {
+        struct esp_audio_nvs_entry *e = &an.entries[i];
+        if (e->valid && e->type == type && strcmp(e->key, key) == 0 && strcmp(e->namespace, namespace) == 0) {
+            e->last_use = ++an.use_counter;
+            return e;
+        }
+        if (!e->valid) {
+            if (!victim || victim->valid) {
+                victim = e;
+            }
+        } else if (!e->dirty && (!victim || (victim->valid && e->last_use < victim->last_use))) {
+            victim = e;
+        }
+    }
+    if (!alloc || !victim || strlen(namespace) >= NVS_KEY_NAME_MAX_SIZE || strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return NULL;
+    }
+    memset(victim, 0, sizeof(struct esp_audio_nvs_entry));
+    strncpy(victim->namespace, namespace, NVS_KEY_NAME_MAX_SIZE - 1);
+    strncpy(victim->key, key, NVS_KEY_NAME_MAX_SIZE - 1);
+    victim->type = type;
+    victim->last_use = ++an.use_counter;
+    return victim;
+}
+
 static esp_err_t esp_audio_nvs_process_common(struct esp_audio_nvs_params *params)
 {
     uint32_t ret = 0;
@@ -86,39 +275,119 @@ static esp_err_t esp_audio_nvs_process_common(struct esp_audio_nvs_params *param
     return err;
 }
 
-esp_err_t esp_audio_nvs_set_i8(char *namespace, char *key, int8_t value)
+static void esp_audio_nvs_shutdown_handler()
+{
+    if (!an.commit_pending) {
+        return;
+    }
+    if (an.timer_task && an.timer_task == xTaskGetCurrentTaskHandle()) {
+        /* Restarting from the timer task itself: cannot wait for it */
+        esp_audio_nvs_flush_fn();
+    } else {
+        struct esp_audio_nvs_params params = {
+            .op = FLUSH,
+        };
+        esp_audio_nvs_process_common(&params);
+    }
+}
+
+static esp_err_t esp_audio_nvs_get(char *namespace, char *key, enum esp_audio_nvs_type type, void *value)
 {
+    if (esp_audio_nvs_cache_init() != ESP_OK) {
+        return ESP_FAIL;
+    }
+    xSemaphoreTake(an.lock, portMAX_DELAY);
+    struct esp_audio_nvs_entry *e = esp_audio_nvs_find(namespace, key, type, false);
+    if (e) {
+        if (type == I8) {
+            *(int8_t *)value = e->value.i8;
+        } else {
+            *(uint16_t *)value = e->value.u16;
+        }
+        xSemaphoreGive(an.lock);
+        return ESP_OK;
+    }
+    xSemaphoreGive(an.lock);
+
     struct esp_audio_nvs_params params = {
         .namespace = namespace,
         .key = key,
-        .value = (void *)value,
-        .op = SET,
-        .type = I8,
+        .value = value,
+        .op = GET,
+        .type = type,
     };
-    return esp_audio_nvs_process_common(&params);
+    esp_err_t err = esp_audio_nvs_process_common(&params);
+    if (err == ESP_OK) {
+        xSemaphoreTake(an.lock, portMAX_DELAY);
+        /* Unless someone set it in the meantime */
+        if (!esp_audio_nvs_find(namespace, key, type, false) && (e = esp_audio_nvs_find(namespace, key, type, true))) {
+            if (type == I8) {
+                e->value.i8 = *(int8_t *)value;
+            } else {
+                e->value.u16 = *(uint16_t *)value;
+            }
+            e->valid = true;
+        }
+        xSemaphoreGive(an.lock);
+    }
+    return err;
 }
 
-esp_err_t esp_audio_nvs_get_i8(char *namespace, char *key, int8_t *value)
+esp_err_t esp_audio_nvs_set_i8(char *namespace, char *key, int8_t value)
 {
+    if (esp_audio_nvs_cache_init() != ESP_OK) {
+        return ESP_FAIL;
+    }
+    xSemaphoreTake(an.lock, portMAX_DELAY);
+    struct esp_audio_nvs_entry *e = esp_audio_nvs_find(namespace, key, I8, true);
+    if (e) {
+        bool commit_now = false;
+        if (!e->valid || e->value.i8 != value) {
+            e->value.i8 = value;
+            e->valid = true;
+            e->dirty = true;
+            if (!an.commit_pending) {
+                an.commit_pending = true;
+                /* Timer command queue full: no commit would be scheduled, and later sets would not try again */
+                commit_now = xTimerStart(an.commit_timer, 0) != pdPASS;
+            }
+        }
+        xSemaphoreGive(an.lock);
+        return commit_now ? esp_audio_nvs_flush() : ESP_OK;
+    }
+    xSemaphoreGive(an.lock);
+
+    /* Cache full: write through */
     struct esp_audio_nvs_params params = {
         .namespace = namespace,
         .key = key,
-        .value = (void *)value,
-        .op = GET,
+        .value = (void *)(intptr_t)value,
+        .op = SET,
         .type = I8,
     };
     return esp_audio_nvs_process_common(&params);
-
 }
 
-esp_err_t esp_audio_nvs_get_u16(char *namespace, char *key, uint16_t *value)
+esp_err_t esp_audio_nvs_flush()
 {
+    if (esp_audio_nvs_cache_init() != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (an.timer_task && an.timer_task == xTaskGetCurrentTaskHandle()) {
+        return esp_audio_nvs_flush_fn();
+    }
     struct esp_audio_nvs_params params = {
-        .namespace = namespace,
-        .key = key,
-        .value = (void *)value,
-        .op = GET,
-        .type = U16,
+        .op = FLUSH,
     };
     return esp_audio_nvs_process_common(&params);
 }
+
+esp_err_t esp_audio_nvs_get_i8(char *namespace, char *key, int8_t *value)
+{
+    return esp_audio_nvs_get(namespace, key, I8, value);
+}
+
+esp_err_t esp_audio_nvs_get_u16(char *namespace, char *key, uint16_t *value)
+{
+    return esp_audio_nvs_get(namespace, key, U16, value);
+}
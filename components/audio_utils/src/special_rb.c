@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <esp_audio_mem.h>
+#include <audio_pool.h>
 
 #include "esp_log.h"
 #include "esp_err.h"
@@ -74,7 +75,7 @@ rb_handle_t srb_init(const char *rb_name, uint32_t size)
 
 static struct srb_anchor_node *srb_node_new(rb_anchor_t *anchor)
 {
-    struct srb_anchor_node *n = esp_audio_mem_calloc(1, sizeof(*n));
+    struct srb_anchor_node *n = audio_pool_alloc(AUDIO_POOL_EXTERNAL, sizeof(*n));
     if (n) {
         n->anchor = *anchor;
         n->next = NULL;
@@ -84,7 +85,7 @@ static struct srb_anchor_node *srb_node_new(rb_anchor_t *anchor)
 
 static void srb_node_free(struct srb_anchor_node * n)
 {
-    esp_audio_mem_free(n);
+    audio_pool_free(n);
 }
 
 static int srb_node_insert(rb_handle_t handle, rb_anchor_t *anchor)
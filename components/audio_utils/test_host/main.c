@@ -0,0 +1,883 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <esp_heap_caps.h>
+#include <audio_pcm.h>
+#include <audio_pool.h>
+#include <audio_jitter.h>
+#include <esp_audio_nvs.h>
+
+#include <host_stubs.h>
+
+#define N 1024
+
+static int16_t in16[N * 2];
+static int16_t out16[N * 2];
+static int32_t acc[N * 2];
+
+static int16_t sat16(int32_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v);
+}
+
+static void fill_random(int16_t *buf, int n)
+{
+    for (int i = 0; i < n; i++) {
+        buf[i] = (int16_t) (rand() & 0xffff);
+    }
+}
+
+static int fail(const char *what, int index, int expected, int got)
+{
+    printf("Fail\n");
+    printf("%s: @index %d expected %d, got %d\n", what, index, expected, got);
+    return -1;
+}
+
+static int test_gain()
+{
+    printf("test: gain ....");
+    fill_random(in16, N);
+    memcpy(out16, in16, sizeof(in16));
+    audio_pcm_gain(out16, N, AUDIO_PCM_GAIN_MAX);
+    for (int i = 0; i < N; i++) {
+        int16_t expected = sat16((in16[i] * AUDIO_PCM_GAIN_MAX) >> 15);
+        if (out16[i] != expected) {
+            return fail("gain", i, expected, out16[i]);
+        }
+    }
+    memcpy(out16, in16, sizeof(in16));
+    audio_pcm_gain(out16, N, 0);
+    for (int i = 0; i < N; i++) {
+        if (out16[i] != 0) {
+            return fail("gain 0", i, 0, out16[i]);
+        }
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_ramp()
+{
+    printf("test: ramp ....");
+    for (int i = 0; i < N * 2; i++) {
+        in16[i] = 10000;
+    }
+    audio_pcm_ramp(in16, N, 2, AUDIO_PCM_GAIN_UNITY, 0);
+    if (in16[0] != 10000 || in16[1] != 10000) {
+        return fail("ramp start", 0, 10000, in16[0]);
+    }
+    for (int i = 1; i < N; i++) {
+        if (in16[2 * i] > in16[2 * (i - 1)] || in16[2 * i] != in16[2 * i + 1]) {
+            return fail("ramp not monotonic", i, in16[2 * (i - 1)], in16[2 * i]);
+        }
+    }
+    if (in16[2 * (N - 1)] > 100) {
+        return fail("ramp end", N - 1, 0, in16[2 * (N - 1)]);
+    }
+    printf("Success\n");
+    return 0;
+}
+
+/* A DC input of half full scale comes out as gain / 2, so each output sample shows the gain applied to it */
+static int test_gain_ramp()
+{
+    printf("test: gain ramp ....");
+    static const int32_t targets[] = { 0, 19519, 19519 + 3, AUDIO_PCM_GAIN_UNITY, AUDIO_PCM_GAIN_MAX };
+    static const int sizes[] = { 7, 100, 1, 333, 64 };
+    audio_pcm_gain_ramp_t r;
+    audio_pcm_gain_ramp_init(&r, AUDIO_PCM_GAIN_UNITY, 48000, 30);
+    int32_t max_delta = r.step_max / 2 + 1;
+    int k = 0;
+    int prev = AUDIO_PCM_GAIN_UNITY / 2;
+    for (int t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+        int32_t target = targets[t];
+        int32_t start = r.gain;
+        int frames = 0;
+        /* Odd buffer sizes: the ramp has to carry over from one to the next */
+        while (r.gain != target && frames < 10 * 48000) {
+            int n = sizes[k++ % (sizeof(sizes) / sizeof(sizes[0]))];
+            for (int i = 0; i < n * 2; i++) {
+                in16[i] = AUDIO_PCM_GAIN_UNITY / 2;
+            }
+            audio_pcm_gain_ramp_process(&r, in16, n, 2, target);
+            for (int i = 0; i < n; i++) {
+                int v = in16[2 * i];
+                if (v != in16[2 * i + 1] || abs(v - prev) > max_delta || (target > start ? v < prev : v > prev)) {
+                    return fail("gain ramp step", frames + i, prev, v);
+                }
+                prev = v;
+            }
+            frames += n;
+        }
+        /* No faster than a full scale change in 30 ms, then exactly on target */
+        int min_frames = (int) ((int64_t) abs(target - start) * 1440 / AUDIO_PCM_GAIN_UNITY);
+        if (r.gain != target || frames < min_frames) {
+            return fail("gain ramp duration", frames, min_frames, r.gain);
+        }
+        for (int i = 0; i < 64; i++) {
+            in16[i] = AUDIO_PCM_GAIN_UNITY / 2;
+        }
+        audio_pcm_gain_ramp_process(&r, in16, 32, 2, target);
+        for (int i = 0; i < 64; i++) {
+            if (in16[i] != (target * (AUDIO_PCM_GAIN_UNITY / 2)) >> 15) {
+                return fail("gain ramp target", i, (target * (AUDIO_PCM_GAIN_UNITY / 2)) >> 15, in16[i]);
+            }
+        }
+        prev = in16[62];
+    }
+
+    /* A steady unity gain does not touch the samples: any access to this buffer faults */
+    int16_t *untouchable = mmap(NULL, 4096, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (untouchable == MAP_FAILED) {
+        return fail("mmap", 0, 0, 0);
+    }
+    audio_pcm_gain_ramp_init(&r, AUDIO_PCM_GAIN_UNITY, 48000, 30);
+    audio_pcm_gain_ramp_process(&r, untouchable, 4096 / 4, 2, AUDIO_PCM_GAIN_UNITY);
+    munmap(untouchable, 4096);
+    printf("Success\n");
+    return 0;
+}
+
+static int test_channels()
+{
+    printf("test: mono <-> stereo ....");
+    fill_random(in16, N);
+    memcpy(out16, in16, N * sizeof(int16_t));
+    audio_pcm_mono_to_stereo(out16, out16, N);
+    for (int i = 0; i < N; i++) {
+        if (out16[2 * i] != in16[i] || out16[2 * i + 1] != in16[i]) {
+            return fail("mono_to_stereo", i, in16[i], out16[2 * i]);
+        }
+    }
+    audio_pcm_stereo_to_mono(out16, out16, N);
+    for (int i = 0; i < N; i++) {
+        if (out16[i] != in16[i]) {
+            return fail("stereo_to_mono", i, in16[i], out16[i]);
+        }
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_expand()
+{
+    printf("test: expand 16 -> 32 ....");
+    fill_random(in16, N);
+    audio_pcm_expand_16_to_32(acc, in16, N);
+    for (int i = 0; i < N; i++) {
+        if (acc[i] != ((int32_t) in16[i] << 16)) {
+            return fail("expand", i, in16[i] << 16, acc[i]);
+        }
+    }
+    /* In place */
+    memcpy(acc, in16, N * sizeof(int16_t));
+    audio_pcm_expand_16_to_32(acc, (int16_t *) acc, N);
+    for (int i = 0; i < N; i++) {
+        if (acc[i] != ((int32_t) in16[i] << 16)) {
+            return fail("expand in place", i, in16[i] << 16, acc[i]);
+        }
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_mix()
+{
+    printf("test: mix accumulate + saturate ....");
+    int16_t b[N * 2];
+    fill_random(in16, N * 2);
+    fill_random(b, N * 2);
+    memset(acc, 0, sizeof(acc));
+    audio_pcm_mix_accumulate(acc, in16, N, 2, AUDIO_PCM_GAIN_UNITY, AUDIO_PCM_GAIN_UNITY);
+    audio_pcm_mix_accumulate(acc, b, N, 2, AUDIO_PCM_GAIN_UNITY, AUDIO_PCM_GAIN_UNITY);
+    audio_pcm_saturate_32_to_16(out16, acc, N * 2);
+    for (int i = 0; i < N * 2; i++) {
+        int16_t expected = sat16(in16[i] + b[i]);
+        if (out16[i] != expected) {
+            return fail("mix accumulate", i, expected, out16[i]);
+        }
+    }
+    memcpy(out16, in16, sizeof(in16));
+    audio_pcm_mix_sat(out16, b, N * 2);
+    for (int i = 0; i < N * 2; i++) {
+        int16_t expected = sat16(in16[i] + b[i]);
+        if (out16[i] != expected) {
+            return fail("mix_sat", i, expected, out16[i]);
+        }
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_meter()
+{
+    printf("test: meter ....");
+    audio_pcm_meter_t m;
+    for (int i = 0; i < N; i++) {
+        in16[i] = (i & 1) ? 1000 : -1000;
+    }
+    in16[7] = INT16_MIN;
+    audio_pcm_meter(in16, N, &m);
+    if (m.peak != INT16_MAX) {
+        return fail("peak", 0, INT16_MAX, m.peak);
+    }
+    in16[7] = 1000;
+    audio_pcm_meter(in16, N, &m);
+    if (m.peak != 1000 || m.rms != 1000) {
+        return fail("rms", 0, 1000, m.rms);
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static double now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+#define BENCH(name, iters, stmt) do {                                               \
+        double start = now_us();                                                    \
+        for (int it = 0; it < (iters); it++) {                                      \
+            stmt;                                                                   \
+        }                                                                           \
+        double t = now_us() - start;                                                \
+        printf("bench: %-24s %8.1f ns/frame\n", name, t * 1000 / ((double) (iters) * N)); \
+    } while (0)
+
+static void bench()
+{
+    int iters = 20000;
+    audio_pcm_meter_t m;
+    fill_random(in16, N * 2);
+    BENCH("gain", iters, audio_pcm_gain(out16, N * 2, 20000));
+    BENCH("ramp", iters, audio_pcm_ramp(out16, N, 2, 0, AUDIO_PCM_GAIN_UNITY));
+    BENCH("mono_to_stereo", iters, audio_pcm_mono_to_stereo(out16, in16, N));
+    BENCH("stereo_to_mono", iters, audio_pcm_stereo_to_mono(out16, in16, N));
+    BENCH("expand_16_to_32", iters, audio_pcm_expand_16_to_32(acc, in16, N * 2));
+    BENCH("mix_accumulate (ramp)", iters, audio_pcm_mix_accumulate(acc, in16, N, 2, 0, 20000));
+    BENCH("saturate_32_to_16", iters, audio_pcm_saturate_32_to_16(out16, acc, N * 2));
+    BENCH("mix_sat", iters, audio_pcm_mix_sat(out16, in16, N * 2));
+    BENCH("meter", iters, audio_pcm_meter(in16, N * 2, &m));
+}
+
+/**
+ * Simulated heaps for the pool: a 512KB internal and a 4MB external one, first fit like the ESP-IDF heap, so that
+ * fragmentation can be measured.
+ */
+#define SIM_ALIGN   16
+
+typedef struct {
+    size_t size;        /* Including this header */
+    size_t used;
+} sim_block_t;
+
+typedef struct {
+    uint8_t *base;
+    size_t size;
+} sim_heap_t;
+
+static sim_heap_t sim_internal, sim_external;
+static int sim_direct_allocs;
+
+static void sim_heap_init(sim_heap_t *heap, size_t size)
+{
+    free(heap->base);
+    heap->base = malloc(size);
+    heap->size = size;
+    sim_block_t *b = (sim_block_t *) heap->base;
+    b->size = size;
+    b->used = 0;
+}
+
+#define SIM_NEXT(b)     ((sim_block_t *) ((uint8_t *) (b) + (b)->size))
+
+/* Merge free neighbours while walking */
+static sim_block_t *sim_merge(sim_heap_t *heap, sim_block_t *b)
+{
+    uint8_t *end = heap->base + heap->size;
+    while (!b->used && (uint8_t *) SIM_NEXT(b) < end && !SIM_NEXT(b)->used) {
+        b->size += SIM_NEXT(b)->size;
+    }
+    return b;
+}
+
+static void *sim_malloc(sim_heap_t *heap, size_t size)
+{
+    size_t need = (size + sizeof(sim_block_t) + SIM_ALIGN - 1) & ~(SIM_ALIGN - 1);
+    uint8_t *end = heap->base + heap->size;
+    for (sim_block_t *b = (sim_block_t *) heap->base; (uint8_t *) b < end; b = SIM_NEXT(b)) {
+        if (b->used || sim_merge(heap, b)->size < need) {
+            continue;
+        }
+        if (b->size - need >= 2 * SIM_ALIGN) {
+            sim_block_t *rest = (sim_block_t *) ((uint8_t *) b + need);
+            rest->size = b->size - need;
+            rest->used = 0;
+            b->size = need;
+        }
+        b->used = 1;
+        return b + 1;
+    }
+    return NULL;
+}
+
+static void sim_largest_free(sim_heap_t *heap, size_t *largest, int *fragments)
+{
+    uint8_t *end = heap->base + heap->size;
+    *largest = 0;
+    *fragments = 0;
+    for (sim_block_t *b = (sim_block_t *) heap->base; (uint8_t *) b < end; b = SIM_NEXT(b)) {
+        if (!b->used) {
+            sim_merge(heap, b);
+            (*fragments)++;
+            if (b->size > *largest) {
+                *largest = b->size;
+            }
+        }
+    }
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return sim_malloc((caps & (MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA)) ? &sim_internal : &sim_external, size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    if (ptr) {
+        ((sim_block_t *) ptr - 1)->used = 0;
+    }
+}
+
+static uint32_t lcg = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return (lcg >> 8) % n;
+}
+
+/* The old way: each caller takes exactly what it needs from the heap */
+static void *direct_alloc(audio_pool_region_t region, size_t size)
+{
+    sim_direct_allocs++;
+    return heap_caps_malloc(size, (region == AUDIO_POOL_EXTERNAL) ? MALLOC_CAP_8BIT : MALLOC_CAP_INTERNAL);
+}
+
+typedef struct {
+    size_t min_largest_free;
+    int fragments;
+    int failed;
+} soak_result_t;
+
+/**
+ * Play tracks: each one has a ring buffer and its struct, a stream buffer and anchor nodes. Ring buffer sizes come
+ * from the player configuration, so there are only a few of them. The next track is set up before the previous one
+ * is torn down, and one in ten needs a large (768KB) buffer.
+ * Playlist entries (HLS) outlive tracks: a few are added per track and the oldest are dropped.
+ * Other components keep allocating from the external heap in between, with lifetimes spanning many tracks.
+ */
+static void soak(int tracks, bool use_pool, soak_result_t *res)
+{
+#define OTHERS      64
+#define PLAYLIST    48
+#define TRACK_MAX   64
+    static const size_t rb_sizes[] = { 32 * 1024, 64 * 1024, 100 * 1024, 128 * 1024 };
+    void *(*alloc)(audio_pool_region_t, size_t) = use_pool ? audio_pool_alloc : direct_alloc;
+    void (*release)(void *) = use_pool ? audio_pool_free : heap_caps_free;
+    void *others[OTHERS] = { 0 };
+    int others_expiry[OTHERS] = { 0 };
+    void *playlist[PLAYLIST][2] = { { 0 } };
+    int playlist_head = 0;
+    void *track[2][TRACK_MAX];
+    int track_n[2] = { 0 };
+
+    sim_heap_init(&sim_internal, 512 * 1024);
+    sim_heap_init(&sim_external, 4 * 1024 * 1024);
+    lcg = 1;
+    memset(res, 0, sizeof(*res));
+    res->min_largest_free = SIZE_MAX;
+    for (int t = 0; t < tracks; t++) {
+        void **cur = track[t & 1];
+        int n = 0;
+        cur[n++] = alloc(AUDIO_POOL_INTERNAL, 72);
+        cur[n++] = alloc(AUDIO_POOL_EXTERNAL, (rnd(10) == 0) ? 768 * 1024 : rb_sizes[rnd(4)]);
+        cur[n++] = alloc(AUDIO_POOL_INTERNAL, 4096);
+        int added = 2 + rnd(6);
+        for (int i = 0; i < added; i++) {
+            void **e = playlist[playlist_head];
+            playlist_head = (playlist_head + 1) % PLAYLIST;
+            release(e[0]);
+            release(e[1]);
+            e[0] = alloc(AUDIO_POOL_INTERNAL, 24);
+            e[1] = alloc(AUDIO_POOL_EXTERNAL, 60 + rnd(140));
+            if (!e[0] || !e[1]) {
+                res->failed++;
+            }
+            /* Other components, in the middle of the track */
+            int slot = rnd(OTHERS);
+            if (others[slot]) {
+                heap_caps_free(others[slot]);
+            }
+            others[slot] = heap_caps_malloc(32 + rnd(16 * 1024), MALLOC_CAP_8BIT);
+            others_expiry[slot] = t + 1 + rnd(200);
+        }
+        int anchors = rnd(TRACK_MAX - 3);
+        for (int i = 0; i < anchors; i++) {
+            cur[n++] = alloc(AUDIO_POOL_EXTERNAL, 32);
+        }
+        for (int i = 0; i < n; i++) {
+            if (!cur[i]) {
+                res->failed++;
+            }
+        }
+        track_n[t & 1] = n;
+
+        /* Now the previous track goes away */
+        void **prev = track[(t + 1) & 1];
+        for (int i = 0; i < track_n[(t + 1) & 1]; i++) {
+            release(prev[i]);
+        }
+        track_n[(t + 1) & 1] = 0;
+        for (int i = 0; i < OTHERS; i++) {
+            if (others[i] && others_expiry[i] <= t) {
+                heap_caps_free(others[i]);
+                others[i] = NULL;
+            }
+        }
+        size_t largest;
+        sim_largest_free(&sim_external, &largest, &res->fragments);
+        if (largest < res->min_largest_free) {
+            res->min_largest_free = largest;
+        }
+    }
+    for (int k = 0; k < 2; k++) {
+        for (int i = 0; i < track_n[k]; i++) {
+            release(track[k][i]);
+        }
+    }
+    for (int i = 0; i < PLAYLIST; i++) {
+        release(playlist[i][0]);
+        release(playlist[i][1]);
+    }
+    for (int i = 0; i < OTHERS; i++) {
+        heap_caps_free(others[i]);
+    }
+}
+
+static int test_pool()
+{
+    printf("test: pool ....");
+    audio_pool_stats_t stats;
+    sim_heap_init(&sim_internal, 512 * 1024);
+    sim_heap_init(&sim_external, 4 * 1024 * 1024);
+
+    /* Every class boundary, zeroed and writable */
+    static const size_t sizes[] = { 0, 1, 16, 17, 256, 257, 320, 321, 1000, 4096, 4097, 16384, 16385, 100000 };
+    void *p[sizeof(sizes) / sizeof(sizes[0])];
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        p[i] = audio_pool_alloc(AUDIO_POOL_EXTERNAL, sizes[i]);
+        if (!p[i] || ((uintptr_t) p[i] & 7)) {
+            return fail("pool alloc", i, 0, 0);
+        }
+        for (size_t j = 0; j < sizes[i]; j++) {
+            if (((uint8_t *) p[i])[j] != 0) {
+                return fail("pool zeroed", i, 0, ((uint8_t *) p[i])[j]);
+            }
+        }
+        memset(p[i], 0xa5, sizes[i]);
+    }
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        audio_pool_free(p[i]);
+    }
+    audio_pool_get_stats(AUDIO_POOL_EXTERNAL, &stats);
+    if (stats.in_use != 0 || stats.allocs != stats.frees || stats.held < stats.cached) {
+        return fail("pool stats", 0, 0, (int) stats.in_use);
+    }
+
+    /* Same class: the freed block comes back, zeroed, without asking the heap */
+    void *a = audio_pool_alloc(AUDIO_POOL_EXTERNAL, 6000);
+    memset(a, 1, 6000);
+    audio_pool_free(a);
+    uint32_t reused = stats.reused;
+    void *b = audio_pool_alloc(AUDIO_POOL_EXTERNAL, 5800);
+    audio_pool_get_stats(AUDIO_POOL_EXTERNAL, &stats);
+    if (b != a || stats.reused == reused || ((uint8_t *) b)[5799] != 0) {
+        return fail("pool reuse", 0, 0, 0);
+    }
+    /* Double free is reported and ignored */
+    audio_pool_free(b);
+    audio_pool_free(b);
+    audio_pool_get_stats(AUDIO_POOL_EXTERNAL, &stats);
+    if (stats.frees != stats.allocs) {
+        return fail("pool double free", 0, stats.allocs, stats.frees);
+    }
+
+    /* Small objects share slabs, and empty slabs beyond the first are released */
+    void *small[200];
+    for (int i = 0; i < 200; i++) {
+        small[i] = audio_pool_alloc(AUDIO_POOL_INTERNAL, 24);
+    }
+    audio_pool_get_stats(AUDIO_POOL_INTERNAL, &stats);
+    size_t slabs = stats.held / 2048;
+    for (int i = 0; i < 200; i++) {
+        audio_pool_free(small[i]);
+    }
+    audio_pool_get_stats(AUDIO_POOL_INTERNAL, &stats);
+    if (slabs < 4 || slabs > 6 || stats.held != 2048) {
+        return fail("pool slabs", 0, (int) slabs, (int) stats.held);
+    }
+
+    /* Trim gives everything back */
+    audio_pool_trim();
+    for (int region = 0; region < AUDIO_POOL_REGION_MAX; region++) {
+        audio_pool_get_stats(region, &stats);
+        if (stats.held != 0 || stats.cached != 0) {
+            return fail("pool trim", region, 0, (int) stats.held);
+        }
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_pool_soak()
+{
+    printf("test: pool fragmentation soak ....");
+    soak_result_t direct, pooled;
+    soak(2000, false, &direct);
+    soak(2000, true, &pooled);
+    audio_pool_trim();
+    if (pooled.failed > direct.failed || pooled.fragments > direct.fragments) {
+        printf("Fail\n");
+        printf("free fragments: direct %d pool %d, failed allocations: direct %d pool %d\n", direct.fragments,
+               pooled.fragments, direct.failed, pooled.failed);
+        return -1;
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static void bench_pool()
+{
+    soak_result_t direct, pooled;
+    int tracks = 10000;
+    sim_direct_allocs = 0;
+    soak(tracks, false, &direct);
+    int heap_allocs = sim_direct_allocs;
+    soak(tracks, true, &pooled);
+    audio_pool_stats_t ext, in;
+    audio_pool_get_stats(AUDIO_POOL_EXTERNAL, &ext);
+    audio_pool_get_stats(AUDIO_POOL_INTERNAL, &in);
+    printf("bench: soak %d tracks, 4MB external heap: min largest free block direct %zu, pool %zu\n", tracks,
+           direct.min_largest_free, pooled.min_largest_free);
+    printf("bench: free fragments at the end: direct %d, pool %d; failed allocations: direct %d, pool %d\n",
+           direct.fragments, pooled.fragments, direct.failed, pooled.failed);
+    printf("bench: pool heap allocations %u of %u (direct: %d)\n", (ext.allocs - ext.reused) + (in.allocs - in.reused),
+           ext.allocs + in.allocs, heap_allocs);
+    audio_pool_print_stats();
+    audio_pool_trim();
+}
+
+/* A2DP sink simulation: remote clock skewed by `skew_ppm`, packets delivered in bursts, local reader at 44.1kHz */
+#define SIM_RATE            44100
+#define SIM_PACKET_FRAMES   512
+#define SIM_READ_FRAMES     256
+#define SIM_RING_FRAMES     (96 * 1024 / 4)
+#define SIM_TARGET_FRAMES   (SIM_RATE * 150 / 1000)
+
+typedef struct {
+    uint32_t dropped;
+    uint32_t underruns;
+    int fill_min;           /* After the first minute */
+    int fill_max;
+    int ppm;
+} jitter_sim_result_t;
+
+static void jitter_sim(int seconds, int skew_ppm, bool correct, jitter_sim_result_t *res)
+{
+    static int16_t in[SIM_PACKET_FRAMES * 2];
+    static int16_t out[SIM_PACKET_FRAMES * 2 + 64];
+    audio_jitter_t jb;
+    audio_jitter_init(&jb, 2, SIM_TARGET_FRAMES);
+    fill_random(in, SIM_PACKET_FRAMES * 2);
+
+    /* Time in us. Packet n is complete at n * packet duration on the remote clock, and arrives up to 60ms later. */
+    double packet_us = SIM_PACKET_FRAMES * 1e6 / (SIM_RATE * (1 + skew_ppm * 1e-6));
+    double read_us = SIM_READ_FRAMES * 1e6 / SIM_RATE;
+    double next_packet = 0, next_read = 0;
+    int64_t fill = 0;
+    bool priming = true;
+    uint32_t underruns = 0;
+    memset(res, 0, sizeof(*res));
+    res->fill_min = SIM_RING_FRAMES;
+    srand(7);
+    int burst = 0;
+
+    while (next_read < seconds * 1e6) {
+        if (next_packet <= next_read) {
+            int n = SIM_PACKET_FRAMES;
+            if (correct) {
+                n = audio_jitter_process(&jb, in, SIM_PACKET_FRAMES, out, sizeof(out) / 4, fill);
+            }
+            if (fill + n > SIM_RING_FRAMES) {
+                audio_jitter_count_drop(&jb);
+            } else {
+                fill += n;
+            }
+            /* Radio bursts: every so often a few packets are held back, then arrive back to back */
+            if (burst > 0) {
+                burst--;
+                next_packet += packet_us / 4;
+            } else if (rand() % 200 == 0) {
+                burst = 4;
+                next_packet += packet_us * 4;
+            } else {
+                next_packet += packet_us * (burst ? 0 : 1);
+            }
+        } else {
+            if (priming) {
+                priming = fill < SIM_TARGET_FRAMES;
+            }
+            if (!priming) {
+                if (fill < SIM_READ_FRAMES) {
+                    audio_jitter_count_underrun(&jb);
+                    underruns++;
+                    priming = true;
+                    if (correct) {
+                        audio_jitter_reset(&jb, SIM_TARGET_FRAMES);
+                    }
+                } else {
+                    fill -= SIM_READ_FRAMES;
+                }
+            }
+            if (next_read > 60e6) {
+                if (fill < res->fill_min) {
+                    res->fill_min = fill;
+                }
+                if (fill > res->fill_max) {
+                    res->fill_max = fill;
+                }
+            }
+            next_read += read_us;
+        }
+    }
+    audio_jitter_stats_t stats;
+    audio_jitter_get_stats(&jb, &stats);
+    res->dropped = stats.dropped;
+    res->underruns = underruns;
+    res->ppm = stats.ppm;
+}
+
+static int test_jitter()
+{
+    printf("test: jitter passthrough and ratio ....");
+    audio_jitter_t jb;
+    int16_t out[N * 2 + 64];
+    fill_random(in16, N * 2);
+
+    /* At the target fill level and no drift, samples pass unchanged */
+    audio_jitter_init(&jb, 2, 1000);
+    for (int k = 0; k < 4; k++) {
+        int n = audio_jitter_process(&jb, in16, N, out, N + 32, 1000);
+        if (n != N || memcmp(out, in16, sizeof(in16))) {
+            return fail("passthrough frames", k, N, n);
+        }
+    }
+
+    /* A full ring shrinks the output, an empty one stretches it, within the ppm limit */
+    int total_low = 0, total_high = 0;
+    audio_jitter_t low, high;
+    audio_jitter_init(&low, 2, 10000);
+    audio_jitter_init(&high, 2, 10000);
+    for (int k = 0; k < 2000; k++) {
+        total_low += audio_jitter_process(&low, in16, N, out, N + 32, 0);
+        total_high += audio_jitter_process(&high, in16, N, out, N + 32, 20000);
+    }
+    int64_t frames = 2000LL * N;
+    int64_t limit = frames * AUDIO_JITTER_MAX_PPM / 1000000 + 2;
+    if (total_low <= frames || total_low > frames + limit) {
+        return fail("stretched frames", 0, (int) (frames + limit), total_low);
+    }
+    if (total_high >= frames || total_high < frames - limit) {
+        return fail("shrunk frames", 0, (int) (frames - limit), total_high);
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_jitter_drift()
+{
+    printf("test: jitter buffer with skewed clocks ....");
+    static const int skews[] = { -300, -50, 0, 80, 300 };
+    for (int i = 0; i < sizeof(skews) / sizeof(skews[0]); i++) {
+        jitter_sim_result_t res;
+        jitter_sim(1800, skews[i], true, &res);
+        /* The ring stays around its target: no drops, no underruns after the start */
+        if (res.dropped || res.underruns || res.fill_min < SIM_TARGET_FRAMES / 4 ||
+                res.fill_max > SIM_TARGET_FRAMES * 2) {
+            printf("Fail\n");
+            printf("skew %d ppm: dropped %u underruns %u fill %d..%d (target %d), correction %d ppm\n", skews[i],
+                   res.dropped, res.underruns, res.fill_min, res.fill_max, SIM_TARGET_FRAMES, res.ppm);
+            return -1;
+        }
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static void bench_jitter()
+{
+    static const int skews[] = { -300, -100, 100, 300 };
+    for (int i = 0; i < sizeof(skews) / sizeof(skews[0]); i++) {
+        jitter_sim_result_t plain, jb;
+        jitter_sim(3600, skews[i], false, &plain);
+        jitter_sim(3600, skews[i], true, &jb);
+        printf("bench: 1h A2DP sink, clock skew %4d ppm: plain ring dropped %u underruns %u fill %d..%d | "
+               "jitter buffer dropped %u underruns %u fill %d..%d, correction %d ppm\n", skews[i],
+               plain.dropped, plain.underruns, plain.fill_min, plain.fill_max,
+               jb.dropped, jb.underruns, jb.fill_min, jb.fill_max, jb.ppm);
+    }
+}
+
+static int test_nvs()
+{
+    printf("test: nvs write behind ....");
+    int8_t i8;
+    /* Sets stay in RAM until the commit timer expires, then go in one batch */
+    for (int i = 0; i < 10; i++) {
+        esp_audio_nvs_set_i8("dsp", "mute", i & 1);
+        esp_audio_nvs_set_i8("codec", "volume", i);
+    }
+    if (host_cnt.sets || host_cnt.task_switches || esp_audio_nvs_get_i8("codec", "volume", &i8) != ESP_OK || i8 != 9) {
+        return fail("write behind", 0, 0, host_cnt.sets);
+    }
+    host_fire_timers();
+    const int8_t *stored = nvs_stub_get("codec", "volume", NVS_STUB_I8);
+    if (host_cnt.sets != 2 || host_cnt.commits != 2 || !stored || *stored != 9) {
+        return fail("batch", 0, 2, host_cnt.sets);
+    }
+
+    /* Explicit flush, then one on esp_restart() */
+    esp_audio_nvs_set_i8("dsp", "mute", 0);
+    if (esp_audio_nvs_flush() != ESP_OK || host_cnt.sets != 3 || host_cnt.commits != 3) {
+        return fail("flush", 0, 3, host_cnt.sets);
+    }
+    esp_audio_nvs_set_i8("dsp", "mute", 1);
+    host_shutdown();
+    stored = nvs_stub_get("dsp", "mute", NVS_STUB_I8);
+    if (host_cnt.sets != 4 || host_cnt.commits != 4 || !stored || *stored != 1) {
+        return fail("shutdown", 0, 4, host_cnt.sets);
+    }
+    /* Restarting from the timer task cannot wait for it */
+    int task_switches = host_cnt.task_switches;
+    esp_audio_nvs_set_i8("dsp", "mute", 0);
+    host_current_task = host_timer_task;
+    host_shutdown();
+    host_current_task = host_app_task;
+    if (host_cnt.sets != 5 || host_cnt.task_switches != task_switches) {
+        return fail("shutdown in timer task", 0, 5, host_cnt.sets);
+    }
+    /* No commit timer: committed right away. The next set schedules one again. */
+    host_timer_start_fails = 1;
+    esp_audio_nvs_set_i8("dsp", "mute", 1);
+    if (host_cnt.sets != 6 || host_cnt.commits != 6) {
+        return fail("timer start failure", 0, 6, host_cnt.sets);
+    }
+    esp_audio_nvs_set_i8("dsp", "mute", 0);
+    host_fire_timers();
+    if (host_cnt.sets != 7 || host_cnt.commits != 7) {
+        return fail("timer after failure", 0, 7, host_cnt.sets);
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_nvs_eviction()
+{
+    printf("test: nvs eviction ....");
+    char key[16];
+    int8_t i8;
+    for (int i = 0; i < 10; i++) {
+        sprintf(key, "k%d", i);
+        nvs_stub_put("evict", key, NVS_STUB_I8, &(int8_t) {i}, 1);
+    }
+    /* Fill the cache, then touch k0 so that k1 is the oldest */
+    memset(&host_cnt, 0, sizeof(host_cnt));
+    for (int i = 0; i < 8; i++) {
+        sprintf(key, "k%d", i);
+        esp_audio_nvs_get_i8("evict", key, &i8);
+    }
+    esp_audio_nvs_get_i8("evict", "k0", &i8);
+    if (host_cnt.gets != 8) {
+        return fail("cached gets", 0, 8, host_cnt.gets);
+    }
+    /* k8 takes the place of k1 */
+    if (esp_audio_nvs_get_i8("evict", "k8", &i8) != ESP_OK || i8 != 8 || host_cnt.gets != 9 ||
+            esp_audio_nvs_get_i8("evict", "k8", &i8) != ESP_OK || esp_audio_nvs_get_i8("evict", "k0", &i8) != ESP_OK ||
+            host_cnt.gets != 9) {
+        return fail("evict", 0, 9, host_cnt.gets);
+    }
+    if (esp_audio_nvs_get_i8("evict", "k1", &i8) != ESP_OK || i8 != 1 || host_cnt.gets != 10) {
+        return fail("evicted", 0, 10, host_cnt.gets);
+    }
+    /* Dirty entries are never evicted: with all of them dirty, a new key is written through */
+    for (int i = 0; i < 8; i++) {
+        sprintf(key, "k%d", i);
+        esp_audio_nvs_set_i8("evict", key, -i - 1);
+    }
+    memset(&host_cnt, 0, sizeof(host_cnt));
+    esp_audio_nvs_set_i8("evict", "k9", -10);
+    if (host_cnt.sets != 1 || host_cnt.commits != 1) {
+        return fail("write through", 0, 1, host_cnt.sets);
+    }
+    host_fire_timers();
+    for (int i = 0; i < 8; i++) {
+        sprintf(key, "k%d", i);
+        const int8_t *stored = nvs_stub_get("evict", key, NVS_STUB_I8);
+        if (!stored || *stored != -i - 1) {
+            return fail("flash content", i, -i - 1, stored ? *stored : 0);
+        }
+    }
+    const int8_t *stored = nvs_stub_get("evict", "k9", NVS_STUB_I8);
+    if (!stored || *stored != -10) {
+        return fail("written through", 9, -10, stored ? *stored : 0);
+    }
+    printf("Success\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        bench_pool();
+        bench_jitter();
+        return 0;
+    }
+    if (test_gain() || test_ramp() || test_gain_ramp() || test_channels() || test_expand() || test_mix() || test_meter() ||
+            test_pool() || test_pool_soak() || test_jitter() || test_jitter_drift() || test_nvs() || test_nvs_eviction()) {
+        return -1;
+    }
+    return 0;
+}
@@ -62,7 +62,7 @@ uint32_t basic_player_get_current_offset(basic_player_handle_t handle)
         return 0;
     }
     struct basic_player *b = (struct basic_player *)handle;
-    return sys_playback_get_current_offset(&b->requester);
+    return sys_playback_get_presentation_offset(&b->requester);
 }
 
 int basic_player_get_codec_output_rb_filled(basic_player_handle_t handle)
@@ -148,7 +148,7 @@ esp_err_t basic_player_play(basic_player_handle_t handle, basic_player_play_conf
     struct basic_player *b = (struct basic_player *)handle;
 
     basic_player_stop(handle);
-    b->requester.samples_cnt = 0;
+    b->requester.frames_played = 0;
     b->player_event_cb = play_config->event_cb;
     b->player_event_cb_data = play_config->event_cb_data;
     b->play_method = play_config->play_method;
@@ -382,11 +382,10 @@ static esp_err_t basic_player_codec_event_cb(void *arg, int event, void *data)
             info = (audio_codec_audio_info_t *)data;
             ESP_LOGI(TAG, "Set Freq event: %d, %d, %d", info->sampling_freq, info->channels, info->bits);
 
-            int sampling_freq_in_ms = info->sampling_freq / 1000;
             b->requester.audio_info.sample_rate = info->sampling_freq;
             b->requester.audio_info.channels = info->channels;
             b->requester.audio_info.bits_per_sample = 16;
-            b->requester.samples_cnt = b->hs_cfg.offset_in_ms * sampling_freq_in_ms * 2 * info->channels;
+            b->requester.frames_played = ((uint64_t) b->hs_cfg.offset_in_ms * info->sampling_freq) / 1000;
             b->player_event_cb(b->player_event_cb_data, PLAYER_EVENT_STARTED);
             break;
 
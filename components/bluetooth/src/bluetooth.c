@@ -264,7 +264,7 @@ static inline int bluetooth_stack_up()
 static int bluetooth_player_read_cb(void *arg, void *data, int len, unsigned int wait)
 {
     int ret;
-    ret = arb_read(bt_app_av_get_rb(), (uint8_t *) data, len, wait);
+    ret = bt_app_av_sink_read((uint8_t *) data, len, wait);
     if (ret == RB_READER_UNBLOCK) {
         /* Just a wake-up */
     } else if (ret < 0) {
@@ -278,7 +278,7 @@ static int bluetooth_player_read_cb(void *arg, void *data, int len, unsigned int
 
 void bluetooth_player_wakeup_reader_cb(void *arg)
 {
-    arb_wakeup_reader(bt_app_av_get_rb());
+    bt_app_av_sink_wakeup_reader();
 }
 
 esp_err_t bluetooth_init(bt_event_handler_t event_handler)
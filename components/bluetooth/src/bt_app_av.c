@@ -8,6 +8,7 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 #include "driver/i2s.h"
 #include <esp_timer.h>
 #include "esp_log.h"
@@ -22,6 +23,8 @@
 #include "bluetooth.h"
 #include "bluetooth_priv.h"
 #include <media_hal.h>
+#include <audio_jitter.h>
+#include <audio_pcm.h>
 
 #define BT_AV_TAG    "BT_AV"
 
@@ -48,6 +51,46 @@ rb_handle_t bt_sink_rb;
 rb_handle_t bt_source_rb;
 bt_event_handler_t event_handler;
 
+/**
+ * Sink jitter buffer.
+ * The phone's clock drifts against ours. audio_jitter resamples incoming packets by a few ppm so that bt_sink_rb
+ * stays at BT_SINK_TARGET_MS. After a start or an underrun, the reader waits for the ring to reach the target again.
+ */
+#define BT_SINK_TARGET_MS       150
+#define BT_SINK_FRAME_SIZE      4           /* 16 bit stereo */
+#define BT_SINK_JITTER_FRAMES   512         /* Packets are processed in pieces of this many frames */
+#define BT_SINK_IDLE_US         (100 * 1000) /* Source considered paused after this long without data */
+
+static audio_jitter_t bt_sink_jitter;
+static int16_t *bt_sink_jitter_buf;
+static int bt_sink_sample_rate = 44100;
+static volatile bool bt_sink_jitter_reset_pending = true;
+static volatile bool bt_sink_priming = true;
+static volatile bool bt_sink_wakeup;
+static volatile int64_t bt_sink_last_write_us;
+static SemaphoreHandle_t bt_sink_primed;     /* Given by the writer once the target is reached, and on wakeup */
+
+/**
+ * Source feed.
+ * The data callback runs in the BT stack task and must never block. It only takes what is already in bt_source_rb.
+ * Playback (re)starts once BT_SOURCE_PREBUFFER_MS is buffered, or when the producer has not added to a shorter tail
+ * for BT_SOURCE_STALL_MS (end of a stream). Across an underrun the audio is faded out and back in
+ * instead of being cut hard.
+ */
+#define BT_SOURCE_SAMPLE_RATE   44100
+#define BT_SOURCE_FRAME_SIZE    4           /* 16 bit stereo */
+#define BT_SOURCE_PREBUFFER_MS  40
+#define BT_SOURCE_PREBUFFER     ((BT_SOURCE_SAMPLE_RATE * BT_SOURCE_PREBUFFER_MS / 1000) * BT_SOURCE_FRAME_SIZE)
+#define BT_SOURCE_FADE_FRAMES   64          /* ~1.5 ms */
+#define BT_SOURCE_STALL_MS      20
+
+static bool bt_source_priming = true;
+static bool bt_source_fade_in;
+static int bt_source_prime_fill;
+static int64_t bt_source_prime_us;     /* When bt_source_prime_fill last changed */
+static bool bt_source_muted;
+static bt_source_stats_t bt_source_stats;
+
 /* Notify volume change. */
 void bt_app_av_notify_vol_change(int volume)
 {
@@ -113,6 +156,8 @@ void bt_app_a2d_sink_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
         case ESP_A2D_AUDIO_STATE_STARTED:
             ESP_LOGD(BT_AV_TAG, "Audio started");
             arb_reset(bt_source_rb);
+            bt_sink_jitter_reset_pending = true;
+            bt_sink_priming = true;
             if (event_handler) {
                 event_handler(EVENT_BT_AUDIO_STREAM_STARTED, NULL);
             }
@@ -141,6 +186,8 @@ void bt_app_a2d_sink_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
                      param->audio_cfg.mcc.cie.sbc[2],
                      param->audio_cfg.mcc.cie.sbc[3]);
             ESP_LOGD(BT_AV_TAG, "audio player configured, samplerate=%d", sample_rate);
+            bt_sink_sample_rate = sample_rate;
+            bt_sink_jitter_reset_pending = true;
 
             if (event_handler) {
                 event_handler(EVENT_BT_UPDATE_FREQ, (void *) &sample_rate);
@@ -213,6 +260,7 @@ void bt_app_a2d_source_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
         case ESP_A2D_AUDIO_STATE_STARTED:
             ESP_LOGD(BT_AV_TAG, "Audio started");
             arb_reset(bt_source_rb);
+            bt_source_priming = true;
             if (event_handler) {
                 event_handler(EVENT_BT_AUDIO_STREAM_STARTED, NULL);
             }
@@ -246,12 +294,36 @@ void bt_sink_rb_mark_aborted()
 void bt_sink_rb_reset()
 {
     arb_reset(bt_sink_rb);
+    bt_sink_jitter_reset_pending = true;
+    bt_sink_priming = true;
 }
 
 static esp_err_t bt_rb_write(const uint8_t *data, uint32_t len)
 {
-    /* Try for 10 ms and give up if full */
-    arb_write(bt_sink_rb, (void *) data, len, pdMS_TO_TICKS(10));
+    if (bt_sink_jitter_reset_pending) {
+        bt_sink_jitter_reset_pending = false;
+        audio_jitter_reset(&bt_sink_jitter, (bt_sink_sample_rate * BT_SINK_TARGET_MS) / 1000);
+    }
+    bt_sink_last_write_us = esp_timer_get_time();
+
+    const int16_t *in = (const int16_t *) data;
+    int frames = len / BT_SINK_FRAME_SIZE;
+    while (frames > 0) {
+        int in_frames = (frames > BT_SINK_JITTER_FRAMES) ? BT_SINK_JITTER_FRAMES : frames;
+        int fill = arb_get_filled(bt_sink_rb) / BT_SINK_FRAME_SIZE;
+        int out_frames = audio_jitter_process(&bt_sink_jitter, in, in_frames, bt_sink_jitter_buf,
+                                              audio_jitter_max_out_frames(BT_SINK_JITTER_FRAMES), fill);
+        int out_len = out_frames * BT_SINK_FRAME_SIZE;
+        /* Try for 10 ms and give up if full */
+        if (arb_write(bt_sink_rb, (uint8_t *) bt_sink_jitter_buf, out_len, pdMS_TO_TICKS(10)) < out_len) {
+            audio_jitter_count_drop(&bt_sink_jitter);
+        }
+        in += in_frames * 2;
+        frames -= in_frames;
+    }
+    if (bt_sink_priming && arb_get_filled(bt_sink_rb) >= bt_sink_jitter.target_frames * BT_SINK_FRAME_SIZE) {
+        xSemaphoreGive(bt_sink_primed);
+    }
     return ESP_OK;
 }
 
@@ -259,22 +331,82 @@ void bt_app_a2d_data_cb(const uint8_t *data, uint32_t len)
 {
     bt_rb_write(data, len);
     if (++m_pkt_cnt % 1000 == 0) {
-        ESP_LOGW(BT_AV_TAG, "audio data pkt cnt %u", m_pkt_cnt);
+        audio_jitter_stats_t stats;
+        audio_jitter_get_stats(&bt_sink_jitter, &stats);
+        ESP_LOGW(BT_AV_TAG, "audio data pkt cnt %u, fill %d frames, correction %d ppm (+%u/-%u frames), dropped %u, underruns %u",
+                 m_pkt_cnt, stats.fill_frames, stats.ppm, stats.frames_added, stats.frames_removed, stats.dropped,
+                 stats.underruns);
     }
 }
 
+int bt_app_av_sink_read(uint8_t *data, int len, unsigned int wait)
+{
+    if (!bt_sink_priming && arb_get_filled(bt_sink_rb) < len) {
+        /* The reader would block: the ring ran dry. Build it up to the target again. */
+        if (esp_timer_get_time() - bt_sink_last_write_us < BT_SINK_IDLE_US) {
+            /* Not just the end of the stream */
+            audio_jitter_count_underrun(&bt_sink_jitter);
+        }
+        bt_sink_jitter_reset_pending = true;
+        bt_sink_priming = true;
+    }
+    TickType_t start = xTaskGetTickCount();
+    while (bt_sink_priming && !bt_sink_wakeup) {
+        int64_t idle_us = esp_timer_get_time() - bt_sink_last_write_us;
+        if (arb_get_filled(bt_sink_rb) >= bt_sink_jitter.target_frames * BT_SINK_FRAME_SIZE || idle_us > BT_SINK_IDLE_US) {
+            /* Target reached, or the source stopped sending and nothing more is coming */
+            bt_sink_priming = false;
+            break;
+        }
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= wait) {
+            return 0;
+        }
+        /* Until the writer reaches the target, or the source has been idle for long enough */
+        TickType_t ticks = pdMS_TO_TICKS((BT_SINK_IDLE_US - idle_us) / 1000) + 1;
+        xSemaphoreTake(bt_sink_primed, (ticks < wait - waited) ? ticks : wait - waited);
+    }
+    bt_sink_wakeup = false;
+    return arb_read(bt_sink_rb, data, len, wait);
+}
+
+void bt_app_av_sink_wakeup_reader()
+{
+    bt_sink_wakeup = true;
+    xSemaphoreGive(bt_sink_primed);
+    arb_wakeup_reader(bt_sink_rb);
+}
+
+void bt_app_av_get_sink_stats(audio_jitter_stats_t *stats)
+{
+    audio_jitter_get_stats(&bt_sink_jitter, stats);
+}
+
 /* Defined in media_hal.c */
 extern bool media_hal_is_codec_mute();
 
 int bluetooth_source_play(const uint8_t *data, size_t len, unsigned int wait)
 {
-    if (media_hal_is_codec_mute()) {
-        /* We know that it is OK to zero out this buffer. */
-        bzero((void *) data, len);
+    /* Mute is applied here, once, rather than on every buffer the BT stack pulls. Transitions are ramped. */
+    bool muted = media_hal_is_codec_mute();
+    if (muted || bt_source_muted) {
+        /* We know that it is OK to modify this buffer. */
+        int16_t *pcm = (int16_t *) data;
+        if (muted == bt_source_muted) {
+            bzero(pcm, len);
+        } else {
+            audio_pcm_ramp(pcm, len / BT_SOURCE_FRAME_SIZE, 2, muted ? AUDIO_PCM_GAIN_UNITY : 0, muted ? 0 : AUDIO_PCM_GAIN_UNITY);
+            bt_source_muted = muted;
+        }
     }
     return arb_write(bt_source_rb, (uint8_t *) data, len, wait);
 }
 
+void bt_app_av_get_source_stats(bt_source_stats_t *stats)
+{
+    *stats = bt_source_stats;
+}
+
 void bt_app_source_start()
 {
     esp_a2d_media_ctrl(ESP_A2D_MEDIA_CTRL_CHECK_SRC_RDY);
@@ -296,13 +428,57 @@ int32_t bt_app_a2d_source_data_cb(uint8_t *data, int32_t len)
         return 0;
     }
 
-    memset(data, 0, len);
-    ssize_t data_read = arb_read(bt_source_rb, data, len, 0);
+    int filled = arb_get_filled(bt_source_rb);
+    if (bt_source_priming) {
+        int64_t now = esp_timer_get_time();
+        if (filled != bt_source_prime_fill) {
+            bt_source_prime_fill = filled;
+            bt_source_prime_us = now;
+        }
+        bool stalled = (filled > 0 && now - bt_source_prime_us > BT_SOURCE_STALL_MS * 1000);
+        if (filled < BT_SOURCE_PREBUFFER && !stalled) {
+            memset(data, 0, len);
+            bt_source_stats.silent_frames += len / BT_SOURCE_FRAME_SIZE;
+            return len;
+        }
+        bt_source_priming = false;
+        bt_source_prime_fill = 0;
+        bt_source_fade_in = true;
+    }
+
+    /* Never ask for more than is there, so that arb_read does not wait */
+    int to_read = (filled < len) ? filled : len;
+    to_read -= to_read % BT_SOURCE_FRAME_SIZE;
+    ssize_t data_read = 0;
+    if (to_read > 0) {
+        data_read = arb_read(bt_source_rb, data, to_read, 0);
+    }
     if (data_read < 0) {
         ESP_LOGI(BT_AV_TAG, "No more data to read for BT");
-        len = 0;
         arb_reset(bt_source_rb);
+        bt_source_priming = true;
+        return 0;
+    }
+
+    int16_t *pcm = (int16_t *) data;
+    int frames = data_read / BT_SOURCE_FRAME_SIZE;
+    if (bt_source_fade_in && frames > 0) {
+        int fade = (frames < BT_SOURCE_FADE_FRAMES) ? frames : BT_SOURCE_FADE_FRAMES;
+        audio_pcm_ramp(pcm, fade, 2, 0, AUDIO_PCM_GAIN_UNITY);
+        bt_source_fade_in = false;
+    }
+    if (data_read < len) {
+        /* Underrun: fade out the tail we have, pad with silence and build up the pre-buffer again */
+        int fade = (frames < BT_SOURCE_FADE_FRAMES) ? frames : BT_SOURCE_FADE_FRAMES;
+        audio_pcm_ramp(pcm + (frames - fade) * 2, fade, 2, AUDIO_PCM_GAIN_UNITY, 0);
+        memset(data + data_read, 0, len - data_read);
+        bt_source_stats.underruns++;
+        bt_source_stats.silent_frames += (len - data_read) / BT_SOURCE_FRAME_SIZE;
+        bt_source_priming = true;
+        ESP_LOGD(BT_AV_TAG, "Source underrun: %d of %d bytes, total %u", (int) data_read, (int) len,
+                 (unsigned) bt_source_stats.underruns);
     }
+    bt_source_stats.frames += frames;
     return len;
 }
 
@@ -377,6 +553,22 @@ int bt_av_init(bt_event_handler_t event_cb)
         arb_deinit(bt_source_rb);
         return ESP_FAIL;
     }
+    bt_sink_jitter_buf = malloc(audio_jitter_max_out_frames(BT_SINK_JITTER_FRAMES) * BT_SINK_FRAME_SIZE);
+    if (!bt_sink_jitter_buf) {
+        ESP_LOGE(BT_AV_TAG, "Error allocating A2DP sink jitter buffer");
+        arb_deinit(bt_sink_rb);
+        arb_deinit(bt_source_rb);
+        return ESP_FAIL;
+    }
+    bt_sink_primed = xSemaphoreCreateBinary();
+    if (!bt_sink_primed) {
+        ESP_LOGE(BT_AV_TAG, "Error creating A2DP sink semaphore");
+        free(bt_sink_jitter_buf);
+        arb_deinit(bt_sink_rb);
+        arb_deinit(bt_source_rb);
+        return ESP_FAIL;
+    }
+    audio_jitter_init(&bt_sink_jitter, 2, (bt_sink_sample_rate * BT_SINK_TARGET_MS) / 1000);
     media_hal_register_volume_change_cb(media_hal_get_handle(), bt_app_av_notify_vol_change);
     event_handler = event_cb;
     return ESP_OK;
@@ -7,6 +7,7 @@
 #include "esp_a2dp_api.h"
 #include "esp_avrc_api.h"
 #include "abstract_rb.h"
+#include "audio_jitter.h"
 #include "bluetooth.h"
 
 /**
@@ -34,6 +35,35 @@ int bt_av_init(bt_event_handler_t event_cb);
 
 rb_handle_t bt_app_av_get_rb();
 
+/**
+ * @brief     Read from the A2DP sink buffer
+ *
+ * Like arb_read on bt_app_av_get_rb(), but holds the reader back after a start or an underrun until the jitter
+ * buffer is back at its target level. Returns 0 if `wait` expires meanwhile.
+ */
+int bt_app_av_sink_read(uint8_t *data, int len, unsigned int wait);
+
+/**
+ * @brief     Wake up a reader blocked in bt_app_av_sink_read
+ */
+void bt_app_av_sink_wakeup_reader();
+
+/**
+ * @brief     Get the A2DP sink jitter buffer counters
+ */
+void bt_app_av_get_sink_stats(audio_jitter_stats_t *stats);
+
+typedef struct {
+    uint32_t frames;            /* Frames handed to the BT stack from bt_source_rb */
+    uint32_t silent_frames;     /* Frames of silence sent while pre-buffering or after an underrun */
+    uint32_t underruns;         /* Times bt_source_rb ran dry while playing */
+} bt_source_stats_t;
+
+/**
+ * @brief     Get the A2DP source feed counters
+ */
+void bt_app_av_get_source_stats(bt_source_stats_t *stats);
+
 //int bt_av_source_play(const uint8_t *data, size_t len);
 void bt_app_stop_media();
 
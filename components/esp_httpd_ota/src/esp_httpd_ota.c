@@ -1,11 +1,24 @@
+#include <string.h>
+#include <strings.h>
 #include <esp_tls.h>
 #include <esp_log.h>
+#include <esp_system.h>
 #include <esp_partition.h>
 #include <esp_ota_ops.h>
 #include <errno.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <mbedtls/sha256.h>
 #include <esp_httpd_ota.h>
 
-#define OTA_BUF_SIZE 2048
+/* Receive and flash writes are pipelined: while the writer task writes one buffer, the next one is received. */
+#define OTA_BUF_SIZE 4096       /* One flash sector */
+#define OTA_NUM_BUFS 2
+#define OTA_WRITER_STACK_SIZE 3072
+/* Optional request header with the hex SHA-256 of the image. The update fails if it does not match. */
+#define OTA_SHA256_HDR "X-Image-SHA256"
 
 static const char *TAG = "[esp_httpd_ota]";
 static void (*event_callback)(esp_httpd_ota_cb_event_t event);
@@ -19,17 +32,178 @@ httpd_uri_t update = {
     .user_ctx  = NULL
 };
 
+typedef struct {
+    char *data;
+    int len;
+} ota_buf_t;
+
+typedef struct {
+    esp_ota_handle_t update_handle;
+    QueueHandle_t free_queue;       /* Buffers to receive into */
+    QueueHandle_t write_queue;      /* Received buffers, in image order. NULL ends the image. */
+    SemaphoreHandle_t writer_done;
+    volatile esp_err_t write_err;   /* Set by the writer task */
+    ota_buf_t bufs[OTA_NUM_BUFS];
+} ota_pipeline_t;
+
+static void ota_writer_task(void *arg)
+{
+    ota_pipeline_t *pipeline = (ota_pipeline_t *)arg;
+    ota_buf_t *buf;
+    while (xQueueReceive(pipeline->write_queue, &buf, portMAX_DELAY) == pdTRUE && buf) {
+        /* After a failure, just drain the queue so the receiver does not block */
+        if (pipeline->write_err == ESP_OK) {
+            pipeline->write_err = esp_ota_write(pipeline->update_handle, (const void *)buf->data, buf->len);
+        }
+        xQueueSend(pipeline->free_queue, &buf, portMAX_DELAY);
+    }
+    xSemaphoreGive(pipeline->writer_done);
+    vTaskDelete(NULL);
+}
+
+static void ota_pipeline_free(ota_pipeline_t *pipeline)
+{
+    for (int i = 0; i < OTA_NUM_BUFS; i++) {
+        free(pipeline->bufs[i].data);
+    }
+    if (pipeline->free_queue) {
+        vQueueDelete(pipeline->free_queue);
+    }
+    if (pipeline->write_queue) {
+        vQueueDelete(pipeline->write_queue);
+    }
+    if (pipeline->writer_done) {
+        vSemaphoreDelete(pipeline->writer_done);
+    }
+    free(pipeline);
+}
+
+/* Receive the image into the update partition, hashing it on the way */
+static esp_err_t ota_receive_image(httpd_req_t *req, esp_ota_handle_t update_handle, unsigned char sha256[32])
+{
+    int data_len = 0, binary_file_len = 0, percentage_done = 0, prev_percentage_done = 0;
+    size_t total_len = req->content_len;
+    size_t remaining = total_len;
+    esp_err_t err = ESP_OK;
+
+    ota_pipeline_t *pipeline = calloc(1, sizeof(ota_pipeline_t));
+    if (!pipeline) {
+        ESP_LOGE(TAG, "Couldn't allocate memory for the OTA pipeline");
+        return ESP_ERR_NO_MEM;
+    }
+    pipeline->update_handle = update_handle;
+    pipeline->free_queue = xQueueCreate(OTA_NUM_BUFS, sizeof(ota_buf_t *));
+    pipeline->write_queue = xQueueCreate(OTA_NUM_BUFS + 1, sizeof(ota_buf_t *));
+    pipeline->writer_done = xSemaphoreCreateBinary();
+    if (!pipeline->free_queue || !pipeline->write_queue || !pipeline->writer_done) {
+        ESP_LOGE(TAG, "Couldn't create the OTA pipeline queues");
+        ota_pipeline_free(pipeline);
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < OTA_NUM_BUFS; i++) {
+        pipeline->bufs[i].data = (char *)malloc(OTA_BUF_SIZE);
+        if (!pipeline->bufs[i].data) {
+            ESP_LOGE(TAG, "Couldn't allocate memory to upgrade data buffer");
+            ota_pipeline_free(pipeline);
+            return ESP_ERR_NO_MEM;
+        }
+        ota_buf_t *buf = &pipeline->bufs[i];
+        xQueueSend(pipeline->free_queue, &buf, 0);
+    }
+    /* Same priority as the server task, so that neither starves the other */
+    if (xTaskCreate(ota_writer_task, "ota_writer", OTA_WRITER_STACK_SIZE, pipeline, uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Couldn't create the OTA writer task");
+        ota_pipeline_free(pipeline);
+        return ESP_ERR_NO_MEM;
+    }
+
+    mbedtls_sha256_context sha_ctx;
+    mbedtls_sha256_init(&sha_ctx);
+    mbedtls_sha256_starts_ret(&sha_ctx, 0);
+
+    ESP_LOGI(TAG, "Receiving binary file and writing to partition.");
+    while (remaining > 0 && pipeline->write_err == ESP_OK) {
+        ota_buf_t *buf;
+        xQueueReceive(pipeline->free_queue, &buf, portMAX_DELAY);
+        /* Fill the whole buffer, so that flash is written a sector at a time */
+        buf->len = 0;
+        while (buf->len < OTA_BUF_SIZE && remaining > 0) {
+            data_len = httpd_req_recv(req, buf->data + buf->len, remaining < OTA_BUF_SIZE - buf->len ? remaining : OTA_BUF_SIZE - buf->len);
+            if (data_len == HTTPD_SOCK_ERR_TIMEOUT) {
+                ESP_LOGE(TAG, "Got timeout. errno is EAGAIN. Trying again.\n");
+                continue;
+            } else if (data_len < 0) {
+                ESP_LOGE(TAG,"Error in https_req_recv. errno is: %d, data_len: %d\n", errno, data_len);
+                break;
+            }
+            buf->len += data_len;
+            remaining -= data_len;
+        }
+        if (data_len < 0) {
+            err = ESP_FAIL;
+            break;
+        }
+        /* Hashing overlaps with the writer task writing the previous buffer */
+        mbedtls_sha256_update_ret(&sha_ctx, (const unsigned char *)buf->data, buf->len);
+        xQueueSend(pipeline->write_queue, &buf, portMAX_DELAY);
+
+        binary_file_len += buf->len;
+        percentage_done = (100 - ((total_len - binary_file_len) * 100 / total_len));
+        if (percentage_done % 5 == 0 && percentage_done != prev_percentage_done && percentage_done < 100) {
+            ESP_LOGI(TAG, "Percentage done: %d, received image length: %d, remaining length: %d", percentage_done, binary_file_len, remaining);
+            prev_percentage_done = percentage_done;
+        }
+    }
+
+    /* Wait for the writer to finish the queued buffers */
+    ota_buf_t *end = NULL;
+    xQueueSend(pipeline->write_queue, &end, portMAX_DELAY);
+    xSemaphoreTake(pipeline->writer_done, portMAX_DELAY);
+    ESP_LOGI(TAG, "Percentage done: %d, written image length: %d, remaining length: %d", percentage_done, binary_file_len, remaining);
+
+    mbedtls_sha256_finish_ret(&sha_ctx, sha256);
+    mbedtls_sha256_free(&sha_ctx);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Receive failed");
+    } else if (pipeline->write_err != ESP_OK) {
+        err = pipeline->write_err;
+        ESP_LOGE(TAG, "Error: esp_ota_write failed! err=0x%x", err);
+    }
+    ota_pipeline_free(pipeline);
+    return err;
+}
+
+/* Compare against the hash sent by the client, if any */
+static esp_err_t ota_check_sha256(httpd_req_t *req, const unsigned char sha256[32])
+{
+    char hex[2 * 32 + 1];
+    for (int i = 0; i < 32; i++) {
+        sprintf(hex + 2 * i, "%02x", sha256[i]);
+    }
+    ESP_LOGI(TAG, "Image SHA-256: %s", hex);
+
+    char expected[2 * 32 + 1];
+    if (httpd_req_get_hdr_value_len(req, OTA_SHA256_HDR) != 2 * 32 ||
+            httpd_req_get_hdr_value_str(req, OTA_SHA256_HDR, expected, sizeof(expected)) != ESP_OK) {
+        return ESP_OK;
+    }
+    if (strcasecmp(expected, hex) != 0) {
+        ESP_LOGE(TAG, "Image SHA-256 does not match %s: %s", OTA_SHA256_HDR, expected);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 esp_err_t update_post_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "Got post request");
     event_callback(ESP_HTTPD_OTA_PRE_UPDATE);
 
-    int data_len = -1, binary_file_len = 0, percentage_done = 0, prev_percentage_done = 0;
-    size_t total_len = req->content_len;
-    size_t remaining = total_len;
     esp_err_t err;
     esp_ota_handle_t update_handle = 0;
     const esp_partition_t *update_partition = NULL;
+    unsigned char sha256[32];
 
     ESP_LOGI(TAG, "Starting OTA...");
     httpd_resp_send_chunk(req, "Starting OTA...\n", strlen("Starting OTA...\n"));
@@ -45,44 +219,11 @@ esp_err_t update_post_handler(httpd_req_t *req)
         goto ota_fail;
     }
 
-    char *upgrade_data_buf = (char *)malloc(OTA_BUF_SIZE);
-    if (!upgrade_data_buf) {
-        ESP_LOGE(TAG, "Couldn't allocate memory to upgrade data buffer");
-        goto ota_fail;
-    }
-    ESP_LOGI(TAG, "Receiving binary file and writing to partition.");
     httpd_resp_send_chunk(req, "Uploading. This may take a while. Please Wait.\n", strlen("Uploading. This may take a while. Please Wait.\n"));
-    while (remaining > 0) {
-        /* Read the data for the request */
-        data_len = httpd_req_recv(req, upgrade_data_buf, remaining < OTA_BUF_SIZE ? remaining : OTA_BUF_SIZE);
-        if (data_len == HTTPD_SOCK_ERR_TIMEOUT) {
-            ESP_LOGE(TAG, "Got timeout. errno is EAGAIN. Trying again.\n");
-            continue;
-        } else if (data_len < 0) {
-            ESP_LOGE(TAG,"Error in https_req_recv. errno is: %d, data_len: %d\n", errno, data_len);
-            break;
-        }
-        remaining -= data_len;
-
-        err = esp_ota_write(update_handle, (const void *)upgrade_data_buf, data_len);
-        if (err != ESP_OK) {
-            break;
-        }
-        binary_file_len += data_len;
-        percentage_done = (100 - ((total_len - binary_file_len) * 100 / total_len));
-        if (percentage_done % 5 == 0 && percentage_done != prev_percentage_done && percentage_done < 100) {
-            ESP_LOGI(TAG, "Percentage done: %d, written image length: %d, remaining length: %d", percentage_done, binary_file_len, remaining);
-            prev_percentage_done = percentage_done;
-        }
-    }
-    ESP_LOGI(TAG, "Percentage done: %d, written image length: %d, remaining length: %d", percentage_done, binary_file_len, remaining);
-    free(upgrade_data_buf);
-
-    if (data_len < 0) {
-        ESP_LOGE(TAG, "Receive failed");
+    if (ota_receive_image(req, update_handle, sha256) != ESP_OK) {
         goto ota_fail;
-    } else if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: esp_ota_write failed! err=0x%x", err);
+    }
+    if (ota_check_sha256(req, sha256) != ESP_OK) {
         goto ota_fail;
     }
 
@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+typedef struct {
+    int subtype;
+    uint32_t address;
+    uint32_t size;
+} esp_partition_t;
@@ -0,0 +1,17 @@
+/* Minimal FreeRTOS stand-in for host tests, on top of pthreads */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+#define portMAX_DELAY       0xffffffff
+#define portTICK_PERIOD_MS  1
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
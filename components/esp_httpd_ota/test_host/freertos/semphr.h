@@ -0,0 +1,9 @@
+#pragma once
+#include <freertos/queue.h>
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+#define xSemaphoreCreateBinary()        xQueueCreate(1, 0)
+#define xSemaphoreTake(sem, wait)       xQueueReceive(sem, NULL, wait)
+#define xSemaphoreGive(sem)             xQueueSend(sem, NULL, 0)
+#define vSemaphoreDelete(sem)           vQueueDelete(sem)
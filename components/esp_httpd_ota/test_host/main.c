@@ -0,0 +1,450 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <esp_system.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+#include <esp_httpd_ota.h>
+
+/* FreeRTOS stand-ins */
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int length;
+    int item_size;
+    int head;
+    int count;
+    unsigned char *items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t q = calloc(1, sizeof(struct host_queue));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    q->length = length;
+    q->item_size = item_size;
+    q->items = calloc(length, item_size ? item_size : 1);
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->length) {
+        if (wait == 0) {
+            pthread_mutex_unlock(&q->lock);
+            return pdFALSE;
+        }
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    memcpy(q->items + ((q->head + q->count) % q->length) * q->item_size, item, q->item_size);
+    q->count++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0) {
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    memcpy(item, q->items + q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+    free(q->items);
+    free(q);
+}
+
+struct host_task {
+    TaskFunction_t fn;
+    void *arg;
+};
+
+static void *host_task_run(void *arg)
+{
+    struct host_task t = *(struct host_task *) arg;
+    free(arg);
+    t.fn(t.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_size, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+    pthread_t thread;
+    struct host_task *t = malloc(sizeof(struct host_task));
+    t->fn = fn;
+    t->arg = arg;
+    if (pthread_create(&thread, NULL, host_task_run, t) != 0) {
+        free(t);
+        return pdFALSE;
+    }
+    pthread_detach(thread);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return 5;
+}
+
+/* mbedtls stand-in */
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+}
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224)
+{
+    ctx->state = 2166136261u;
+    return 0;
+}
+
+int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    for (size_t i = 0; i < ilen; i++, ctx->count++) {
+        ctx->state = (ctx->state ^ input[i]) * 16777619u;
+        ctx->digest[ctx->count % 32] ^= ctx->state >> 24;
+    }
+    return 0;
+}
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+    memcpy(output, ctx->digest, 32);
+    return 0;
+}
+
+/* Simulated device */
+static struct {
+    /* Network: bytes per recv call and time per byte */
+    int mss;
+    int net_ns_per_byte;
+    int timeout_every;          /* Return HTTPD_SOCK_ERR_TIMEOUT every n calls */
+    int fail_at;                /* Fail the receive at this offset, -1 for never */
+    /* Flash: erase time per new 4KB sector and time per byte written */
+    int erase_us;
+    int flash_ns_per_byte;
+    int write_fail_at;          /* Fail esp_ota_write at this offset, -1 for never */
+    const char *sha_hdr;
+} sim;
+
+static unsigned char *image;
+static size_t image_len;
+static size_t sent;
+static int recv_calls;
+static unsigned char *flash;
+static size_t flash_len;
+static int boot_set, restarted, post_update_events;
+static esp_err_t (*handler)(httpd_req_t *r);
+static const esp_partition_t ota_1 = { .subtype = 17, .address = 0x210000, .size = 0x200000 };
+
+static void sleep_ns(long ns)
+{
+    if (ns > 0) {
+        struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return "error";
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    handler = uri_handler->handler;
+    return ESP_OK;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    recv_calls++;
+    if (sim.timeout_every && recv_calls % sim.timeout_every == 0) {
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    if (sim.fail_at >= 0 && sent >= (size_t) sim.fail_at) {
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    size_t len = image_len - sent;
+    len = len < buf_len ? len : buf_len;
+    len = len < (size_t) sim.mss ? len : (size_t) sim.mss;
+    sleep_ns((long) len * sim.net_ns_per_byte);
+    memcpy(buf, image + sent, len);
+    sent += len;
+    return len;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    return ESP_OK;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    return (sim.sha_hdr && strcmp(field, "X-Image-SHA256") == 0) ? strlen(sim.sha_hdr) : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    if (httpd_req_get_hdr_value_len(r, field) == 0 || strlen(sim.sha_hdr) >= val_size) {
+        return ESP_FAIL;
+    }
+    strcpy(val, sim.sha_hdr);
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return &ota_1;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    flash_len = 0;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    if (sim.write_fail_at >= 0 && flash_len + size > (size_t) sim.write_fail_at) {
+        return ESP_FAIL;
+    }
+    /* Sectors are erased as the write reaches them */
+    size_t new_sectors = (flash_len + size + 4095) / 4096 - (flash_len + 4095) / 4096;
+    sleep_ns((long) new_sectors * sim.erase_us * 1000 + (long) size * sim.flash_ns_per_byte);
+    memcpy(flash + flash_len, data, size);
+    flash_len += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    boot_set++;
+    return ESP_OK;
+}
+
+void esp_restart(void)
+{
+    restarted++;
+}
+
+static void event_cb(esp_httpd_ota_cb_event_t event)
+{
+    if (event == ESP_HTTPD_OTA_POST_UPDATE) {
+        post_update_events++;
+    }
+}
+
+static void image_hash_hex(char hex[65])
+{
+    unsigned char digest[32];
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, 0);
+    mbedtls_sha256_update_ret(&ctx, image, image_len);
+    mbedtls_sha256_finish_ret(&ctx, digest);
+    for (int i = 0; i < 32; i++) {
+        sprintf(hex + 2 * i, "%02X", digest[i]);
+    }
+}
+
+static void sim_reset(size_t len)
+{
+    memset(&sim, 0, sizeof(sim));
+    sim.mss = 1460;
+    sim.fail_at = -1;
+    sim.write_fail_at = -1;
+    image_len = len;
+    uint32_t x = len;
+    for (size_t i = 0; i < len; i++) {
+        x = x * 1103515245 + 12345;
+        image[i] = x >> 24;
+    }
+    sent = 0;
+    recv_calls = 0;
+    flash_len = 0;
+    boot_set = restarted = post_update_events = 0;
+}
+
+static esp_err_t run_update()
+{
+    httpd_req_t req = {
+        .content_len = image_len,
+    };
+    return handler(&req);
+}
+
+static int test_ota()
+{
+    char hex[65];
+    printf("test: pipelined ota ....");
+
+    /* Odd sized image, odd sized receives with timeouts, hash checked (upper case hex) */
+    sim_reset(1000003);
+    sim.mss = 1000;
+    sim.timeout_every = 211;
+    image_hash_hex(hex);
+    sim.sha_hdr = hex;
+    if (run_update() != ESP_OK || flash_len != image_len || memcmp(flash, image, image_len) != 0 ||
+            boot_set != 1 || restarted != 1 || post_update_events != 1) {
+        printf("Fail\nupdate: flash_len %zu boot_set %d restarted %d\n", flash_len, boot_set, restarted);
+        return -1;
+    }
+
+    /* Hash mismatch */
+    sim_reset(100000);
+    sim.sha_hdr = "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff";
+    if (run_update() == ESP_OK || boot_set || restarted) {
+        printf("Fail\nhash mismatch accepted\n");
+        return -1;
+    }
+
+    /* Connection drops half way: the writer task must still finish */
+    sim_reset(100000);
+    sim.fail_at = 50000;
+    if (run_update() == ESP_OK || boot_set || flash_len > 50000) {
+        printf("Fail\nreceive failure\n");
+        return -1;
+    }
+
+    /* Flash write fails: the receive stops soon after */
+    sim_reset(1000000);
+    sim.write_fail_at = 20000;
+    if (run_update() == ESP_OK || boot_set || sent > 20000 + 4 * 4096) {
+        printf("Fail\nwrite failure, %zu bytes received\n", sent);
+        return -1;
+    }
+    printf("Success\n");
+    return 0;
+}
+
+/* The previous handler loop: receive 2KB, write it, repeat */
+static void reference_sequential()
+{
+    char *buf = malloc(2048);
+    size_t remaining = image_len;
+    esp_ota_handle_t handle;
+    esp_ota_begin(&ota_1, OTA_SIZE_UNKNOWN, &handle);
+    while (remaining > 0) {
+        int len = httpd_req_recv(NULL, buf, remaining < 2048 ? remaining : 2048);
+        if (len < 0) {
+            continue;
+        }
+        remaining -= len;
+        esp_ota_write(handle, buf, len);
+    }
+    free(buf);
+}
+
+static double elapsed_ms(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static void bench()
+{
+    /* ~1MB/s WiFi and ~8ms to erase and write a sector: the two take about as long */
+    struct {
+        const char *name;
+        int net_ns_per_byte;
+        int erase_us;
+        int flash_ns_per_byte;
+    } profiles[] = {
+        { "balanced", 1000, 4000, 1000 },
+        { "slow network", 2000, 4000, 1000 },
+        { "slow flash", 1000, 8000, 2000 },
+    };
+    for (int i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+        struct timespec start;
+        double seq, pipe;
+        sim_reset(512 * 1024);
+        sim.net_ns_per_byte = profiles[i].net_ns_per_byte;
+        sim.erase_us = profiles[i].erase_us;
+        sim.flash_ns_per_byte = profiles[i].flash_ns_per_byte;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        reference_sequential();
+        seq = elapsed_ms(&start);
+
+        sent = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        run_update();
+        pipe = elapsed_ms(&start);
+        printf("bench: 512KB image, %s: sequential %.0f ms, pipelined %.0f ms\n", profiles[i].name, seq, pipe);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    image = malloc(2 * 1024 * 1024);
+    flash = malloc(2 * 1024 * 1024);
+    esp_httpd_ota_update_init(event_cb, (httpd_handle_t) 1);
+    int ret = 0;
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+    } else if (test_ota()) {
+        ret = -1;
+    }
+    free(image);
+    free(flash);
+    return ret;
+}
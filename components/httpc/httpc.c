@@ -83,6 +83,34 @@ void http_connection_set_keepalive_and_recv_timeout(httpc_conn_t *httpc)
     setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 }
 
+static bool http_is_crlf(const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != '\r' && data[i] != '\n') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Keep bytes of the next response until its request is picked up */
+static int http_rx_stash(httpc_conn_t *httpc, const char *data, size_t len)
+{
+    if (len > httpc->rx_buf_size) {
+        char *buf = (char *) realloc(httpc->rx_buf, len);
+        if (!buf) {
+            ESP_LOGE(TAG, "Could not allocate %zu bytes for the next response. Line = %d", len, __LINE__);
+            return -1;
+        }
+        httpc->rx_buf = buf;
+        httpc->rx_buf_size = len;
+    }
+    memcpy(httpc->rx_buf, data, len);
+    httpc->rx_off = 0;
+    httpc->rx_len = len;
+    return 0;
+}
+
 static int http_response_read_and_parse(httpc_conn_t *httpc, char *buf, size_t buf_len,
                                         bool discard_buf)
 {
@@ -95,21 +123,51 @@ static int http_response_read_and_parse(httpc_conn_t *httpc, char *buf, size_t b
         httpc->request.out_buf_len = buf_len;
         httpc->request.out_buf_index = 0;
     }
-    /* Read data.*/
-    int data_read = esp_tls_conn_read(httpc->tls, buf, buf_len);
-    if (data_read < 0) {
-        if ((httpc->is_tls && data_read == MBEDTLS_ERR_SSL_WANT_READ) || errno == EAGAIN) {
-            /* Currently this is only supported if the timeout is set AFTER the headers are already parsed */
-            return -EAGAIN;
+    const char *data = buf;
+    int data_read;
+    bool from_rx_buf = httpc->rx_off < httpc->rx_len;
+    if (from_rx_buf) {
+        /* Data of this response that was read along with the end of the previous one */
+        data = httpc->rx_buf + httpc->rx_off;
+        data_read = httpc->rx_len - httpc->rx_off;
+        if (data_read > buf_len) {
+            data_read = buf_len;
+        }
+    } else {
+        /* Read data.*/
+        data_read = esp_tls_conn_read(httpc->tls, buf, buf_len);
+        if (data_read < 0) {
+            if ((httpc->is_tls && data_read == MBEDTLS_ERR_SSL_WANT_READ) || errno == EAGAIN) {
+                /* Currently this is only supported if the timeout is set AFTER the headers are already parsed */
+                return -EAGAIN;
+            }
+            return data_read;
         }
-        return data_read;
     }
     /* Feed the parser */
     int parsed = http_parser_execute(&httpc->request.parser, &httpc->request.parser_settings,
-                                     buf, data_read);
+                                     data, data_read);
+    if (parsed != data_read && HTTP_PARSER_ERRNO(&httpc->request.parser) == HPE_PAUSED && httpc->pipeline_len == 0 &&
+            http_is_crlf(data + parsed, data_read - parsed)) {
+        /* Stray CRLF after the body. The parser skips it before a response, so it was fine before pausing either. */
+        parsed = data_read;
+    }
+    if (from_rx_buf) {
+        httpc->rx_off += parsed;
+        if (httpc->rx_off == httpc->rx_len) {
+            httpc->rx_off = httpc->rx_len = 0;
+        }
+    }
     if (parsed != data_read) {
-        ESP_LOGE(TAG, "Error in parsing parsed:%d data_read:%d\n", parsed, data_read);
-        return -1 ;
+        /* The parser stops at the end of the response. Only a pipelined response may follow it: anything else,
+         * e.g. bytes of a response that was never asked for, fails the connection. */
+        if (HTTP_PARSER_ERRNO(&httpc->request.parser) != HPE_PAUSED || httpc->pipeline_len == 0) {
+            ESP_LOGE(TAG, "Error in parsing parsed:%d data_read:%d\n", parsed, data_read);
+            return -1 ;
+        }
+        if (!from_rx_buf && http_rx_stash(httpc, data + parsed, data_read - parsed) != 0) {
+            return -1;
+        }
     } else if (data_read == 0 && httpc->state < ESP_HTTP_RESP_BDY_RECEIVED) {
         /**
          * We should blindly return -1 from here to able to break the `http_response_recv` loop!?
@@ -275,141 +333,172 @@ void http_connection_delete(httpc_conn_t *httpc)
     if (httpc->host) {
         free(httpc->host);
     }
+    if (httpc->tx_buf) {
+        free(httpc->tx_buf);
+    }
+    if (httpc->rx_buf) {
+        free(httpc->rx_buf);
+    }
+    for (int i = 0; i < httpc->pipeline_len; i++) {
+        free(httpc->pipeline[i]);
+    }
     esp_tls_conn_delete(httpc->tls);
     free(httpc);
 }
 
-int http_request_send_custom_hdr(httpc_conn_t *httpc, const char *user_hdr)
+/* Make room for `len` more bytes in the staging buffer */
+static int http_tx_reserve(httpc_conn_t *httpc, size_t len)
+{
+    if (httpc->tx_len + len <= httpc->tx_buf_size) {
+        return 0;
+    }
+    size_t size = httpc->tx_buf_size ? httpc->tx_buf_size : HTTPC_TX_BUF_SIZE;
+    while (size < httpc->tx_len + len) {
+        size *= 2;
+    }
+    char *buf = (char *) realloc(httpc->tx_buf, size);
+    if (!buf) {
+        ESP_LOGE(TAG, "Could not allocate %zu bytes for the request. Line = %d", size, __LINE__);
+        return -1;
+    }
+    httpc->tx_buf = buf;
+    httpc->tx_buf_size = size;
+    return 0;
+}
+
+static int http_tx_append(httpc_conn_t *httpc, const char *data, size_t len)
+{
+    if (http_tx_reserve(httpc, len) != 0) {
+        return -1;
+    }
+    memcpy(httpc->tx_buf + httpc->tx_len, data, len);
+    httpc->tx_len += len;
+    return 0;
+}
+
+static int http_tx_append_str(httpc_conn_t *httpc, const char *str)
+{
+    return http_tx_append(httpc, str, strlen(str));
+}
+
+/* Append `val` in decimal, or in hex for chunk sizes */
+static int http_tx_append_uint(httpc_conn_t *httpc, size_t val, bool hex)
+{
+    char tmp[24];
+    int i = sizeof(tmp);
+    unsigned int base = hex ? 16 : 10;
+    do {
+        tmp[--i] = "0123456789abcdef"[val % base];
+        val /= base;
+    } while (val);
+    return http_tx_append(httpc, &tmp[i], sizeof(tmp) - i);
+}
+
+/* Send the staged data, followed by `data`. Both go out in one write if `data` fits in the buffer. */
+static int http_tx_flush(httpc_conn_t *httpc, const char *data, size_t data_len)
+{
+    if (data_len && httpc->tx_len && httpc->tx_len + data_len <= httpc->tx_buf_size) {
+        memcpy(httpc->tx_buf + httpc->tx_len, data, data_len);
+        httpc->tx_len += data_len;
+        data_len = 0;
+    }
+    size_t len = httpc->tx_len;
+    httpc->tx_len = 0;
+    if (len && esp_tls_conn_write(httpc->tls, httpc->tx_buf, len) < 0) {
+        return -1;
+    }
+    if (data_len && esp_tls_conn_write(httpc->tls, data, data_len) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Stage "<METHOD> <path> HTTP/1.1\r\n" */
+static int http_tx_request_line(httpc_conn_t *httpc, httpc_ops_t req_op, const char *path)
 {
-    char *hdr;
-    char *req_template;
-#define GET_DATA_TEMPLATE   "GET %s HTTP/1.1\r\n"
-#define POST_DATA_TEMPLATE  "POST %s HTTP/1.1\r\n"
-#define PUT_DATA_TEMPLATE   "PUT %s HTTP/1.1\r\n"
-#define NOTIFY_DATA_TEMPLATE "NOTIFY %s HTTP/1.1\r\n"
-    switch (httpc->request.op) {
+    const char *op;
+    switch (req_op) {
     case ESP_HTTP_GET:
-        req_template = GET_DATA_TEMPLATE;
+        op = "GET ";
         break;
     case ESP_HTTP_POST:
-        req_template = POST_DATA_TEMPLATE;
+        op = "POST ";
         break;
     case ESP_HTTP_PUT:
-        req_template = PUT_DATA_TEMPLATE;
+        op = "PUT ";
         break;
     case ESP_HTTP_NOTIFY:
-        req_template = NOTIFY_DATA_TEMPLATE;
+        op = "NOTIFY ";
         break;
     default:
         return -1;
-        break;
     }
-    int hdr_len = strlen(req_template) + strlen(httpc->request.url) + 1;
-    hdr = (char *)calloc(1, hdr_len);
-    if (!hdr) {
+    httpc->tx_len = 0;
+    if (http_tx_append_str(httpc, op) != 0 ||
+            http_tx_append_str(httpc, path) != 0 ||
+            http_tx_append_str(httpc, " HTTP/1.1\r\n") != 0) {
         return -1;
     }
-    snprintf(hdr, hdr_len, req_template, httpc->request.url);
-    if (esp_tls_conn_write(httpc->tls, hdr, strlen(hdr)) < 0) {
-        free(hdr);
-        return -1;
-    }
-    free(hdr);
-    /* Send the entire set of headers */
-    if (esp_tls_conn_write(httpc->tls, user_hdr, strlen(user_hdr)) < 0) {
+    return 0;
+}
+
+int http_request_send_custom_hdr(httpc_conn_t *httpc, const char *user_hdr)
+{
+    /* Request line and the entire set of headers, in one write */
+    if (http_tx_request_line(httpc, httpc->request.op, httpc->request.url) != 0 ||
+            http_tx_append_str(httpc, user_hdr) != 0 ||
+            http_tx_flush(httpc, NULL, 0) != 0) {
+        httpc->tx_len = 0;
         return -1;
     }
     httpc->state = ESP_HTTP_REQ_HDR_SENT;
     return 0;
-#undef GET_DATA_TEMPLATE
-#undef POST_DATA_TEMPLATE
-#undef PUT_DATA_TEMPLATE
 }
 
-static int http_request_send_our_hdr(httpc_conn_t *httpc, size_t data_len)
+/* Stage our headers. The request is sent with the first piece of the body. */
+static int http_request_stage_our_hdr(httpc_conn_t *httpc, httpc_ops_t op, const char *path, size_t offset,
+                                      size_t data_len)
 {
-    char *hdr;
-    switch (httpc->request.op) {
-    case ESP_HTTP_GET: {
-#define GET_DATA_TEMPLATE               \
-"GET %s HTTP/1.1\r\n"                   \
-"User-Agent: ESP32 HTTP Client/1.0\r\n" \
-"Host: %s\r\n"                          \
-"Range: bytes=%s-\r\n"                  \
-"\r\n"                                  \
-
-#define INT_TO_CHAR_SIZE 12 // Enough to store signed 32 bit number + `\0`
-        char range_str[INT_TO_CHAR_SIZE] = {0, };
-        snprintf(range_str, INT_TO_CHAR_SIZE, "%d", httpc->request.offset);
-#undef INT_TO_CHAR_SIZE
-
-        int hdr_len = strlen(GET_DATA_TEMPLATE) + strlen(httpc->request.url) +
-                      strlen(httpc->host) + strlen(range_str) + 1;
-
-        hdr = (char *)calloc(1, hdr_len);
-        if (!hdr) {
-            return -1;
-        }
-        snprintf(hdr, hdr_len, GET_DATA_TEMPLATE, httpc->request.url,
-                 httpc->host, range_str);
-    }
-    break;
-    case ESP_HTTP_PUT:
-    case ESP_HTTP_NOTIFY:
-    case ESP_HTTP_POST: {
-#define POST_DATA_TEMPLATE                      \
-"%s %s HTTP/1.1\r\n"                \
-"Host: %s\r\n"                      \
-"Content-Length: %zu\r\n"           \
-"Content-Type: %s\r\n\r\n"
-	const char *op;
-	if (httpc->request.op == ESP_HTTP_POST) {
-	    op = "POST";
-	} else if (httpc->request.op == ESP_HTTP_PUT) {
-	    op = "PUT";
-	} else {
-        op = "NOTIFY";
-    }
-        /* 10 bytes should be sufficient to encode the content-length */
-        int hdr_len = strlen(op) + strlen(POST_DATA_TEMPLATE) + strlen(httpc->request.url) +
-                      strlen(httpc->host) + 10 + strlen(httpc->request.content_type) + 1;
-        hdr = (char *)calloc(1, hdr_len);
-        if (!hdr) {
-            return -1;
-        }
-        snprintf(hdr, hdr_len, POST_DATA_TEMPLATE, op, httpc->request.url,
-                 httpc->host, data_len, httpc->request.content_type);
-    }
-    break;
-    default:
+    if (http_tx_request_line(httpc, op, path) != 0) {
         return -1;
     }
-
-    /* hdr should be allocated and populated */
-    ESP_LOGD(TAG, "Sending hdr: \n%s\n", hdr);
-
-    if (esp_tls_conn_write(httpc->tls, hdr, strlen(hdr)) < 0) {
-        free(hdr);
+    int ret;
+    if (op == ESP_HTTP_GET) {
+        ret = http_tx_append_str(httpc, "User-Agent: ESP32 HTTP Client/1.0\r\nHost: ") ||
+              http_tx_append_str(httpc, httpc->host) ||
+              http_tx_append_str(httpc, "\r\nRange: bytes=") ||
+              http_tx_append_uint(httpc, offset, false) ||
+              http_tx_append_str(httpc, "-\r\n\r\n");
+    } else {
+        ret = http_tx_append_str(httpc, "Host: ") ||
+              http_tx_append_str(httpc, httpc->host) ||
+              http_tx_append_str(httpc, "\r\nContent-Length: ") ||
+              http_tx_append_uint(httpc, data_len, false) ||
+              http_tx_append_str(httpc, "\r\nContent-Type: ") ||
+              http_tx_append_str(httpc, httpc->request.content_type) ||
+              http_tx_append_str(httpc, "\r\n\r\n");
+    }
+    if (ret) {
+        httpc->tx_len = 0;
         return -1;
     }
-    free(hdr);
-    httpc->state = ESP_HTTP_REQ_HDR_SENT;
+    ESP_LOGD(TAG, "Sending hdr: \n%.*s\n", (int) httpc->tx_len, httpc->tx_buf);
     return 0;
 }
 
 int http_request_send(httpc_conn_t *httpc, const char *data, size_t data_len)
 {
-    if (httpc->state < ESP_HTTP_REQ_HDR_SENT) {
-        if (http_request_send_our_hdr(httpc, data_len) != 0) {
-            return -1;
-        }
+    if (!data) {
+        data_len = 0;
     }
-    if (data && data_len) {
-        if (esp_tls_conn_write(httpc->tls, data, data_len) < 0) {
+    if (httpc->state < ESP_HTTP_REQ_HDR_SENT) {
+        if (http_request_stage_our_hdr(httpc, httpc->request.op, httpc->request.url, httpc->request.offset,
+                                       data_len) != 0) {
             return -1;
         }
+        httpc->state = ESP_HTTP_REQ_HDR_SENT;
     }
-    return 0;
+    return http_tx_flush(httpc, data, data_len);
 }
 
 void http_response_set_header_cb(httpc_conn_t *httpc, httpc_response_header_cb cb, void *arg)
@@ -529,7 +618,8 @@ static int http_get_body(http_parser *parser, const char *p, size_t len)
         ESP_LOGE(TAG, "ASSERT: This shouldn't happen\n");
         return -1;
     }
-    memcpy(h->request.out_buf + h->request.out_buf_index, p, len);
+    /* Body data is usually moved down within the same buffer it was read into */
+    memmove(h->request.out_buf + h->request.out_buf_index, p, len);
     h->request.out_buf_index += len;
 
     return 0;
@@ -555,6 +645,8 @@ static int http_message_complete(http_parser *parser)
 {
     httpc_conn_t *h = parser->data;
     h->state = ESP_HTTP_RESP_BDY_RECEIVED;
+    /* Don't parse on into the next (pipelined) response */
+    http_parser_pause(parser, 1);
     return 0;
 }
 
@@ -618,6 +710,17 @@ int http_request_new(httpc_conn_t *httpc, httpc_ops_t op, const char *url)
     }
     httpc->request.content_type = DEFAULT_CONTENT_TYPE;
     httpc->state = ESP_HTTP_REQ_NEW;
+    if (httpc->pipeline_len) {
+        /* The next response on the connection is for the oldest pipelined request */
+        if (op != ESP_HTTP_GET || strcmp(httpc->pipeline[0], httpc->request.url) != 0) {
+            ESP_LOGE(TAG, "Pipelined requests must be picked up in order. Expected GET %s", httpc->pipeline[0]);
+            return -1;
+        }
+        free(httpc->pipeline[0]);
+        httpc->pipeline_len--;
+        memmove(&httpc->pipeline[0], &httpc->pipeline[1], httpc->pipeline_len * sizeof(httpc->pipeline[0]));
+        httpc->state = ESP_HTTP_REQ_HDR_SENT;
+    }
     http_parser_init(&httpc->request.parser, HTTP_RESPONSE);
     httpc->request.parser.data = httpc;
     httpc->request.parser_settings.on_headers_complete = http_hdr_complete;
@@ -628,6 +731,30 @@ int http_request_new(httpc_conn_t *httpc, httpc_ops_t op, const char *url)
     return 0;
 }
 
+int http_request_pipeline(httpc_conn_t *httpc, const char *url)
+{
+    if (httpc->state < ESP_HTTP_CONNECTION_DONE || httpc->state == ESP_HTTP_REQ_NEW) {
+        ESP_LOGE(TAG, "Current request not sent yet!");
+        return -1;
+    }
+    if (!HTTPC_PIPELINING || httpc->pipeline_len == HTTPC_PIPELINE_MAX) {
+        return -1;
+    }
+    struct http_parser_url u;
+    char *path = http_get_correct_path(url, &u);
+    if (!path) {
+        return -1;
+    }
+    if (http_request_stage_our_hdr(httpc, ESP_HTTP_GET, path, 0, 0) != 0 ||
+            http_tx_flush(httpc, NULL, 0) != 0) {
+        httpc->tx_len = 0;
+        free(path);
+        return -1;
+    }
+    httpc->pipeline[httpc->pipeline_len++] = path;
+    return 0;
+}
+
 /**
  * Check if renew session needed
  */
@@ -752,20 +879,20 @@ int http_header_fetch(httpc_conn_t *httpc)
 
 int http_send_chunk(httpc_conn_t *httpc, const char *data, size_t data_len)
 {
-    char start_chunk[12];
-    int ret;
     const char *cr_lf = "\r\n";
-    unsigned int chunk_len;
 
-    ret = snprintf(start_chunk, sizeof(start_chunk), "%x%s", (unsigned int)data_len, cr_lf);
-    if ((ret <= 0) || (ret >= sizeof(start_chunk))) {
+    /* Size line, data and the trailing CRLF go out together when they fit */
+    httpc->tx_len = 0;
+    if (http_tx_append_uint(httpc, data_len, true) != 0 ||
+            http_tx_append(httpc, cr_lf, 2) != 0) {
         return -1;
     }
-    chunk_len = ret;
-    if (esp_tls_conn_write(httpc->tls, start_chunk, chunk_len) < 0) {
-        return -1;
+    if (httpc->tx_len + data_len + 2 <= httpc->tx_buf_size) {
+        memcpy(httpc->tx_buf + httpc->tx_len, data, data_len);
+        httpc->tx_len += data_len;
+        return http_tx_flush(httpc, cr_lf, 2);
     }
-    if (esp_tls_conn_write(httpc->tls, data, data_len) < 0) {
+    if (http_tx_flush(httpc, data, data_len) != 0) {
         return -1;
     }
     if (esp_tls_conn_write(httpc->tls, cr_lf, strlen(cr_lf)) < 0) {
@@ -53,9 +53,20 @@ typedef void  (* httpc_response_header_cb)(const char *, const char *, void *arg
 /* The maximum length of a header or value that we are interested in */
 #ifdef ESP_PLATFORM
 #define MAX_HDR_VAL_LEN   CONFIG_HTTP_CLIENT_MAX_HDR_VAL_LEN
+#define HTTPC_TX_BUF_SIZE CONFIG_HTTP_CLIENT_TX_BUF_SIZE
+#ifdef CONFIG_HTTP_CLIENT_PIPELINING
+#define HTTPC_PIPELINING 1
+#else
+#define HTTPC_PIPELINING 0
+#endif
 #else
 #define MAX_HDR_VAL_LEN 50
+#define HTTPC_TX_BUF_SIZE 1024
+#define HTTPC_PIPELINING 1
 #endif
+
+/* Maximum number of GETs sent ahead of the current request, see http_request_pipeline() */
+#define HTTPC_PIPELINE_MAX 4
 typedef struct httpc_conn {
     struct http_parser_url u; /* Used for url parsing */
     struct esp_tls *tls;
@@ -96,6 +107,21 @@ typedef struct httpc_conn {
         int hdr_overflow_buf_index;
         char response_content_type[MAX_HDR_VAL_LEN];
     } request;
+
+    /* Staging buffer for outgoing requests, reused across requests on this connection */
+    char *tx_buf;
+    size_t tx_buf_size;
+    size_t tx_len;
+
+    /* Bytes read past the end of the current response: the start of the next pipelined response */
+    char *rx_buf;
+    size_t rx_buf_size;
+    size_t rx_off;
+    size_t rx_len;
+
+    /* Paths of the pipelined GETs already sent, oldest first */
+    char *pipeline[HTTPC_PIPELINE_MAX];
+    int pipeline_len;
 } httpc_conn_t;
 
 httpc_conn_t *http_connection_new(const char *url, esp_tls_cfg_t *tls_cfg);
@@ -116,6 +142,28 @@ void http_connection_delete(httpc_conn_t *httpc);
 bool http_connection_new_needed(httpc_conn_t *httpc, const char *url);
 
 int http_request_new(httpc_conn_t *httpc, httpc_ops_t op, const char *url);
+
+/**
+ * Send a GET for `url` right away, without waiting for the responses to the
+ * requests before it (HTTP/1.1 pipelining). The server answers in order.
+ *
+ * Pick the response up later, in the same order, with the usual
+ * http_request_new(httpc, ESP_HTTP_GET, url), http_request_send() (which then
+ * sends nothing) and http_response_recv() sequence.
+ *
+ * The current request, if any, must have been sent already.
+ * Returns 0 on success, -1 if the pipeline is full, pipelining is disabled
+ * (CONFIG_HTTP_CLIENT_PIPELINING) or on a send error. The caller then sends
+ * its requests one at a time.
+ */
+int http_request_pipeline(httpc_conn_t *httpc, const char *url);
+
+/* Number of pipelined requests whose response has not been picked up yet */
+static inline int http_request_pipeline_len(httpc_conn_t *httpc)
+{
+    return httpc->pipeline_len;
+}
+
 void http_request_delete(httpc_conn_t *httpc);
 int http_header_fetch(httpc_conn_t *h);
 int http_request_send(httpc_conn_t *httpc, const char *data, size_t data_len);
@@ -144,7 +192,8 @@ static inline char *http_response_get_redirect_location(httpc_conn_t *httpc)
 }
 
 /* All the headers will be the responsibility of the caller.
- * The httpc module will only prefix this with the request line.
+ * The httpc module will only prefix this with the request line. Both go out
+ * in a single write.
  */
 int http_request_send_custom_hdr(httpc_conn_t *httpc, const char *hdr);
 int http_send_chunk(httpc_conn_t *httpc, const char *data, size_t data_len);
@@ -0,0 +1,323 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <httpc.h>
+
+static int validate_status_code(httpc_conn_t *h, int expected_code)
+{
+    if (http_response_get_code(h) != expected_code) {
+        printf("Fail\n");
+        printf("Expected Status Code: %d, got %d\n", expected_code, http_response_get_code(h));
+        return -1;
+    }
+    return 0;
+}
+
+/* Local HTTP/1.1 server that answers pipelined requests in order.
+ * It waits a bit after the first request, so that all requests sent ahead
+ * arrive together and their responses go out in a single write.
+ */
+struct pipeline_server {
+    int listen_fd;
+    int port;
+    int requests;
+    int max_batch;
+    const char *trailer;    /* Sent after each response, e.g. a stray CRLF */
+    int close_after;        /* Close the connection after this many responses, 0 for never */
+};
+
+static void *pipeline_server_task(void *arg)
+{
+    struct pipeline_server *srv = arg;
+    int fd = accept(srv->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return NULL;
+    }
+    char req[4096];
+    int req_len = 0;
+    while (1) {
+        int n = recv(fd, req + req_len, sizeof(req) - req_len - 1, 0);
+        if (n <= 0) {
+            break;
+        }
+        if (req_len == 0) {
+            usleep(50 * 1000);
+            int more = recv(fd, req + n, sizeof(req) - n - 1, MSG_DONTWAIT);
+            if (more > 0) {
+                n += more;
+            }
+        }
+        req_len += n;
+        req[req_len] = '\0';
+
+        char resp[4096];
+        int resp_len = 0;
+        int batch = 0;
+        char *end;
+        while ((end = strstr(req, "\r\n\r\n")) && (!srv->close_after || srv->requests < srv->close_after)) {
+            char path[64] = "";
+            sscanf(req, "GET %63s HTTP/1.1", path);
+            char body[128];
+            int body_len = snprintf(body, sizeof(body), "response to %s, request %d on this connection", path, srv->requests);
+            resp_len += snprintf(resp + resp_len, sizeof(resp) - resp_len,
+                                 "HTTP/1.1 200 OK\r\nContent-Length: %d\r\nContent-Type: text/plain\r\n\r\n%s%s", body_len, body,
+                                 srv->trailer ? srv->trailer : "");
+            srv->requests++;
+            batch++;
+            int consumed = end + 4 - req;
+            memmove(req, end + 4, req_len - consumed);
+            req_len -= consumed;
+            req[req_len] = '\0';
+        }
+        if (batch > srv->max_batch) {
+            srv->max_batch = batch;
+        }
+        if (resp_len && send(fd, resp, resp_len, 0) != resp_len) {
+            break;
+        }
+        if (srv->close_after && srv->requests == srv->close_after) {
+            break;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static int pipeline_server_start(struct pipeline_server *srv, pthread_t *thread)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addr_len = sizeof(addr);
+    srv->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (srv->listen_fd < 0 || bind(srv->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+            listen(srv->listen_fd, 1) || getsockname(srv->listen_fd, (struct sockaddr *) &addr, &addr_len)) {
+        return -1;
+    }
+    srv->port = ntohs(addr.sin_port);
+    return pthread_create(thread, NULL, pipeline_server_task, srv);
+}
+
+static httpc_conn_t *pipeline_server_connect(struct pipeline_server *srv)
+{
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d", srv->port);
+    esp_tls_cfg_t tls_cfg;
+    memset(&tls_cfg, 0, sizeof(tls_cfg));
+    return http_connection_new(url, &tls_cfg);
+}
+
+static int recv_full_response(httpc_conn_t *h, char *out, int out_len)
+{
+    /* Small reads, so that responses are split across reads */
+    char buf[10];
+    int total = 0;
+    int data_read;
+    while ((data_read = http_response_recv(h, buf, sizeof(buf))) > 0) {
+        if (total + data_read >= out_len) {
+            return -1;
+        }
+        memcpy(out + total, buf, data_read);
+        total += data_read;
+    }
+    if (data_read < 0) {
+        return -1;
+    }
+    out[total] = '\0';
+    return total;
+}
+
+static int test_local_pipelining()
+{
+    printf("test: pipelined GETs on a local keep-alive connection ....");
+    struct pipeline_server srv = {0};
+    pthread_t thread;
+    if (pipeline_server_start(&srv, &thread) != 0) {
+        printf("Fail, couldn't start local server\n");
+        return -1;
+    }
+    httpc_conn_t *h = pipeline_server_connect(&srv);
+    if (!h) {
+        printf("Fail, couldn't open connection\n");
+        return -1;
+    }
+
+    static const char *paths[] = { "/playlist.m3u8", "/seg0.ts", "/seg1.ts", "/seg2.ts", "/seg3.ts" };
+    int num_paths = sizeof(paths) / sizeof(paths[0]);
+    http_request_new(h, ESP_HTTP_GET, paths[0]);
+    http_request_send(h, NULL, 0);
+    for (int i = 1; i < num_paths; i++) {
+        if (http_request_pipeline(h, paths[i]) != 0) {
+            printf("Fail\n");
+            printf("Couldn't pipeline %s\n", paths[i]);
+            return -1;
+        }
+    }
+    if (http_request_pipeline(h, "/one-too-many") == 0 && HTTPC_PIPELINE_MAX == num_paths - 1) {
+        printf("Fail\n");
+        printf("Pipeline depth not enforced\n");
+        return -1;
+    }
+
+    for (int i = 0; i < num_paths; i++) {
+        if (i) {
+            if (http_request_new(h, ESP_HTTP_GET, paths[i]) != 0 || http_request_send(h, NULL, 0) != 0) {
+                printf("Fail\n");
+                printf("Couldn't pick up the request for %s\n", paths[i]);
+                return -1;
+            }
+        }
+        char resp[256];
+        char expected[128];
+        if (i == 2) {
+            /* Leave most of this one unread: it is drained by the next http_request_new() */
+            if (http_response_recv(h, resp, 10) <= 0 || validate_status_code(h, 200)) {
+                return -1;
+            }
+            http_request_delete(h);
+            continue;
+        }
+        if (recv_full_response(h, resp, sizeof(resp)) < 0 || validate_status_code(h, 200)) {
+            printf("Fail\n");
+            printf("Couldn't read the response for %s\n", paths[i]);
+            return -1;
+        }
+        snprintf(expected, sizeof(expected), "response to %s, request %d on this connection", paths[i], i);
+        if (strcmp(resp, expected)) {
+            printf("Fail\n");
+            printf("Expected \"%s\", got \"%s\"\n", expected, resp);
+            return -1;
+        }
+        http_request_delete(h);
+    }
+    if (http_request_pipeline_len(h) != 0) {
+        printf("Fail\n");
+        printf("%d pipelined requests not picked up\n", http_request_pipeline_len(h));
+        return -1;
+    }
+
+    /* Responses must be picked up in the order the requests were sent */
+    http_request_pipeline(h, "/a");
+    if (http_request_new(h, ESP_HTTP_GET, "/b") == 0) {
+        printf("Fail\n");
+        printf("Out of order pick up accepted\n");
+        return -1;
+    }
+    http_request_delete(h);
+    http_connection_delete(h);
+    pthread_join(thread, NULL);
+    close(srv.listen_fd);
+    if (srv.max_batch < 2) {
+        printf("Fail\n");
+        printf("Requests were not pipelined: at most %d requests per batch\n", srv.max_batch);
+        return -1;
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_local_stray_crlf()
+{
+    printf("test: stray CRLF after a response, without pipelining ....");
+    struct pipeline_server srv = {
+        .trailer = "\r\n",
+    };
+    pthread_t thread;
+    if (pipeline_server_start(&srv, &thread) != 0) {
+        printf("Fail, couldn't start local server\n");
+        return -1;
+    }
+    httpc_conn_t *h = pipeline_server_connect(&srv);
+    if (!h) {
+        printf("Fail, couldn't open connection\n");
+        return -1;
+    }
+    static const char *paths[] = { "/a", "/b", "/c" };
+    for (int i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        char resp[256];
+        char expected[128];
+        if (http_request_new(h, ESP_HTTP_GET, paths[i]) != 0 || http_request_send(h, NULL, 0) != 0 ||
+                recv_full_response(h, resp, sizeof(resp)) < 0 || validate_status_code(h, 200)) {
+            printf("Fail\n");
+            printf("Couldn't read the response for %s\n", paths[i]);
+            return -1;
+        }
+        snprintf(expected, sizeof(expected), "response to %s, request %d on this connection", paths[i], i);
+        if (strcmp(resp, expected)) {
+            printf("Fail\n");
+            printf("Expected \"%s\", got \"%s\"\n", expected, resp);
+            return -1;
+        }
+        http_request_delete(h);
+    }
+    http_connection_delete(h);
+    pthread_join(thread, NULL);
+    close(srv.listen_fd);
+    printf("Success\n");
+    return 0;
+}
+
+static int test_local_pipeline_dropped()
+{
+    printf("test: server closes the connection with pipelined requests pending ....");
+    struct pipeline_server srv = {
+        .close_after = 1,
+    };
+    pthread_t thread;
+    if (pipeline_server_start(&srv, &thread) != 0) {
+        printf("Fail, couldn't start local server\n");
+        return -1;
+    }
+    httpc_conn_t *h = pipeline_server_connect(&srv);
+    if (!h) {
+        printf("Fail, couldn't open connection\n");
+        return -1;
+    }
+    char resp[256];
+    http_request_new(h, ESP_HTTP_GET, "/a");
+    http_request_send(h, NULL, 0);
+    if (http_request_pipeline(h, "/b") != 0 || recv_full_response(h, resp, sizeof(resp)) < 0) {
+        printf("Fail\n");
+        printf("Couldn't read the response for /a\n");
+        return -1;
+    }
+    http_request_delete(h);
+    /* The caller sees the failure on the pipelined request, and may send it again on a new connection */
+    if (http_request_new(h, ESP_HTTP_GET, "/b") != 0 || http_request_send(h, NULL, 0) != 0 ||
+            recv_full_response(h, resp, sizeof(resp)) >= 0) {
+        printf("Fail\n");
+        printf("Unanswered pipelined request did not fail\n");
+        return -1;
+    }
+    http_request_delete(h);
+    http_connection_delete(h);
+    pthread_join(thread, NULL);
+    close(srv.listen_fd);
+    printf("Success\n");
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    return test_local_pipelining() || test_local_stray_crlf() || test_local_pipeline_dropped();
+}
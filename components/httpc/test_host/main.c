@@ -336,6 +336,40 @@ static int test_postman_send_custom_hdrs()
     return 0;
 }
 
+static int test_postman_post()
+{
+    printf("test: POST https://postman-echo.com/post (headers and body in one write) ....");
+    esp_tls_cfg_t tls_cfg;
+    memset(&tls_cfg, 0, sizeof(tls_cfg));
+    httpc_conn_t *h = http_connection_new("https://postman-echo.com", &tls_cfg);
+    if (!h) {
+        printf("Fail, couldn't open connection\n");
+        return -1;
+    }
+    const char *data = "a=b&c=d";
+    http_request_new(h, ESP_HTTP_POST, "/post");
+    http_request_send(h, data, strlen(data));
+    char buf[700];
+    int data_read, total_data_read = 0;
+    while ((data_read = http_response_recv(h, buf + total_data_read, sizeof(buf) - total_data_read - 1)) > 0) {
+        total_data_read += data_read;
+    }
+    buf[total_data_read] = '\0';
+
+    if (validate_status_code(h, 200)) {
+        return -1;
+    }
+    if (!strstr(buf, "\"form\":{\"a\":\"b\",\"c\":\"d\"}")) {
+        printf("Fail\n");
+        printf("Form data not echoed: %s\n", buf);
+        return -1;
+    }
+    printf("Success\n");
+    http_request_delete(h);
+    http_connection_delete(h);
+    return 0;
+}
+
 static int test_postman_http_get()
 {
     printf("test: GET http://postman-echo.com/get ....");
@@ -487,6 +521,7 @@ int main_test_func()
     test_postman_get_multi();
     test_postman_get_with_full_path();
     test_postman_send_custom_hdrs();
+    test_postman_post();
     test_postman_get_multi_with_header_fetch();
     test_validate_header_values();
     return 0;
@@ -0,0 +1,93 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+
+#include <esp_tls.h>
+
+static int tcp_connect(const char *hostname, int hostlen, int port)
+{
+    char host[64];
+    char service[8];
+    if (hostlen >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, hostname, hostlen);
+    host[hostlen] = '\0';
+    snprintf(service, sizeof(service), "%d", port);
+
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res;
+    if (getaddrinfo(host, service, &hints, &res) != 0) {
+        return -1;
+    }
+    int fd = socket(res->ai_family, res->ai_socktype, 0);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+struct esp_tls *esp_tls_conn_new(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg)
+{
+    if (cfg) {
+        return NULL;
+    }
+    int fd = tcp_connect(hostname, hostlen, port);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct esp_tls *tls = calloc(1, sizeof(struct esp_tls));
+    tls->sockfd = fd;
+    return tls;
+}
+
+int esp_tls_conn_new_async(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg,
+                           struct esp_tls *tls)
+{
+    if (cfg) {
+        return -1;
+    }
+    tls->sockfd = tcp_connect(hostname, hostlen, port);
+    return (tls->sockfd < 0) ? -1 : 1;
+}
+
+void esp_tls_conn_delete(struct esp_tls *tls)
+{
+    if (tls) {
+        if (tls->sockfd >= 0) {
+            close(tls->sockfd);
+        }
+        free(tls);
+    }
+}
+
+ssize_t esp_tls_conn_write(struct esp_tls *tls, const void *data, size_t datalen)
+{
+    return send(tls->sockfd, data, datalen, MSG_NOSIGNAL);
+}
+
+ssize_t esp_tls_conn_read(struct esp_tls *tls, void *data, size_t datalen)
+{
+    return recv(tls->sockfd, data, datalen, 0);
+}
@@ -0,0 +1,28 @@
+#pragma once
+/* Host stand-in for esp-tls: plain TCP connections only, enough for tests against a local server */
+#include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define MBEDTLS_ERR_SSL_WANT_READ   -0x6900
+
+typedef struct esp_tls_cfg {
+    bool use_global_ca_store;
+} esp_tls_cfg_t;
+
+struct esp_tls {
+    int sockfd;
+};
+
+/* A non NULL `cfg` asks for TLS, which fails */
+struct esp_tls *esp_tls_conn_new(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg);
+/* Connects right away: returns 1 on success, -1 on failure */
+int esp_tls_conn_new_async(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg,
+                           struct esp_tls *tls);
+void esp_tls_conn_delete(struct esp_tls *tls);
+ssize_t esp_tls_conn_write(struct esp_tls *tls, const void *data, size_t datalen);
+ssize_t esp_tls_conn_read(struct esp_tls *tls, void *data, size_t datalen);
@@ -0,0 +1,207 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+#include <http_parser.h>
+
+enum {
+    ST_START,       /* Before a response: stray CR and LF are skipped */
+    ST_STATUS,
+    ST_HEADER,
+    ST_BODY,
+    ST_BODY_EOF,    /* No Content-Length: the body ends with the connection */
+};
+
+#define NO_CONTENT_LENGTH   UINT64_MAX
+
+void http_parser_init(http_parser *parser, enum http_parser_type type)
+{
+    void *data = parser->data;
+    memset(parser, 0, sizeof(*parser));
+    parser->data = data;
+}
+
+void http_parser_pause(http_parser *parser, int paused)
+{
+    if (parser->http_errno == HPE_OK || parser->http_errno == HPE_PAUSED) {
+        parser->http_errno = paused ? HPE_PAUSED : HPE_OK;
+    }
+}
+
+static int message_complete(http_parser *parser, const http_parser_settings *settings)
+{
+    parser->state = ST_START;
+    if (settings->on_message_complete && settings->on_message_complete(parser)) {
+        parser->http_errno = HPE_CB_message_complete;
+    }
+    return parser->http_errno != HPE_OK;
+}
+
+/* A complete status or header line, without its CRLF. Returns non 0 to stop. */
+static int parse_line(http_parser *parser, const http_parser_settings *settings)
+{
+    char *line = parser->line;
+    if (parser->state == ST_STATUS) {
+        if (strncmp(line, "HTTP/1.", 7) || parser->line_len < 12) {
+            parser->http_errno = HPE_INVALID_STATUS;
+            return 1;
+        }
+        parser->status_code = atoi(line + 9);
+        parser->content_length = NO_CONTENT_LENGTH;
+        parser->state = ST_HEADER;
+        return 0;
+    }
+    if (parser->line_len == 0) {
+        if (settings->on_headers_complete && settings->on_headers_complete(parser)) {
+            parser->http_errno = HPE_CB_headers_complete;
+            return 1;
+        }
+        if (parser->content_length == NO_CONTENT_LENGTH) {
+            parser->state = ST_BODY_EOF;
+            return 0;
+        }
+        parser->body_left = parser->content_length;
+        parser->state = ST_BODY;
+        return (parser->body_left == 0) ? message_complete(parser, settings) : 0;
+    }
+    char *value = strchr(line, ':');
+    if (!value) {
+        return 0;
+    }
+    *value++ = '\0';
+    while (*value == ' ') {
+        value++;
+    }
+    if (strcasecmp(line, "Content-Length") == 0) {
+        parser->content_length = strtoull(value, NULL, 10);
+    }
+    if (settings->on_header_field) {
+        settings->on_header_field(parser, line, strlen(line));
+    }
+    if (settings->on_header_value) {
+        settings->on_header_value(parser, value, strlen(value));
+    }
+    return 0;
+}
+
+size_t http_parser_execute(http_parser *parser, const http_parser_settings *settings, const char *data, size_t len)
+{
+    if (parser->http_errno != HPE_OK) {
+        return 0;
+    }
+    if (len == 0) {
+        /* End of the connection */
+        if (parser->state == ST_BODY_EOF) {
+            message_complete(parser, settings);
+        } else if (parser->state != ST_START) {
+            parser->http_errno = HPE_INVALID_EOF_STATE;
+            return 1;
+        }
+        return 0;
+    }
+    size_t i = 0;
+    while (i < len) {
+        if (parser->state == ST_BODY || parser->state == ST_BODY_EOF) {
+            size_t n = len - i;
+            if (parser->state == ST_BODY && n > parser->body_left) {
+                n = parser->body_left;
+            }
+            if (settings->on_body) {
+                settings->on_body(parser, data + i, n);
+            }
+            i += n;
+            if (parser->state == ST_BODY) {
+                parser->body_left -= n;
+                if (parser->body_left == 0 && message_complete(parser, settings)) {
+                    return i;
+                }
+            }
+            continue;
+        }
+        char c = data[i++];
+        if (parser->state == ST_START) {
+            if (c == '\r' || c == '\n') {
+                continue;
+            }
+            parser->state = ST_STATUS;
+        }
+        if (c == '\r') {
+            continue;
+        }
+        if (c != '\n') {
+            if (parser->line_len == sizeof(parser->line) - 1) {
+                parser->http_errno = HPE_HEADER_OVERFLOW;
+                return i - 1;
+            }
+            parser->line[parser->line_len++] = c;
+            continue;
+        }
+        parser->line[parser->line_len] = '\0';
+        int stop = parse_line(parser, settings);
+        parser->line_len = 0;
+        if (stop) {
+            return (parser->http_errno == HPE_PAUSED) ? i : i - 1;
+        }
+    }
+    return i;
+}
+
+void http_parser_url_init(struct http_parser_url *u)
+{
+    memset(u, 0, sizeof(*u));
+}
+
+static void url_field(struct http_parser_url *u, int field, const char *buf, const char *start, const char *end)
+{
+    u->field_set |= 1 << field;
+    u->field_data[field].off = start - buf;
+    u->field_data[field].len = end - start;
+}
+
+/* scheme://host[:port][/path][?query] */
+int http_parser_parse_url(const char *buf, size_t buflen, int is_connect, struct http_parser_url *u)
+{
+    const char *end = buf + buflen;
+    const char *p = strstr(buf, "://");
+    if (!p || p >= end) {
+        return 1;
+    }
+    url_field(u, UF_SCHEMA, buf, buf, p);
+    const char *host = p + 3;
+    for (p = host; p < end && *p != ':' && *p != '/' && *p != '?'; p++) {
+    }
+    url_field(u, UF_HOST, buf, host, p);
+    if (p < end && *p == ':') {
+        const char *port = ++p;
+        while (p < end && *p != '/' && *p != '?') {
+            p++;
+        }
+        url_field(u, UF_PORT, buf, port, p);
+        u->port = strtoul(port, NULL, 10);
+    }
+    if (p < end && *p == '/') {
+        const char *path = p;
+        while (p < end && *p != '?') {
+            p++;
+        }
+        url_field(u, UF_PATH, buf, path, p);
+    }
+    if (p < end && *p == '?') {
+        url_field(u, UF_QUERY, buf, p + 1, end);
+    }
+    return 0;
+}
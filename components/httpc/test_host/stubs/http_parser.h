@@ -0,0 +1,78 @@
+#pragma once
+/* Host stand-in for the http_parser of IDF's nghttp component, with the part of its API that httpc uses.
+ * Responses only: status line, headers and Content-Length bodies (or bodies up to the end of the connection).
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+enum http_parser_type {
+    HTTP_REQUEST,
+    HTTP_RESPONSE,
+};
+
+enum http_errno {
+    HPE_OK,
+    HPE_CB_headers_complete,
+    HPE_CB_message_complete,
+    HPE_INVALID_STATUS,
+    HPE_INVALID_EOF_STATE,
+    HPE_HEADER_OVERFLOW,
+    HPE_PAUSED,
+};
+
+#define HTTP_PARSER_ERRNO(p)    ((enum http_errno) (p)->http_errno)
+
+enum http_parser_url_fields {
+    UF_SCHEMA,
+    UF_HOST,
+    UF_PORT,
+    UF_PATH,
+    UF_QUERY,
+    UF_FRAGMENT,
+    UF_USERINFO,
+    UF_MAX,
+};
+
+struct http_parser_url {
+    uint16_t field_set;
+    uint16_t port;
+    struct {
+        uint16_t off;
+        uint16_t len;
+    } field_data[UF_MAX];
+};
+
+typedef struct http_parser {
+    unsigned int status_code;
+    unsigned int http_errno;
+    uint64_t content_length;
+    void *data;
+
+    /* Private */
+    int state;
+    uint64_t body_left;
+    char line[256];
+    size_t line_len;
+} http_parser;
+
+typedef int (*http_data_cb)(http_parser *, const char *at, size_t length);
+typedef int (*http_cb)(http_parser *);
+
+typedef struct http_parser_settings {
+    http_cb on_message_begin;
+    http_data_cb on_url;
+    http_data_cb on_status;
+    http_data_cb on_header_field;
+    http_data_cb on_header_value;
+    http_cb on_headers_complete;
+    http_data_cb on_body;
+    http_cb on_message_complete;
+    http_cb on_chunk_header;
+    http_cb on_chunk_complete;
+} http_parser_settings;
+
+void http_parser_init(http_parser *parser, enum http_parser_type type);
+size_t http_parser_execute(http_parser *parser, const http_parser_settings *settings, const char *data, size_t len);
+void http_parser_pause(http_parser *parser, int paused);
+void http_parser_url_init(struct http_parser_url *u);
+int http_parser_parse_url(const char *buf, size_t buflen, int is_connect, struct http_parser_url *u);
@@ -70,6 +70,8 @@ enum jsmnerr {
  * @param       type    type (object, array, string etc.)
  * @param       start   start position in JSON data string
  * @param       end     end position in JSON data string
+ * @param       next    number of tokens in this token's subtree, including itself,
+ *                      i.e. offset to the next sibling. Filled in by json_parser.
  */
 typedef struct {
     _jsmntype_t type;
@@ -79,6 +81,7 @@ typedef struct {
 #ifdef JSMN_PARENT_LINKS
     int parent;
 #endif
+    int next;
 } _jsmntok_t;
 
 /**
@@ -22,20 +22,37 @@
 
 static bool token_matches_str(jparse_ctx_t *ctx, json_tok_t *tok, char *str)
 {
-    char *js = ctx->js;
-    return ((strncmp(js + tok->start, str, strlen(str)) == 0)
-            && (strlen(str) == (size_t) (tok->end - tok->start)));
+    size_t len = strlen(str);
+    return ((len == (size_t) (tok->end - tok->start))
+            && (memcmp(ctx->js + tok->start, str, len) == 0));
 }
 
+/* Returns the last token of the element's subtree */
 static json_tok_t *json_skip_elem(json_tok_t *token)
 {
-    json_tok_t *cur = token;
-    int cnt = cur->size;
-    while (cnt--) {
-        cur++;
-        cur = json_skip_elem(cur);
+    return token + token->next - 1;
+}
+
+/**
+ * Fill in `next` (subtree size) for all tokens, so that skipping an element is O(1).
+ *
+ * Tokens are in pre-order, so walking backwards every child is seen before its parent and the
+ * first child seen is the last one. `next` temporarily holds the absolute end of the subtree
+ * until the token itself is reached.
+ */
+static void json_index_tokens(json_tok_t *tokens, int num_tokens)
+{
+    for (int i = 0; i < num_tokens; i++) {
+        tokens[i].next = 0;
+    }
+    for (int i = num_tokens - 1; i >= 0; i--) {
+        int end = tokens[i].next ? tokens[i].next : i + 1;
+        tokens[i].next = end - i;
+        int parent = tokens[i].parent;
+        if (parent >= 0 && tokens[parent].next == 0) {
+            tokens[parent].next = end;
+        }
     }
-    return cur;
 }
 
 static int json_tok_to_bool(jparse_ctx_t *jctx, json_tok_t *tok, bool *val)
@@ -94,7 +111,7 @@ static int json_tok_to_string(jparse_ctx_t *jctx, json_tok_t *tok, char *val, in
     if ((tok->end - tok->start) > (size - 1)) {
         return -OS_FAIL;
     }
-    strncpy(val, jctx->js + tok->start, tok->end - tok->start);
+    memcpy(val, jctx->js + tok->start, tok->end - tok->start);
     val[tok->end - tok->start] = 0;
     return OS_SUCCESS;
 }
@@ -241,6 +258,17 @@ int json_obj_get_strlen(jparse_ctx_t *jctx, char *name, int *strlen)
     return OS_SUCCESS;
 }
 
+int json_obj_get_strview(jparse_ctx_t *jctx, char *name, char **str, int *len)
+{
+    json_tok_t *tok = json_obj_get_val_tok(jctx, name, JSMN_STRING);
+    if (!tok) {
+        return -OS_FAIL;
+    }
+    *str = jctx->js + tok->start;
+    *len = tok->end - tok->start;
+    return OS_SUCCESS;
+}
+
 int json_obj_get_object_str(jparse_ctx_t *jctx, char *name, char *val, int size)
 {
 	json_tok_t *tok = json_obj_get_val_tok(jctx, name, JSMN_OBJECT);
@@ -396,29 +424,187 @@ int json_arr_get_strlen(jparse_ctx_t *jctx, uint32_t index, int *strlen)
     return OS_SUCCESS;
 }
 
-int json_parse_start(jparse_ctx_t *jctx, char *js, int len)
+int json_arr_get_strview(jparse_ctx_t *jctx, uint32_t index, char **str, int *len)
 {
-    memset(jctx, 0, sizeof(jparse_ctx_t));
-    __jsmn_init(&jctx->parser);
-    int num_tokens = __jsmn_parse(&jctx->parser, js, len, NULL, 0);
-    if (num_tokens <= 0) {
+    json_tok_t *tok = json_arr_get_val_tok(jctx, index, JSMN_STRING);
+    if (!tok) {
         return -OS_FAIL;
     }
-    jctx->num_tokens = num_tokens;
-    jctx->tokens = calloc(num_tokens, sizeof(json_tok_t));
-    if (!jctx->tokens) {
-        return -OS_FAIL;
+    *str = jctx->js + tok->start;
+    *len = tok->end - tok->start;
+    return OS_SUCCESS;
+}
+
+static int json_hex_val(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static int json_parse_hex4(const char *s, uint32_t *val)
+{
+    *val = 0;
+    for (int i = 0; i < 4; i++) {
+        int h = json_hex_val(s[i]);
+        if (h < 0) {
+            return -OS_FAIL;
+        }
+        *val = (*val << 4) | h;
+    }
+    return OS_SUCCESS;
+}
+
+static int json_put_utf8(char *out, uint32_t cp)
+{
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = 0xc0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = 0xe0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3f);
+        out[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3f);
+    out[2] = 0x80 | ((cp >> 6) & 0x3f);
+    out[3] = 0x80 | (cp & 0x3f);
+    return 4;
+}
+
+int json_unescape_str(char *str, int len)
+{
+    char *end = str + len;
+    char *in = memchr(str, '\\', len);
+    if (!in) {
+        return len;
+    }
+    /* The decoded form of every escape is shorter than the escape, so this works in place */
+    char *out = in;
+    while (in < end) {
+        if (*in != '\\') {
+            *out++ = *in++;
+            continue;
+        }
+        if (++in == end) {
+            return -OS_FAIL;
+        }
+        char c = *in++;
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            *out++ = c;
+            break;
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case 'u': {
+            uint32_t cp, low;
+            if (end - in < 4 || json_parse_hex4(in, &cp) != OS_SUCCESS) {
+                return -OS_FAIL;
+            }
+            in += 4;
+            /* Surrogate pair */
+            if (cp >= 0xd800 && cp < 0xdc00 && end - in >= 6 && in[0] == '\\' && in[1] == 'u' &&
+                    json_parse_hex4(in + 2, &low) == OS_SUCCESS && low >= 0xdc00 && low < 0xe000) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                in += 6;
+            }
+            out += json_put_utf8(out, cp);
+            break;
+        }
+        default:
+            return -OS_FAIL;
+        }
     }
-    jctx->js = js;
+    return out - str;
+}
+
+/* Initial token array size for json_parse_start: roughly one token per 16 bytes of JSON */
+#define JSON_TOKENS_PER_BYTE_SHIFT  4
+#define JSON_MIN_TOKENS             16
+
+/**
+ * Tokenize `js` in a single pass.
+ *
+ * Parsing starts with `tokens` (heap allocated if `tokens_on_heap`, else owned by the caller).
+ * If jsmn runs out of tokens, the array is grown on the heap and parsing resumes where it stopped.
+ */
+static int json_parse_tokens(jparse_ctx_t *jctx, char *js, int len, json_tok_t *tokens, int num_tokens, bool tokens_on_heap)
+{
+    memset(jctx, 0, sizeof(jparse_ctx_t));
     __jsmn_init(&jctx->parser);
-    int ret = __jsmn_parse(&jctx->parser, js, len, jctx->tokens, jctx->num_tokens);
-    if (ret <= 0) {
-        free(jctx->tokens);
+    while (1) {
+        int ret = __jsmn_parse(&jctx->parser, js, len, tokens, num_tokens);
+        if (ret > 0) {
+            json_index_tokens(tokens, ret);
+            jctx->js = js;
+            jctx->tokens = tokens;
+            jctx->num_tokens = ret;
+            jctx->cur = jctx->tokens;
+            return OS_SUCCESS;
+        }
+        if (ret != JSMN_ERROR_NOMEM) {
+            break;
+        }
+        int new_num_tokens = num_tokens * 2;
+        json_tok_t *new_tokens;
+        if (tokens_on_heap) {
+            new_tokens = realloc(tokens, new_num_tokens * sizeof(json_tok_t));
+        } else {
+            new_tokens = malloc(new_num_tokens * sizeof(json_tok_t));
+            if (new_tokens) {
+                memcpy(new_tokens, tokens, num_tokens * sizeof(json_tok_t));
+            }
+        }
+        if (!new_tokens) {
+            break;
+        }
+        tokens = new_tokens;
+        num_tokens = new_num_tokens;
+        tokens_on_heap = true;
+    }
+    if (tokens_on_heap) {
+        free(tokens);
+    }
+    memset(jctx, 0, sizeof(jparse_ctx_t));
+    return -OS_FAIL;
+}
+
+int json_parse_start(jparse_ctx_t *jctx, char *js, int len)
+{
+    int num_tokens = (len >> JSON_TOKENS_PER_BYTE_SHIFT) + JSON_MIN_TOKENS;
+    json_tok_t *tokens = malloc(num_tokens * sizeof(json_tok_t));
+    if (!tokens) {
         memset(jctx, 0, sizeof(jparse_ctx_t));
         return -OS_FAIL;
     }
-    jctx->cur = jctx->tokens;
-    return OS_SUCCESS;
+    return json_parse_tokens(jctx, js, len, tokens, num_tokens, true);
 }
 
 int json_parse_end(jparse_ctx_t *jctx)
@@ -429,3 +615,21 @@ int json_parse_end(jparse_ctx_t *jctx)
     memset(jctx, 0, sizeof(jparse_ctx_t));
     return OS_SUCCESS;
 }
+
+int json_parse_start_static(jparse_ctx_t *jctx, char *js, int len, json_tok_t *tokens, int num_tokens)
+{
+    if (!tokens || num_tokens <= 0) {
+        return json_parse_start(jctx, js, len);
+    }
+    return json_parse_tokens(jctx, js, len, tokens, num_tokens, false);
+}
+
+int json_parse_end_static(jparse_ctx_t *jctx, json_tok_t *tokens)
+{
+    if (jctx->tokens && jctx->tokens != tokens) {
+        /* Pool was too small and parsing moved to the heap */
+        free(jctx->tokens);
+    }
+    memset(jctx, 0, sizeof(jparse_ctx_t));
+    return OS_SUCCESS;
+}
@@ -36,6 +36,11 @@ typedef struct {
 int json_parse_start(jparse_ctx_t *jctx, char *js, int len);
 int json_parse_end(jparse_ctx_t *jctx);
 
+/* Same as json_parse_start, but tokens go into the caller's `tokens` array. Grows on the heap only if it overflows.
+ * Must be paired with json_parse_end_static with the same array. */
+int json_parse_start_static(jparse_ctx_t *jctx, char *js, int len, json_tok_t *tokens, int num_tokens);
+int json_parse_end_static(jparse_ctx_t *jctx, json_tok_t *tokens);
+
 int json_obj_get_array(jparse_ctx_t *jctx, char *name, int *num_elem);
 int json_obj_leave_array(jparse_ctx_t *jctx);
 int json_obj_get_object(jparse_ctx_t *jctx, char *name);
@@ -46,6 +51,8 @@ int json_obj_get_int64(jparse_ctx_t *jctx, char *name, int64_t *val);
 int json_obj_get_float(jparse_ctx_t *jctx, char *name, float *val);
 int json_obj_get_string(jparse_ctx_t *jctx, char *name, char *val, int size);
 int json_obj_get_strlen(jparse_ctx_t *jctx, char *name, int *strlen);
+/* Points `str` at the string inside the JSON buffer, without copying. `str` is not NUL terminated. */
+int json_obj_get_strview(jparse_ctx_t *jctx, char *name, char **str, int *len);
 int json_obj_get_object_str(jparse_ctx_t *jctx, char *name, char *val, int size);
 int json_obj_get_object_strlen(jparse_ctx_t *jctx, char *name, int *strlen);
 int json_obj_get_array_str(jparse_ctx_t *jctx, char *name, char *val, int size);
@@ -61,5 +68,10 @@ int json_arr_get_int64(jparse_ctx_t *jctx, uint32_t index, int64_t *val);
 int json_arr_get_float(jparse_ctx_t *jctx, uint32_t index, float *val);
 int json_arr_get_string(jparse_ctx_t *jctx, uint32_t index, char *val, int size);
 int json_arr_get_strlen(jparse_ctx_t *jctx, uint32_t index, int *strlen);
+int json_arr_get_strview(jparse_ctx_t *jctx, uint32_t index, char **str, int *len);
+
+/* Decode JSON escapes of a string view in place. Returns the new length, or -OS_FAIL for an invalid escape.
+ * This modifies the JSON buffer: read a string only once after unescaping it. */
+int json_unescape_str(char *str, int len);
 
 #endif /* _JSON_PARSER_H_ */
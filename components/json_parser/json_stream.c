@@ -0,0 +1,329 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <json_stream.h>
+
+enum {
+    ST_VALUE,               /* Expecting a value */
+    ST_VALUE_OR_END,        /* After '[' */
+    ST_MEMBER,              /* After ',' in an object */
+    ST_MEMBER_OR_END,       /* After '{' */
+    ST_KEY,                 /* Inside a member name */
+    ST_COLON,
+    ST_STRING,
+    ST_PRIMITIVE,
+    ST_NEXT,                /* After a value: ',' or the end of the container */
+    ST_DONE,
+    ST_ERROR,
+};
+
+enum {
+    LEVEL_OBJECT,
+    LEVEL_ARRAY,
+};
+
+#define IS_WS(c)    ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+
+static int json_stream_fail(json_stream_ctx_t *ctx)
+{
+    ctx->state = ST_ERROR;
+    return -OS_FAIL;
+}
+
+static int json_stream_emit(json_stream_ctx_t *ctx, json_stream_event_t event, const char *val, int len)
+{
+    ctx->path[ctx->path_len] = '\0';
+    if (ctx->cb(ctx->arg, event, ctx->path, val, len) != 0) {
+        return json_stream_fail(ctx);
+    }
+    return OS_SUCCESS;
+}
+
+/* Extend the path with the name of the value that is starting: ".key" or "[index]" */
+static int json_stream_value_begin(json_stream_ctx_t *ctx)
+{
+    ctx->value_path_len = ctx->path_len;
+    if (ctx->depth == 0) {
+        return OS_SUCCESS;
+    }
+    json_stream_level_t *level = &ctx->levels[ctx->depth - 1];
+    int avail = JSON_STREAM_MAX_PATH - ctx->path_len;
+    int n;
+    if (level->type == LEVEL_OBJECT) {
+        char *p = ctx->path + ctx->path_len;
+        n = ctx->key_len + (ctx->path_len ? 1 : 0);
+        if (n >= avail) {
+            return json_stream_fail(ctx);
+        }
+        if (ctx->path_len) {
+            *p++ = '.';
+        }
+        memcpy(p, ctx->key, ctx->key_len);
+    } else {
+        n = snprintf(ctx->path + ctx->path_len, avail, "[%d]", level->index);
+        if (n >= avail) {
+            return json_stream_fail(ctx);
+        }
+    }
+    ctx->path_len += n;
+    return OS_SUCCESS;
+}
+
+static void json_stream_value_end(json_stream_ctx_t *ctx)
+{
+    ctx->path_len = ctx->value_path_len;
+    if (ctx->depth == 0) {
+        ctx->state = ST_DONE;
+        return;
+    }
+    json_stream_level_t *level = &ctx->levels[ctx->depth - 1];
+    if (level->type == LEVEL_ARRAY) {
+        level->index++;
+    }
+    ctx->state = ST_NEXT;
+}
+
+static int json_stream_open(json_stream_ctx_t *ctx, int type)
+{
+    if (json_stream_value_begin(ctx) != OS_SUCCESS) {
+        return -OS_FAIL;
+    }
+    if (ctx->depth == JSON_STREAM_MAX_DEPTH) {
+        return json_stream_fail(ctx);
+    }
+    json_stream_level_t *level = &ctx->levels[ctx->depth++];
+    level->type = type;
+    level->path_len = ctx->value_path_len;
+    level->index = 0;
+    ctx->state = (type == LEVEL_OBJECT) ? ST_MEMBER_OR_END : ST_VALUE_OR_END;
+    return json_stream_emit(ctx, (type == LEVEL_OBJECT) ? JSON_STREAM_OBJECT_START : JSON_STREAM_ARRAY_START, NULL, 0);
+}
+
+static int json_stream_close(json_stream_ctx_t *ctx, int type)
+{
+    if (ctx->depth == 0 || ctx->levels[ctx->depth - 1].type != type) {
+        return json_stream_fail(ctx);
+    }
+    if (json_stream_emit(ctx, (type == LEVEL_OBJECT) ? JSON_STREAM_OBJECT_END : JSON_STREAM_ARRAY_END, NULL, 0) != OS_SUCCESS) {
+        return -OS_FAIL;
+    }
+    ctx->value_path_len = ctx->levels[--ctx->depth].path_len;
+    json_stream_value_end(ctx);
+    return OS_SUCCESS;
+}
+
+static int json_stream_value_start(json_stream_ctx_t *ctx, char c)
+{
+    if (c == '{') {
+        return json_stream_open(ctx, LEVEL_OBJECT);
+    }
+    if (c == '[') {
+        return json_stream_open(ctx, LEVEL_ARRAY);
+    }
+    if (json_stream_value_begin(ctx) != OS_SUCCESS) {
+        return -OS_FAIL;
+    }
+    ctx->val_len = 0;
+    if (c == '"') {
+        ctx->escape = false;
+        ctx->state = ST_STRING;
+        return OS_SUCCESS;
+    }
+    if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+        ctx->val[ctx->val_len++] = c;
+        ctx->state = ST_PRIMITIVE;
+        return OS_SUCCESS;
+    }
+    return json_stream_fail(ctx);
+}
+
+static int json_stream_flush_val(json_stream_ctx_t *ctx, json_stream_event_t event)
+{
+    ctx->val[ctx->val_len] = '\0';
+    int ret = json_stream_emit(ctx, event, ctx->val, ctx->val_len);
+    ctx->val_len = 0;
+    return ret;
+}
+
+/**
+ * Copy string bytes from `data` into `buf` until the closing quote.
+ * Returns the number of bytes consumed, including the quote if found (*closed is then set).
+ */
+static int json_stream_scan_string(json_stream_ctx_t *ctx, const char *data, int len, char *buf, int *buf_len, int buf_size, bool *closed)
+{
+    int i = 0;
+    *closed = false;
+    while (i < len && *buf_len < buf_size) {
+        char c = data[i++];
+        if (ctx->escape) {
+            ctx->escape = false;
+        } else if (c == '\\') {
+            ctx->escape = true;
+        } else if (c == '"') {
+            *closed = true;
+            return i;
+        } else if ((unsigned char) c < 0x20) {
+            return -1;
+        }
+        buf[(*buf_len)++] = c;
+    }
+    return i;
+}
+
+int json_stream_init(json_stream_ctx_t *ctx, char *val_buf, int val_size, json_stream_cb_t cb, void *arg)
+{
+    /* Room for the NUL terminator and at least a short primitive */
+    if (!ctx || !val_buf || val_size < 8 || !cb) {
+        return -OS_FAIL;
+    }
+    memset(ctx, 0, sizeof(json_stream_ctx_t));
+    ctx->cb = cb;
+    ctx->arg = arg;
+    ctx->val = val_buf;
+    ctx->val_size = val_size;
+    ctx->state = ST_VALUE;
+    return OS_SUCCESS;
+}
+
+int json_stream_parse(json_stream_ctx_t *ctx, const char *data, int len)
+{
+    int i = 0;
+    while (i < len) {
+        char c = data[i];
+        switch (ctx->state) {
+        case ST_STRING: {
+            bool closed;
+            int n = json_stream_scan_string(ctx, data + i, len - i, ctx->val, &ctx->val_len, ctx->val_size - 1, &closed);
+            if (n < 0) {
+                return json_stream_fail(ctx);
+            }
+            i += n;
+            if (closed) {
+                if (json_stream_flush_val(ctx, JSON_STREAM_STRING) != OS_SUCCESS) {
+                    return -OS_FAIL;
+                }
+                json_stream_value_end(ctx);
+            } else if (ctx->val_len == ctx->val_size - 1) {
+                if (json_stream_flush_val(ctx, JSON_STREAM_STRING_PART) != OS_SUCCESS) {
+                    return -OS_FAIL;
+                }
+            }
+            continue;
+        }
+        case ST_KEY: {
+            bool closed;
+            int n = json_stream_scan_string(ctx, data + i, len - i, ctx->key, &ctx->key_len, JSON_STREAM_MAX_KEY, &closed);
+            if (n < 0) {
+                return json_stream_fail(ctx);
+            }
+            i += n;
+            if (closed) {
+                ctx->state = ST_COLON;
+            } else if (ctx->key_len == JSON_STREAM_MAX_KEY) {
+                return json_stream_fail(ctx);
+            }
+            continue;
+        }
+        case ST_PRIMITIVE:
+            if (c == ',' || c == '}' || c == ']' || IS_WS(c)) {
+                /* Delimiter is handled in ST_NEXT */
+                if (json_stream_flush_val(ctx, JSON_STREAM_PRIMITIVE) != OS_SUCCESS) {
+                    return -OS_FAIL;
+                }
+                json_stream_value_end(ctx);
+                continue;
+            }
+            if (ctx->val_len == ctx->val_size - 1 || (unsigned char) c < 0x20 || c == '"' || c == ':' || c == '{' || c == '[') {
+                return json_stream_fail(ctx);
+            }
+            ctx->val[ctx->val_len++] = c;
+            break;
+        case ST_ERROR:
+            return -OS_FAIL;
+        default:
+            if (IS_WS(c)) {
+                break;
+            }
+            switch (ctx->state) {
+            case ST_VALUE_OR_END:
+                if (c == ']') {
+                    if (json_stream_close(ctx, LEVEL_ARRAY) != OS_SUCCESS) {
+                        return -OS_FAIL;
+                    }
+                    break;
+                }
+            /* Fall through */
+            case ST_VALUE:
+                if (json_stream_value_start(ctx, c) != OS_SUCCESS) {
+                    return -OS_FAIL;
+                }
+                break;
+            case ST_MEMBER_OR_END:
+                if (c == '}') {
+                    if (json_stream_close(ctx, LEVEL_OBJECT) != OS_SUCCESS) {
+                        return -OS_FAIL;
+                    }
+                    break;
+                }
+            /* Fall through */
+            case ST_MEMBER:
+                if (c != '"') {
+                    return json_stream_fail(ctx);
+                }
+                ctx->key_len = 0;
+                ctx->escape = false;
+                ctx->state = ST_KEY;
+                break;
+            case ST_COLON:
+                if (c != ':') {
+                    return json_stream_fail(ctx);
+                }
+                ctx->state = ST_VALUE;
+                break;
+            case ST_NEXT:
+                if (c == ',') {
+                    ctx->state = (ctx->levels[ctx->depth - 1].type == LEVEL_OBJECT) ? ST_MEMBER : ST_VALUE;
+                } else if (c == '}' || c == ']') {
+                    if (json_stream_close(ctx, (c == '}') ? LEVEL_OBJECT : LEVEL_ARRAY) != OS_SUCCESS) {
+                        return -OS_FAIL;
+                    }
+                } else {
+                    return json_stream_fail(ctx);
+                }
+                break;
+            default:
+                /* ST_DONE: only whitespace may follow */
+                return json_stream_fail(ctx);
+            }
+            break;
+        }
+        i++;
+    }
+    return OS_SUCCESS;
+}
+
+int json_stream_end(json_stream_ctx_t *ctx)
+{
+    if (ctx->state == ST_PRIMITIVE && ctx->depth == 0) {
+        /* A bare primitive has no delimiter */
+        if (json_stream_flush_val(ctx, JSON_STREAM_PRIMITIVE) != OS_SUCCESS) {
+            return -OS_FAIL;
+        }
+        json_stream_value_end(ctx);
+    }
+    return (ctx->state == ST_DONE) ? OS_SUCCESS : -OS_FAIL;
+}
@@ -0,0 +1,115 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Resumable, callback based JSON parser.
+ *
+ * Unlike json_parse_start, the document does not have to be in memory as a whole. Data is fed in
+ * chunks as it arrives (e.g. from the multipart data_cb) and an event is raised for every value,
+ * along with its path, e.g. "directive.payload.audioItem.stream.url" or "payload.assets[2].url".
+ * Memory use is bounded by the context and the caller's value buffer.
+ *
+ * Strings are reported raw, as in the source (escape sequences are not decoded).
+ */
+
+#ifndef _JSON_STREAM_H_
+#define _JSON_STREAM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <json_parser.h>
+
+#define JSON_STREAM_MAX_DEPTH   16
+#define JSON_STREAM_MAX_PATH    128
+#define JSON_STREAM_MAX_KEY     64
+
+typedef enum {
+    JSON_STREAM_OBJECT_START,
+    JSON_STREAM_OBJECT_END,
+    JSON_STREAM_ARRAY_START,
+    JSON_STREAM_ARRAY_END,
+    /* A piece of a string that did not fit the value buffer. More follows. */
+    JSON_STREAM_STRING_PART,
+    /* A complete string, or the last piece of one */
+    JSON_STREAM_STRING,
+    /* Number, true, false or null */
+    JSON_STREAM_PRIMITIVE,
+} json_stream_event_t;
+
+/**
+ * @brief   Event callback
+ *
+ * @param[in] arg   Argument given to json_stream_init
+ * @param[in] event Event type
+ * @param[in] path  Path of the value. "" for the root value. NUL terminated.
+ * @param[in] val   Value for string and primitive events, NUL terminated. NULL otherwise.
+ * @param[in] len   Length of val
+ *
+ * @return  0 to continue parsing, anything else to abort.
+ */
+typedef int (*json_stream_cb_t)(void *arg, json_stream_event_t event, const char *path, const char *val, int len);
+
+typedef struct {
+    uint8_t type;
+    uint8_t path_len;   /* Path length outside of this container */
+    uint16_t index;     /* Current element, for arrays */
+} json_stream_level_t;
+
+typedef struct {
+    json_stream_cb_t cb;
+    void *arg;
+    int state;
+    bool escape;
+    int depth;
+    json_stream_level_t levels[JSON_STREAM_MAX_DEPTH];
+    char path[JSON_STREAM_MAX_PATH];
+    int path_len;
+    int value_path_len;
+    char key[JSON_STREAM_MAX_KEY];
+    int key_len;
+    char *val;
+    int val_size;
+    int val_len;
+} json_stream_ctx_t;
+
+/**
+ * @brief   Initialise a streaming parse
+ *
+ * @param[in] ctx       Parser context, owned by the caller
+ * @param[in] val_buf   Buffer for string and primitive values. Longer strings are reported in pieces.
+ * @param[in] val_size  Size of val_buf
+ * @param[in] cb        Event callback
+ * @param[in] arg       Argument passed to cb
+ *
+ * @return OS_SUCCESS on success, -OS_FAIL otherwise.
+ */
+int json_stream_init(json_stream_ctx_t *ctx, char *val_buf, int val_size, json_stream_cb_t cb, void *arg);
+
+/**
+ * @brief   Feed the next chunk of the document
+ *
+ * @return OS_SUCCESS if the chunk was consumed, -OS_FAIL on malformed JSON, on exceeding the
+ *         context limits or if the callback aborted. The context is unusable after a failure.
+ */
+int json_stream_parse(json_stream_ctx_t *ctx, const char *data, int len);
+
+/**
+ * @brief   Finish the parse
+ *
+ * @return OS_SUCCESS if a complete document was parsed, -OS_FAIL otherwise.
+ */
+int json_stream_end(json_stream_ctx_t *ctx);
+
+#endif /* _JSON_STREAM_H_ */
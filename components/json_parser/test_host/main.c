@@ -0,0 +1,462 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <json_parser.h>
+#include <json_stream.h>
+
+/* Directive payloads as received from the cloud */
+static const char *corpus[] = {
+    "{\"directive\":{\"header\":{\"namespace\":\"SpeechSynthesizer\",\"name\":\"Speak\",\"messageId\":\"1f8a4a3c-5b0e-4d8e-9a0f-36b0c8e5b7a1\","
+    "\"dialogRequestId\":\"dialog-5c3e3b2a\"},\"payload\":{\"url\":\"cid:DailyBriefingPrompt.ChannelIntroduction:2b1f0c8a-9b44-4c3e\","
+    "\"format\":\"AUDIO_MPEG\",\"token\":\"amzn1.as-ct.v1.ThirdPartySdkSpeechlet#ACRI#DailyBriefingPrompt.ChannelIntroduction:2b1f0c8a\","
+    "\"caption\":{\"type\":\"WEBVTT\",\"content\":\"WEBVTT\\n\\n1\\n00:00.000 --> 00:01.500\\nHere's your Flash Briefing.\"}}}}",
+
+    "{\"directive\":{\"header\":{\"namespace\":\"AudioPlayer\",\"name\":\"Play\",\"messageId\":\"0a6c7d3e-21b9-4a73-8f19-0e0f6e2d7c44\","
+    "\"dialogRequestId\":\"dialog-9e1d\"},\"payload\":{\"playBehavior\":\"REPLACE_ALL\",\"audioItem\":{\"audioItemId\":\"item-4d0b\","
+    "\"stream\":{\"url\":\"https://example.com/stream/episode-214.mp3\",\"streamFormat\":\"AUDIO_MPEG\",\"offsetInMilliseconds\":0,"
+    "\"expiryTime\":\"2021-03-01T10:00:00+0000\",\"progressReport\":{\"progressReportDelayInMilliseconds\":15000,"
+    "\"progressReportIntervalInMilliseconds\":30000},\"token\":\"episode-214\",\"expectedPreviousToken\":\"episode-213\"}}}}}",
+
+    "{\"directive\":{\"header\":{\"namespace\":\"Alerts\",\"name\":\"SetAlert\",\"messageId\":\"7cf0d6a2-3d5e-4f1a-b0e6-5d1b7d2c9e80\"},"
+    "\"payload\":{\"token\":\"alert-0b77\",\"type\":\"ALARM\",\"scheduledTime\":\"2021-03-02T07:00:00+0000\",\"label\":\"Wake up\","
+    "\"loopCount\":2,\"loopPauseInMilliSeconds\":300,\"assets\":[{\"assetId\":\"a1\",\"url\":\"https://example.com/a1.mp3\"},"
+    "{\"assetId\":\"a2\",\"url\":\"https://example.com/a2.mp3\"},{\"assetId\":\"a3\",\"url\":\"https://example.com/a3.mp3\"}],"
+    "\"assetPlayOrder\":[\"a1\",\"a2\",\"a3\",\"a1\"],\"backgroundAlertAsset\":\"a2\"}}}",
+
+    "{\"directive\":{\"header\":{\"namespace\":\"SpeechRecognizer\",\"name\":\"ExpectSpeech\",\"messageId\":\"3e2d\",\"dialogRequestId\":\"d-1\"},"
+    "\"payload\":{\"timeoutInMilliseconds\":8000,\"initiator\":{\"type\":\"TAP\",\"payload\":{\"token\":\"t-88\"}}}}}",
+
+    "{\"directive\":{\"header\":{\"namespace\":\"Speaker\",\"name\":\"SetVolume\",\"messageId\":\"c04b\"},\"payload\":{\"volume\":45}}}",
+
+    "{\"directive\":{\"header\":{\"namespace\":\"TemplateRuntime\",\"name\":\"RenderTemplate\",\"messageId\":\"5a1e\",\"dialogRequestId\":\"d-7\"},"
+    "\"payload\":{\"token\":\"tmpl-1\",\"type\":\"WeatherTemplate\",\"title\":{\"mainTitle\":\"Seattle\",\"subTitle\":\"Tuesday\"},"
+    "\"currentWeather\":\"54\\u00b0\",\"description\":\"Mostly cloudy\",\"highTemperature\":{\"value\":\"58\\u00b0\",\"arrow\":{\"contentDescription\":\"up\"}},"
+    "\"lowTemperature\":{\"value\":\"47\\u00b0\",\"arrow\":{\"contentDescription\":\"down\"}},\"weatherForecast\":["
+    "{\"day\":\"Wed\",\"date\":\"Mar 3\",\"highTemperature\":\"60\",\"lowTemperature\":\"45\",\"image\":{\"sources\":[{\"url\":\"https://example.com/w/1.png\",\"size\":\"SMALL\"}]}},"
+    "{\"day\":\"Thu\",\"date\":\"Mar 4\",\"highTemperature\":\"57\",\"lowTemperature\":\"44\",\"image\":{\"sources\":[{\"url\":\"https://example.com/w/2.png\",\"size\":\"SMALL\"}]}},"
+    "{\"day\":\"Fri\",\"date\":\"Mar 5\",\"highTemperature\":\"55\",\"lowTemperature\":\"43\",\"image\":{\"sources\":[{\"url\":\"https://example.com/w/3.png\",\"size\":\"SMALL\"}]}},"
+    "{\"day\":\"Sat\",\"date\":\"Mar 6\",\"highTemperature\":\"61\",\"lowTemperature\":\"46\",\"image\":{\"sources\":[{\"url\":\"https://example.com/w/4.png\",\"size\":\"SMALL\"}]}}]}}}",
+};
+
+#define CORPUS_LEN  (sizeof(corpus) / sizeof(corpus[0]))
+
+/* Reference: the previous two pass json_parse_start (count, allocate exactly, parse again) */
+static int two_pass_parse(jparse_ctx_t *jctx, char *js, int len)
+{
+    memset(jctx, 0, sizeof(jparse_ctx_t));
+    __jsmn_init(&jctx->parser);
+    int num_tokens = __jsmn_parse(&jctx->parser, js, len, NULL, 0);
+    if (num_tokens <= 0) {
+        return -OS_FAIL;
+    }
+    jctx->tokens = calloc(num_tokens, sizeof(json_tok_t));
+    if (!jctx->tokens) {
+        return -OS_FAIL;
+    }
+    __jsmn_init(&jctx->parser);
+    jctx->num_tokens = __jsmn_parse(&jctx->parser, js, len, jctx->tokens, num_tokens);
+    jctx->js = js;
+    jctx->cur = jctx->tokens;
+    return OS_SUCCESS;
+}
+
+/* Reference: the previous recursive skip. Returns the last token of the element's subtree. */
+static json_tok_t *recursive_skip(json_tok_t *token)
+{
+    json_tok_t *cur = token;
+    int cnt = cur->size;
+    while (cnt--) {
+        cur++;
+        cur = recursive_skip(cur);
+    }
+    return cur;
+}
+
+static int fail(const char *what, int index)
+{
+    printf("Fail\n");
+    printf("%s: corpus entry %d\n", what, index);
+    return -1;
+}
+
+static int same_tokens(jparse_ctx_t *a, jparse_ctx_t *b)
+{
+    if (a->num_tokens != b->num_tokens) {
+        return 0;
+    }
+    for (int i = 0; i < a->num_tokens; i++) {
+        if (a->tokens[i].type != b->tokens[i].type || a->tokens[i].start != b->tokens[i].start ||
+                a->tokens[i].end != b->tokens[i].end || a->tokens[i].size != b->tokens[i].size ||
+                a->tokens[i].parent != b->tokens[i].parent) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int test_single_pass()
+{
+    printf("test: single pass ....");
+    for (int i = 0; i < CORPUS_LEN; i++) {
+        jparse_ctx_t ref, jctx;
+        char *js = (char *) corpus[i];
+        if (two_pass_parse(&ref, js, strlen(js)) != OS_SUCCESS) {
+            return fail("reference parse", i);
+        }
+        if (json_parse_start(&jctx, js, strlen(js)) != OS_SUCCESS) {
+            json_parse_end(&ref);
+            return fail("json_parse_start", i);
+        }
+        int same = same_tokens(&ref, &jctx);
+        json_parse_end(&jctx);
+        json_parse_end(&ref);
+        if (!same) {
+            return fail("token mismatch", i);
+        }
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_static_pool()
+{
+    printf("test: static pool ....");
+    json_tok_t pool[128];
+    /* Pool sizes that fit, that overflow, and that overflow several times */
+    int pool_sizes[] = {128, 16, 1};
+    for (int p = 0; p < sizeof(pool_sizes) / sizeof(pool_sizes[0]); p++) {
+        for (int i = 0; i < CORPUS_LEN; i++) {
+            jparse_ctx_t ref, jctx;
+            char *js = (char *) corpus[i];
+            two_pass_parse(&ref, js, strlen(js));
+            if (json_parse_start_static(&jctx, js, strlen(js), pool, pool_sizes[p]) != OS_SUCCESS) {
+                json_parse_end(&ref);
+                return fail("json_parse_start_static", i);
+            }
+            int same = same_tokens(&ref, &jctx);
+            int in_pool = (jctx.tokens == pool);
+            int fits = (ref.num_tokens <= pool_sizes[p]);
+            json_parse_end_static(&jctx, pool);
+            json_parse_end(&ref);
+            if (!same) {
+                return fail("token mismatch", i);
+            }
+            if (in_pool != fits) {
+                return fail("pool use", i);
+            }
+        }
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_skip_index()
+{
+    printf("test: skip index ....");
+    for (int i = 0; i < CORPUS_LEN; i++) {
+        jparse_ctx_t jctx;
+        char *js = (char *) corpus[i];
+        if (json_parse_start(&jctx, js, strlen(js)) != OS_SUCCESS) {
+            return fail("json_parse_start", i);
+        }
+        for (int t = 0; t < jctx.num_tokens; t++) {
+            json_tok_t *tok = &jctx.tokens[t];
+            if (tok + tok->next - 1 != recursive_skip(tok)) {
+                json_parse_end(&jctx);
+                return fail("subtree size", i);
+            }
+        }
+        json_parse_end(&jctx);
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_strview()
+{
+    printf("test: strview ....");
+    jparse_ctx_t jctx;
+    char js[] = "{\"a\":\"plain\",\"b\":\"q\\\"\\\\\\/\\n\\u00e9\\u20ac\\ud83d\\ude00\",\"c\":[\"x\",\"\\t\"]}";
+    char *str;
+    int len;
+    if (json_parse_start(&jctx, js, strlen(js)) != OS_SUCCESS) {
+        return fail("parse", -1);
+    }
+    if (json_obj_get_strview(&jctx, "a", &str, &len) != OS_SUCCESS || len != 5 || strncmp(str, "plain", 5) != 0 ||
+            str < js || str >= js + sizeof(js)) {
+        json_parse_end(&jctx);
+        return fail("strview", 0);
+    }
+    if (json_unescape_str(str, len) != 5) {
+        json_parse_end(&jctx);
+        return fail("unescape plain", 0);
+    }
+    if (json_obj_get_strview(&jctx, "b", &str, &len) != OS_SUCCESS || (len = json_unescape_str(str, len)) < 0 ||
+            len != 14 || memcmp(str, "q\"\\/\n\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", len) != 0) {
+        json_parse_end(&jctx);
+        return fail("unescape", 1);
+    }
+    if (json_obj_get_array(&jctx, "c", &len) != OS_SUCCESS || json_arr_get_strview(&jctx, 1, &str, &len) != OS_SUCCESS ||
+            json_unescape_str(str, len) != 1 || str[0] != '\t') {
+        json_parse_end(&jctx);
+        return fail("arr strview", 2);
+    }
+    json_obj_leave_array(&jctx);
+    char bad[] = "bad\\q";
+    if (json_unescape_str(bad, strlen(bad)) != -OS_FAIL || json_obj_get_strview(&jctx, "e", &str, &len) == OS_SUCCESS) {
+        json_parse_end(&jctx);
+        return fail("strview errors", 3);
+    }
+    json_parse_end(&jctx);
+    printf("Success\n");
+    return 0;
+}
+
+static int test_access()
+{
+    printf("test: access ....");
+    jparse_ctx_t jctx;
+    json_tok_t pool[8];
+    char *js = (char *) corpus[2];
+    char str[32];
+    int val, num;
+    if (json_parse_start_static(&jctx, js, strlen(js), pool, 8) != OS_SUCCESS) {
+        return fail("parse", 2);
+    }
+    if (json_obj_get_object(&jctx, "directive") != OS_SUCCESS || json_obj_get_object(&jctx, "payload") != OS_SUCCESS ||
+            json_obj_get_int(&jctx, "loopCount", &val) != OS_SUCCESS || val != 2 ||
+            json_obj_get_array(&jctx, "assetPlayOrder", &num) != OS_SUCCESS || num != 4 ||
+            json_arr_get_string(&jctx, 3, str, sizeof(str)) != OS_SUCCESS || strcmp(str, "a1") != 0) {
+        json_parse_end_static(&jctx, pool);
+        return fail("access", 2);
+    }
+    json_obj_leave_array(&jctx);
+    if (json_obj_get_string(&jctx, "backgroundAlertAsset", str, sizeof(str)) != OS_SUCCESS || strcmp(str, "a2") != 0) {
+        json_parse_end_static(&jctx, pool);
+        return fail("access", 2);
+    }
+    json_parse_end_static(&jctx, pool);
+
+    if (json_parse_start(&jctx, "{\"a\":", 5) == OS_SUCCESS || jctx.tokens != NULL) {
+        return fail("truncated json", -1);
+    }
+    printf("Success\n");
+    return 0;
+}
+
+/* Event log of a streaming parse: one line per event, string pieces are joined */
+typedef struct {
+    char log[8192];
+    int len;
+    int in_string;
+} stream_log_t;
+
+static int stream_log_cb(void *arg, json_stream_event_t event, const char *path, const char *val, int len)
+{
+    stream_log_t *l = (stream_log_t *) arg;
+    int avail = sizeof(l->log) - l->len;
+    if (event == JSON_STREAM_STRING_PART || (event == JSON_STREAM_STRING && l->in_string)) {
+        /* Continuation of a string: just append */
+        if (!l->in_string) {
+            l->len += snprintf(l->log + l->len, avail, "%d %s=", JSON_STREAM_STRING, path);
+            avail = sizeof(l->log) - l->len;
+        }
+        l->len += snprintf(l->log + l->len, avail, "%s%s", val, (event == JSON_STREAM_STRING) ? "\n" : "");
+        l->in_string = (event == JSON_STREAM_STRING_PART);
+        return 0;
+    }
+    l->len += snprintf(l->log + l->len, avail, "%d %s=%s\n", event, path, val ? val : "");
+    return 0;
+}
+
+static int stream_parse(const char *js, int chunk, char *val_buf, int val_size, stream_log_t *l)
+{
+    json_stream_ctx_t ctx;
+    int len = strlen(js);
+    memset(l, 0, sizeof(stream_log_t));
+    if (json_stream_init(&ctx, val_buf, val_size, stream_log_cb, l) != OS_SUCCESS) {
+        return -OS_FAIL;
+    }
+    for (int off = 0; off < len; off += chunk) {
+        int n = (len - off < chunk) ? len - off : chunk;
+        if (json_stream_parse(&ctx, js + off, n) != OS_SUCCESS) {
+            return -OS_FAIL;
+        }
+    }
+    return json_stream_end(&ctx);
+}
+
+static int test_stream()
+{
+    printf("test: stream ....");
+    static stream_log_t ref, l;
+    char val_buf[256], small_buf[8];
+    int chunks[] = {1, 3, 17, 4096};
+    for (int i = 0; i < CORPUS_LEN; i++) {
+        if (stream_parse(corpus[i], 4096, val_buf, sizeof(val_buf), &ref) != OS_SUCCESS) {
+            return fail("stream parse", i);
+        }
+        /* Same events regardless of how the data is chunked or how small the value buffer is */
+        for (int c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+            if (stream_parse(corpus[i], chunks[c], small_buf, sizeof(small_buf), &l) != OS_SUCCESS ||
+                    strcmp(ref.log, l.log) != 0) {
+                return fail("stream chunking", i);
+            }
+        }
+    }
+    stream_parse(corpus[2], 5, val_buf, sizeof(val_buf), &l);
+    if (!strstr(l.log, "\n5 directive.payload.assets[1].url=https://example.com/a2.mp3\n") ||
+            !strstr(l.log, "\n6 directive.payload.loopCount=2\n") ||
+            !strstr(l.log, "\n5 directive.payload.assetPlayOrder[3]=a1\n") ||
+            !strstr(l.log, "\n3 directive.payload.assets=\n")) {
+        return fail("stream paths", 2);
+    }
+    const char *bad[] = {"{\"a\":1", "{\"a\" 1}", "[1,]", "{\"a\":1,}", "[1}", "{\"a\":\"x\"} x", "{\"a\":tru\"}"};
+    for (int i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        if (stream_parse(bad[i], 2, val_buf, sizeof(val_buf), &l) == OS_SUCCESS) {
+            return fail("stream malformed", i);
+        }
+    }
+    if (stream_parse("42", 1, val_buf, sizeof(val_buf), &l) != OS_SUCCESS || strcmp(l.log, "6 =42\n") != 0 ||
+            stream_parse("[]", 1, val_buf, sizeof(val_buf), &l) != OS_SUCCESS) {
+        return fail("stream root", -1);
+    }
+    printf("Success\n");
+    return 0;
+}
+
+#define BENCH(name, iters, start, end)                                                      \
+    do {                                                                                    \
+        clock_t c = clock();                                                                \
+        for (int it = 0; it < (iters); it++) {                                              \
+            for (int i = 0; i < CORPUS_LEN; i++) {                                          \
+                jparse_ctx_t jctx;                                                          \
+                char *js = (char *) corpus[i];                                              \
+                start;                                                                      \
+                end;                                                                        \
+            }                                                                               \
+        }                                                                                   \
+        double t = (double) (clock() - c) * 1000000 / CLOCKS_PER_SEC;                       \
+        printf("bench: %-24s %8.1f ns/directive\n", name, t * 1000 / ((double) (iters) * CORPUS_LEN)); \
+    } while (0)
+
+/* Object with `keys` members, each holding a small nested object */
+static char *make_large_object(int keys)
+{
+    char *js = malloc(keys * 96 + 16);
+    int off = sprintf(js, "{");
+    for (int i = 0; i < keys; i++) {
+        off += sprintf(js + off, "%s\"key%d\":{\"id\":%d,\"tags\":[\"a\",\"b\",\"c\"],\"meta\":{\"x\":1,\"y\":2}}",
+                       i ? "," : "", i, i);
+    }
+    sprintf(js + off, "}");
+    return js;
+}
+
+/* Reference: key lookup with the recursive skip */
+static json_tok_t *recursive_search(jparse_ctx_t *jctx, char *key)
+{
+    json_tok_t *tok = jctx->cur;
+    int size = tok->size;
+    while (size--) {
+        tok++;
+        if (strlen(key) == (size_t) (tok->end - tok->start) && strncmp(jctx->js + tok->start, key, strlen(key)) == 0) {
+            return tok;
+        }
+        tok = recursive_skip(tok);
+    }
+    return NULL;
+}
+
+static void bench_lookup()
+{
+    int keys = 200;
+    int iters = 2000;
+    char *js = make_large_object(keys);
+    char key[16];
+    volatile int found = 0;
+    jparse_ctx_t jctx;
+    json_parse_start(&jctx, js, strlen(js));
+
+    clock_t c = clock();
+    for (int it = 0; it < iters; it++) {
+        for (int k = 0; k < keys; k += 10) {
+            sprintf(key, "key%d", k);
+            found += recursive_search(&jctx, key) != NULL;
+        }
+    }
+    double t = (double) (clock() - c) * 1000000 / CLOCKS_PER_SEC;
+    printf("bench: %-24s %8.1f ns/lookup\n", "lookup (recursive skip)", t * 1000 / ((double) iters * keys / 10));
+
+    c = clock();
+    for (int it = 0; it < iters; it++) {
+        for (int k = 0; k < keys; k += 10) {
+            sprintf(key, "key%d", k);
+            if (json_obj_get_object(&jctx, key) == OS_SUCCESS) {
+                found++;
+                json_obj_leave_object(&jctx);
+            }
+        }
+    }
+    t = (double) (clock() - c) * 1000000 / CLOCKS_PER_SEC;
+    printf("bench: %-24s %8.1f ns/lookup\n", "lookup (skip index)", t * 1000 / ((double) iters * keys / 10));
+    json_parse_end(&jctx);
+    free(js);
+}
+
+static int stream_nop_cb(void *arg, json_stream_event_t event, const char *path, const char *val, int len)
+{
+    return 0;
+}
+
+static void stream_parse_nop(const char *js, int chunk)
+{
+    json_stream_ctx_t ctx;
+    char val_buf[256];
+    int len = strlen(js);
+    json_stream_init(&ctx, val_buf, sizeof(val_buf), stream_nop_cb, NULL);
+    for (int off = 0; off < len; off += chunk) {
+        json_stream_parse(&ctx, js + off, (len - off < chunk) ? len - off : chunk);
+    }
+    json_stream_end(&ctx);
+}
+
+static void bench()
+{
+    int iters = 100000;
+    json_tok_t pool[128];
+    BENCH("two pass (reference)", iters, two_pass_parse(&jctx, js, strlen(js)), json_parse_end(&jctx));
+    BENCH("json_parse_start", iters, json_parse_start(&jctx, js, strlen(js)), json_parse_end(&jctx));
+    BENCH("json_parse_start_static", iters, json_parse_start_static(&jctx, js, strlen(js), pool, 128),
+          json_parse_end_static(&jctx, pool));
+    BENCH("json_stream (512B chunks)", iters, stream_parse_nop(js, 512), (void) jctx);
+    bench_lookup();
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+    if (test_single_pass() || test_static_pool() || test_skip_index() || test_access() || test_strview() || test_stream()) {
+        return -1;
+    }
+    return 0;
+}
@@ -27,6 +27,7 @@
 #include <resampling.h>
 #include <audio_board.h>
 #include <esp_equalizer.h>
+#include <audio_pcm.h>
 #include "media_hal_playback.h"
 #include "esp_audio_mem.h"
 
@@ -41,17 +42,40 @@ static const char *TAG = "[media_hal_playback]";
 #define BUF_SZ (CONVERT_BUF_SIZE * 12) /* Can handle 12x conv: 8k/1 --> 48k/2 */
 static uint8_t *convert_buf;
 
-static xSemaphoreHandle eq_mutex = NULL; /* To protect eq_handle */
+/* Max change (in dB) of a band gain per processed buffer. Avoids clicks on large changes. */
+#define EQ_RAMP_STEP_DB 1
+
+static xSemaphoreHandle eq_mutex = NULL; /* To protect eq_handle creation/deletion */
+static xSemaphoreHandle eq_set_mutex = NULL; /* Serializes writers of eq_sets */
+
+/**
+ * Band gains are published here by `media_hal_equalizer_set_band_vals`.
+ * The writer fills the set not in use and then bumps `eq_generation`, whose LSB selects the current set.
+ * The playback path never takes a lock for this: it copies the current set and re-checks the generation.
+ */
+static int8_t eq_sets[2][MEDIA_HAL_EQ_BANDS];
+static volatile uint32_t eq_generation;
+
+/* Time taken by a full scale (0 to unity) software gain change */
+#define GAIN_RAMP_MS 30
+
+/* Software gain published by `media_hal_playback_set_gain`. A single aligned word: read without a lock. */
+static volatile int32_t playback_gain = AUDIO_PCM_GAIN_UNITY;
 
 /* Contains data or config relevant to a playback. */
 typedef struct media_hal_playback {
     media_hal_playback_cfg_t cfg;
     audio_resample_config_t resample;
     void *eq_handle; /* equalizer handle */
+    uint32_t eq_generation; /* Generation of eq_sets last copied into eq_target */
+    int8_t eq_target[MEDIA_HAL_EQ_BANDS];
+    int8_t eq_applied[MEDIA_HAL_EQ_BANDS]; /* Currently set in eq_handle */
+    uint32_t dma_queue_frames; /* Frames the I2S DMA buffers can hold */
+    audio_pcm_gain_ramp_t gain; /* Software gain, ramped towards playback_gain */
     bool is_disabled;
 } media_hal_playback_t;
 
-static void *active_eq;
+static struct media_hal_playback *active_pb;
 static media_hal_playback_t *media_hal_requesters[MAX_PLAYBACK_REQUESTERS];
 static bool first_sound_flag = false;
 
@@ -84,12 +108,66 @@ end:
     return sent_len;
 }
 
+/* Pick up newly published band gains. Returns false if there was nothing new or it changed while copying. */
+static bool media_hal_eq_fetch_bands(media_hal_playback_t *pb)
+{
+    uint32_t gen = eq_generation;
+    if (gen == pb->eq_generation) {
+        return false;
+    }
+    __sync_synchronize();
+    memcpy(pb->eq_target, eq_sets[gen & 1], MEDIA_HAL_EQ_BANDS);
+    __sync_synchronize();
+    if (gen != eq_generation) {
+        /* A writer reused this set while we were copying. Retry with the next buffer. */
+        return false;
+    }
+    pb->eq_generation = gen;
+    return true;
+}
+
+/* Move band gains of the handle one step closer to the published ones. */
+static void media_hal_eq_step_bands(media_hal_playback_t *pb)
+{
+    media_hal_eq_fetch_bands(pb);
+    for (int i = 0; i < MEDIA_HAL_EQ_BANDS; i++) {
+        int diff = pb->eq_target[i] - pb->eq_applied[i];
+        if (__builtin_expect(diff == 0, true)) {
+            continue;
+        }
+        if (diff > EQ_RAMP_STEP_DB) {
+            diff = EQ_RAMP_STEP_DB;
+        } else if (diff < -EQ_RAMP_STEP_DB) {
+            diff = -EQ_RAMP_STEP_DB;
+        }
+        pb->eq_applied[i] += diff;
+        /* For two channels */
+        esp_equalizer_set_band_value(pb->eq_handle, pb->eq_applied[i], i, 0);
+        esp_equalizer_set_band_value(pb->eq_handle, pb->eq_applied[i], i, 1);
+    }
+}
+
+void media_hal_playback_set_gain(int32_t gain)
+{
+    if (gain < 0) {
+        gain = 0;
+    } else if (gain > AUDIO_PCM_GAIN_MAX) {
+        gain = AUDIO_PCM_GAIN_MAX;
+    }
+    playback_gain = gain;
+}
+
 static int default_equalizer_callback(char *buffer, int len, int sample_rate, int channels)
 {
     int ret = 0;
-    xSemaphoreTake(eq_mutex, portMAX_DELAY);
-    if (__builtin_expect(!!active_eq, true)) { /* This could rarely be not set at this point. Recheck with mutex taken. */
-        ret = esp_equalizer_process(active_eq, (unsigned char *) buffer, len, sample_rate, channels);
+    /* Never block playback. eq_mutex is only held while the equalizer is enabled/disabled; skip this buffer then. */
+    if (xSemaphoreTake(eq_mutex, 0) != pdTRUE) {
+        return ret;
+    }
+    media_hal_playback_t *pb = active_pb;
+    if (__builtin_expect(pb && pb->eq_handle, true)) { /* This could rarely be not set at this point. Recheck with mutex taken. */
+        media_hal_eq_step_bands(pb);
+        ret = esp_equalizer_process(pb->eq_handle, (unsigned char *) buffer, len, sample_rate, channels);
     }
     xSemaphoreGive(eq_mutex);
     return ret;
@@ -97,32 +175,34 @@ static int default_equalizer_callback(char *buffer, int len, int sample_rate, in
 
 esp_err_t media_hal_equalizer_set_band_vals(const int8_t *gain_vals)
 {
+    bool eq_enabled = false;
     for (int i = 0; i < MAX_PLAYBACK_REQUESTERS; i++) {
         if (!media_hal_requesters[i]) {
             break;
         }
-        media_hal_playback_cfg_t *cfg = &media_hal_requesters[i]->cfg;
-        void *eq_handle = media_hal_requesters[i]->eq_handle;
-
-        if (__builtin_expect(cfg->equalizer_callback != default_equalizer_callback, false)) {
+        if (__builtin_expect(media_hal_requesters[i]->cfg.equalizer_callback != default_equalizer_callback, false)) {
             ESP_LOGW(TAG, "Custom EQ callback was provided. Ignoring gain set.");
         }
-        xSemaphoreTake(eq_mutex, portMAX_DELAY);
-        if (!eq_handle) {
-            ESP_LOGW(TAG, "Can't set gain values. Equalizer is not enabled");
-        } else {
-            for (int i = 0; i < MEDIA_HAL_EQ_BANDS; i++) { /* 10 bands */
-                /* For two channels */
-                esp_equalizer_set_band_value(eq_handle, gain_vals[i], i, 0);
-                esp_equalizer_set_band_value(eq_handle, gain_vals[i], i, 1);
-            }
+        if (media_hal_requesters[i]->eq_handle) {
+            eq_enabled = true;
         }
-        xSemaphoreGive(eq_mutex);
     }
+    if (!eq_enabled) {
+        ESP_LOGW(TAG, "Can't set gain values. Equalizer is not enabled");
+        return ESP_OK;
+    }
+
+    /* Publish the new set. Playback applies it, ramped, from the next buffer on. */
+    xSemaphoreTake(eq_set_mutex, portMAX_DELAY);
+    uint32_t gen = eq_generation + 1;
+    memcpy(eq_sets[gen & 1], gain_vals, MEDIA_HAL_EQ_BANDS);
+    __sync_synchronize();
+    eq_generation = gen;
+    xSemaphoreGive(eq_set_mutex);
     return ESP_OK;
 }
 
-esp_err_t media_hal_enable_equalizer()
+static esp_err_t media_hal_eq_mutex_init()
 {
     if (!eq_mutex) {
         eq_mutex = xSemaphoreCreateMutex();
@@ -131,6 +211,21 @@ esp_err_t media_hal_enable_equalizer()
             return ESP_FAIL;
         }
     }
+    if (!eq_set_mutex) {
+        eq_set_mutex = xSemaphoreCreateMutex();
+        if (!eq_set_mutex) {
+            ESP_LOGE(TAG, "eq_set_mutex initialization failed");
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t media_hal_enable_equalizer()
+{
+    if (media_hal_eq_mutex_init() != ESP_OK) {
+        return ESP_FAIL;
+    }
 
     int i = 0;
     for (; i < MAX_PLAYBACK_REQUESTERS; i++) {
@@ -148,6 +243,9 @@ esp_err_t media_hal_enable_equalizer()
             xSemaphoreTake(eq_mutex, portMAX_DELAY);
             if (!media_hal_requesters[i]->eq_handle) {
                 media_hal_requesters[i]->eq_handle = esp_equalizer_init(cfg->channels, cfg->sample_rate, MEDIA_HAL_EQ_BANDS /* number of bands */, true);
+                /* New handle is flat. Ramp to whatever is published. */
+                memset(media_hal_requesters[i]->eq_applied, 0, MEDIA_HAL_EQ_BANDS);
+                media_hal_requesters[i]->eq_generation = eq_generation - 1;
             }
             if (!media_hal_requesters[i]->eq_handle) {
                 ESP_LOGE(TAG, "esp_equalizer_init failed index = %d", i);
@@ -230,12 +328,7 @@ void *media_hal_init_playback(media_hal_playback_cfg_t *cfg)
         }
     }
 
-    if (!eq_mutex) {
-        eq_mutex = xSemaphoreCreateMutex();
-        if (!eq_mutex) {
-            ESP_LOGE(TAG, "eq_mutex initialization failed");
-        }
-    }
+    media_hal_eq_mutex_init();
 
     /* Iterate through existing configs and find a spot */
     int i = 0;
@@ -252,6 +345,13 @@ void *media_hal_init_playback(media_hal_playback_cfg_t *cfg)
     media_hal_requesters[i] = esp_audio_mem_calloc(1, sizeof (media_hal_playback_t));
 
     memcpy(&media_hal_requesters[i]->cfg, cfg, sizeof (media_hal_playback_cfg_t));
+
+    audio_pcm_gain_ramp_init(&media_hal_requesters[i]->gain, playback_gain, cfg->sample_rate, GAIN_RAMP_MS);
+
+    i2s_config_t i2s_cfg = {0};
+    if (audio_board_i2s_init_default(&i2s_cfg) == ESP_OK) {
+        media_hal_requesters[i]->dma_queue_frames = i2s_cfg.dma_buf_count * i2s_cfg.dma_buf_len;
+    }
     if (media_hal_requesters[i]->cfg.write_callback == NULL) {
         media_hal_requesters[i]->cfg.write_callback = default_write_callback;
     }
@@ -317,9 +417,11 @@ int media_hal_playback_play(media_hal_playback_t *playback, media_hal_audio_info
         }
 
         if (cfg->equalizer_callback) {
-            active_eq = playback->eq_handle;
+            active_pb = playback;
             cfg->equalizer_callback((void *) convert_buf, conv_len * 2, cfg->sample_rate, cfg->channels);
         }
+        audio_pcm_gain_ramp_process(&playback->gain, (int16_t *) convert_buf, conv_len / cfg->channels, cfg->channels,
+                                    playback_gain);
         
         cfg->write_callback((int) cfg->i2s_port_num, (void *) convert_buf, conv_len * 2,
                                         audio_info->bits_per_sample, cfg->bits_per_sample);
@@ -327,6 +429,20 @@ int media_hal_playback_play(media_hal_playback_t *playback, media_hal_audio_info
     return sent_len;
 }
 
+uint32_t media_hal_playback_get_queued_ms()
+{
+    for (int i = 0; i < MAX_PLAYBACK_REQUESTERS; i++) {
+        if (!media_hal_requesters[i]) {
+            break;
+        }
+        media_hal_playback_t *pb = media_hal_requesters[i];
+        if (!pb->is_disabled && pb->cfg.sample_rate) {
+            return (pb->dma_queue_frames * 1000) / pb->cfg.sample_rate;
+        }
+    }
+    return 0;
+}
+
 int media_hal_playback(media_hal_audio_info_t *audio_info, void *buf, int len)
 {
     //printf("%s: [resample-cb] %d spiram %d\n", TAG, heap_caps_get_free_size_sram(), heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
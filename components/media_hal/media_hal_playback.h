@@ -33,6 +33,11 @@
  */
 #define MEDIA_HAL_EQ_BANDS 10
 
+/**
+ * Software gain for 0dB. Gains are Q15.
+ */
+#define MEDIA_HAL_PLAYBACK_GAIN_UNITY (1 << 15)
+
 #define DEFAULT_MEDIA_HAL_PLAYBACK_CONFIG() {       \
     .channels = 2,                                  \
     .sample_rate = 48000,                           \
@@ -121,6 +126,15 @@ typedef struct {
  */
 int media_hal_playback(media_hal_audio_info_t *audio_info, void *buf, int len);
 
+/**
+ * Get duration of audio queued for output.
+ *
+ * While playing, i2s DMA buffers stay full, so this is the delay between `media_hal_playback` and the audio being heard.
+ *
+ * Return: Queued duration in milliseconds.
+ */
+uint32_t media_hal_playback_get_queued_ms();
+
 /**
  * Enable audio equalizer.
  *
@@ -147,9 +161,22 @@ void media_hal_disable_equalizer();
  * 10 gain values are given to the equalizer. Equalizer will apply effects using these values.
  * Can be called anytime when equalizer is running/enabled state.
  * Same will be used for both the channels.
+ * Values are picked up by playback from the next buffer on without blocking it, and each band moves
+ * towards the new gain by at most 1dB per buffer to avoid clicks.
  *
  * Return: ESP_OK on success, ESP_FAIL on error.
  * Note: 1. Equalizer must be enabled first using `media_hal_enable_equalizer` before setting gain values.
  *       2. If `equalizer_callback` is provided, this has no effect.
  */
 esp_err_t media_hal_equalizer_set_band_vals(const int8_t gain_vals[MEDIA_HAL_EQ_BANDS]);
+
+/**
+ * Set the software gain of playback.
+ *
+ * The gain is applied to every buffer, after the equalizer. Playback moves towards a new gain with a per sample ramp
+ * (a full scale change takes 30ms) without blocking, so volume changes and mute/unmute do not click.
+ * `gain` is Q15: MEDIA_HAL_PLAYBACK_GAIN_UNITY is 0dB, 0 is silence. Values above ~+6dB are clipped.
+ *
+ * Note: `media_hal_control_volume` and `media_hal_set_mute` use this for the fine volume steps and for mute.
+ */
+void media_hal_playback_set_gain(int32_t gain);
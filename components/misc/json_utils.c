@@ -21,25 +21,27 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  *
  */
+#include <string.h>
 #include <json_utils.h>
 #include <va_mem_utils.h>
 
 char *json_alloc_and_get_str(jparse_ctx_t *jp, const char *json_key)
 {
+    char *val;
     int len;
     char *str = NULL;
-    if (json_obj_get_strlen(jp, (char *)json_key, &len) < 0) {
+    /* Single lookup: view the string in place, then copy it */
+    if (json_obj_get_strview(jp, (char *)json_key, &val, &len) < 0) {
 	return NULL;
     }
 
     if (len) {
-	len += 1; /* For the null termination */
-	str = (char *)va_mem_alloc(len, VA_MEM_EXTERNAL);
+	str = (char *)va_mem_alloc(len + 1, VA_MEM_EXTERNAL); /* +1 for the null termination */
 	if (!str) {
 	    return NULL;
 	}
-	json_obj_get_string(jp, (char *)json_key, str, len);
+	memcpy(str, val, len);
+	str[len] = '\0';
     }
     return str;
 }
-
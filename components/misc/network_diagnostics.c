@@ -41,10 +41,9 @@ struct network_diagnostics_ping {
 
 struct network_speed {
     bool status;
-    int data;
-    uint64_t prev_time;
     int enable_count;
-    SemaphoreHandle_t data_lock;
+    SemaphoreHandle_t enable_lock;
+    network_speed_t counter;
 };
 
 static struct network_speed network_speed[NETWORK_PATH_MAX];
@@ -112,20 +111,19 @@ static int network_diagnostics_register_cli()
 
 void network_diagnostics_speed_add(network_path_t path, int data)
 {
-    if (!init_done) {
+    if (!init_done || path >= NETWORK_PATH_MAX) {
         return;
     }
-    xSemaphoreTake(network_speed[path].data_lock, portMAX_DELAY);
-    network_speed[path].data += data;
-    xSemaphoreGive(network_speed[path].data_lock);
+    /* Lock-free: called for every read and write of the connections */
+    network_speed_add(&network_speed[path].counter, esp_timer_get_time(), data);
 }
 
 void network_diagnostics_speed_enable(network_path_t path, bool status)
 {
-    if (!init_done) {
+    if (!init_done || path >= NETWORK_PATH_MAX) {
         return;
     }
-    xSemaphoreTake(network_speed[path].data_lock, portMAX_DELAY);
+    xSemaphoreTake(network_speed[path].enable_lock, portMAX_DELAY);
 
     /* The count can go negative in case of disconnects where multiple sources disable */
     network_speed[path].enable_count += status ? 1 : -1;
@@ -133,55 +131,53 @@ void network_diagnostics_speed_enable(network_path_t path, bool status)
     /* Check if first one to enable or if last one to disable */
     if ((status == true && network_speed[path].enable_count != 1) || (status == false && network_speed[path].enable_count != 0)) {
         ESP_LOGD(TAG, "Already enabled so not enabling again. (Or someone else enabled too, so not disabling.)");
-        xSemaphoreGive(network_speed[path].data_lock);
+        xSemaphoreGive(network_speed[path].enable_lock);
         return;
     }
 
     if (status == true) {
-        network_speed[path].prev_time = esp_timer_get_time();
+        network_speed_start(&network_speed[path].counter, esp_timer_get_time());
     }
     network_speed[path].status = status;
-    xSemaphoreGive(network_speed[path].data_lock);
+    xSemaphoreGive(network_speed[path].enable_lock);
 }
 
-static int network_diagnostics_speed_get(network_path_t path)
+esp_err_t network_diagnostics_speed_get_stats(network_path_t path, network_speed_stats_t *stats)
 {
-    xSemaphoreTake(network_speed[path].data_lock, portMAX_DELAY);
-    if (network_speed[path].status == false && network_speed[path].data <= 0) {
-        xSemaphoreGive(network_speed[path].data_lock);
-        return -1;
+    if (!init_done) {
+        return ESP_ERR_INVALID_STATE;
     }
-    uint32_t current_time = 0;
-    current_time = esp_timer_get_time();
-    uint64_t time_diff = (current_time - network_speed[path].prev_time);
-    if (time_diff < PRINT_INTERVAL_SPEED) {
-        xSemaphoreGive(network_speed[path].data_lock);
-        return -1;
+    if (path >= NETWORK_PATH_MAX || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
-    int data = network_speed[path].data;
-    int speed = data / (time_diff / (1000 * 1000));
-    network_speed[path].prev_time = current_time;
-    network_speed[path].data -= data;
-    xSemaphoreGive(network_speed[path].data_lock);
-    return speed;
+    network_speed_get(&network_speed[path].counter, esp_timer_get_time(), stats);
+    return ESP_OK;
 }
 
-static esp_err_t network_diagnostics_check_network_speed()
+static void network_diagnostics_print_speed(network_path_t path, const char *name)
 {
-    int speed = 0;
-
-    /* Download */
-    speed = network_diagnostics_speed_get(NETWORK_PATH_DOWNLOAD);
-    if (speed != -1) {
-        ESP_LOGI(TAG, "Download speed (bytes per second) is: %d", speed);
+    network_speed_stats_t stats;
+    uint32_t bytes = network_speed_get(&network_speed[path].counter, esp_timer_get_time(), &stats);
+    /* Nothing to say once disabled and the window has drained */
+    if ((network_speed[path].status == false && bytes == 0) || stats.window_ms == 0) {
+        return;
     }
+    ESP_LOGI(TAG, "%s speed (bytes per second) is: %u (1s: %u, %us: %u, p10/p50/p90: %u/%u/%u)", name, stats.instant,
+             stats.avg_1s, stats.window_ms / 1000, stats.avg_10s, stats.p10, stats.p50, stats.p90);
+}
 
-    /* Upload */
-    speed = network_diagnostics_speed_get(NETWORK_PATH_UPLOAD);
-    if (speed != -1) {
-        ESP_LOGI(TAG, "Upload speed (bytes per second) is: %d", speed);
+static esp_err_t network_diagnostics_check_network_speed()
+{
+    /* Print in PRINT_INTERVAL_SPEED intervals */
+    static int64_t prev_time = 0;
+    int64_t current_time = esp_timer_get_time();
+    if (current_time - prev_time < PRINT_INTERVAL_SPEED) {
+        return ESP_OK;
     }
+    prev_time = current_time;
 
+    network_diagnostics_print_speed(NETWORK_PATH_DOWNLOAD, "Download");
+    network_diagnostics_print_speed(NETWORK_PATH_UPLOAD, "Upload");
     return ESP_OK;
 }
 
@@ -469,8 +465,8 @@ esp_err_t network_diagnostics_init()
 
     /* Network speed */
     for (int path = 0; path < NETWORK_PATH_MAX; path++) {
-        vSemaphoreCreateBinary(network_speed[path].data_lock);
-        if (network_speed[path].data_lock == NULL) {
+        vSemaphoreCreateBinary(network_speed[path].enable_lock);
+        if (network_speed[path].enable_lock == NULL) {
             ESP_LOGE(TAG, "Could not create semaphore");
             return ESP_FAIL;
         }
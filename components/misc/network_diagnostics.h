@@ -1,7 +1,12 @@
 // Copyright 2021 Espressif Systems (Shanghai) PTE LTD
 // All rights reserved.
 
+#ifndef _NETWORK_DIAGNOSTICS_H_
+#define _NETWORK_DIAGNOSTICS_H_
+
+#include <stdbool.h>
 #include <esp_err.h>
+#include <network_speed.h>
 
 typedef enum network_path {
     NETWORK_PATH_UPLOAD,
@@ -28,6 +33,19 @@ esp_err_t network_diagnostics_init();
  */
 void network_diagnostics_speed_add(network_path_t path, int data);
 
+/** Network Speed: Get Statistics
+ *
+ * Instantaneous (last 100 ms), 1 second and 10 second throughput of the upload or download path, and the percentiles
+ * of the 100 ms rates over the last 10 seconds. The windows restart when the path is enabled.
+ *
+ * @param[in] path upload or download
+ * @param[out] stats rates in bytes per second
+ *
+ * @return ESP_OK on success.
+ * @return ESP_ERR_INVALID_STATE if not initialized, ESP_ERR_INVALID_ARG for an invalid path.
+ */
+esp_err_t network_diagnostics_speed_get_stats(network_path_t path, network_speed_stats_t *stats);
+
 /** Network Speed: Enable
  *
  * This API should be called to start or stop calculating the upload or download speed.
@@ -36,3 +54,5 @@ void network_diagnostics_speed_add(network_path_t path, int data);
  * @param[in] status true to start, false to stop
  */
 void network_diagnostics_speed_enable(network_path_t path, bool status);
+
+#endif /* _NETWORK_DIAGNOSTICS_H_ */
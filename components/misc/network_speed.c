@@ -0,0 +1,149 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+// All rights reserved.
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <network_speed.h>
+
+#define BYTES_BITS          20
+#define BYTES_MASK          ((1U << BYTES_BITS) - 1)
+#define LAP_MASK            ((1U << (32 - BYTES_BITS)) - 1)
+#define LAP(idx)            (((idx) / NETWORK_SPEED_BUCKETS) & LAP_MASK)
+#define BUCKETS_PER_SEC     (1000 / NETWORK_SPEED_BUCKET_MS)
+
+static inline uint32_t network_speed_index(int64_t now_us)
+{
+    return (uint32_t) (now_us / (NETWORK_SPEED_BUCKET_MS * 1000));
+}
+
+/* Bytes of bucket `idx`, 0 if the slot was last written in another lap */
+static inline uint32_t network_speed_bucket(network_speed_t *speed, uint32_t idx)
+{
+    uint32_t word = __atomic_load_n(&speed->buckets[idx % NETWORK_SPEED_BUCKETS], __ATOMIC_RELAXED);
+    return ((word >> BYTES_BITS) == LAP(idx)) ? (word & BYTES_MASK) : 0;
+}
+
+void network_speed_start(network_speed_t *speed, int64_t now_us)
+{
+    for (int i = 0; i < NETWORK_SPEED_BUCKETS; i++) {
+        __atomic_store_n(&speed->buckets[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&speed->start, network_speed_index(now_us), __ATOMIC_RELAXED);
+    __atomic_store_n(&speed->last, network_speed_index(now_us), __ATOMIC_RELAXED);
+}
+
+/**
+ * Move the newest index to `idx`. The writer that does it clears the buckets skipped since the previous add, so
+ * every bucket up to the newest index holds a count of its own lap or none.
+ */
+static void network_speed_advance(network_speed_t *speed, uint32_t idx)
+{
+    volatile uint32_t *bucket = &speed->buckets[idx % NETWORK_SPEED_BUCKETS];
+    /* Nobody adds to this bucket for `idx` before `last` reaches it */
+    uint32_t stale = __atomic_load_n(bucket, __ATOMIC_RELAXED);
+    uint32_t last = __atomic_load_n(&speed->last, __ATOMIC_RELAXED);
+    do {
+        if ((int32_t) (idx - last) <= 0) {
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&speed->last, &last, idx, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    uint32_t gap = idx - last;
+    for (uint32_t i = 1; i < gap && i < NETWORK_SPEED_BUCKETS; i++) {
+        volatile uint32_t *skipped = &speed->buckets[(idx - i) % NETWORK_SPEED_BUCKETS];
+        uint32_t old = __atomic_load_n(skipped, __ATOMIC_RELAXED);
+        /* Fails only if a late add got there first: keep it */
+        __atomic_compare_exchange_n(skipped, &old, 0, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    if (gap >= NETWORK_SPEED_BUCKETS && (stale >> BYTES_BITS) == LAP(idx)) {
+        /* Idle for a multiple of 4096 laps: the lap matches but the count is old. Take it out, keeping new adds. */
+        uint32_t cur = __atomic_load_n(bucket, __ATOMIC_RELAXED);
+        uint32_t fresh;
+        do {
+            if ((cur >> BYTES_BITS) != LAP(idx)) {
+                return;
+            }
+            fresh = cur - (stale & BYTES_MASK);
+        } while (!__atomic_compare_exchange_n(bucket, &cur, fresh, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+}
+
+void network_speed_add(network_speed_t *speed, int64_t now_us, int bytes)
+{
+    if (bytes <= 0) {
+        return;
+    }
+    uint32_t idx = network_speed_index(now_us);
+    network_speed_advance(speed, idx);
+    uint32_t lap = LAP(idx);
+    volatile uint32_t *bucket = &speed->buckets[idx % NETWORK_SPEED_BUCKETS];
+    uint32_t old = __atomic_load_n(bucket, __ATOMIC_RELAXED);
+    uint32_t new;
+    do {
+        /* The first add of a lap starts the bucket over */
+        uint32_t count = ((old >> BYTES_BITS) == lap) ? (old & BYTES_MASK) : 0;
+        count = ((uint32_t) bytes >= BYTES_MASK - count) ? BYTES_MASK : count + bytes;
+        new = (lap << BYTES_BITS) | count;
+    } while (!__atomic_compare_exchange_n(bucket, &old, new, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static uint32_t network_speed_avg(const uint32_t *bytes, int count)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += bytes[i];
+    }
+    return (uint32_t) (sum * BUCKETS_PER_SEC / count);
+}
+
+/* Nearest rank percentile of sorted bucket counts, as a rate */
+static uint32_t network_speed_percentile(const uint32_t *sorted, int count, int pct)
+{
+    int rank = (pct * count + 99) / 100;
+    return sorted[(rank > 0) ? rank - 1 : 0] * BUCKETS_PER_SEC;
+}
+
+uint32_t network_speed_get(network_speed_t *speed, int64_t now_us, network_speed_stats_t *stats)
+{
+    memset(stats, 0, sizeof(network_speed_stats_t));
+    uint32_t idx = network_speed_index(now_us);
+    uint32_t start = __atomic_load_n(&speed->start, __ATOMIC_RELAXED);
+    /* Completed buckets since the start, newest first */
+    int count = (idx > start) ? idx - start : 0;
+    if (count > NETWORK_SPEED_WINDOW) {
+        count = NETWORK_SPEED_WINDOW;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t bytes[NETWORK_SPEED_WINDOW] = {0};
+    uint32_t total = 0;
+    uint32_t last = __atomic_load_n(&speed->last, __ATOMIC_RELAXED);
+    for (int i = 0; i < count; i++) {
+        /* Nothing was added after the newest index, whatever the lap of the bucket says */
+        if ((int32_t) (idx - 1 - i - last) <= 0) {
+            bytes[i] = network_speed_bucket(speed, idx - 1 - i);
+            total += bytes[i];
+        }
+    }
+    stats->instant = bytes[0] * BUCKETS_PER_SEC;
+    stats->avg_1s = network_speed_avg(bytes, (count < BUCKETS_PER_SEC) ? count : BUCKETS_PER_SEC);
+    stats->avg_10s = network_speed_avg(bytes, count);
+    stats->window_ms = count * NETWORK_SPEED_BUCKET_MS;
+
+    /* Insertion sort: at most 100 entries, on the reader side only */
+    for (int i = 1; i < count; i++) {
+        uint32_t v = bytes[i];
+        int j = i - 1;
+        while (j >= 0 && bytes[j] > v) {
+            bytes[j + 1] = bytes[j];
+            j--;
+        }
+        bytes[j + 1] = v;
+    }
+    stats->p10 = network_speed_percentile(bytes, count, 10);
+    stats->p50 = network_speed_percentile(bytes, count, 50);
+    stats->p90 = network_speed_percentile(bytes, count, 90);
+    return total;
+}
@@ -0,0 +1,62 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+// All rights reserved.
+
+#ifndef _NETWORK_SPEED_H_
+#define _NETWORK_SPEED_H_
+
+/**
+ * Throughput counter.
+ *
+ * Bytes are counted in a ring of 100 ms buckets covering the last 12.8 s. Each bucket is a single word holding the
+ * byte count and the lap of the ring it belongs to, so adding is one atomic compare-and-swap: no lock, cheap enough
+ * for every read or write of a connection. Readers derive the rates from the completed buckets.
+ *
+ * The lap number wraps after about 14.5 h. The first add of a bucket clears the buckets skipped since the previous
+ * add, and readers ignore buckets after the newest add, so an old count is never taken for a current one.
+ *
+ * The counter does no I/O and keeps no clock: the current time is passed in (microseconds, e.g. esp_timer_get_time()).
+ */
+
+#include <stdint.h>
+
+#define NETWORK_SPEED_BUCKET_MS     100
+#define NETWORK_SPEED_BUCKETS       128                 /* Power of 2 */
+#define NETWORK_SPEED_WINDOW        100                 /* Buckets in the long window: 10 s */
+
+typedef struct {
+    volatile uint32_t buckets[NETWORK_SPEED_BUCKETS];   /* Lap in the upper bits, bytes in the lower ones */
+    volatile uint32_t start;                            /* Bucket index at which counting (re)started */
+    volatile uint32_t last;                             /* Bucket index of the newest add */
+} network_speed_t;
+
+/* All rates in bytes per second */
+typedef struct {
+    uint32_t instant;       /* Last 100 ms */
+    uint32_t avg_1s;
+    uint32_t avg_10s;
+    uint32_t p10;           /* Percentiles of the 100 ms rates over the long window */
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t window_ms;     /* Time covered by avg_10s and the percentiles: shorter after a (re)start */
+} network_speed_stats_t;
+
+/**
+ * @brief   Clear the counter and start the windows at `now_us`
+ */
+void network_speed_start(network_speed_t *speed, int64_t now_us);
+
+/**
+ * @brief   Count `bytes` at `now_us`. May be called from any task, concurrently.
+ *
+ * A bucket saturates at 1 MB (80 Mbit/s).
+ */
+void network_speed_add(network_speed_t *speed, int64_t now_us, int bytes);
+
+/**
+ * @brief   Rates over the buckets completed before `now_us`
+ *
+ * @return  Bytes counted in the long window, 0 if there was no traffic or no bucket has completed since the start.
+ */
+uint32_t network_speed_get(network_speed_t *speed, int64_t now_us, network_speed_stats_t *stats);
+
+#endif /* _NETWORK_SPEED_H_ */
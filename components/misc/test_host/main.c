@@ -0,0 +1,616 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <esp_partition.h>
+
+#include <va_mem_utils.h>
+#include <va_nvs_utils.h>
+#include <va_file_utils.h>
+#include <va_led_anim.h>
+#include <network_speed.h>
+
+#include <host_stubs.h>
+
+void *va_mem_alloc(size_t size, enum va_mem_region region)
+{
+    return malloc(size);
+}
+
+void va_mem_free(void *ptr)
+{
+    free(ptr);
+}
+
+/* A single 64KB "prompts" data partition */
+static uint8_t flash[64 * 1024];
+static const esp_partition_t prompts_partition = {
+    .address = 0x310000,
+    .size = sizeof(flash),
+    .label = "prompts",
+};
+static int mapped;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    return (strcmp(label, prompts_partition.label) == 0) ? &prompts_partition : NULL;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size, spi_flash_mmap_memory_t memory,
+                             const void **out_ptr, spi_flash_mmap_handle_t *out_handle)
+{
+    if (offset + size > partition->size) {
+        return ESP_FAIL;
+    }
+    mapped++;
+    *out_ptr = flash + offset;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle)
+{
+    mapped--;
+}
+
+static int fail(const char *what)
+{
+    printf("Fail\n");
+    printf("%s: opens %d sets %d gets %d commits %d task switches %d\n", what, host_cnt.opens, host_cnt.sets, host_cnt.gets,
+           host_cnt.commits, host_cnt.task_switches);
+    return -1;
+}
+
+static void reset()
+{
+    host_fire_timers();
+    va_nvs_flash_erase();
+    memset(&host_cnt, 0, sizeof(host_cnt));
+}
+
+static int test_write_behind()
+{
+    printf("test: write behind ....");
+    reset();
+    char str[32];
+    size_t len = sizeof(str);
+    int8_t i8;
+    uint16_t u16;
+    uint8_t blob[100];
+    for (int i = 0; i < 10; i++) {
+        va_nvs_set_i8("volume", i);
+    }
+    va_nvs_set_u16("alarm_vol", 1234);
+    memset(blob, 0xab, sizeof(blob));
+    va_nvs_set_blob("cert", blob, sizeof(blob));
+    va_nvs_set_str("token", "abc");
+    va_nvs_set_str("token", "refresh-token");
+    /* Served from RAM, nothing written yet */
+    if (va_nvs_get_i8("volume", &i8) != ESP_OK || i8 != 9 || va_nvs_get_u16("alarm_vol", &u16) != ESP_OK || u16 != 1234 ||
+            va_nvs_get_str("token", str, &len) != ESP_OK || strcmp(str, "refresh-token") != 0 || len != 14) {
+        return fail("cached values");
+    }
+    if (host_cnt.sets || host_cnt.commits || host_cnt.task_switches) {
+        return fail("write behind");
+    }
+    /* One batch, one commit */
+    host_fire_timers();
+    if (host_cnt.sets != 4 || host_cnt.commits != 1 || host_cnt.gets) {
+        return fail("batch");
+    }
+    const int8_t *volume = nvs_stub_get(NULL, "volume", NVS_STUB_I8);
+    const char *token = nvs_stub_get(NULL, "token", NVS_STUB_STR);
+    if (!volume || *volume != 9 || !token || strcmp(token, "refresh-token")) {
+        return fail("flash content");
+    }
+    /* Writing the same values again is free */
+    va_nvs_set_i8("volume", 9);
+    va_nvs_set_str("token", "refresh-token");
+    host_fire_timers();
+    if (host_cnt.sets != 4 || host_cnt.commits != 1 || host_cnt.task_switches) {
+        return fail("unchanged values");
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_read_cache()
+{
+    printf("test: read cache ....");
+    reset();
+    int8_t i8 = 0;
+    nvs_stub_put("avs", "mute", NVS_STUB_I8, &(int8_t) {1}, 1);
+    nvs_stub_put("avs", "locale", NVS_STUB_STR, "en-US", 6);
+    memset(&host_cnt, 0, sizeof(host_cnt));
+    /* First get loads from flash, later ones do not */
+    for (int i = 0; i < 5; i++) {
+        if (va_nvs_get_i8("mute", &i8) != ESP_OK || i8 != 1) {
+            return fail("get i8");
+        }
+    }
+    if (host_cnt.task_switches != 1 || host_cnt.gets != 1) {
+        return fail("cached get");
+    }
+    /* Missing keys are remembered too */
+    for (int i = 0; i < 5; i++) {
+        if (va_nvs_get_i8("missing", &i8) == ESP_OK) {
+            return fail("missing key");
+        }
+    }
+    if (host_cnt.task_switches != 2) {
+        return fail("cached miss");
+    }
+    /* String size query, then read. Too small a buffer fails, with the size needed. */
+    char str[8];
+    size_t len = 0;
+    if (va_nvs_get_str("locale", NULL, &len) != ESP_OK || len != 6 || va_nvs_get_str("locale", str, &len) != ESP_OK ||
+            strcmp(str, "en-US") != 0) {
+        return fail("get str");
+    }
+    len = 3;
+    if (va_nvs_get_str("locale", str, &len) == ESP_OK || len != 6 || host_cnt.task_switches != 3) {
+        return fail("short buffer");
+    }
+    if (va_nvs_get_str("locale", str, &len) != ESP_OK || strcmp(str, "en-US") != 0) {
+        return fail("retry with the size needed");
+    }
+    /* Types are separate */
+    uint16_t u16;
+    if (va_nvs_get_u16("mute", &u16) == ESP_OK) {
+        return fail("type mismatch");
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_erase_and_flush()
+{
+    printf("test: erase and flush ....");
+    reset();
+    /* Erasing drops a pending write */
+    va_nvs_set_str("token", "abc");
+    va_nvs_erase_key("token");
+    host_fire_timers();
+    char str[8];
+    size_t len = sizeof(str);
+    if (nvs_stub_get(NULL, "token", NVS_STUB_STR) || va_nvs_get_str("token", str, &len) == ESP_OK) {
+        return fail("erase key");
+    }
+    /* Explicit flush */
+    va_nvs_set_i8("volume", 5);
+    memset(&host_cnt, 0, sizeof(host_cnt));
+    if (va_nvs_flush() != ESP_OK || host_cnt.sets != 1 || host_cnt.commits != 1) {
+        return fail("flush");
+    }
+    /* Restart */
+    va_nvs_set_i8("volume", 6);
+    host_shutdown();
+    if (host_cnt.sets != 2 || host_cnt.commits != 2) {
+        return fail("shutdown");
+    }
+    /* Restart from the esp_timer task itself */
+    va_nvs_set_i8("volume", 7);
+    host_current_task = host_timer_task;
+    host_shutdown();
+    host_current_task = host_app_task;
+    if (host_cnt.sets != 3 || host_cnt.commits != 3 || host_cnt.task_switches != 2) {
+        return fail("shutdown in timer task");
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static int test_large_and_many()
+{
+    printf("test: large values and eviction ....");
+    reset();
+    /* Too big to cache: written through */
+    static uint8_t big[6000];
+    size_t len = sizeof(big);
+    memset(big, 0x5a, sizeof(big));
+    va_nvs_set_blob("big", big, sizeof(big));
+    if (host_cnt.sets != 1 || host_cnt.commits != 1 || va_nvs_get_blob("big", big, &len) != ESP_OK || len != sizeof(big)) {
+        return fail("large value");
+    }
+    /* More keys than the cache holds */
+    char key[16];
+    for (int i = 0; i < 50; i++) {
+        sprintf(key, "k%d", i);
+        va_nvs_set_u16(key, i);
+    }
+    host_fire_timers();
+    memset(&host_cnt, 0, sizeof(host_cnt));
+    for (int i = 0; i < 50; i++) {
+        uint16_t u16;
+        sprintf(key, "k%d", i);
+        const uint16_t *stored = nvs_stub_get(NULL, key, NVS_STUB_U16);
+        if (!stored || *stored != i || va_nvs_get_u16(key, &u16) != ESP_OK || u16 != i) {
+            return fail("eviction");
+        }
+    }
+    printf("Success\n");
+    return 0;
+}
+
+#define TEST_FILE       "/tmp/va_file_reader_test"
+#define TEST_FILE_SIZE  100000
+
+static uint8_t *make_test_file()
+{
+    uint8_t *content = malloc(TEST_FILE_SIZE);
+    uint32_t x = 1;
+    for (int i = 0; i < TEST_FILE_SIZE; i++) {
+        x = x * 1103515245 + 12345;
+        content[i] = x >> 24;
+    }
+    FILE *f = fopen(TEST_FILE, "wb");
+    fwrite(content, 1, TEST_FILE_SIZE, f);
+    fclose(f);
+    return content;
+}
+
+static int test_file_reader()
+{
+    printf("test: file reader ....");
+    uint8_t *content = make_test_file();
+    uint8_t buf[3000];
+    int ret = -1;
+
+    if (va_file_reader_open("/tmp/va_file_reader_missing", 0) != NULL) {
+        goto out;
+    }
+
+    /* Odd chunk sizes, smaller and larger than a block */
+    memset(&host_cnt, 0, sizeof(host_cnt));
+    va_file_reader_t *reader = va_file_reader_open(TEST_FILE, 1000);
+    int off = 0, chunk = 1, n;
+    while ((n = va_file_reader_read(reader, buf, chunk)) > 0) {
+        if (off + n > TEST_FILE_SIZE || memcmp(buf, content + off, n) != 0) {
+            fail("content mismatch");
+            goto out;
+        }
+        off += n;
+        chunk = (chunk * 7 + 13) % sizeof(buf) + 1;
+    }
+    /* Block size rounded up to 1024: one hop per block, the two initial fills, the EOF and the open/close */
+    if (n != 0 || off != TEST_FILE_SIZE || va_file_reader_read(reader, buf, 1) != 0 ||
+            host_cnt.task_switches > TEST_FILE_SIZE / 1024 + 5) {
+        fail("read");
+        goto out;
+    }
+    va_file_reader_close(reader);
+
+    /* Zero copy, closed half way with a fill still queued */
+    reader = va_file_reader_open(TEST_FILE, 0);
+    const void *data;
+    off = 0;
+    while (off < 3 * 4096 && (n = va_file_reader_get(reader, &data, 100)) > 0) {
+        if (n > 100 || memcmp(data, content + off, n) != 0) {
+            fail("get");
+            goto out;
+        }
+        off += n;
+    }
+    va_file_reader_close(reader);
+
+    /* Memory mapped, from an offset to the end of the partition */
+    memcpy(flash, content, sizeof(flash));
+    reader = va_file_reader_open_partition("prompts", 1000, 0);
+    off = 1000;
+    while ((n = va_file_reader_read(reader, buf, sizeof(buf))) > 0) {
+        if (memcmp(buf, flash + off, n) != 0) {
+            fail("mapped content mismatch");
+            goto out;
+        }
+        off += n;
+    }
+    va_file_reader_close(reader);
+    if (off != sizeof(flash) || mapped != 0 || va_file_reader_open_partition("nvs", 0, 0) != NULL ||
+            va_file_reader_open_partition("prompts", sizeof(flash) + 1, 0) != NULL) {
+        fail("mapped");
+        goto out;
+    }
+    printf("Success\n");
+    ret = 0;
+out:
+    unlink(TEST_FILE);
+    free(content);
+    return ret;
+}
+
+/* Patterns where every state's first LED holds (pattern << 8 | state) */
+static led_pattern_state_t led_states[LED_PATTERN_MAX][4];
+static led_pattern_config_t led_conf[LED_PATTERN_MAX];
+
+static void led_conf_add(led_pattern_t p, int count, int delay)
+{
+    for (int i = 0; i < count; i++) {
+        led_states[p][i].led_state_delay = delay;
+        led_states[p][i].led_state_val[0] = (p << 8) | i;
+    }
+    led_conf[p].led_states_count = count;
+    led_conf[p].led_states = led_states[p];
+}
+
+/* Advance to `until`, waking up exactly when asked to. Returns the value on display and counts the wakeups. */
+static uint32_t led_shown;
+static int led_wakeups;
+static int64_t led_now;
+
+static void led_run(va_led_anim_t *a, int64_t until)
+{
+    int64_t next;
+    const uint32_t *val = va_led_anim_run(a, led_now, &next);
+    for (;;) {
+        if (val) {
+            led_shown = val[0];
+        }
+        if (next > until) {
+            break;
+        }
+        led_now = next;
+        led_wakeups++;
+        val = va_led_anim_run(a, led_now, &next);
+    }
+    led_now = until;
+}
+
+static int test_led_anim()
+{
+    printf("test: led animation ....");
+    memset(led_conf, 0, sizeof(led_conf));
+    led_conf_add(LED_PATTERN_THINKING, 4, 100);
+    led_conf_add(LED_PATTERN_LISTENING_ENTER, 3, 50);
+    led_conf_add(LED_PATTERN_LISTENING_ONGOING, 1, 0);
+    led_conf_add(LED_PATTERN_MIC_OFF_ENTER, 2, 30);
+    led_conf_add(LED_PATTERN_SPEAKER_VOL, 4, 0);
+    led_conf_add(LED_PATTERN_OFF, 3, 10);
+    /* Identical states are merged */
+    led_states[LED_PATTERN_OFF][1].led_state_val[0] = led_states[LED_PATTERN_OFF][0].led_state_val[0];
+    led_states[LED_PATTERN_OFF][2].led_state_val[0] = led_states[LED_PATTERN_OFF][0].led_state_val[0];
+    led_states[LED_PATTERN_SPEAKER_VOL][1].led_state_val[0] = led_states[LED_PATTERN_SPEAKER_VOL][0].led_state_val[0];
+
+    va_led_anim_t a;
+    if (va_led_anim_init(&a, led_conf) != ESP_OK || a.clips[LED_PATTERN_OFF].count != 1 ||
+            a.clips[LED_PATTERN_OFF].frames[0].duration_ms != 30 || a.clips[LED_PATTERN_SPEAKER_VOL].count != 4 ||
+            a.clips[LED_PATTERN_LISTENING_ONGOING].frames[0].duration_ms != 1 || a.clips[LED_PATTERN_SETUP].count != 0) {
+        return fail("compile");
+    }
+
+    /* Listening enter, then hold the ongoing state: 3 keyframes, then no more wakeups */
+    led_now = 1000;
+    led_wakeups = 0;
+    va_led_anim_play(&a, 0, LED_PATTERN_LISTENING_ENTER, VA_LED_ANIM_ONCE, 0);
+    va_led_anim_play(&a, 0, LED_PATTERN_LISTENING_ONGOING, VA_LED_ANIM_HOLD, 0);
+    led_run(&a, 1120);
+    if (led_shown != ((LED_PATTERN_LISTENING_ENTER << 8) | 2) || led_wakeups != 2) {
+        return fail("queue");
+    }
+    led_run(&a, 10000);
+    if (led_shown != (LED_PATTERN_LISTENING_ONGOING << 8) || led_wakeups != 4) {
+        return fail("hold");
+    }
+
+    /* A loop keeps its schedule, and is not restarted by playing it again */
+    va_led_anim_play(&a, 0, LED_PATTERN_THINKING, VA_LED_ANIM_LOOP, 0);
+    led_run(&a, 10250);
+    va_led_anim_play(&a, 0, LED_PATTERN_THINKING, VA_LED_ANIM_LOOP, 0);
+    led_run(&a, 10550);
+    if (led_shown != ((LED_PATTERN_THINKING << 8) | 1)) {
+        return fail("loop");
+    }
+
+    /* Mic off on a higher layer preempts the loop, which then resumes where it was */
+    va_led_anim_play(&a, 1, LED_PATTERN_MIC_OFF_ENTER, VA_LED_ANIM_ONCE, 0);
+    led_run(&a, 10570);
+    if (led_shown != ((LED_PATTERN_MIC_OFF_ENTER << 8) | 0)) {
+        return fail("preempt");
+    }
+    led_run(&a, 10610);
+    if (led_shown != ((LED_PATTERN_THINKING << 8) | 1)) {
+        return fail("resume");
+    }
+
+    /* Volume: one state, kept for at least the given time after it was shown */
+    va_led_anim_show(&a, 2, LED_PATTERN_SPEAKER_VOL, 2);
+    led_run(&a, 10620);
+    va_led_anim_release(&a, 2, 10790);
+    led_run(&a, 10780);
+    if (led_shown != ((LED_PATTERN_SPEAKER_VOL << 8) | 2)) {
+        return fail("volume");
+    }
+    led_run(&a, 10800);
+    if (led_shown != ((LED_PATTERN_THINKING << 8) | 1)) {
+        return fail("release");
+    }
+
+    /* Patterns without states leave the display alone. The resumed frame was restarted at 10790. */
+    va_led_anim_play(&a, 0, LED_PATTERN_SETUP, VA_LED_ANIM_ONCE, 0);
+    led_run(&a, 10900);
+    if (led_shown != ((LED_PATTERN_THINKING << 8) | 2)) {
+        return fail("empty pattern");
+    }
+    free(a.keyframes);
+    printf("Success\n");
+    return 0;
+}
+
+#define SPEED_T0        (1000LL * 1000 * 1000)      /* Far from 0, so that the buckets are not in their first lap */
+#define SPEED_BUCKET_US (NETWORK_SPEED_BUCKET_MS * 1000)
+
+static int test_network_speed()
+{
+    printf("test: network speed ....");
+    network_speed_t speed;
+    network_speed_stats_t st;
+    memset(&speed, 0xa5, sizeof(speed));
+    network_speed_start(&speed, SPEED_T0);
+    if (network_speed_get(&speed, SPEED_T0 + 50000, &st) != 0 || st.window_ms != 0 || st.avg_1s != 0) {
+        return fail("empty");
+    }
+
+    /* Less than a second: rates over the time actually covered */
+    for (int i = 0; i < 5; i++) {
+        network_speed_add(&speed, SPEED_T0 + i * SPEED_BUCKET_US + 10, 600);
+        network_speed_add(&speed, SPEED_T0 + i * SPEED_BUCKET_US + 90000, 400);
+    }
+    network_speed_add(&speed, SPEED_T0 + 5 * SPEED_BUCKET_US, 123);
+    network_speed_add(&speed, SPEED_T0, 0);
+    network_speed_add(&speed, SPEED_T0, -100);
+    if (network_speed_get(&speed, SPEED_T0 + 5 * SPEED_BUCKET_US + 50000, &st) != 5000 || st.window_ms != 500 ||
+            st.instant != 10000 || st.avg_1s != 10000 || st.avg_10s != 10000 || st.p10 != 10000 || st.p90 != 10000) {
+        return fail("partial window");
+    }
+
+    /* A ramp over the long window */
+    int64_t t1 = SPEED_T0 + 60 * 1000 * 1000;
+    network_speed_start(&speed, t1);
+    for (int i = 0; i < NETWORK_SPEED_WINDOW; i++) {
+        network_speed_add(&speed, t1 + i * SPEED_BUCKET_US, (i + 1) * 100);
+    }
+    int64_t t2 = t1 + NETWORK_SPEED_WINDOW * SPEED_BUCKET_US;
+    if (network_speed_get(&speed, t2, &st) != 505000 || st.window_ms != 10000 || st.instant != 100000 ||
+            st.avg_1s != 95500 || st.avg_10s != 50500 || st.p10 != 10000 || st.p50 != 50000 || st.p90 != 90000) {
+        return fail("ramp");
+    }
+    /* Only the newest buckets are counted once the window is full */
+    if (network_speed_get(&speed, t2 + 2 * SPEED_BUCKET_US, &st) != 505000 - 100 - 200 || st.instant != 0 ||
+            st.window_ms != 10000) {
+        return fail("sliding");
+    }
+
+    /* Buckets last written a lap ago are stale */
+    int64_t lap = (int64_t) NETWORK_SPEED_BUCKETS * SPEED_BUCKET_US;
+    if (network_speed_get(&speed, t2 + lap, &st) != 0 || st.p90 != 0) {
+        return fail("stale");
+    }
+    network_speed_add(&speed, t2 + lap, 7);
+    if (network_speed_get(&speed, t2 + lap + SPEED_BUCKET_US, &st) != 7 || st.instant != 70) {
+        return fail("reuse");
+    }
+
+    /* A bucket saturates rather than wrapping into the lap bits */
+    network_speed_add(&speed, t2 + lap + SPEED_BUCKET_US, 0x7fffffff);
+    network_speed_add(&speed, t2 + lap + SPEED_BUCKET_US, 0x7fffffff);
+    if (network_speed_get(&speed, t2 + lap + 2 * SPEED_BUCKET_US, &st) != 0xfffff + 7 || st.instant != 0xfffff * 10) {
+        return fail("saturate");
+    }
+
+    /* The lap number wraps after 4096 laps. Old counts must not come back, whether idle all along... */
+    int64_t t3 = t1 + 4096 * lap;
+    if (network_speed_get(&speed, t3 + SPEED_BUCKET_US, &st) != 0) {
+        return fail("lap wrap, read");
+    }
+    network_speed_add(&speed, t3, 5);
+    if (network_speed_get(&speed, t3 + SPEED_BUCKET_US, &st) != 5 || st.instant != 50) {
+        return fail("lap wrap, add");
+    }
+    /* ... or with traffic in other buckets only */
+    network_speed_start(&speed, t1);
+    network_speed_add(&speed, t1, 1000);
+    for (int i = 1; i <= 4096; i++) {
+        network_speed_add(&speed, t1 + i * lap + SPEED_BUCKET_US, 1);
+    }
+    if (network_speed_get(&speed, t3 + 2 * SPEED_BUCKET_US, &st) != 1) {
+        return fail("lap wrap, other buckets");
+    }
+    printf("Success\n");
+    return 0;
+}
+
+static void bench_file_reader()
+{
+    uint8_t *content = make_test_file();
+    uint8_t buf[64];
+    memset(&host_cnt, 0, sizeof(host_cnt));
+    int fd = (int) va_file_open(TEST_FILE, O_RDONLY);
+    while ((int) va_file_read(fd, buf, sizeof(buf)) > 0);
+    va_file_close(fd);
+    int unbuffered = host_cnt.task_switches;
+    memset(&host_cnt, 0, sizeof(host_cnt));
+    va_file_reader_t *reader = va_file_reader_open(TEST_FILE, 0);
+    while (va_file_reader_read(reader, buf, sizeof(buf)) > 0);
+    va_file_reader_close(reader);
+    printf("bench: reading %d bytes in 64 byte chunks: va_file_read %d task switches, reader %d\n", TEST_FILE_SIZE,
+           unbuffered, host_cnt.task_switches);
+    unlink(TEST_FILE);
+    free(content);
+}
+
+static void bench()
+{
+    int iters = 1000000;
+    int8_t i8;
+    reset();
+    va_nvs_set_i8("volume", 3);
+    host_fire_timers();
+    memset(&host_cnt, 0, sizeof(host_cnt));
+    clock_t c = clock();
+    for (int i = 0; i < iters; i++) {
+        va_nvs_get_i8("volume", &i8);
+    }
+    double t = (double) (clock() - c) * 1000000 / CLOCKS_PER_SEC;
+    printf("bench: cached get %.1f ns, %d task switches, %d flash reads\n", t * 1000 / iters, host_cnt.task_switches, host_cnt.gets);
+    c = clock();
+    for (int i = 0; i < iters; i++) {
+        va_nvs_set_i8("volume", i & 0x7f);
+        if ((i & 0xff) == 0) {
+            host_fire_timers();
+        }
+    }
+    host_fire_timers();
+    t = (double) (clock() - c) * 1000000 / CLOCKS_PER_SEC;
+    printf("bench: set %.1f ns, %d task switches, %d flash writes, %d commits for %d sets\n", t * 1000 / iters,
+           host_cnt.task_switches, host_cnt.sets, host_cnt.commits, iters);
+}
+
+static void bench_network_speed()
+{
+    int iters = 10000000;
+    network_speed_t speed;
+    network_speed_stats_t st;
+    network_speed_start(&speed, SPEED_T0);
+    clock_t c = clock();
+    for (int i = 0; i < iters; i++) {
+        network_speed_add(&speed, SPEED_T0 + i, 1460);
+    }
+    double t = (double) (clock() - c) * 1000000 / CLOCKS_PER_SEC;
+    c = clock();
+    for (int i = 0; i < 10000; i++) {
+        network_speed_get(&speed, SPEED_T0 + iters + i, &st);
+    }
+    double g = (double) (clock() - c) * 1000000 / CLOCKS_PER_SEC;
+    printf("bench: network speed add %.1f ns, get %.1f us\n", t * 1000 / iters, g / 10000);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        bench_file_reader();
+        bench_network_speed();
+        return 0;
+    }
+    if (test_write_behind() || test_read_cache() || test_erase_and_flush() || test_large_and_many() || test_file_reader() ||
+            test_led_anim() || test_network_speed()) {
+        return -1;
+    }
+    return 0;
+}
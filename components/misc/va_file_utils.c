@@ -21,15 +21,22 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <string.h>
 #include <fcntl.h>
 #include <esp_vfs.h>
+#include <esp_partition.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/timers.h>
+#include <freertos/semphr.h>
 #include <esp_log.h>
 
+#include <va_mem_utils.h>
 #include <va_file_utils.h>
 
+#define VA_FILE_READER_ALIGN            512     /* FAT sector */
+#define VA_FILE_READER_BLOCK_DEFAULT    (4 * 1024)
+
 static const char *TAG = "[va_file_utils]";
 
 struct va_file_params {
@@ -102,3 +109,185 @@ uint32_t va_file_close(int fd)
     };
     return va_file_process_common(&params);
 }
+
+struct va_file_reader {
+    int fd;
+    size_t block_size;
+    uint8_t *buf[2];
+    int buf_len[2];             /* Set by the timer task. 0 at the end of the file, -1 on error. */
+    int cur;                    /* Buffer being consumed */
+    bool started;
+    bool done;
+    int pending;                /* Fills queued on the timer task */
+    SemaphoreHandle_t filled;   /* Given once per completed fill. Fills complete in the order they are queued. */
+    const uint8_t *pos;
+    int avail;
+    int err;
+    /* Memory mapped partition */
+    bool mapped;
+    spi_flash_mmap_handle_t map_handle;
+};
+
+static void va_file_reader_fill_cb(void *arg, uint32_t idx)
+{
+    va_file_reader_t *reader = (va_file_reader_t *)arg;
+    reader->buf_len[idx] = read(reader->fd, reader->buf[idx], reader->block_size);
+    xSemaphoreGive(reader->filled);
+}
+
+static void va_file_reader_queue_fill(va_file_reader_t *reader, int idx)
+{
+    reader->pending++;
+    xTimerPendFunctionCall(va_file_reader_fill_cb, reader, idx, portMAX_DELAY);
+}
+
+/* Move on to the other buffer, and have the drained one filled with the block after it */
+static int va_file_reader_next(va_file_reader_t *reader)
+{
+    if (reader->done) {
+        return reader->err;
+    }
+    if (reader->started) {
+        va_file_reader_queue_fill(reader, reader->cur);
+        reader->cur ^= 1;
+    }
+    reader->started = true;
+    xSemaphoreTake(reader->filled, portMAX_DELAY);
+    reader->pending--;
+    int len = reader->buf_len[reader->cur];
+    if (len <= 0) {
+        reader->done = true;
+        reader->err = (len < 0) ? -1 : 0;
+        return reader->err;
+    }
+    reader->pos = reader->buf[reader->cur];
+    reader->avail = len;
+    return len;
+}
+
+static void va_file_reader_free(va_file_reader_t *reader)
+{
+    if (reader->filled) {
+        vSemaphoreDelete(reader->filled);
+    }
+    if (reader->buf[0]) {
+        va_mem_free(reader->buf[0]);
+    }
+    if (reader->buf[1]) {
+        va_mem_free(reader->buf[1]);
+    }
+    va_mem_free(reader);
+}
+
+va_file_reader_t *va_file_reader_open(char *file_name, size_t block_size)
+{
+    if (block_size == 0) {
+        block_size = VA_FILE_READER_BLOCK_DEFAULT;
+    }
+    block_size = (block_size + VA_FILE_READER_ALIGN - 1) & ~(VA_FILE_READER_ALIGN - 1);
+
+    va_file_reader_t *reader = va_mem_alloc(sizeof(va_file_reader_t), VA_MEM_INTERNAL);
+    if (!reader) {
+        ESP_LOGE(TAG, "Failed to allocate reader");
+        return NULL;
+    }
+    memset(reader, 0, sizeof(va_file_reader_t));
+    reader->block_size = block_size;
+    reader->buf[0] = va_mem_alloc(block_size, VA_MEM_EXTERNAL);
+    reader->buf[1] = va_mem_alloc(block_size, VA_MEM_EXTERNAL);
+    reader->filled = xSemaphoreCreateCounting(2, 0);
+    if (!reader->buf[0] || !reader->buf[1] || !reader->filled) {
+        ESP_LOGE(TAG, "Failed to allocate reader buffers");
+        va_file_reader_free(reader);
+        return NULL;
+    }
+    reader->fd = (int)va_file_open(file_name, O_RDONLY);
+    if (reader->fd < 0) {
+        ESP_LOGE(TAG, "Failed to open %s", file_name);
+        va_file_reader_free(reader);
+        return NULL;
+    }
+    /* Start reading the first two blocks right away */
+    va_file_reader_queue_fill(reader, 0);
+    va_file_reader_queue_fill(reader, 1);
+    return reader;
+}
+
+va_file_reader_t *va_file_reader_open_partition(const char *label, size_t offset, size_t len)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!partition || offset > partition->size) {
+        ESP_LOGE(TAG, "Partition %s not found or too small", label);
+        return NULL;
+    }
+    if (len == 0 || len > partition->size - offset) {
+        len = partition->size - offset;
+    }
+    va_file_reader_t *reader = va_mem_alloc(sizeof(va_file_reader_t), VA_MEM_INTERNAL);
+    if (!reader) {
+        ESP_LOGE(TAG, "Failed to allocate reader");
+        return NULL;
+    }
+    memset(reader, 0, sizeof(va_file_reader_t));
+    const void *ptr;
+    if (esp_partition_mmap(partition, offset, len, SPI_FLASH_MMAP_DATA, &ptr, &reader->map_handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map partition %s", label);
+        va_mem_free(reader);
+        return NULL;
+    }
+    reader->fd = -1;
+    reader->mapped = true;
+    reader->done = true;
+    reader->pos = ptr;
+    reader->avail = len;
+    return reader;
+}
+
+int va_file_reader_get(va_file_reader_t *reader, const void **data, int max_len)
+{
+    if (reader->avail == 0) {
+        int ret = va_file_reader_next(reader);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
+    int len = (max_len < reader->avail) ? max_len : reader->avail;
+    *data = reader->pos;
+    reader->pos += len;
+    reader->avail -= len;
+    return len;
+}
+
+int va_file_reader_read(va_file_reader_t *reader, void *data, int len)
+{
+    int copied = 0;
+    while (copied < len) {
+        const void *src;
+        int n = va_file_reader_get(reader, &src, len - copied);
+        if (n <= 0) {
+            return copied ? copied : n;
+        }
+        memcpy((uint8_t *)data + copied, src, n);
+        copied += n;
+    }
+    return copied;
+}
+
+void va_file_reader_close(va_file_reader_t *reader)
+{
+    if (!reader) {
+        return;
+    }
+    if (reader->mapped) {
+        spi_flash_munmap(reader->map_handle);
+        va_mem_free(reader);
+        return;
+    }
+    /* The timer task may still be reading into the buffers */
+    while (reader->pending) {
+        xSemaphoreTake(reader->filled, portMAX_DELAY);
+        reader->pending--;
+    }
+    va_file_close(reader->fd);
+    va_file_reader_free(reader);
+}
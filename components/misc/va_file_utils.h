@@ -24,7 +24,61 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 uint32_t va_file_open(char *file_name, int mode);
 uint32_t va_file_close(int fd);
 uint32_t va_file_read(int fd, void *data, int len);
+
+/**
+ * Buffered, sequential file reader.
+ *
+ * va_file_read hops to the timer task for every call. The reader instead reads whole blocks there, one block
+ * ahead of the caller, so most reads are served from memory without a task switch.
+ */
+typedef struct va_file_reader va_file_reader_t;
+
+/**
+ * @brief   Open a file for buffered reading
+ *
+ * @param[in] file_name     File to read
+ * @param[in] block_size    Size of each read from the file. Rounded up to a multiple of 512. 0 for the default (4KB).
+ *                          Two blocks are allocated.
+ *
+ * @return  Reader handle, NULL on failure.
+ */
+va_file_reader_t *va_file_reader_open(char *file_name, size_t block_size);
+
+/**
+ * @brief   Open a data partition for reading, memory mapped
+ *
+ * Nothing is copied or read ahead: data is read straight from the flash cache.
+ *
+ * @param[in] label     Partition label
+ * @param[in] offset    Start offset within the partition
+ * @param[in] len       Bytes to map. 0 for the rest of the partition.
+ *
+ * @return  Reader handle, NULL on failure.
+ */
+va_file_reader_t *va_file_reader_open_partition(const char *label, size_t offset, size_t len);
+
+/**
+ * @brief   Copy up to len bytes
+ *
+ * @return  Number of bytes read, 0 at the end of the file, -1 on error.
+ */
+int va_file_reader_read(va_file_reader_t *reader, void *data, int len);
+
+/**
+ * @brief   Get up to max_len bytes without a copy
+ *
+ * *data points into the reader's buffer (or the mapped flash) and stays valid until the next call on the reader.
+ *
+ * @return  Number of bytes available at *data, 0 at the end of the file, -1 on error.
+ */
+int va_file_reader_get(va_file_reader_t *reader, const void **data, int max_len);
+
+/**
+ * @brief   Close the reader and free its buffers
+ */
+void va_file_reader_close(va_file_reader_t *reader);
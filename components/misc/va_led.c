@@ -11,6 +11,7 @@
 #include <led_driver.h>
 #include <led_pattern.h>
 #include <va_led.h>
+#include <va_led_anim.h>
 #include <esp_timer.h>
 
 //#define EN_STACK_MEASUREMENT
@@ -26,23 +27,47 @@ static bool va_led_dnd_st = false;
 static bool va_led_error_st = false;
 static bool va_led_alert_short_en = false;
 static bool init_done;
-static uint8_t counter = 0;
 static uint64_t bootup_start_time = 0;
 
+/* Layers, lowest priority first */
+enum {
+    VA_LED_LAYER_STATE,         /* Dialog and device state */
+    VA_LED_LAYER_MIC,           /* Mic off enter/exit */
+    VA_LED_LAYER_VOLUME,        /* Volume level / speaker mute, until VA_SET_VOLUME_DONE */
+};
+
+#define VA_LED_VOLUME_MIN_MS    178     /* Volume level stays on at least this long */
+
+/* Requests from va_led_set() and friends, picked up by the led task */
+#define VA_LED_EV_MUTE          (1 << 0)
+#define VA_LED_EV_UNMUTE        (1 << 1)
+#define VA_LED_EV_VOLUME        (1 << 2)
+#define VA_LED_EV_VOLUME_DONE   (1 << 3)
+#define VA_LED_EV_ERROR         (1 << 4)
+#define VA_LED_EV_ALERT_SHORT   (1 << 5)
+#define VA_LED_EV_STATE         (1 << 6)
+
 typedef struct {
     TaskHandle_t va_led_task_handle;
-    SemaphoreHandle_t va_led_tim_sema;
-    SemaphoreHandle_t va_led_patttern_sema;
     esp_timer_handle_t esp_delay_timer_hdl;
+    portMUX_TYPE lock;
+    uint32_t events;
+    int state;                  /* For VA_LED_EV_STATE */
+    int volume_state;           /* For VA_LED_EV_VOLUME */
 } va_led_t;
 
-static va_led_t led_st = {NULL, NULL,  NULL, NULL};
+static va_led_t led_st = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
 
-typedef struct {
-    uint32_t va_led_current_state;
-    bool va_led_priority_status;
-} va_led_priority_t;
-static va_led_priority_t va_led_priority[4];    //Mute, Unmute, Vol, all other states
+static va_led_anim_t va_led_anim;
+
+/* Owned by the led task */
+static int va_led_cur_state = -1;
+static bool va_led_is_mute = false;
+static bool va_led_listen_on_going = false;
+static bool va_led_listening_end_flag = false;
+static int64_t va_led_volume_shown;
 
 static void va_led_bootup_start()
 {
@@ -64,9 +89,16 @@ static bool va_led_bootup_check_time_expiry()
     return ret;
 }
 
+static void va_led_notify()
+{
+    if (led_st.va_led_task_handle) {
+        xTaskNotifyGive(led_st.va_led_task_handle);
+    }
+}
+
 void va_led_delay_timer_cb()
 {
-    xSemaphoreGive(led_st.va_led_tim_sema);
+    va_led_notify();
 }
 
 IRAM_ATTR esp_err_t va_led_set(int va_state)
@@ -74,216 +106,190 @@ IRAM_ATTR esp_err_t va_led_set(int va_state)
     if (!init_done) {
         return ESP_OK;
     }
-    if(va_state == VA_MUTE_ENABLE) {
-        va_led_alert_short_en = false;
-        va_led_priority[0].va_led_priority_status = true;
-        va_led_priority[1].va_led_priority_status = false;
-        va_led_priority[0].va_led_current_state = va_state;
+    portENTER_CRITICAL(&led_st.lock);
+    if (va_state == VA_MUTE_ENABLE) {
+        led_st.events = (led_st.events & ~(VA_LED_EV_UNMUTE | VA_LED_EV_ALERT_SHORT)) | VA_LED_EV_MUTE;
     } else if (va_state == VA_MUTE_DISABLE) {
-        va_led_alert_short_en = false;
-        va_led_priority[1].va_led_priority_status = true;
-        va_led_priority[0].va_led_priority_status = false;
-        va_led_priority[1].va_led_current_state = va_state;
-        if (DND_IS_PRESENT) {
-            va_led_dnd_st = true;
-        }
+        led_st.events = (led_st.events & ~(VA_LED_EV_MUTE | VA_LED_EV_ALERT_SHORT)) | VA_LED_EV_UNMUTE;
     } else if (va_state == VA_SET_VOLUME || va_state == VA_SPEAKER_MUTE_ENABLE) {
-        va_led_alert_short_en = false;
-        va_led_priority[2].va_led_priority_status = true;
-        va_led_priority[2].va_led_current_state = va_state;
-        va_led_priority[3].va_led_priority_status = false; //When in volume condition, turn off other states
+        led_st.events = (led_st.events & ~(VA_LED_EV_VOLUME_DONE | VA_LED_EV_ALERT_SHORT)) | VA_LED_EV_VOLUME;
+        led_st.volume_state = va_state;
     } else if (va_state == VA_SET_VOLUME_DONE) {
-        va_led_priority[3].va_led_priority_status = true;
+        led_st.events |= VA_LED_EV_VOLUME_DONE;
     } else if (va_state == VA_UI_ERROR) {
-        va_led_error_st = true;
+        led_st.events |= VA_LED_EV_ERROR;
     } else if (va_state == LED_PATTERN_ALERT_SHORT) {
-        counter = 0;
-        va_led_alert_short_en = true;
+        led_st.events |= VA_LED_EV_ALERT_SHORT;
     } else {
-        va_led_priority[3].va_led_priority_status = true;    //Once in this state, this will always be true
-        va_led_priority[3].va_led_current_state = va_state;
+        led_st.events |= VA_LED_EV_STATE;
+        led_st.state = va_state;
     }
+    portEXIT_CRITICAL(&led_st.lock);
 
 #ifdef EN_STACK_MEASUREMENT
     ESP_LOGI("TAG", "Free Task Stack is: %s %u\n\n\n", __func__, uxTaskGetStackHighWaterMark(led_st.va_led_task_handle));
 #endif
-    xSemaphoreGive(led_st.va_led_patttern_sema);
-    if (!va_led_alert_short_en) {
-        counter = 0;
-    }
+    va_led_notify();
     return ESP_OK;
 }
 
-static void va_led_send_vl(led_pattern_state_t *va_led_v, uint8_t num)
+/* What the state layer shows for the current state. One-shot patterns are queued as their conditions are consumed. */
+static void va_led_compose_state()
 {
-    xSemaphoreTake(led_st.va_led_tim_sema, portMAX_DELAY);
-    led_driver_set_value((uint32_t *)va_led_v[num].led_state_val);
-    esp_timer_start_once(led_st.esp_delay_timer_hdl, (va_led_v[num].led_state_delay * 1000));
+    va_led_anim_t *a = &va_led_anim;
+    const int layer = VA_LED_LAYER_STATE;
+    switch (va_led_cur_state) {
+        case VA_UI_CAN_START :
+            /* Stop when LEDs are turned off (state change) OR there is an error OR bootup time has expired */
+            va_led_anim_play(a, layer, LED_PATTERN_BOOTUP_2,
+                             (va_led_error_st || va_led_bootup_check_time_expiry()) ? VA_LED_ANIM_HOLD : VA_LED_ANIM_LOOP, 0);
+        break;
+        case VA_IDLE :
+            if (va_led_listening_end_flag) {
+                va_led_anim_play(a, layer, LED_PATTERN_LISTENING_EXIT, VA_LED_ANIM_ONCE, 0);
+                va_led_listening_end_flag = false;
+                va_led_listen_on_going = false;
+            }
+            if (va_led_dnd_st) {
+                va_led_anim_play(a, layer, LED_PATTERN_DO_NOT_DISTURB, VA_LED_ANIM_ONCE, 0);
+                va_led_dnd_st = false;
+            }
+            if (va_led_error_st) {
+                va_led_anim_play(a, layer, LED_PATTERN_ERROR, VA_LED_ANIM_ONCE, 0);
+                va_led_error_st = false;
+            }
+            if (NOTIFICATION_IS_PRESENT && va_led_notif_incoming_is_done) {
+                va_led_anim_play(a, layer, LED_PATTERN_NOTIFICATION_NEW, VA_LED_ANIM_ONCE, 0);
+                va_led_notif_incoming_is_done = false;
+            }
+            if (NOTIFICATION_IS_PRESENT && !(ALERT_IS_PRESENT > 0)) {
+                va_led_anim_play(a, layer, LED_PATTERN_NOTIFICATION_ONGOING, VA_LED_ANIM_LOOP, 0);
+            } else if (ALERT_IS_PRESENT > 0) {
+                va_led_anim_play(a, layer, LED_PATTERN_ALERT, VA_LED_ANIM_LOOP, 0);
+            } else if (va_led_is_mute) {
+                va_led_anim_play(a, layer, LED_PATTERN_MIC_OFF_ONGOING, VA_LED_ANIM_HOLD, 0);
+            } else {
+                va_led_anim_play(a, layer, LED_PATTERN_OFF, VA_LED_ANIM_HOLD, 0);
+            }
+        break;
+        case VA_LISTENING :
+            va_led_listening_end_flag = true;
+            if (va_led_listen_on_going == false) {
+                va_led_anim_play(a, layer, LED_PATTERN_LISTENING_ENTER, VA_LED_ANIM_ONCE, 0);
+                va_led_listen_on_going = true;
+                va_led_alert_short_en = false;
+            }
+            if (va_led_alert_short_en) {
+                va_led_anim_play(a, layer, LED_PATTERN_ALERT_SHORT, VA_LED_ANIM_ONCE, 0);
+                va_led_alert_short_en = false;
+            }
+            va_led_anim_play(a, layer, LED_PATTERN_LISTENING_ONGOING, VA_LED_ANIM_HOLD, 0);
+        break;
+        case VA_THINKING :
+        case VA_SPEAKING :
+            va_led_listening_end_flag = true;
+            va_led_listen_on_going = false;
+            if (va_led_alert_short_en) {
+                va_led_anim_play(a, layer, LED_PATTERN_ALERT_SHORT, VA_LED_ANIM_ONCE, 0);
+                va_led_alert_short_en = false;
+            }
+            if (va_led_cur_state == VA_THINKING) {
+                va_led_anim_play(a, layer, LED_PATTERN_THINKING, VA_LED_ANIM_LOOP, 0);
+            } else {
+                va_led_anim_play(a, layer, LED_PATTERN_SPEAKING, VA_LED_ANIM_LOOP, 0);
+                if (DND_IS_PRESENT) {
+                    va_led_dnd_st = true;
+                }
+            }
+        break;
+        case VA_UI_RESET :
+            va_led_anim_play(a, layer, LED_PATTERN_SETUP, VA_LED_ANIM_LOOP, 0);
+        break;
+        case VA_UI_OTA :
+            va_led_anim_play(a, layer, LED_PATTERN_OTA, VA_LED_ANIM_HOLD, 0);
+        break;
+        case VA_UI_OFF :
+            va_led_anim_play(a, layer, LED_PATTERN_OFF, VA_LED_ANIM_HOLD, 0);
+        break;
+        default :
+        break;
+    }
 }
 
-static void va_led_set_state(size_t sz, const led_pattern_state_t *va_led_conf)
+static void va_led_handle_events(int64_t now)
 {
-    for(int i = 0; i < sz; i++) {
-        va_led_send_vl((led_pattern_state_t *)va_led_conf, i);
+    va_led_anim_t *a = &va_led_anim;
+    portENTER_CRITICAL(&led_st.lock);
+    uint32_t events = led_st.events;
+    int state = led_st.state;
+    int volume_state = led_st.volume_state;
+    led_st.events = 0;
+    portEXIT_CRITICAL(&led_st.lock);
+
+    //Handle Mute / Un-mute
+    if (events & (VA_LED_EV_MUTE | VA_LED_EV_UNMUTE)) {
+        va_led_alert_short_en = false;
+        va_led_is_mute = (events & VA_LED_EV_MUTE) != 0;
+        va_led_anim_stop(a, VA_LED_LAYER_MIC);
+        va_led_anim_play(a, VA_LED_LAYER_MIC, va_led_is_mute ? LED_PATTERN_MIC_OFF_ENTER : LED_PATTERN_MIC_OFF_EXIT,
+                         VA_LED_ANIM_ONCE, 0);
+        if (!va_led_is_mute && DND_IS_PRESENT) {
+            va_led_dnd_st = true;
+        }
     }
+    //Handle Volume and speaker Mute
+    if (events & VA_LED_EV_VOLUME) {
+        va_led_alert_short_en = false;
+        va_led_anim_stop(a, VA_LED_LAYER_VOLUME);
+        if (volume_to_set == 0 || volume_state == VA_SPEAKER_MUTE_ENABLE) {
+            /* Three times, then keep the last state */
+            va_led_anim_play(a, VA_LED_LAYER_VOLUME, LED_PATTERN_SPEAKER_MUTE, VA_LED_ANIM_ONCE, 2);
+            va_led_anim_play(a, VA_LED_LAYER_VOLUME, LED_PATTERN_SPEAKER_MUTE, VA_LED_ANIM_HOLD, 0);
+        } else {
+            uint8_t vol = volume_to_set / 5;
+            if (vol <= 0) {
+                vol = 1;
+            }
+            va_led_anim_show(a, VA_LED_LAYER_VOLUME, LED_PATTERN_SPEAKER_VOL, vol - 1);
+        }
+        va_led_volume_shown = now;
+    }
+    if (events & VA_LED_EV_VOLUME_DONE) {
+        va_led_anim_release(a, VA_LED_LAYER_VOLUME, va_led_volume_shown + VA_LED_VOLUME_MIN_MS);
+    }
+    if (events & VA_LED_EV_ERROR) {
+        va_led_error_st = true;
+    }
+    if (events & VA_LED_EV_ALERT_SHORT) {
+        va_led_alert_short_en = true;
+    }
+    if ((events & VA_LED_EV_STATE) && state != va_led_cur_state) {
+        va_led_cur_state = state;
+        if (state == VA_UI_CAN_START) {
+            va_led_bootup_start();
+            va_led_anim_stop(a, VA_LED_LAYER_STATE);
+            va_led_anim_play(a, VA_LED_LAYER_STATE, LED_PATTERN_BOOTUP_1, VA_LED_ANIM_ONCE, 0);
+        }
+    }
+    va_led_compose_state();
 }
 
+/* All layers are driven from one one-shot timer, armed for the next keyframe. Requests only wake the task up. */
 static void va_led_task(void *arg)
 {
-    bool va_led_is_mute = false;
-    bool va_led_listen_on_going = false;
-    bool va_led_listening_end_flag = false;
-    led_pattern_config_t *va_led_con = (led_pattern_config_t *)arg;
-    TickType_t va_led_tick = portMAX_DELAY;
     while (1) {
-        vTaskDelay(1);      // Temporary fix for ui-led-thread spinning
-        xSemaphoreTake(led_st.va_led_patttern_sema, va_led_tick);
-        //Handle Mute
-        if (va_led_priority[0].va_led_priority_status) {
-            va_led_set_state(va_led_con[LED_PATTERN_MIC_OFF_ENTER].led_states_count, va_led_con[LED_PATTERN_MIC_OFF_ENTER].led_states);
-            va_led_is_mute = true;
-            va_led_priority[0].va_led_priority_status = false;
-            va_led_tick = portMAX_DELAY;
-        }
-        //Handle Un-mute
-        if (va_led_priority[1].va_led_priority_status) {
-            va_led_set_state(va_led_con[LED_PATTERN_MIC_OFF_EXIT].led_states_count, va_led_con[LED_PATTERN_MIC_OFF_EXIT].led_states);
-            va_led_is_mute = false;
-            va_led_priority[1].va_led_priority_status = false;
-            va_led_tick = portMAX_DELAY;
-        }
-        //Handle Volume and speaker Mute
-        if (va_led_priority[2].va_led_priority_status) {
-            if(volume_to_set == 0 || va_led_priority[2].va_led_current_state == VA_SPEAKER_MUTE_ENABLE) {
-                for(int i = 0; i < 3; i++) {
-                    va_led_set_state(va_led_con[LED_PATTERN_SPEAKER_MUTE].led_states_count, va_led_con[LED_PATTERN_SPEAKER_MUTE].led_states);
-                }
-            } else {
-                uint8_t vol = volume_to_set / 5;
-                if (vol <= 0) {
-                    vol = 1;
-                }
-                va_led_send_vl(va_led_con[LED_PATTERN_SPEAKER_VOL].led_states, vol - 1);
-                vTaskDelay(178 / portTICK_RATE_MS); //Need to figue out this delay
-            }
-            va_led_priority[2].va_led_priority_status = false;
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        int64_t now = esp_timer_get_time() / 1000;
+        va_led_handle_events(now);
+        int64_t next;
+        const uint32_t *val = va_led_anim_run(&va_led_anim, now, &next);
+        if (val) {
+            led_driver_set_value(val);
         }
-        //Handle all other led states
-        if (va_led_priority[3].va_led_priority_status) {
-            switch (va_led_priority[3].va_led_current_state) {
-                case VA_UI_CAN_START :
-                    va_led_bootup_start();
-                    va_led_set_state(va_led_con[LED_PATTERN_BOOTUP_1].led_states_count, va_led_con[LED_PATTERN_BOOTUP_1].led_states);  //bootup 1
-                    /* Stop when LEDs are turned off OR there is an error OR bootup time has expired */
-                    while (va_led_priority[3].va_led_current_state != VA_UI_OFF && va_led_error_st != true && va_led_bootup_check_time_expiry() == false) {
-                        va_led_send_vl(va_led_con[LED_PATTERN_BOOTUP_2].led_states, counter);
-                        counter = (counter + 1) % va_led_con[LED_PATTERN_BOOTUP_2].led_states_count;
-                    }
-                    va_led_tick = portMAX_DELAY;
-                break;
-                case VA_IDLE :
-                    if(va_led_listening_end_flag && (va_led_priority[3].va_led_current_state == VA_IDLE)) {
-                        va_led_set_state(va_led_con[LED_PATTERN_LISTENING_EXIT].led_states_count, va_led_con[LED_PATTERN_LISTENING_EXIT].led_states);
-                        va_led_listening_end_flag = false;
-                        va_led_listen_on_going = false;
-                    }
-                    if (va_led_dnd_st) {
-                        va_led_set_state(va_led_con[LED_PATTERN_DO_NOT_DISTURB].led_states_count, va_led_con[LED_PATTERN_DO_NOT_DISTURB].led_states);
-                        va_led_dnd_st = false;
-                    }
-                    if (va_led_error_st) {
-                        va_led_set_state(va_led_con[LED_PATTERN_ERROR].led_states_count, va_led_con[LED_PATTERN_ERROR].led_states);
-                        va_led_error_st = false;
-                    }
-                    if (NOTIFICATION_IS_PRESENT && (!(ALERT_IS_PRESENT > 0) || va_led_notif_incoming_is_done == true)) {
-                        if(va_led_notif_incoming_is_done) {
-                            va_led_set_state(va_led_con[LED_PATTERN_NOTIFICATION_NEW].led_states_count, va_led_con[LED_PATTERN_NOTIFICATION_NEW].led_states);
-                            va_led_notif_incoming_is_done = false;
-                        }
-                        if (!(ALERT_IS_PRESENT > 0)) {
-                            va_led_send_vl(va_led_con[LED_PATTERN_NOTIFICATION_ONGOING].led_states, counter);
-                            counter = (counter + 1) % va_led_con[LED_PATTERN_NOTIFICATION_ONGOING].led_states_count;
-                            va_led_tick = 0;
-                        }
-                    } else if (ALERT_IS_PRESENT > 0) {
-                        va_led_send_vl(va_led_con[LED_PATTERN_ALERT].led_states, counter);
-                        counter = (counter + 1) % va_led_con[LED_PATTERN_ALERT].led_states_count;
-                        va_led_tick = 0;
-                    } else if(va_led_is_mute) {
-                        va_led_set_state(va_led_con[LED_PATTERN_MIC_OFF_ONGOING].led_states_count, va_led_con[LED_PATTERN_MIC_OFF_ONGOING].led_states);
-                        va_led_tick = portMAX_DELAY;
-                        break;
-                    } else {
-                        va_led_set_state(va_led_con[LED_PATTERN_OFF].led_states_count, va_led_con[LED_PATTERN_OFF].led_states);  //LED off
-                        va_led_tick = portMAX_DELAY;
-                    }
-                break;
-                case VA_LISTENING :
-                    va_led_listening_end_flag = true;
-                    if (va_led_listen_on_going == false) {
-                        va_led_set_state(va_led_con[LED_PATTERN_LISTENING_ENTER].led_states_count, va_led_con[LED_PATTERN_LISTENING_ENTER].led_states);
-                        va_led_listen_on_going = true;
-                        va_led_alert_short_en = false;
-                    }
-                    if (va_led_alert_short_en) {
-                        va_led_send_vl(va_led_con[LED_PATTERN_ALERT_SHORT].led_states, counter);
-                        if ((counter = (counter + 1) % va_led_con[LED_PATTERN_ALERT_SHORT].led_states_count) == 0) {
-                            va_led_alert_short_en = false;
-                        }
-                        va_led_tick = 0;
-                    } else {
-                        va_led_set_state(va_led_con[LED_PATTERN_LISTENING_ONGOING].led_states_count, va_led_con[LED_PATTERN_LISTENING_ONGOING].led_states);
-                        va_led_tick = portMAX_DELAY;
-                    }
-                break;
-                case VA_THINKING :
-                    va_led_listening_end_flag = true;
-                    va_led_listen_on_going = false;
-                    if (va_led_alert_short_en) {
-                        va_led_send_vl(va_led_con[LED_PATTERN_ALERT_SHORT].led_states, counter);
-                        if ((counter = (counter + 1) % va_led_con[LED_PATTERN_ALERT_SHORT].led_states_count) == 0) {
-                            va_led_alert_short_en = false;
-                        }
-                    } else {
-                        va_led_send_vl(va_led_con[LED_PATTERN_THINKING].led_states, counter);
-                        counter = (counter + 1) % va_led_con[LED_PATTERN_THINKING].led_states_count;
-                    }
-                    va_led_tick = 0;
-                break;
-                case VA_SPEAKING :
-                    va_led_listening_end_flag = true;
-                    va_led_listen_on_going = false;
-                    if (va_led_alert_short_en) {
-                        va_led_send_vl(va_led_con[LED_PATTERN_ALERT_SHORT].led_states, counter);
-                        if ((counter = (counter + 1) % va_led_con[LED_PATTERN_ALERT_SHORT].led_states_count) == 0) {
-                            va_led_alert_short_en = false;
-                        }
-                    } else {
-                        va_led_send_vl(va_led_con[LED_PATTERN_SPEAKING].led_states, counter);
-                        counter = (counter + 1) % va_led_con[LED_PATTERN_SPEAKING].led_states_count;
-                    }
-                    va_led_tick = 0;
-                    if (DND_IS_PRESENT) {
-                        va_led_dnd_st = true;
-                    }
-                    break;
-                case VA_UI_RESET :
-                    va_led_send_vl(va_led_con[LED_PATTERN_SETUP].led_states, counter);
-                    counter = (counter + 1) % va_led_con[LED_PATTERN_SETUP].led_states_count;
-                    va_led_tick = 0;
-                break;
-                case VA_UI_OTA :
-                    va_led_set_state(va_led_con[LED_PATTERN_OTA].led_states_count, va_led_con[LED_PATTERN_OTA].led_states);  //led off
-                    va_led_tick = portMAX_DELAY;
-                break;
-                case VA_UI_OFF :
-                    va_led_set_state(va_led_con[LED_PATTERN_OFF].led_states_count, va_led_con[LED_PATTERN_OFF].led_states);  //led off
-                    va_led_tick = portMAX_DELAY;
-                break;
-                default :
-                    va_led_tick = portMAX_DELAY;
-                break;
-            }
+        esp_timer_stop(led_st.esp_delay_timer_hdl);
+        if (next != VA_LED_ANIM_NEVER) {
+            int64_t delay_ms = (next > now) ? next - now : 1;
+            esp_timer_start_once(led_st.esp_delay_timer_hdl, delay_ms * 1000);
         }
     }
 }
@@ -317,11 +323,13 @@ void va_led_set_alert(alexa_alert_types_t alert_type, alexa_alert_state_t alert_
         default:
             break;
     }
+    va_led_notify();
 }
 
 void va_led_set_dnd(bool dnd_state)
 {
     DND_IS_PRESENT = dnd_state;
+    va_led_notify();
 }
 
 esp_err_t va_led_init()
@@ -334,24 +342,18 @@ esp_err_t va_led_init()
     led_pattern_get_config(&va_led_conf);
 
     static StaticTask_t va_led_buf;
+    esp_err_t ret = va_led_anim_init(&va_led_anim, va_led_conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Could not allocate memory for led keyframes");
+        return ret;
+    }
     init_done = true;
-    esp_err_t ret = ESP_FAIL;
 
     StackType_t *va_led_task_stack = (StackType_t *)va_mem_alloc(VA_LED_TASK_STACK_SZ, VA_MEM_EXTERNAL);
     if (va_led_task_stack == NULL) {
         ESP_LOGE(TAG, "Could not allocate memomory for ui led thread");
         return ESP_FAIL;
     }
-    vSemaphoreCreateBinary(led_st.va_led_tim_sema);
-    if (led_st.va_led_tim_sema == NULL) {
-        ESP_LOGE(TAG, "Could not create semaphore");
-        return ESP_FAIL;
-    }
-    vSemaphoreCreateBinary(led_st.va_led_patttern_sema);
-    if (led_st.va_led_patttern_sema == NULL) {
-        ESP_LOGE(TAG, "Could not create led pattern semaphore");
-        return ESP_FAIL;
-    }
     ret = esp_timer_init();
     if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
         ESP_LOGE(TAG, "Could not create esp timer");
@@ -366,7 +368,7 @@ esp_err_t va_led_init()
         ESP_LOGE(TAG, "Failed to create esp timer");
         return ESP_FAIL;
     }
-    led_st.va_led_task_handle = xTaskCreateStatic(va_led_task, "ui-led-thread", VA_LED_TASK_STACK_SZ, (void *)va_led_conf,
+    led_st.va_led_task_handle = xTaskCreateStatic(va_led_task, "ui-led-thread", VA_LED_TASK_STACK_SZ, NULL,
                                 CONFIG_ESP32_PTHREAD_TASK_PRIO_DEFAULT, va_led_task_stack, &va_led_buf);
     if (led_st.va_led_task_handle == NULL) {
         ESP_LOGE(TAG, "Could not create ui led task");
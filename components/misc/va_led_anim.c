@@ -0,0 +1,167 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+// All rights reserved.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <va_led_anim.h>
+
+esp_err_t va_led_anim_init(va_led_anim_t *anim, const led_pattern_config_t *conf)
+{
+    memset(anim, 0, sizeof(va_led_anim_t));
+    int total = 0;
+    for (int p = 0; p < LED_PATTERN_MAX; p++) {
+        total += conf[p].led_states ? conf[p].led_states_count : 0;
+    }
+    anim->keyframes = calloc(total ? total : 1, sizeof(va_led_keyframe_t));
+    if (!anim->keyframes) {
+        return ESP_ERR_NO_MEM;
+    }
+    va_led_keyframe_t *kf = anim->keyframes;
+    for (int p = 0; p < LED_PATTERN_MAX; p++) {
+        const led_pattern_state_t *st = conf[p].led_states;
+        int count = st ? conf[p].led_states_count : 0;
+        anim->clips[p].frames = kf;
+        for (int i = 0; i < count; i++) {
+            uint32_t delay = (st[i].led_state_delay > 0) ? st[i].led_state_delay : 1;
+            if (p != LED_PATTERN_SPEAKER_VOL && anim->clips[p].count &&
+                    memcmp(kf[-1].val, st[i].led_state_val, sizeof(st[i].led_state_val)) == 0) {
+                kf[-1].duration_ms += delay;
+                continue;
+            }
+            kf->val = st[i].led_state_val;
+            kf->duration_ms = delay;
+            kf++;
+            anim->clips[p].count++;
+        }
+    }
+    return ESP_OK;
+}
+
+static void va_led_anim_track_set(va_led_anim_t *anim, va_led_anim_track_t *track, const va_led_anim_clip_t *clip,
+                                  va_led_anim_mode_t mode, int frame, int repeat)
+{
+    track->clip = clip;
+    track->mode = mode;
+    track->frame = frame;
+    track->repeat = repeat;
+    track->deadline = 0;
+    track->id = ++anim->next_id;
+}
+
+void va_led_anim_play(va_led_anim_t *anim, int layer, led_pattern_t pattern, va_led_anim_mode_t mode, int repeat)
+{
+    va_led_anim_layer_t *l = &anim->layers[layer];
+    const va_led_anim_clip_t *clip = &anim->clips[pattern];
+    l->release = 0;
+    if (mode == VA_LED_ANIM_ONCE) {
+        if (clip->count && l->queued < VA_LED_ANIM_QUEUE_LEN) {
+            va_led_anim_track_set(anim, &l->queue[l->queued++], clip, mode, 0, repeat);
+        }
+        return;
+    }
+    if (!clip->count) {
+        l->steady.clip = NULL;
+    } else if (l->steady.clip == clip && l->steady.mode != VA_LED_ANIM_STILL) {
+        l->steady.mode = mode;
+    } else {
+        va_led_anim_track_set(anim, &l->steady, clip, mode, 0, 0);
+    }
+}
+
+void va_led_anim_show(va_led_anim_t *anim, int layer, led_pattern_t pattern, int state)
+{
+    va_led_anim_layer_t *l = &anim->layers[layer];
+    const va_led_anim_clip_t *clip = &anim->clips[pattern];
+    l->release = 0;
+    if (!clip->count) {
+        l->steady.clip = NULL;
+        return;
+    }
+    if (state >= clip->count) {
+        state = clip->count - 1;
+    }
+    va_led_anim_track_set(anim, &l->steady, clip, VA_LED_ANIM_STILL, state, 0);
+}
+
+void va_led_anim_release(va_led_anim_t *anim, int layer, int64_t at)
+{
+    anim->layers[layer].release = (at > 0) ? at : 1;
+}
+
+void va_led_anim_stop(va_led_anim_t *anim, int layer)
+{
+    va_led_anim_layer_t *l = &anim->layers[layer];
+    l->queued = 0;
+    l->steady.clip = NULL;
+    l->release = 0;
+}
+
+static va_led_anim_track_t *va_led_anim_current(va_led_anim_t *anim, int64_t now, va_led_anim_layer_t **layer)
+{
+    for (int i = VA_LED_ANIM_LAYERS - 1; i >= 0; i--) {
+        va_led_anim_layer_t *l = &anim->layers[i];
+        if (l->queued) {
+            *layer = l;
+            return &l->queue[0];
+        }
+        if (l->release && now >= l->release) {
+            va_led_anim_stop(anim, i);
+        }
+        if (l->steady.clip) {
+            *layer = l;
+            return &l->steady;
+        }
+    }
+    return NULL;
+}
+
+const uint32_t *va_led_anim_run(va_led_anim_t *anim, int64_t now, int64_t *next)
+{
+    bool changed = false;
+    va_led_anim_layer_t *l;
+    va_led_anim_track_t *t;
+    while ((t = va_led_anim_current(anim, now, &l)) != NULL) {
+        if (t->id != anim->cur_id) {
+            /* Started, or resumed after being preempted: (re)start the current frame */
+            anim->cur_id = t->id;
+            t->deadline = (t->mode == VA_LED_ANIM_STILL) ? VA_LED_ANIM_NEVER : now + t->clip->frames[t->frame].duration_ms;
+            changed = true;
+            break;
+        }
+        if (now < t->deadline) {
+            break;
+        }
+        if (++t->frame == t->clip->count) {
+            if (t->repeat > 0) {
+                t->repeat--;
+                t->frame = 0;
+            } else if (t->mode == VA_LED_ANIM_LOOP) {
+                t->frame = 0;
+            } else if (t->mode == VA_LED_ANIM_ONCE) {
+                l->queued--;
+                memmove(&l->queue[0], &l->queue[1], l->queued * sizeof(va_led_anim_track_t));
+                continue;
+            } else {
+                t->frame--;
+                t->deadline = VA_LED_ANIM_NEVER;
+                break;
+            }
+        }
+        /* Keep to the schedule, unless we are late by more than a frame */
+        int64_t deadline = t->deadline + t->clip->frames[t->frame].duration_ms;
+        t->deadline = (deadline > now) ? deadline : now + t->clip->frames[t->frame].duration_ms;
+        changed = true;
+        break;
+    }
+    if (!t) {
+        anim->cur_id = 0;
+        *next = VA_LED_ANIM_NEVER;
+        return NULL;
+    }
+    *next = t->deadline;
+    if (!l->queued && l->release && l->release < *next) {
+        *next = l->release;
+    }
+    return changed ? t->clip->frames[t->frame].val : NULL;
+}
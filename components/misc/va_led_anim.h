@@ -0,0 +1,115 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+// All rights reserved.
+
+#ifndef _VA_LED_ANIM_H_
+#define _VA_LED_ANIM_H_
+
+/**
+ * LED animation engine.
+ *
+ * The led_pattern_config_t patterns are compiled into keyframes once. Animations are played on layers: a higher
+ * layer preempts (pauses) the ones below it until it has nothing left to show. Each layer has a queue of one-shot
+ * animations, played in order, followed by a steady animation that loops or holds its last frame.
+ *
+ * The engine does no I/O and keeps no clock: va_led_anim_run() is called with the current time, returns the frame to
+ * show if it changed and the time at which it needs to be called again.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include <led_pattern.h>
+
+#define VA_LED_ANIM_LAYERS      3
+#define VA_LED_ANIM_QUEUE_LEN   6
+#define VA_LED_ANIM_NEVER       INT64_MAX
+
+typedef enum {
+    /** Play once, then move on to the next queued animation or the steady one */
+    VA_LED_ANIM_ONCE,
+    /** Steady: play to the end and keep showing the last frame */
+    VA_LED_ANIM_HOLD,
+    /** Steady: repeat */
+    VA_LED_ANIM_LOOP,
+    /** Steady: show a single frame */
+    VA_LED_ANIM_STILL,
+} va_led_anim_mode_t;
+
+typedef struct {
+    const uint32_t *val;
+    uint32_t duration_ms;
+} va_led_keyframe_t;
+
+typedef struct {
+    const va_led_keyframe_t *frames;
+    int count;
+} va_led_anim_clip_t;
+
+typedef struct {
+    const va_led_anim_clip_t *clip;     /* NULL if unused */
+    va_led_anim_mode_t mode;
+    int frame;
+    int repeat;                         /* Extra plays left for VA_LED_ANIM_ONCE */
+    int64_t deadline;
+    uint32_t id;
+} va_led_anim_track_t;
+
+typedef struct {
+    va_led_anim_track_t queue[VA_LED_ANIM_QUEUE_LEN];
+    int queued;
+    va_led_anim_track_t steady;
+    int64_t release;                    /* Layer is cleared at this time once its queue is empty. 0 if not set. */
+} va_led_anim_layer_t;
+
+typedef struct {
+    va_led_anim_clip_t clips[LED_PATTERN_MAX];
+    va_led_keyframe_t *keyframes;
+    va_led_anim_layer_t layers[VA_LED_ANIM_LAYERS];     /* Index 0 has the lowest priority */
+    uint32_t next_id;
+    uint32_t cur_id;                                    /* Track on display */
+} va_led_anim_t;
+
+/**
+ * @brief   Compile the patterns into keyframes
+ *
+ * Consecutive identical states are merged (except for LED_PATTERN_SPEAKER_VOL, which is indexed by volume level) and
+ * zero delays are raised to 1 ms.
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM otherwise.
+ */
+esp_err_t va_led_anim_init(va_led_anim_t *anim, const led_pattern_config_t *conf);
+
+/**
+ * @brief   Play a pattern on a layer
+ *
+ * VA_LED_ANIM_ONCE queues the pattern, `repeat` extra times. The other modes replace the steady animation, unless
+ * it is already the same pattern (then only the mode is updated and the animation carries on). Patterns without
+ * states are ignored, or clear the steady animation.
+ */
+void va_led_anim_play(va_led_anim_t *anim, int layer, led_pattern_t pattern, va_led_anim_mode_t mode, int repeat);
+
+/**
+ * @brief   Show one state of a pattern as the steady animation of a layer
+ */
+void va_led_anim_show(va_led_anim_t *anim, int layer, led_pattern_t pattern, int state);
+
+/**
+ * @brief   Clear the layer at time `at`, or once its queue is empty, whichever is later
+ */
+void va_led_anim_release(va_led_anim_t *anim, int layer, int64_t at);
+
+/**
+ * @brief   Clear a layer right away
+ */
+void va_led_anim_stop(va_led_anim_t *anim, int layer);
+
+/**
+ * @brief   Advance the animation to `now` (ms)
+ *
+ * @param[out] next     Time at which to call again, VA_LED_ANIM_NEVER if nothing is scheduled
+ *
+ * @return  The LED values to show if they changed, NULL otherwise.
+ */
+const uint32_t *va_led_anim_run(va_led_anim_t *anim, int64_t now, int64_t *next);
+
+#endif /* _VA_LED_ANIM_H_ */
@@ -20,124 +20,120 @@
  * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
+#include <string.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_system.h>
 #include <nvs_flash.h>
 
+#include "va_mem_utils.h"
 #include "va_nvs_utils.h"
 
-#define NVS_TASK_STACK_SIZE 2048
 #define VA_NVS_NAMESPACE "avs"
 
+/* Number of keys kept in RAM */
+#define VA_NVS_CACHE_ENTRIES    32
+/* Larger values are not cached and are written through */
+#define VA_NVS_CACHE_MAX_VAL    4096
+/* Dirty values are written and committed in one batch this long after the first change */
+#define VA_NVS_COMMIT_DELAY_MS  1000
+
 static const char *TAG = "[va_nvs_utils]";
 
-/* TODO: As of now, this utility will create a task for every NVS get/set operation. This is required,
- * only if a task having stack in SPIRAM needs NVS functionality. In future, we can add a check
- * if task is in extram or intram and act accordingly.
+/* Flash operations cannot be done from a task having its stack in SPIRAM, so every NVS access runs
+ * in the esp_timer task. To keep this off the common path, values are cached in RAM:
+ * - gets are served from the cache without a task switch. A miss loads the key once.
+ * - sets only update the cache. Changes are written in a batch, with a single commit, by the commit
+ *   timer or by va_nvs_flush().
+ * The NVS handle is opened once and kept open.
+ * Flash is never accessed with the cache lock held by a task waiting for the esp_timer task.
  */
 
-/* This structure can take partition and other datatype as parameters in future, if required. */
-struct nvs_ops_params {
-    const char *ns;
-    const char *key;
-    void *val_buf;
-    size_t *buf_size;
-    enum {
-        GET,
-        SET,
-        ERASE,
-    } op;
-    enum {
-        I8,
-        U16,
-        STR,
-        BLOB,
-        KEY,
-        INVALID,
-    } type;
-    TaskHandle_t calling_task_handle;
+enum va_nvs_type {
+    I8,
+    U16,
+    STR,
+    BLOB,
 };
 
-static void nvs_task(void *arg)
-{
-    struct nvs_ops_params *params = (struct nvs_ops_params *)arg;
+enum va_nvs_entry_state {
+    ENTRY_FREE = 0,
+    ENTRY_CLEAN,        /* Same as in flash */
+    ENTRY_ABSENT,       /* Known to not be in flash */
+    ENTRY_DIRTY,        /* To be written */
+};
+
+struct va_nvs_entry {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t type;
+    uint8_t state;
+    uint32_t last_use;
+    size_t len;         /* For STR, including the NUL */
+    union {
+        int8_t i8;
+        uint16_t u16;
+        uint8_t *buf;
+    } val;
+};
+
+static struct {
+    SemaphoreHandle_t lock;
+    esp_timer_handle_t commit_timer;
+    bool commit_pending;
     nvs_handle handle;
-    uint32_t ret = ESP_OK;
-    esp_err_t err = ESP_OK;
+    bool handle_open;
+    TaskHandle_t timer_task;
+    uint32_t use_counter;
+    struct va_nvs_entry entries[VA_NVS_CACHE_ENTRIES];
+} vn;
 
-    nvs_open_mode mode = params->op == GET ? NVS_READONLY : NVS_READWRITE;
+static portMUX_TYPE vn_init_mux = portMUX_INITIALIZER_UNLOCKED;
 
-    if (params->type != INVALID) {
-        err = nvs_open(params->ns, mode, &handle);
-        if (err != ESP_OK) {
-            ESP_LOGI(TAG, "Cannot find namespace %s in NVS", params->ns);
-            ret = ESP_FAIL;
-            goto done;
-        }
-    }
+/* A value moving between flash and the cache */
+struct va_nvs_value {
+    const char *key;
+    enum va_nvs_type type;
+    size_t len;
+    union {
+        int8_t i8;
+        uint16_t u16;
+        uint8_t *buf;
+    } val;
+    esp_err_t err;
+};
 
-    if (params->op == SET) {
-        if (params->type == BLOB) {
-            err = nvs_set_blob(handle, params->key, params->val_buf, *(params->buf_size));
-        } else if (params->type == STR) {
-            err = nvs_set_str(handle, params->key, (char *)params->val_buf);
-        } else if (params->type == I8) {
-            err = nvs_set_i8(handle, params->key, (int8_t)params->val_buf);
-        } else if (params->type == U16) {
-            err = nvs_set_u16(handle, params->key, (uint16_t)params->val_buf);
-        }
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Error setting value: %s", params->key);
-            ret = ESP_FAIL;
-        }
-    } else if (params->op == GET) {
-        if (params->type == BLOB) {
-            err = nvs_get_blob(handle, params->key, params->val_buf, params->buf_size);
-        } else if (params->type == STR) {
-            err = nvs_get_str(handle, params->key, (char *)params->val_buf, params->buf_size);
-        } else if (params->type == I8) {
-            err = nvs_get_i8(handle, params->key, (int8_t *)params->val_buf);
-        } else if (params->type == U16) {
-            err = nvs_get_u16(handle, params->key, (uint16_t *)params->val_buf);
-        }
-        if (err != ESP_OK) {
-            ESP_LOGI(TAG, "No value set for: %s", params->key);
-            ret = ESP_FAIL;
-        }
-    } else if (params->op == ERASE) {
-        if (params->type == KEY) {
-            err = nvs_erase_key(handle, params->key);
-        } else if (params->type == INVALID) {
-            err = nvs_flash_erase();
-        }
-        if (err != ESP_OK) {
-            ESP_LOGI(TAG, "Error erasing nvs type: %d, %s, %d", params->type, params->key, err);
-            ret = ESP_FAIL;
-        }
-    }
-    if (params->type != INVALID) {
-        nvs_close(handle);
-    }
+struct va_nvs_call_params {
+    esp_err_t (*fn)(void *arg);
+    void *arg;
+    TaskHandle_t calling_task_handle;
+};
 
-done:
+static void va_nvs_call_cb(void *arg)
+{
+    struct va_nvs_call_params *params = (struct va_nvs_call_params *)arg;
+    vn.timer_task = xTaskGetCurrentTaskHandle();
+    uint32_t ret = params->fn(params->arg);
     /* Notify calling task */
     xTaskNotify(params->calling_task_handle, ret, eSetValueWithOverwrite);
 }
 
-esp_err_t va_nvs_set_blob(const char *key, uint8_t *val_buf, size_t buf_size)
+/* Run fn(arg) in the esp_timer task and wait for it */
+static esp_err_t va_nvs_call(esp_err_t (*fn)(void *arg), void *arg, const char *name)
 {
-    struct nvs_ops_params tp = {VA_NVS_NAMESPACE, key, val_buf, &buf_size, SET, BLOB, xTaskGetCurrentTaskHandle()};
+    struct va_nvs_call_params params = {fn, arg, xTaskGetCurrentTaskHandle()};
     esp_timer_handle_t nvs_task_handle;
     esp_timer_create_args_t timer_arg = {
-        .callback = nvs_task,
-        .arg = &tp,
+        .callback = va_nvs_call_cb,
+        .arg = &params,
         .dispatch_method = ESP_TIMER_TASK,
-        .name = "va_nvs_set_blob",
+        .name = name,
     };
     if (esp_timer_create(&timer_arg, &nvs_task_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create timer to set %s in NVS", key);
+        ESP_LOGE(TAG, "Failed to create timer for %s", name);
         return ESP_FAIL;
     }
     esp_timer_start_once(nvs_task_handle, 0);
@@ -145,243 +141,488 @@ esp_err_t va_nvs_set_blob(const char *key, uint8_t *val_buf, size_t buf_size)
     /* Wait for operation to complete */
     xTaskNotifyWait(0, 0, &result, portMAX_DELAY);
     esp_timer_delete(nvs_task_handle);
-    if ((int)result != ESP_OK) {
-        return ESP_FAIL;
-    } else {
-        return ESP_OK;
+    return ((int)result != ESP_OK) ? ESP_FAIL : ESP_OK;
+}
+
+/* esp_timer task only */
+static esp_err_t va_nvs_open()
+{
+    if (!vn.handle_open) {
+        esp_err_t err = nvs_open(VA_NVS_NAMESPACE, NVS_READWRITE, &vn.handle);
+        if (err != ESP_OK) {
+            ESP_LOGI(TAG, "Cannot open namespace %s in NVS", VA_NVS_NAMESPACE);
+            return err;
+        }
+        vn.handle_open = true;
     }
+    return ESP_OK;
 }
 
-esp_err_t va_nvs_get_blob(const char *key, uint8_t *val_buf, size_t *buf_size)
+/* esp_timer task only */
+static esp_err_t va_nvs_write_value(const char *key, enum va_nvs_type type, const void *val, size_t len)
 {
-    struct nvs_ops_params tp = {VA_NVS_NAMESPACE, key, val_buf, buf_size, GET, BLOB, xTaskGetCurrentTaskHandle()};
-    esp_timer_handle_t nvs_task_handle;
+    esp_err_t err = ESP_FAIL;
+    if (type == BLOB) {
+        err = nvs_set_blob(vn.handle, key, val, len);
+    } else if (type == STR) {
+        err = nvs_set_str(vn.handle, key, (const char *)val);
+    } else if (type == I8) {
+        err = nvs_set_i8(vn.handle, key, *(const int8_t *)val);
+    } else if (type == U16) {
+        err = nvs_set_u16(vn.handle, key, *(const uint16_t *)val);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error setting value: %s", key);
+    }
+    return err;
+}
+
+static const void *va_nvs_value_ptr(enum va_nvs_type type, const void *u)
+{
+    /* `u` points to one of the val unions */
+    if (type == STR || type == BLOB) {
+        return *(uint8_t *const *)u;
+    }
+    return u;
+}
+
+static void va_nvs_commit_cb(void *arg);
+static void va_nvs_shutdown_handler();
+
+static esp_err_t va_nvs_cache_init()
+{
+    if (vn.lock) {
+        return ESP_OK;
+    }
+    SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+    esp_timer_handle_t commit_timer = NULL;
     esp_timer_create_args_t timer_arg = {
-        .callback = nvs_task,
-        .arg = &tp,
+        .callback = va_nvs_commit_cb,
         .dispatch_method = ESP_TIMER_TASK,
-        .name = "va_nvs_get_blob",
+        .name = "va_nvs_commit",
     };
-    if (esp_timer_create(&timer_arg, &nvs_task_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create timer to set %s in NVS", key);
+    if (!lock || esp_timer_create(&timer_arg, &commit_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialise NVS cache");
+        if (lock) {
+            vSemaphoreDelete(lock);
+        }
         return ESP_FAIL;
     }
-    esp_timer_start_once(nvs_task_handle, 0);
-    uint32_t result;
-    /* Wait for operation to complete */
-    xTaskNotifyWait(0, 0, &result, portMAX_DELAY);
-    esp_timer_delete(nvs_task_handle);
-    if ((int)result != ESP_OK) {
-        return ESP_FAIL;
+    portENTER_CRITICAL(&vn_init_mux);
+    if (!vn.lock) {
+        vn.commit_timer = commit_timer;
+        vn.lock = lock;
+        lock = NULL;
+    }
+    portEXIT_CRITICAL(&vn_init_mux);
+    if (lock) {
+        /* Someone else initialised it first */
+        vSemaphoreDelete(lock);
+        esp_timer_delete(commit_timer);
     } else {
-        return ESP_OK;
+        /* Do not lose pending writes on esp_restart() */
+        esp_register_shutdown_handler(va_nvs_shutdown_handler);
     }
+    return ESP_OK;
 }
 
-esp_err_t va_nvs_set_str(const char *key, char *val_buf)
+static void va_nvs_entry_free(struct va_nvs_entry *e)
 {
-    struct nvs_ops_params tp = {VA_NVS_NAMESPACE, key, val_buf, NULL, SET, STR, xTaskGetCurrentTaskHandle()};
-    esp_timer_handle_t nvs_task_handle;
-    esp_timer_create_args_t timer_arg = {
-        .callback = nvs_task,
-        .arg = &tp,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "va_nvs_set_str",
-    };
-    if (esp_timer_create(&timer_arg, &nvs_task_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create timer to set %s in NVS", key);
-        return ESP_FAIL;
+    if ((e->type == STR || e->type == BLOB) && e->val.buf) {
+        va_mem_free(e->val.buf);
     }
-    esp_timer_start_once(nvs_task_handle, 0);
-    uint32_t result;
-    /* Wait for operation to complete */
-    xTaskNotifyWait(0, 0, &result, portMAX_DELAY);
-    esp_timer_delete(nvs_task_handle);
-    if ((int)result != ESP_OK) {
+    memset(e, 0, sizeof(struct va_nvs_entry));
+}
+
+static struct va_nvs_entry *va_nvs_entry_find(const char *key, enum va_nvs_type type)
+{
+    for (int i = 0; i < VA_NVS_CACHE_ENTRIES; i++) {
+        struct va_nvs_entry *e = &vn.entries[i];
+        if (e->state != ENTRY_FREE && e->type == type && strcmp(e->key, key) == 0) {
+            e->last_use = ++vn.use_counter;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/* A free entry, or the least recently used one that is not dirty. NULL if all are dirty. */
+static struct va_nvs_entry *va_nvs_entry_alloc(const char *key, enum va_nvs_type type)
+{
+    struct va_nvs_entry *victim = NULL;
+    for (int i = 0; i < VA_NVS_CACHE_ENTRIES; i++) {
+        struct va_nvs_entry *e = &vn.entries[i];
+        if (e->state == ENTRY_FREE) {
+            victim = e;
+            break;
+        }
+        if (e->state != ENTRY_DIRTY && (!victim || e->last_use < victim->last_use)) {
+            victim = e;
+        }
+    }
+    if (victim) {
+        va_nvs_entry_free(victim);
+        strncpy(victim->key, key, sizeof(victim->key) - 1);
+        victim->type = type;
+        victim->last_use = ++vn.use_counter;
+    }
+    return victim;
+}
+
+/* Hand a cached value out with the nvs_get_* semantics */
+static esp_err_t va_nvs_entry_read(enum va_nvs_type type, int state, const void *u, size_t len, void *val_buf, size_t *buf_size)
+{
+    if (state == ENTRY_ABSENT) {
         return ESP_FAIL;
+    }
+    if (type == I8) {
+        *(int8_t *)val_buf = *(const int8_t *)u;
+    } else if (type == U16) {
+        *(uint16_t *)val_buf = *(const uint16_t *)u;
     } else {
-        return ESP_OK;
+        if (val_buf) {
+            if (*buf_size < len) {
+                /* Like nvs_get_blob(): report the size needed, so that the caller can retry */
+                *buf_size = len;
+                return ESP_FAIL;
+            }
+            memcpy(val_buf, va_nvs_value_ptr(type, u), len);
+        }
+        *buf_size = len;
     }
+    return ESP_OK;
 }
 
-esp_err_t va_nvs_get_str(const char *key, char *val_buf, size_t *buf_size)
+/* esp_timer task: read a key from flash into `v` */
+static esp_err_t va_nvs_load_fn(void *arg)
 {
-    struct nvs_ops_params tp = {VA_NVS_NAMESPACE, key, val_buf, buf_size, GET, STR, xTaskGetCurrentTaskHandle()};
-    esp_timer_handle_t nvs_task_handle;
-    esp_timer_create_args_t timer_arg = {
-        .callback = nvs_task,
-        .arg = &tp,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "va_nvs_get_str",
-    };
-    if (esp_timer_create(&timer_arg, &nvs_task_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create timer to set %s in NVS", key);
-        return ESP_FAIL;
+    struct va_nvs_value *v = (struct va_nvs_value *)arg;
+    v->err = va_nvs_open();
+    if (v->err != ESP_OK) {
+        return v->err;
     }
-    esp_timer_start_once(nvs_task_handle, 0);
-    uint32_t result;
-    /* Wait for operation to complete */
-    xTaskNotifyWait(0, 0, &result, portMAX_DELAY);
-    esp_timer_delete(nvs_task_handle);
-    if ((int)result != ESP_OK) {
-        return ESP_FAIL;
+    if (v->type == I8) {
+        v->err = nvs_get_i8(vn.handle, v->key, &v->val.i8);
+    } else if (v->type == U16) {
+        v->err = nvs_get_u16(vn.handle, v->key, &v->val.u16);
     } else {
-        return ESP_OK;
+        if (v->type == STR) {
+            v->err = nvs_get_str(vn.handle, v->key, NULL, &v->len);
+        } else {
+            v->err = nvs_get_blob(vn.handle, v->key, NULL, &v->len);
+        }
+        if (v->err == ESP_OK) {
+            v->val.buf = va_mem_alloc(v->len ? v->len : 1, VA_MEM_EXTERNAL);
+            if (!v->val.buf) {
+                v->err = ESP_ERR_NO_MEM;
+            } else if (v->type == STR) {
+                v->err = nvs_get_str(vn.handle, v->key, (char *)v->val.buf, &v->len);
+            } else {
+                v->err = nvs_get_blob(vn.handle, v->key, v->val.buf, &v->len);
+            }
+        }
+    }
+    if (v->err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No value set for: %s", v->key);
     }
+    return v->err;
 }
 
-esp_err_t va_nvs_set_i8(const char *key, int8_t val_buf)
+/* esp_timer task: write a single value and commit (write through) */
+static esp_err_t va_nvs_store_fn(void *arg)
 {
-    struct nvs_ops_params tp = {VA_NVS_NAMESPACE, key, val_buf, NULL, SET, I8, xTaskGetCurrentTaskHandle()};
-    esp_timer_handle_t nvs_task_handle;
-    esp_timer_create_args_t timer_arg = {
-        .callback = nvs_task,
-        .arg = &tp,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "va_nvs_set_i8",
-    };
-    if (esp_timer_create(&timer_arg, &nvs_task_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create timer to set %s in NVS", key);
-        return ESP_FAIL;
+    struct va_nvs_value *v = (struct va_nvs_value *)arg;
+    esp_err_t err = va_nvs_open();
+    if (err == ESP_OK) {
+        err = va_nvs_write_value(v->key, v->type, va_nvs_value_ptr(v->type, &v->val), v->len);
     }
-    esp_timer_start_once(nvs_task_handle, 0);
-    uint32_t result;
-    /* Wait for operation to complete */
-    xTaskNotifyWait(0, 0, &result, portMAX_DELAY);
-    esp_timer_delete(nvs_task_handle);
-    if ((int)result != ESP_OK) {
-        return ESP_FAIL;
+    if (err == ESP_OK) {
+        err = nvs_commit(vn.handle);
+    }
+    return err;
+}
+
+/* esp_timer task: write all dirty entries and commit once */
+static esp_err_t va_nvs_flush_fn(void *arg)
+{
+    int written = 0;
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(vn.lock, portMAX_DELAY);
+    vn.commit_pending = false;
+    for (int i = 0; i < VA_NVS_CACHE_ENTRIES; i++) {
+        struct va_nvs_entry *e = &vn.entries[i];
+        if (e->state != ENTRY_DIRTY) {
+            continue;
+        }
+        esp_err_t err = va_nvs_open();
+        if (err == ESP_OK) {
+            err = va_nvs_write_value(e->key, e->type, va_nvs_value_ptr(e->type, &e->val), e->len);
+        }
+        if (err == ESP_OK) {
+            e->state = ENTRY_CLEAN;
+            written++;
+        } else {
+            /* Forget it: the next get will show what is actually in flash */
+            va_nvs_entry_free(e);
+            ret = ESP_FAIL;
+        }
+    }
+    if (written && nvs_commit(vn.handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Error committing %d values", written);
+        ret = ESP_FAIL;
+    }
+    xSemaphoreGive(vn.lock);
+    return ret;
+}
+
+static void va_nvs_commit_cb(void *arg)
+{
+    vn.timer_task = xTaskGetCurrentTaskHandle();
+    va_nvs_flush_fn(NULL);
+}
+
+static void va_nvs_shutdown_handler()
+{
+    if (!vn.commit_pending) {
+        return;
+    }
+    if (vn.timer_task && vn.timer_task == xTaskGetCurrentTaskHandle()) {
+        /* Restarting from the esp_timer task itself: cannot wait for it */
+        va_nvs_flush_fn(NULL);
     } else {
-        return ESP_OK;
+        va_nvs_call(va_nvs_flush_fn, NULL, "va_nvs_flush");
     }
 }
 
-esp_err_t va_nvs_get_i8(const char *key, int8_t *val_buf)
+/* Called with the lock held */
+static void va_nvs_schedule_commit()
 {
-    struct nvs_ops_params tp = {VA_NVS_NAMESPACE, key, val_buf, NULL, GET, I8, xTaskGetCurrentTaskHandle()};
-    esp_timer_handle_t nvs_task_handle;
-    esp_timer_create_args_t timer_arg = {
-        .callback = nvs_task,
-        .arg = &tp,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "va_nvs_get_i8",
-    };
-    if (esp_timer_create(&timer_arg, &nvs_task_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create timer to set %s in NVS", key);
+    if (!vn.commit_pending) {
+        vn.commit_pending = true;
+        esp_timer_start_once(vn.commit_timer, VA_NVS_COMMIT_DELAY_MS * 1000);
+    }
+}
+
+static esp_err_t va_nvs_get(const char *key, enum va_nvs_type type, void *val_buf, size_t *buf_size)
+{
+    esp_err_t ret;
+    if (va_nvs_cache_init() != ESP_OK) {
         return ESP_FAIL;
     }
-    esp_timer_start_once(nvs_task_handle, 0);
-    uint32_t result;
-    /* Wait for operation to complete */
-    xTaskNotifyWait(0, 0, &result, portMAX_DELAY);
-    esp_timer_delete(nvs_task_handle);
-    if ((int)result != ESP_OK) {
+    xSemaphoreTake(vn.lock, portMAX_DELAY);
+    struct va_nvs_entry *e = va_nvs_entry_find(key, type);
+    if (e) {
+        ret = va_nvs_entry_read(type, e->state, &e->val, e->len, val_buf, buf_size);
+        xSemaphoreGive(vn.lock);
+        return ret;
+    }
+    xSemaphoreGive(vn.lock);
+
+    /* Miss: load it from flash */
+    struct va_nvs_value v = {.key = key, .type = type};
+    va_nvs_call(va_nvs_load_fn, &v, "va_nvs_get");
+    if (v.err != ESP_OK && v.err != ESP_ERR_NVS_NOT_FOUND) {
+        if ((type == STR || type == BLOB) && v.val.buf) {
+            va_mem_free(v.val.buf);
+        }
         return ESP_FAIL;
+    }
+    int state = (v.err == ESP_OK) ? ENTRY_CLEAN : ENTRY_ABSENT;
+
+    xSemaphoreTake(vn.lock, portMAX_DELAY);
+    /* Someone may have set it in the meantime: that value wins */
+    e = va_nvs_entry_find(key, type);
+    if (e) {
+        ret = va_nvs_entry_read(type, e->state, &e->val, e->len, val_buf, buf_size);
     } else {
-        return ESP_OK;
+        ret = va_nvs_entry_read(type, state, &v.val, v.len, val_buf, buf_size);
+        if (v.len <= VA_NVS_CACHE_MAX_VAL && strlen(key) < NVS_KEY_NAME_MAX_SIZE && (e = va_nvs_entry_alloc(key, type))) {
+            e->state = state;
+            e->len = v.len;
+            memcpy(&e->val, &v.val, sizeof(e->val));
+            /* Buffer now owned by the cache */
+            v.val.buf = NULL;
+        }
     }
+    xSemaphoreGive(vn.lock);
+    if ((type == STR || type == BLOB) && v.val.buf) {
+        va_mem_free(v.val.buf);
+    }
+    return ret;
 }
 
-esp_err_t va_nvs_set_u16(const char *key, uint16_t val_buf)
+static esp_err_t va_nvs_set(const char *key, enum va_nvs_type type, const void *val, size_t len)
 {
-    struct nvs_ops_params tp = {VA_NVS_NAMESPACE, key, val_buf, NULL, SET, U16, xTaskGetCurrentTaskHandle()};
-    esp_timer_handle_t nvs_task_handle;
-    esp_timer_create_args_t timer_arg = {
-        .callback = nvs_task,
-        .arg = &tp,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "va_nvs_set_u16",
-    };
-    if (esp_timer_create(&timer_arg, &nvs_task_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create timer to set %s in NVS", key);
+    if (va_nvs_cache_init() != ESP_OK) {
         return ESP_FAIL;
     }
-    esp_timer_start_once(nvs_task_handle, 0);
-    uint32_t result;
-    /* Wait for operation to complete */
-    xTaskNotifyWait(0, 0, &result, portMAX_DELAY);
-    esp_timer_delete(nvs_task_handle);
-    if ((int)result != ESP_OK) {
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        ESP_LOGE(TAG, "Error setting value: %s", key);
         return ESP_FAIL;
-    } else {
+    }
+    uint8_t *buf = NULL;
+    if ((type == STR || type == BLOB) && len <= VA_NVS_CACHE_MAX_VAL) {
+        buf = va_mem_alloc(len ? len : 1, VA_MEM_EXTERNAL);
+        if (!buf) {
+            return ESP_FAIL;
+        }
+        memcpy(buf, val, len);
+    }
+
+    xSemaphoreTake(vn.lock, portMAX_DELAY);
+    struct va_nvs_entry *e = va_nvs_entry_find(key, type);
+    if (len > VA_NVS_CACHE_MAX_VAL) {
+        /* Too big to cache: drop the cached value (and any older pending write) and write through below */
+        if (e) {
+            va_nvs_entry_free(e);
+        }
+        e = NULL;
+    } else if (e && e->state != ENTRY_ABSENT && e->len == len && memcmp(va_nvs_value_ptr(type, &e->val), val, len) == 0) {
+        /* Unchanged: nothing to write */
+        xSemaphoreGive(vn.lock);
+        if (buf) {
+            va_mem_free(buf);
+        }
+        return ESP_OK;
+    } else if (!e) {
+        e = va_nvs_entry_alloc(key, type);
+    }
+    if (e) {
+        if ((type == STR || type == BLOB) && e->val.buf) {
+            va_mem_free(e->val.buf);
+        }
+        if (type == I8) {
+            e->val.i8 = *(const int8_t *)val;
+        } else if (type == U16) {
+            e->val.u16 = *(const uint16_t *)val;
+        } else {
+            e->val.buf = buf;
+        }
+        e->len = len;
+        e->state = ENTRY_DIRTY;
+        va_nvs_schedule_commit();
+        xSemaphoreGive(vn.lock);
         return ESP_OK;
     }
+    xSemaphoreGive(vn.lock);
+
+    /* Not cached (too big, or every entry is waiting to be written): write through */
+    if (buf) {
+        va_mem_free(buf);
+    }
+    struct va_nvs_value v = {.key = key, .type = type, .len = len};
+    if (type == I8) {
+        v.val.i8 = *(const int8_t *)val;
+    } else if (type == U16) {
+        v.val.u16 = *(const uint16_t *)val;
+    } else {
+        v.val.buf = (uint8_t *)val;
+    }
+    return va_nvs_call(va_nvs_store_fn, &v, "va_nvs_set");
+}
+
+esp_err_t va_nvs_set_blob(const char *key, uint8_t *val_buf, size_t buf_size)
+{
+    return va_nvs_set(key, BLOB, val_buf, buf_size);
+}
+
+esp_err_t va_nvs_get_blob(const char *key, uint8_t *val_buf, size_t *buf_size)
+{
+    return va_nvs_get(key, BLOB, val_buf, buf_size);
+}
+
+esp_err_t va_nvs_set_str(const char *key, char *val_buf)
+{
+    return va_nvs_set(key, STR, val_buf, strlen(val_buf) + 1);
+}
+
+esp_err_t va_nvs_get_str(const char *key, char *val_buf, size_t *buf_size)
+{
+    return va_nvs_get(key, STR, val_buf, buf_size);
+}
+
+esp_err_t va_nvs_set_i8(const char *key, int8_t val_buf)
+{
+    return va_nvs_set(key, I8, &val_buf, sizeof(val_buf));
+}
+
+esp_err_t va_nvs_get_i8(const char *key, int8_t *val_buf)
+{
+    return va_nvs_get(key, I8, val_buf, NULL);
+}
+
+esp_err_t va_nvs_set_u16(const char *key, uint16_t val_buf)
+{
+    return va_nvs_set(key, U16, &val_buf, sizeof(val_buf));
 }
 
 esp_err_t va_nvs_get_u16(const char *key, uint16_t *val_buf)
 {
-    struct nvs_ops_params tp = {VA_NVS_NAMESPACE, key, val_buf, NULL, GET, U16, xTaskGetCurrentTaskHandle()};
-    esp_timer_handle_t nvs_task_handle;
-    esp_timer_create_args_t timer_arg = {
-        .callback = nvs_task,
-        .arg = &tp,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "va_nvs_get_u16",
-    };
-    if (esp_timer_create(&timer_arg, &nvs_task_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create timer to set %s in NVS", key);
+    return va_nvs_get(key, U16, val_buf, NULL);
+}
+
+esp_err_t va_nvs_flush()
+{
+    if (va_nvs_cache_init() != ESP_OK) {
         return ESP_FAIL;
     }
-    esp_timer_start_once(nvs_task_handle, 0);
-    uint32_t result;
-    /* Wait for operation to complete */
-    xTaskNotifyWait(0, 0, &result, portMAX_DELAY);
-    esp_timer_delete(nvs_task_handle);
-    if ((int)result != ESP_OK) {
-        return ESP_FAIL;
-    } else {
-        return ESP_OK;
+    return va_nvs_call(va_nvs_flush_fn, NULL, "va_nvs_flush");
+}
+
+static esp_err_t va_nvs_flash_erase_fn(void *arg)
+{
+    /* Erasing de-initialises NVS, which closes the handle */
+    vn.handle_open = false;
+    esp_err_t err = nvs_flash_erase();
+    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "Error erasing nvs: %d", err);
     }
+    return err;
 }
 
 esp_err_t va_nvs_flash_erase()
 {
-    struct nvs_ops_params tp = {NULL, NULL, NULL, 0, ERASE, INVALID, xTaskGetCurrentTaskHandle()};
-    esp_timer_handle_t nvs_task_handle;
-    esp_timer_create_args_t timer_arg = {
-        .callback = nvs_task,
-        .arg = &tp,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "va_nvs_flash_erase",
-    };
-    if (esp_timer_create(&timer_arg, &nvs_task_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create timer to erase flash in NVS");
+    if (va_nvs_cache_init() != ESP_OK) {
         return ESP_FAIL;
     }
-    esp_timer_start_once(nvs_task_handle, 0);
-    uint32_t result;
-    /* Wait for operation to complete */
-    xTaskNotifyWait(0, 0, &result, portMAX_DELAY);
-    esp_timer_delete(nvs_task_handle);
-    if ((int)result != ESP_OK) {
-        return ESP_FAIL;
-    } else {
-        return ESP_OK;
+    /* Pending writes are dropped along with everything else */
+    xSemaphoreTake(vn.lock, portMAX_DELAY);
+    for (int i = 0; i < VA_NVS_CACHE_ENTRIES; i++) {
+        va_nvs_entry_free(&vn.entries[i]);
     }
+    xSemaphoreGive(vn.lock);
+    return va_nvs_call(va_nvs_flash_erase_fn, NULL, "va_nvs_flash_erase");
+}
+
+static esp_err_t va_nvs_erase_key_fn(void *arg)
+{
+    const char *key = (const char *)arg;
+    esp_err_t err = va_nvs_open();
+    if (err == ESP_OK) {
+        err = nvs_erase_key(vn.handle, key);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(vn.handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "Error erasing nvs key: %s, %d", key, err);
+    }
+    return err;
 }
 
 esp_err_t va_nvs_erase_key(const char *key)
 {
-    struct nvs_ops_params tp = {VA_NVS_NAMESPACE, key, NULL, NULL, ERASE, KEY, xTaskGetCurrentTaskHandle()};
-    esp_timer_handle_t nvs_task_handle;
-    esp_timer_create_args_t timer_arg = {
-        .callback = nvs_task,
-        .arg = &tp,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "va_nvs_erase_key",
-    };
-    if (esp_timer_create(&timer_arg, &nvs_task_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to create timer to erase %s in NVS", key);
+    if (va_nvs_cache_init() != ESP_OK) {
         return ESP_FAIL;
     }
-    esp_timer_start_once(nvs_task_handle, 0);
-    uint32_t result;
-    /* Wait for operation to complete */
-    xTaskNotifyWait(0, 0, &result, portMAX_DELAY);
-    esp_timer_delete(nvs_task_handle);
-    if ((int)result != ESP_OK) {
-        return ESP_FAIL;
-    } else {
-        return ESP_OK;
+    /* Cached values of the key, including pending writes, go away with it */
+    xSemaphoreTake(vn.lock, portMAX_DELAY);
+    for (int i = 0; i < VA_NVS_CACHE_ENTRIES; i++) {
+        struct va_nvs_entry *e = &vn.entries[i];
+        if (e->state != ENTRY_FREE && strcmp(e->key, key) == 0) {
+            va_nvs_entry_free(e);
+        }
     }
+    xSemaphoreGive(vn.lock);
+    return va_nvs_call(va_nvs_erase_key_fn, (void *)key, "va_nvs_erase_key");
 }
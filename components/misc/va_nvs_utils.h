@@ -35,3 +35,7 @@ esp_err_t va_nvs_get_u16(const char *key, uint16_t *val_buf);
 esp_err_t va_nvs_set_u16(const char *key, uint16_t val_buf);
 esp_err_t va_nvs_flash_erase();
 esp_err_t va_nvs_erase_key(const char *key);
+
+/* Sets are cached and written to flash in batches, shortly after they are made (and on esp_restart()).
+ * This writes and commits all pending sets right away. */
+esp_err_t va_nvs_flush();
@@ -0,0 +1,85 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/**
+Part aware layer on top of the multipart parser.
+
+Part headers are collected into a multipart_part_info_t. Once a part's headers are complete, the bind
+callback chooses a sink for its body, e.g. a player ring buffer for audio/mpeg or the streaming JSON
+parser for application/json. Body slices are passed to the sink straight from the input buffer.
+*/
+#ifndef _MULTIPART_PARTS_H_
+#define _MULTIPART_PARTS_H_
+
+#include <stdbool.h>
+#include <multipart.h>
+
+#define MULTIPART_CONTENT_TYPE_LEN  64
+#define MULTIPART_CONTENT_ID_LEN    128
+#define MULTIPART_HDR_NAME_LEN      32
+
+/* Metadata of a part. Values longer than the fields are truncated. */
+typedef struct {
+    int index;                                          /* 0 for the first part */
+    char content_type[MULTIPART_CONTENT_TYPE_LEN];      /* e.g. "application/json; charset=UTF-8" */
+    char content_id[MULTIPART_CONTENT_ID_LEN];          /* Without the enclosing '<' '>' */
+} multipart_part_info_t;
+
+/* Destination for a part's body */
+typedef struct {
+    /* Called with each body slice. Return < 0 to drop the rest of the part. */
+    int (*write)(void *ctx, const char *data, size_t len);
+    /* Called at the end of the part (optional) */
+    void (*end)(void *ctx);
+    void *ctx;
+} multipart_sink_t;
+
+/* Return the sink for this part, or NULL to discard its body. The sink must stay valid until its end. */
+typedef multipart_sink_t *(*multipart_bind_cb_t)(void *arg, const multipart_part_info_t *info);
+
+typedef struct {
+    multipart_handle_t handle;
+    multipart_callbacks_t cbs;
+    multipart_bind_cb_t bind_cb;
+    void *arg;
+    multipart_part_info_t info;
+    multipart_sink_t *sink;
+    bool bound;
+    char hdr_name[MULTIPART_HDR_NAME_LEN];
+    int hdr_name_len;
+    char *hdr_value;        /* Field in info the current header goes to, if any */
+    int hdr_value_size;
+    int hdr_value_len;
+} multipart_parts_t;
+
+/* Initialize the part aware parser. `bind_cb` is called once per part with the part's headers. */
+void multipart_parts_init(multipart_parts_t *mp, char *boundary, multipart_bind_cb_t bind_cb, void *arg);
+
+/* Feed the next piece of the response. Returns buffer_size. */
+int multipart_parts_parse(multipart_parts_t *mp, char *buffer, int buffer_size);
+
+/* Check the media type of a part, ignoring case and parameters: multipart_part_type_is(info, "audio/mpeg") */
+bool multipart_part_type_is(const multipart_part_info_t *info, const char *type);
+
+#endif /* _MULTIPART_PARTS_H_ */
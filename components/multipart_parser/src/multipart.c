@@ -27,6 +27,7 @@ This file has the function definations required for the multipart parser
 */
 
 #include <stdio.h>
+#include <string.h>
 #include <multipart.h>
 
 static const char *TAG = "[multipart]";
@@ -71,15 +72,21 @@ int multipart_parse_data(multipart_handle_t *handle, multipart_callbacks_t *cbs,
         switch (handle->state) {
 
         case finding_data :
-            if (buffer[handle->iterator] == handle->boundary[handle->matcher]) {
-                handle->matcher++;
-                handle->state = finding_boundary;
-            }
             if (handle->first_data) {
                 handle->current_data_start = (buffer + handle->iterator);
                 handle->current_data_size = 1;
                 handle->first_data = 0;
             }
+            if (buffer[handle->iterator] == handle->boundary[handle->matcher]) {
+                handle->matcher++;
+                handle->state = finding_boundary;
+            } else {
+                /* Everything up to the next possible delimiter start is payload: skip to it */
+                char *next = memchr(buffer + handle->iterator + 1, handle->boundary[handle->matcher], buffer_size - handle->iterator - 1);
+                int skip = next ? (next - (buffer + handle->iterator + 1)) : (buffer_size - handle->iterator - 1);
+                handle->iterator += skip;
+                handle->current_data_size += skip;
+            }
             break;
 
         case finding_boundary :
@@ -105,6 +112,9 @@ int multipart_parse_data(multipart_handle_t *handle, multipart_callbacks_t *cbs,
                 }
                 handle->state = finding_data;
                 handle->matcher = 0;
+                /* The delimiter can start at this byte: look at it again */
+                handle->iterator--;
+                handle->current_data_size--;
             }
             break;
 
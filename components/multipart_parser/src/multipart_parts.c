@@ -0,0 +1,154 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <multipart_parts.h>
+
+static void multipart_parts_bind(multipart_parts_t *mp)
+{
+    if (!mp->bound) {
+        mp->bound = true;
+        mp->sink = mp->bind_cb(mp->arg, &mp->info);
+    }
+}
+
+static void multipart_parts_part_begin(multipart_handle_t *handle)
+{
+    multipart_parts_t *mp = (multipart_parts_t *) handle->data;
+    mp->info.content_type[0] = '\0';
+    mp->info.content_id[0] = '\0';
+    mp->bound = false;
+    mp->sink = NULL;
+    mp->hdr_value = NULL;
+    mp->hdr_name_len = 0;
+}
+
+static void multipart_parts_part_end(multipart_handle_t *handle)
+{
+    multipart_parts_t *mp = (multipart_parts_t *) handle->data;
+    /* A part with an empty body is still bound, so that the sink sees its end */
+    multipart_parts_bind(mp);
+    if (mp->sink && mp->sink->end) {
+        mp->sink->end(mp->sink->ctx);
+    }
+    mp->sink = NULL;
+    mp->info.index++;
+}
+
+static void multipart_parts_header_name(multipart_handle_t *handle, const char *buf, size_t len)
+{
+    multipart_parts_t *mp = (multipart_parts_t *) handle->data;
+    if (buf) {
+        int n = MULTIPART_HDR_NAME_LEN - 1 - mp->hdr_name_len;
+        n = ((int) len < n) ? (int) len : n;
+        memcpy(mp->hdr_name + mp->hdr_name_len, buf, n);
+        mp->hdr_name_len += n;
+        return;
+    }
+    /* Name complete: pick the field the value goes to */
+    mp->hdr_name[mp->hdr_name_len] = '\0';
+    mp->hdr_value = NULL;
+    if (strcasecmp(mp->hdr_name, "Content-Type") == 0) {
+        mp->hdr_value = mp->info.content_type;
+        mp->hdr_value_size = MULTIPART_CONTENT_TYPE_LEN;
+    } else if (strcasecmp(mp->hdr_name, "Content-ID") == 0) {
+        mp->hdr_value = mp->info.content_id;
+        mp->hdr_value_size = MULTIPART_CONTENT_ID_LEN;
+    }
+    mp->hdr_value_len = 0;
+}
+
+static void multipart_parts_header_value(multipart_handle_t *handle, const char *buf, size_t len)
+{
+    multipart_parts_t *mp = (multipart_parts_t *) handle->data;
+    if (buf) {
+        if (!mp->hdr_value) {
+            return;
+        }
+        int n = mp->hdr_value_size - 1 - mp->hdr_value_len;
+        n = ((int) len < n) ? (int) len : n;
+        memcpy(mp->hdr_value + mp->hdr_value_len, buf, n);
+        mp->hdr_value_len += n;
+        return;
+    }
+    /* Value complete */
+    mp->hdr_name_len = 0;
+    if (!mp->hdr_value) {
+        return;
+    }
+    char *val = mp->hdr_value;
+    int val_len = mp->hdr_value_len;
+    if (val == mp->info.content_id && val_len >= 2 && val[0] == '<' && val[val_len - 1] == '>') {
+        memmove(val, val + 1, val_len - 2);
+        val_len -= 2;
+    }
+    val[val_len] = '\0';
+    mp->hdr_value = NULL;
+}
+
+static void multipart_parts_data(multipart_handle_t *handle, const char *buf, size_t len)
+{
+    multipart_parts_t *mp = (multipart_parts_t *) handle->data;
+    if (!buf) {
+        return;
+    }
+    multipart_parts_bind(mp);
+    if (mp->sink && mp->sink->write(mp->sink->ctx, buf, len) < 0) {
+        /* Sink gave up: drop the rest of the part. Its end is still reported. */
+        if (mp->sink->end) {
+            mp->sink->end(mp->sink->ctx);
+        }
+        mp->sink = NULL;
+    }
+}
+
+void multipart_parts_init(multipart_parts_t *mp, char *boundary, multipart_bind_cb_t bind_cb, void *arg)
+{
+    memset(mp, 0, sizeof(multipart_parts_t));
+    multipart_init(&mp->handle, boundary);
+    mp->handle.data = mp;
+    mp->cbs.part_begin_cb = multipart_parts_part_begin;
+    mp->cbs.part_end_cb = multipart_parts_part_end;
+    mp->cbs.header_name_cb = multipart_parts_header_name;
+    mp->cbs.header_value_cb = multipart_parts_header_value;
+    mp->cbs.data_cb = multipart_parts_data;
+    mp->bind_cb = bind_cb;
+    mp->arg = arg;
+}
+
+int multipart_parts_parse(multipart_parts_t *mp, char *buffer, int buffer_size)
+{
+    return multipart_parse_data(&mp->handle, &mp->cbs, buffer, buffer_size);
+}
+
+bool multipart_part_type_is(const multipart_part_info_t *info, const char *type)
+{
+    size_t len = strlen(type);
+    if (strncasecmp(info->content_type, type, len) != 0) {
+        return false;
+    }
+    char next = info->content_type[len];
+    return (next == '\0' || next == ';' || next == ' ');
+}
@@ -0,0 +1,328 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <multipart.h>
+#include <multipart_parts.h>
+
+#define BOUNDARY        "------abcde123"
+#define MAX_PARTS       4
+#define AUDIO_LEN       (2 * 1024 * 1024)
+
+static const char *json_part = "{\"directive\":{\"header\":{\"namespace\":\"SpeechSynthesizer\",\"name\":\"Speak\","
+                               "\"messageId\":\"1f8a\",\"dialogRequestId\":\"d-1\"},\"payload\":{\"url\":\"cid:tts-1\","
+                               "\"format\":\"AUDIO_MPEG\",\"token\":\"tts-1\"}}}";
+
+/* What the callbacks received */
+typedef struct {
+    int num_parts;
+    int open;
+    char headers[MAX_PARTS][256];
+    int headers_len[MAX_PARTS];
+    char *data[MAX_PARTS];
+    int data_len[MAX_PARTS];
+    int data_cbs;
+} parse_result_t;
+
+static parse_result_t result;
+static int store_data = 1;
+
+static void part_begin_cb(multipart_handle_t *h)
+{
+    result.open = 1;
+    result.num_parts++;
+}
+
+static void part_end_cb(multipart_handle_t *h)
+{
+    result.open = 0;
+}
+
+static void header_cb(multipart_handle_t *h, const char *buf, size_t len)
+{
+    int p = result.num_parts - 1;
+    if (p < 0 || p >= MAX_PARTS) {
+        return;
+    }
+    if (!buf) {
+        /* Separator between names and values */
+        buf = "|";
+        len = 1;
+    }
+    if (result.headers_len[p] + len < sizeof(result.headers[p])) {
+        memcpy(result.headers[p] + result.headers_len[p], buf, len);
+        result.headers_len[p] += len;
+    }
+}
+
+static void data_cb(multipart_handle_t *h, const char *buf, size_t len)
+{
+    int p = result.num_parts - 1;
+    if (!buf || p < 0 || p >= MAX_PARTS) {
+        return;
+    }
+    result.data_cbs++;
+    if (store_data) {
+        memcpy(result.data[p] + result.data_len[p], buf, len);
+    }
+    result.data_len[p] += len;
+}
+
+static multipart_callbacks_t cbs = {
+    .part_begin_cb = part_begin_cb,
+    .part_end_cb = part_end_cb,
+    .header_name_cb = header_cb,
+    .header_value_cb = header_cb,
+    .data_cb = data_cb,
+};
+
+/* A TTS response: a JSON directive part followed by an audio part */
+static char *make_response(const unsigned char *audio, int audio_len, int *len)
+{
+    char *buf = malloc(audio_len + 1024);
+    int off = sprintf(buf, "--" BOUNDARY "\r\nContent-Type: application/json; charset=UTF-8\r\n\r\n%s\r\n", json_part);
+    off += sprintf(buf + off, "--" BOUNDARY "\r\nContent-ID: <tts-1>\r\nContent-Type: application/octet-stream\r\n\r\n");
+    memcpy(buf + off, audio, audio_len);
+    off += audio_len;
+    off += sprintf(buf + off, "\r\n--" BOUNDARY "--\r\n");
+    *len = off;
+    return buf;
+}
+
+static void reset_result()
+{
+    for (int i = 0; i < MAX_PARTS; i++) {
+        free(result.data[i]);
+    }
+    memset(&result, 0, sizeof(result));
+    for (int i = 0; i < MAX_PARTS; i++) {
+        result.data[i] = malloc(AUDIO_LEN + 1024);
+    }
+}
+
+static void parse(char *buf, int len, int chunk)
+{
+    multipart_handle_t handle;
+    multipart_init(&handle, BOUNDARY);
+    for (int off = 0; off < len; off += chunk) {
+        int n = (len - off < chunk) ? len - off : chunk;
+        multipart_parse_data(&handle, &cbs, buf + off, n);
+    }
+}
+
+static int fail(const char *what, int chunk)
+{
+    printf("Fail\n");
+    printf("%s: chunk size %d\n", what, chunk);
+    return -1;
+}
+
+static int check_result(const unsigned char *audio, int audio_len, int chunk)
+{
+    if (result.num_parts != 2 || result.open) {
+        return fail("parts", chunk);
+    }
+    if (result.headers_len[0] != strlen("Content-Type|application/json; charset=UTF-8|") ||
+            memcmp(result.headers[0], "Content-Type|application/json; charset=UTF-8|", result.headers_len[0]) != 0) {
+        return fail("headers", chunk);
+    }
+    if (result.data_len[0] != strlen(json_part) || memcmp(result.data[0], json_part, result.data_len[0]) != 0) {
+        return fail("json part", chunk);
+    }
+    if (result.data_len[1] != audio_len || memcmp(result.data[1], audio, audio_len) != 0) {
+        return fail("audio part", chunk);
+    }
+    return 0;
+}
+
+static int test_parse()
+{
+    printf("test: parse ....");
+    int audio_len = 64 * 1024;
+    unsigned char *audio = malloc(audio_len);
+    for (int i = 0; i < audio_len; i++) {
+        audio[i] = rand();
+    }
+    /* Near misses of the delimiter inside the payload */
+    const char *traps[] = {"\r\n--", "\r\r\n-", "\r\n-\r\n--", "\r\n--" "------abcde12\r\n"};
+    int off = 100;
+    for (int i = 0; i < sizeof(traps) / sizeof(traps[0]); i++) {
+        memcpy(audio + off, traps[i], strlen(traps[i]));
+        off += 5000;
+    }
+    /* Payload ending in a partial delimiter */
+    memcpy(audio + audio_len - 6, "\r\n--" "--", 6);
+
+    int len;
+    char *buf = make_response(audio, audio_len, &len);
+    int chunks[] = {1, 2, 7, 100, 1460, 4096, len};
+    for (int c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        reset_result();
+        parse(buf, len, chunks[c]);
+        if (check_result(audio, audio_len, chunks[c]) != 0) {
+            free(buf);
+            free(audio);
+            return -1;
+        }
+    }
+    free(buf);
+    free(audio);
+    printf("Success\n");
+    return 0;
+}
+
+/* Sink that collects a part's body */
+typedef struct {
+    char *buf;
+    int len;
+    int ended;
+    int limit;      /* Give up after this many bytes */
+} buf_sink_t;
+
+static int buf_sink_write(void *ctx, const char *data, size_t len)
+{
+    buf_sink_t *b = (buf_sink_t *) ctx;
+    memcpy(b->buf + b->len, data, len);
+    b->len += len;
+    return (b->limit && b->len >= b->limit) ? -1 : 0;
+}
+
+static void buf_sink_end(void *ctx)
+{
+    ((buf_sink_t *) ctx)->ended++;
+}
+
+typedef struct {
+    multipart_part_info_t info[MAX_PARTS];
+    buf_sink_t json, audio;
+    multipart_sink_t json_sink, audio_sink;
+    int bound;
+    int drop_json;
+} bind_test_t;
+
+static multipart_sink_t *bind_cb(void *arg, const multipart_part_info_t *info)
+{
+    bind_test_t *t = (bind_test_t *) arg;
+    if (t->bound < MAX_PARTS) {
+        t->info[t->bound] = *info;
+    }
+    t->bound++;
+    if (multipart_part_type_is(info, "application/json")) {
+        return t->drop_json ? NULL : &t->json_sink;
+    }
+    if (multipart_part_type_is(info, "application/octet-stream")) {
+        return &t->audio_sink;
+    }
+    return NULL;
+}
+
+static int test_parts()
+{
+    printf("test: parts ....");
+    int audio_len = 64 * 1024;
+    unsigned char *audio = malloc(audio_len);
+    for (int i = 0; i < audio_len; i++) {
+        audio[i] = rand();
+    }
+    int len;
+    char *buf = make_response(audio, audio_len, &len);
+    static bind_test_t t;
+    int chunks[] = {1, 13, 4096, len};
+    for (int c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        for (int variant = 0; variant < 2; variant++) {
+            memset(&t, 0, sizeof(t));
+            t.json.buf = malloc(1024);
+            t.audio.buf = malloc(audio_len);
+            t.json_sink = (multipart_sink_t) {buf_sink_write, buf_sink_end, &t.json};
+            t.audio_sink = (multipart_sink_t) {buf_sink_write, buf_sink_end, &t.audio};
+            /* Variant 1: JSON part dropped, audio sink gives up after 1000 bytes */
+            t.drop_json = variant;
+            t.audio.limit = variant ? 1000 : 0;
+
+            multipart_parts_t mp;
+            multipart_parts_init(&mp, BOUNDARY, bind_cb, &t);
+            for (int off = 0; off < len; off += chunks[c]) {
+                int n = (len - off < chunks[c]) ? len - off : chunks[c];
+                multipart_parts_parse(&mp, buf + off, n);
+            }
+            int ok = (t.bound == 2) && t.info[0].index == 0 && t.info[1].index == 1 &&
+                     strcmp(t.info[0].content_type, "application/json; charset=UTF-8") == 0 &&
+                     t.info[0].content_id[0] == '\0' &&
+                     strcmp(t.info[1].content_type, "application/octet-stream") == 0 &&
+                     strcmp(t.info[1].content_id, "tts-1") == 0 &&
+                     !multipart_part_type_is(&t.info[0], "application/js") && t.audio.ended == 1;
+            if (variant == 0) {
+                ok = ok && t.json.ended == 1 && t.json.len == strlen(json_part) && memcmp(t.json.buf, json_part, t.json.len) == 0 &&
+                     t.audio.len == audio_len && memcmp(t.audio.buf, audio, audio_len) == 0;
+            } else {
+                ok = ok && t.json.ended == 0 && t.json.len == 0 && t.audio.len >= 1000 && t.audio.len < 1000 + chunks[c];
+            }
+            free(t.json.buf);
+            free(t.audio.buf);
+            if (!ok) {
+                free(buf);
+                free(audio);
+                return fail("parts", chunks[c]);
+            }
+        }
+    }
+    free(buf);
+    free(audio);
+    printf("Success\n");
+    return 0;
+}
+
+static void bench()
+{
+    unsigned char *audio = malloc(AUDIO_LEN);
+    /* MP3-like payload: random bytes */
+    for (int i = 0; i < AUDIO_LEN; i++) {
+        audio[i] = rand();
+    }
+    int len;
+    char *buf = make_response(audio, AUDIO_LEN, &len);
+    int chunks[] = {1460, 4096, 16384};
+    int iters = 20;
+    store_data = 0;
+    for (int c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        reset_result();
+        clock_t start = clock();
+        for (int it = 0; it < iters; it++) {
+            result.num_parts = 0;
+            parse(buf, len, chunks[c]);
+        }
+        double t = (double) (clock() - start) / CLOCKS_PER_SEC;
+        printf("bench: %5d byte chunks %8.1f MB/s, %6.1f data_cb per chunk\n", chunks[c],
+               (double) len * iters / t / (1024 * 1024), (double) result.data_cbs / iters / ((len + chunks[c] - 1) / chunks[c]));
+    }
+    store_data = 1;
+    free(buf);
+    free(audio);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+    if (test_parse() || test_parts()) {
+        return -1;
+    }
+    return 0;
+}
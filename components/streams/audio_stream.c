@@ -27,6 +27,7 @@
 #include <esp_err.h>
 #include <esp_log.h>
 #include <esp_audio_mem.h>
+#include <audio_pool.h>
 #include <audio_stream.h>
 
 #define ASTAG   "audio_stream"
@@ -183,7 +184,7 @@ static void audio_stream_cleanup(audio_stream_t *stream)
     }
 
     if (stream->buf) {
-        free(stream->buf);
+        audio_pool_free(stream->buf);
         stream->buf = NULL;
     }
 
@@ -218,7 +219,7 @@ esp_err_t audio_stream_init(audio_stream_t *stream, const char *label, audio_io_
     stream->_pause = 0;
     stream->_destroy = 0;
 
-    stream->buf = calloc(1, stream->cfg.buf_size);
+    stream->buf = audio_pool_alloc(AUDIO_POOL_INTERNAL, stream->cfg.buf_size);
     if (stream->buf == NULL) {
         ESP_LOGE(ASTAG, "Failed to allocate stream buffer");
         audio_stream_cleanup(stream);
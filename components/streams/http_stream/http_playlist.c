@@ -34,6 +34,7 @@
 #include <http_playback_stream.h>
 #include <http_playlist.h>
 #include <esp_audio_mem.h>
+#include <audio_pool.h>
 #include <string.h>
 #include <m3u8_parser.h>
 
@@ -43,7 +44,7 @@
 esp_err_t playlist_add_entry(http_playlist_t *playlist, char *line, const char *host_url)
 {
     char *tmp_str = NULL;
-    playlist_entry_t *new = (playlist_entry_t *) malloc(sizeof(playlist_entry_t));
+    playlist_entry_t *new = (playlist_entry_t *) audio_pool_alloc(AUDIO_POOL_INTERNAL, sizeof(playlist_entry_t));
     if (new == NULL) {
         ESP_LOGE(TAG, "Not enough memory for malloc");
         return ESP_ERR_NO_MEM;
@@ -61,8 +62,10 @@ esp_err_t playlist_add_entry(http_playlist_t *playlist, char *line, const char *
             }
             pos[1] = 0;
             size_t uri_len = strlen(tmp_str) + strlen(line) + 1;
-            new->uri = esp_audio_mem_calloc(1, uri_len);
-            snprintf(new->uri, uri_len, "%s%s", tmp_str, line);
+            new->uri = audio_pool_alloc(AUDIO_POOL_EXTERNAL, uri_len);
+            if (new->uri) {
+                snprintf(new->uri, uri_len, "%s%s", tmp_str, line);
+            }
         } else { //Relative URI
             char *pos = strrchr(tmp_str, '/'); //Search for last "/"
             if (!pos) { //'/' not found case
@@ -70,20 +73,31 @@ esp_err_t playlist_add_entry(http_playlist_t *playlist, char *line, const char *
             }
             pos[1] = 0;
             size_t uri_len = strlen(tmp_str) + strlen(line) + 1;
-            new->uri = esp_audio_mem_calloc(1, uri_len);
-            snprintf(new->uri, uri_len, "%s%s", tmp_str, line);
+            new->uri = audio_pool_alloc(AUDIO_POOL_EXTERNAL, uri_len);
+            if (new->uri) {
+                snprintf(new->uri, uri_len, "%s%s", tmp_str, line);
+            }
         }
         free(tmp_str);
     } else {
-        new->uri = esp_audio_mem_strdup(line);
+        size_t uri_len = strlen(line) + 1;
+        new->uri = audio_pool_alloc(AUDIO_POOL_EXTERNAL, uri_len);
+        if (new->uri) {
+            memcpy(new->uri, line, uri_len);
+        }
+    }
+    if (!new->uri) {
+        ESP_LOGE(TAG, "Not enough memory for the URI");
+        audio_pool_free(new);
+        return ESP_ERR_NO_MEM;
     }
 
     playlist_entry_t *find = NULL;
     STAILQ_FOREACH(find, &playlist->head, entries) {
         if (strcmp(find->uri, new->uri) == 0) {
             ESP_LOGD(TAG, "URI exists");
-            esp_audio_mem_free(new->uri);
-            free(new);
+            audio_pool_free(new->uri);
+            audio_pool_free(new);
             return ESP_OK;
         }
     }
@@ -95,7 +109,7 @@ esp_err_t playlist_add_entry(http_playlist_t *playlist, char *line, const char *
 add_entry_err2:
     free(tmp_str);
 add_entry_err1:
-    free(new);
+    audio_pool_free(new);
     return ESP_FAIL;
 }
 
@@ -106,8 +120,8 @@ esp_err_t playlist_free(http_playlist_t *playlist)
     }
     playlist_entry_t *datap, *temp;
     STAILQ_FOREACH_SAFE(datap, &playlist->head, entries, temp) {
-        esp_audio_mem_free(datap->uri);
-        free(datap);
+        audio_pool_free(datap->uri);
+        audio_pool_free(datap);
     }
     if (playlist->host_uri) {
         free(playlist->host_uri);
@@ -140,8 +154,8 @@ char *playlist_get_next_entry(http_playlist_t *playlist)
         if (playlist->total_entries > MAX_PLAYLIST_KEEP_TRACKS) {
             playlist_entry_t *tmp = STAILQ_FIRST(&playlist->head);
             STAILQ_REMOVE_HEAD(&playlist->head, entries);
-            esp_audio_mem_free(tmp->uri);
-            free(tmp);
+            audio_pool_free(tmp->uri);
+            audio_pool_free(tmp);
             playlist->total_entries--;
         }
     }
@@ -149,6 +163,34 @@ char *playlist_get_next_entry(http_playlist_t *playlist)
     return uri;
 }
 
+const char *playlist_peek_entry(http_playlist_t *playlist, int n)
+{
+    if (!playlist) {
+        return NULL;
+    }
+
+    playlist_entry_t *entry;
+    STAILQ_FOREACH(entry, &playlist->head, entries) {
+        if (!entry->is_played && n-- == 0) {
+            return entry->uri;
+        }
+    }
+    return NULL;
+}
+
+/* Send the GETs for the next entries ahead of time, on the same connection. They are picked up in order by
+ * playlist_get_next_entry() and http_request_new(). The pipelined ones are always the first not played entries. */
+static void http_playlist_pipeline(http_playback_stream_t *bstream, http_playlist_t *playlist)
+{
+    while (!playlist->no_pipelining && http_request_pipeline_len(bstream->handle) < HTTPC_PIPELINE_MAX) {
+        const char *url = playlist_peek_entry(playlist, http_request_pipeline_len(bstream->handle));
+        if (!url || http_connection_new_needed(bstream->handle, url) ||
+                http_request_pipeline(bstream->handle, url) != 0) {
+            break;
+        }
+    }
+}
+
 /* reads http data to buf using url from list */
 int http_playlist_read_data(void *base_stream, void *buf, ssize_t len)
 {
@@ -196,18 +238,40 @@ int http_playlist_read_data(void *base_stream, void *buf, ssize_t len)
             }
 
             http_request_delete(bstream->handle);
+            /* The first not played entry is the oldest pipelined request, if any */
+            bool pipelined = http_request_pipeline_len(bstream->handle) > 0;
             ret = http_request_new(bstream->handle, ESP_HTTP_GET, url);
             esp_audio_mem_free(bstream->cfg.url); /* free old url */
             bstream->cfg.url = url; /* keep current url in cfg */
 
             if (ret < 0) {
+                if (pipelined) {
+                    goto pipeline_error;
+                }
                 goto error1;
             }
             ret = http_request_send(bstream->handle, NULL, 0);
             if (ret < 0) {
                 goto error2;
             }
+            http_playlist_pipeline(bstream, playlist);
 
+            data_read = http_response_recv(bstream->handle, buf, len);
+            if (data_read < 0 && data_read != -EAGAIN && pipelined) {
+                goto pipeline_error;
+            }
+            continue;
+pipeline_error:
+            /* The server or a proxy on the way may not handle pipelining. Get this entry again on a new connection,
+             * and don't pipeline the rest of the playlist. */
+            ESP_LOGW(TAG, "Pipelined request failed, sending one request at a time from now on");
+            playlist->no_pipelining = true;
+            http_request_delete(bstream->handle);
+            http_connection_delete(bstream->handle);
+            bstream->handle = NULL;
+            if (http_playback_stream_create_or_renew_session(bstream) == ESP_FAIL) {
+                goto error1;
+            }
             data_read = http_response_recv(bstream->handle, buf, len);
             continue;
 error2:
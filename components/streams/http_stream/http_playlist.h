@@ -50,6 +50,7 @@ typedef struct http_playlist {
     char *host_uri; /* host uri of playlist */
     int total_entries; /* number of entries in playlist */
     bool is_complete; /* to signal if parsing was complete */
+    bool no_pipelining; /* a pipelined request failed: send one request at a time */
     STAILQ_HEAD(stailqhead, playlist_entry_s) head;
 } http_playlist_t;
 
@@ -73,6 +74,12 @@ esp_err_t playlist_free(http_playlist_t *playlist);
  */
 char *playlist_get_next_entry(http_playlist_t *playlist);
 
+/**
+ * Get the `n`th (from 0) not played url from the playlist, without marking it played.
+ * The string belongs to the playlist.
+ */
+const char *playlist_peek_entry(http_playlist_t *playlist, int n);
+
 /**
  * Connect to uri in the playlist and start reading data in `buf` of size `len`
  */
@@ -12,7 +12,7 @@
 #include "sys_playback.h"
 #include "media_hal_playback.h"
 #include <esp_audio_mem.h>
-#include <esp_downmix.h>
+#include <audio_pcm.h>
 
 #define PB_DEFAULT_STACK_SIZE   (3 * 1024)
 #define PB_DOWNMIX_STACK_SIZE   (4 * 1024)
@@ -22,6 +22,31 @@
 #define PB_BUFFER_SIZE          (12 * 512) /* 12x can handle 8k/1 --> 48k/2 */
 #define OUT_SAMPLING_RATE       48000
 
+#define SP_MAX_MIX_INPUTS       (SYS_PLAYBACK_MIXER_MAX_INPUTS + 1)  /* + main audio */
+#define SP_FRAME_SIZE           4                       /* 16 bit stereo */
+#define SP_READ_BUF_SIZE        512
+#define SP_MIX_FRAMES           128                     /* Frames mixed per iteration: 512 bytes out */
+#define SP_MIX_STAGE_FRAMES     (PB_BUFFER_SIZE / SP_FRAME_SIZE)
+#define SP_GAIN_UNITY           AUDIO_PCM_GAIN_UNITY
+#define SP_GAIN_FROM_PERCENT(g) (((g) * SP_GAIN_UNITY) / 100)
+#define SP_DUCK_GAIN_PERCENT    10                      /* -20dB */
+#define SP_SIDE_WAIT            2                       /* Ticks to wait on inputs other than the main one */
+#define SP_IDLE_WAIT            pdMS_TO_TICKS(20)       /* Wait on the input driving the mixer when main is idle */
+
+/* Per-input mixer state */
+typedef struct {
+    sys_playback_requester_t *requester;    /* Attached requester. Changed by the API, under mix_lock. */
+    sys_playback_requester_t *bound;        /* Requester the stage belongs to. Only changed by the mixer task. */
+    bool rebind;                            /* (Re)attached since the mixer last bound the slot */
+    audio_resample_config_t resample;
+    int16_t *stage;         /* Resampled OUT_SAMPLING_RATE stereo frames */
+    int stage_start;        /* First unconsumed frame in `stage` */
+    int stage_frames;       /* Number of unconsumed frames in `stage` */
+    int32_t cur_gain;       /* Q15 */
+    int32_t target_gain;    /* Q15 */
+    uint32_t played_frac;   /* Remainder (x OUT_SAMPLING_RATE) of requester frames played */
+} sp_mix_input_t;
+
 static const char *TAG = "[sys_playback]";
 
 static struct {
@@ -34,13 +59,23 @@ static struct {
      * sys_playback_consume_buffer reads from this buffer and calls va_playback_data.
      */
     rb_handle_t downmix_rb;
-    void *downmix_handle;
+    /* Bytes written to/played from downmix_rb. Each is updated by a single task. */
+    volatile uint32_t downmix_written;
+    volatile uint32_t downmix_played;
+    /* Given by the consumer task whenever it has played everything written to downmix_rb */
+    SemaphoreHandle_t downmix_drained;
     /* If present, the tone gets priority */
     sys_playback_requester_t *tone;
     /* The currently playing playback requester */
     sys_playback_requester_t *current;
     sys_playback_requester_t *duck;
-    SemaphoreHandle_t duck_lock;
+    /* mix[0] always follows the main audio (tone or current). The rest are attached inputs. */
+    sp_mix_input_t mix[SP_MAX_MIX_INPUTS];
+    volatile int mix_attached;
+    /* Protects `duck` and the attached mixer inputs */
+    SemaphoreHandle_t mix_lock;
+    /* Held by the mixer task while it reads from the attached inputs, without mix_lock */
+    SemaphoreHandle_t fill_lock;
     sys_playback_requester_t dummy;
     bool acquired;
     bool playback_starting_sent;
@@ -60,14 +95,27 @@ static void sys_playback_dummy_wakeup_read_cb(void *cb_data)
 
 uint32_t sys_playback_get_current_offset(sys_playback_requester_t *requester)
 {
-    int sampling_freq_in_khz = requester->audio_info.sample_rate / 1000;
-    /* Frequency x Channels x 2-bytes (per sample) */
-    int divisor = sampling_freq_in_khz * requester->audio_info.channels * 2;
-    if (divisor) {
-        return requester->samples_cnt / divisor;
-    } else {
+    if (!requester->audio_info.sample_rate) {
         return 0;
     }
+    return (uint32_t) ((requester->frames_played * 1000) / requester->audio_info.sample_rate);
+}
+
+static bool sys_playback_is_mixed(sys_playback_requester_t *requester);
+
+uint32_t sys_playback_get_presentation_offset(sys_playback_requester_t *requester)
+{
+    uint32_t offset = sys_playback_get_current_offset(requester);
+    sys_playback_requester_t *active = sp.tone ? sp.tone : sp.current;
+    if (requester != active && !sys_playback_is_mixed(requester)) {
+        /* Not playing: Nothing of it is queued */
+        return offset;
+    }
+
+    /* I2S DMA queue + whatever is in downmix_rb (nothing unless mixing) */
+    uint32_t queued = media_hal_playback_get_queued_ms();
+    queued += (sp.downmix_written - sp.downmix_played) / (SP_FRAME_SIZE * (OUT_SAMPLING_RATE / 1000));
+    return (offset > queued) ? offset - queued : 0;
 }
 
 int sys_playback_play_data(media_hal_audio_info_t *audio_info, void *buf, ssize_t len)
@@ -84,162 +132,316 @@ int sys_playback_play_data(media_hal_audio_info_t *audio_info, void *buf, ssize_
 }
 
 /**
- * The function keeps reading data from main audio and ducked audio,
- * resamples+mixes it and writes to downmix_rb.
+ * (Re)bind a mixer slot to `requester`. Only called from the mixer task.
+ *
+ * Resampler state and staged frames belong to the previous requester, so they are dropped.
+ * The slot starts at `start_gain` and ramps to `target_gain` over the first mixed block.
+ */
+static void sys_playback_mix_bind(sp_mix_input_t *in, sys_playback_requester_t *requester, int32_t start_gain, int32_t target_gain)
+{
+    in->requester = requester;
+    in->bound = requester;
+    in->rebind = false;
+    memset(&in->resample, 0, sizeof(in->resample));
+    in->stage_start = 0;
+    in->stage_frames = 0;
+    in->cur_gain = start_gain;
+    in->target_gain = target_gain;
+    in->played_frac = 0;
+}
+
+/* Account `frames` output frames of the input as played, in frames of the requester's own rate */
+static void sys_playback_mix_count_played(sp_mix_input_t *in, int frames)
+{
+    sys_playback_requester_t *requester = in->bound;
+    uint32_t in_rate = requester->audio_info.sample_rate ? requester->audio_info.sample_rate : OUT_SAMPLING_RATE;
+    uint64_t total = (uint64_t) frames * in_rate + in->played_frac;
+    requester->frames_played += total / OUT_SAMPLING_RATE;
+    in->played_frac = total % OUT_SAMPLING_RATE;
+}
+
+/**
+ * Read from the input's requester until at least `frames_needed` output frames are staged.
+ *
+ * Data is resampled to OUT_SAMPLING_RATE/stereo directly into the input's stage.
+ * Only one read is issued per call, sized so that the resampled output always fits.
+ *
+ * Returns the read_cb result: bytes read, 0, RB_READER_UNBLOCK or other -ve value on end of data.
+ */
+static int sys_playback_mix_fill(sp_mix_input_t *in, char *read_buf, int frames_needed, unsigned int wait)
+{
+    sys_playback_requester_t *requester = in->bound;
+    if (in->stage_frames >= frames_needed) {
+        return 0;
+    }
+    if (in->stage_start) {
+        /* Move the few leftover frames to the start so that new data lands contiguously */
+        memmove(in->stage, in->stage + in->stage_start * 2, in->stage_frames * SP_FRAME_SIZE);
+        in->stage_start = 0;
+    }
+
+    int channels = (requester->audio_info.channels == 1) ? 1 : 2;
+    int in_rate = requester->audio_info.sample_rate ? requester->audio_info.sample_rate : OUT_SAMPLING_RATE;
+    int free_frames = SP_MIX_STAGE_FRAMES - in->stage_frames;
+    /* Input frames for the missing output frames, with 2 extra to absorb resampler rounding */
+    int in_frames = (int) (((int64_t) (frames_needed - in->stage_frames) * in_rate) / OUT_SAMPLING_RATE) + 2;
+    int in_frames_max = (int) (((int64_t) free_frames * in_rate) / OUT_SAMPLING_RATE) - 2;
+    if (in_frames > in_frames_max) {
+        in_frames = in_frames_max;
+    }
+    if (in_frames > SP_READ_BUF_SIZE / (2 * channels)) {
+        in_frames = SP_READ_BUF_SIZE / (2 * channels);
+    }
+    if (in_frames <= 0) {
+        return 0;
+    }
+
+    int data_read = requester->read_cb(requester->cb_data, read_buf, in_frames * channels * 2, wait);
+    if (data_read <= 0) {
+        return data_read;
+    }
+
+    int16_t *dst = in->stage + in->stage_frames * 2;
+    int conv_len = audio_resample((short *) read_buf, dst, in_rate, OUT_SAMPLING_RATE,
+                                  data_read / 2, free_frames * channels, channels, &in->resample);
+    if (channels == 1) {
+        audio_pcm_mono_to_stereo(dst, dst, conv_len);
+        conv_len *= 2;
+    }
+    in->stage_frames += conv_len / 2;
+    return data_read;
+}
+
+/**
+ * Add `frames` staged frames of the input to `acc`, ramping the input gain towards its target.
+ *
+ * If the input has fewer frames staged (underrun), it contributes silence for the rest.
+ */
+static void sys_playback_mix_accumulate(int32_t *acc, sp_mix_input_t *in, int frames)
+{
+    int n = (in->stage_frames < frames) ? in->stage_frames : frames;
+    int32_t gain_end = in->target_gain;
+
+    if (n < frames) {
+        /* Ramp only as far as the frames we have */
+        gain_end = in->cur_gain + ((in->target_gain - in->cur_gain) / frames) * n;
+    }
+    audio_pcm_mix_accumulate(acc, in->stage + in->stage_start * 2, n, 2, in->cur_gain, gain_end);
+    in->cur_gain = gain_end;
+    if (n) {
+        sys_playback_mix_count_played(in, n);
+    }
+
+    in->stage_frames -= n;
+    in->stage_start = in->stage_frames ? in->stage_start + n : 0;
+}
+
+/**
+ * One mixer iteration.
+ *
+ * The main audio (tone or current) is the clock: a block of SP_MIX_FRAMES is mixed once that many
+ * frames are staged for it. All other inputs contribute whatever they have for that block.
+ * When there is no main audio, the first attached input drives the mixer instead.
+ */
+static void sys_playback_mix_iteration(sys_playback_requester_t *active, char *read_buf, int32_t *acc, int16_t *out)
+{
+    sp_mix_input_t *main_in = &sp.mix[0];
+    unsigned int wait_main = portMAX_DELAY;
+    int frames = 0;
+
+    if (main_in->requester != active) {
+        sys_playback_mix_bind(main_in, active, SP_GAIN_UNITY, SP_GAIN_UNITY);
+    }
+
+    xSemaphoreTake(sp.mix_lock, portMAX_DELAY);
+    int attached = sp.mix_attached;
+    xSemaphoreGive(sp.mix_lock);
+
+    if (active == &sp.dummy) {
+        if (!attached) {
+            /* Nothing to play! Raise va_dsp_playback_stopped event */
+            (void) va_dsp_playback_stopped();
+            sp.playback_starting_sent = false;
+        } else {
+            wait_main = 0;
+        }
+    }
+
+    /**** Main Data ****/
+    int main_read = sys_playback_mix_fill(main_in, read_buf, SP_MIX_FRAMES, wait_main);
+    if (main_in->stage_frames >= SP_MIX_FRAMES) {
+        frames = SP_MIX_FRAMES;
+    } else if (main_read < 0) {
+        /* End of data or wakeup for a requester switch: flush whatever is staged */
+        frames = main_in->stage_frames;
+        if (main_read != RB_READER_UNBLOCK && active == sp.tone) {
+            /* If this was a tone, it has been completely played out, reset the pointer now */
+            sp.tone = NULL;
+        }
+    }
+    if (frames == 0 && (active != &sp.dummy || !attached)) {
+        /* Main audio is still filling up */
+        return;
+    }
+
+    /**** Other Inputs ****/
+    /* They are read without mix_lock: the mixer API must not wait for an idle input */
+    sp_mix_input_t *inputs[SP_MAX_MIX_INPUTS];
+    int count = 0;
+    xSemaphoreTake(sp.fill_lock, portMAX_DELAY);
+    xSemaphoreTake(sp.mix_lock, portMAX_DELAY);
+    for (int i = 1; i < SP_MAX_MIX_INPUTS; i++) {
+        sp_mix_input_t *in = &sp.mix[i];
+        if (in->rebind || in->requester != in->bound) {
+            /* Attached, replaced or detached since the last block. Fade in from silence. */
+            sys_playback_mix_bind(in, in->requester, 0, in->target_gain);
+        }
+        if (in->bound) {
+            inputs[count++] = in;
+        }
+    }
+    xSemaphoreGive(sp.mix_lock);
+
+    bool driven = (frames != 0);
+    for (int i = 0; i < count; i++) {
+        sp_mix_input_t *in = inputs[i];
+        if (!driven) {
+            /* No main audio. This input sets the pace. */
+            int ret = sys_playback_mix_fill(in, read_buf, SP_MIX_FRAMES, SP_IDLE_WAIT);
+            frames = (in->stage_frames >= SP_MIX_FRAMES || ret < 0) ? in->stage_frames : 0;
+            if (frames > SP_MIX_FRAMES) {
+                frames = SP_MIX_FRAMES;
+            }
+            driven = (frames != 0);
+        } else {
+            sys_playback_mix_fill(in, read_buf, frames, SP_SIDE_WAIT);
+        }
+    }
+    xSemaphoreGive(sp.fill_lock);
+
+    if (frames) {
+        memset(acc, 0, frames * 2 * sizeof(int32_t));
+        sys_playback_mix_accumulate(acc, main_in, frames);
+        xSemaphoreTake(sp.mix_lock, portMAX_DELAY);
+        for (int i = 0; i < count; i++) {
+            /* Skip inputs detached while we were reading: their requester may be gone */
+            if (inputs[i]->requester == inputs[i]->bound) {
+                sys_playback_mix_accumulate(acc, inputs[i], frames);
+            }
+        }
+        xSemaphoreGive(sp.mix_lock);
+    }
+
+    if (frames) {
+        audio_pcm_saturate_32_to_16(out, acc, frames * 2);
+        int written = rb_write(sp.downmix_rb, (uint8_t *) out, frames * SP_FRAME_SIZE, portMAX_DELAY);
+        if (written > 0) {
+            sp.downmix_written += written;
+        }
+    }
+}
+
+/**
+ * Leave the mixer path.
+ *
+ * Main audio frames still staged are pushed to downmix_rb and we wait for the consumer task to play
+ * everything out, so that the directly played data that follows stays in order. The consumer never waits
+ * for more than a frame, so it plays out tails of any length.
+ */
+static void sys_playback_mix_leave()
+{
+    sp_mix_input_t *main_in = &sp.mix[0];
+    if (main_in->stage_frames) {
+        int written = rb_write(sp.downmix_rb, (uint8_t *) (main_in->stage + main_in->stage_start * 2),
+                               main_in->stage_frames * SP_FRAME_SIZE, portMAX_DELAY);
+        if (written > 0) {
+            sp.downmix_written += written;
+        }
+        if (main_in->requester) {
+            sys_playback_mix_count_played(main_in, main_in->stage_frames);
+        }
+        main_in->stage_frames = 0;
+    }
+    /* Force a rebind (and resampler reset) when mixing starts again */
+    sys_playback_mix_bind(main_in, NULL, SP_GAIN_UNITY, SP_GAIN_UNITY);
+
+    /**
+     * Nothing more is written, so a give from now on means we are done. A give from before (the consumer caught up
+     * while mixing) is stale: drop it.
+     */
+    xSemaphoreTake(sp.downmix_drained, 0);
+    if (sp.downmix_played != sp.downmix_written) {
+        xSemaphoreTake(sp.downmix_drained, portMAX_DELAY);
+    }
+}
+
+/**
+ * The function keeps reading data from main audio and other mixer inputs.
+ *
+ * As long as only the main audio is there, it is played directly.
+ * While other inputs are attached, everything is resampled+mixed and written to downmix_rb.
  */
 static void sys_playback_task()
 {
-#define DATA_BUF_SIZE   (512)
-    int prev_remain = 0;
-    char *data = (char *) esp_audio_mem_calloc(1, DATA_BUF_SIZE);
-    unsigned char *duck_buffer  = NULL;
-    unsigned char *conv_main_buf = NULL;
-    unsigned char *conv_duck_buf = NULL;
-    int wait = portMAX_DELAY;
+    char *data = (char *) esp_audio_mem_calloc(1, SP_READ_BUF_SIZE);
+    int32_t *acc = NULL;
+    int16_t *out = NULL;
+    bool mixing = false;
 
     if (sp.downmix_support) {
-        duck_buffer  = (unsigned char *) esp_audio_mem_calloc(1, PB_BUFFER_SIZE);
-        conv_main_buf = (unsigned char *) esp_audio_mem_calloc(1, PB_BUFFER_SIZE);
-        conv_duck_buf = (unsigned char *) esp_audio_mem_calloc(1, PB_BUFFER_SIZE);
+        acc = (int32_t *) esp_audio_mem_calloc(SP_MIX_FRAMES * 2, sizeof(int32_t));
+        out = (int16_t *) esp_audio_mem_calloc(SP_MIX_FRAMES, SP_FRAME_SIZE);
     }
 
-    audio_resample_config_t resample_main = {0};
-    audio_resample_config_t resample_duck = {0};
-    downmix_status_t downmix_status = DOWNMIX_SWITCH_ON;
-
     while (1) {
-        int conv_main_len = 0, conv_duck_len = 0;
         sys_playback_requester_t *active = sp.current;
-        int data_read = 0, duck_read = 0;
-        unsigned int wait_main = wait, wait_duck = 2;
 
         if (sp.tone) {
             /* Tone gets priority */
             active = sp.tone;
         }
 
+        if (sp.mix_attached) {
+            mixing = true;
+            sys_playback_mix_iteration(active, data, acc, out);
+            continue;
+        } else if (mixing) {
+            /* Last input went away. Back to the fast path. */
+            sys_playback_mix_leave();
+            mixing = false;
+        }
+
         if (active == &sp.dummy) {
-            if (!sp.duck) {
-                /* Nothing to play! Raise va_dsp_playback_stopped event */
-                (void) va_dsp_playback_stopped();
-                sp.playback_starting_sent = false;
-            } else if (sp.downmix_support) {
-                /* active == &dummy, sp.duck is there and downmix feature is enabled */
-                wait_duck = wait;
-                wait_main = 0;
-            }
+            /* Nothing to play! Raise va_dsp_playback_stopped event */
+            (void) va_dsp_playback_stopped();
+            sp.playback_starting_sent = false;
         }
 
-        /**** Read and Process Main Data ****/
-        data_read = active->read_cb(active->cb_data, data, DATA_BUF_SIZE, wait_main);
-
-        if (data_read == RB_READER_UNBLOCK) {
-            /* Just a wakeup, do nothing and go for duck audio. */
-        } else if (data_read > 0) {
-            active->samples_cnt += data_read;
-            if (sp.downmix_support) {
-                /* Resample to OUT_SAMPLING_RATE */
-                conv_main_len = audio_resample((short *) data, (short *) conv_main_buf, active->audio_info.sample_rate, OUT_SAMPLING_RATE,
-                                               data_read / 2, PB_BUFFER_SIZE, active->audio_info.channels, &resample_main);
-
-                if (active->audio_info.channels == 1) {
-                    conv_main_len = audio_resample_up_channel((short *) conv_main_buf, (short *) conv_main_buf, OUT_SAMPLING_RATE, OUT_SAMPLING_RATE,
-                                                              conv_main_len, PB_BUFFER_SIZE, &resample_main);
-                }
-            } else {
-                sys_playback_play_data(&active->audio_info, data, data_read);
+        int data_read = active->read_cb(active->cb_data, data, SP_READ_BUF_SIZE, portMAX_DELAY);
+        if (data_read > 0) {
+            sys_playback_play_data(&active->audio_info, data, data_read);
+            if (active->audio_info.channels) {
+                active->frames_played += data_read / (2 * active->audio_info.channels);
             }
-        } else if (data_read < 0) {
+        } else if (data_read < 0 && data_read != RB_READER_UNBLOCK) {
             /* If this was a tone, it has been completely played out, reset the pointer now */
             if (active == sp.tone) {
                 sp.tone = NULL;
             }
-            prev_remain = 0;
-        }
-        /**** Main Data Done ****/
-
-        if (sp.downmix_support) {
-            /**** Read and Process Ducked Data ****/
-            xSemaphoreTake(sp.duck_lock, portMAX_DELAY);
-            if (sp.duck) {
-                int duck_to_read = DATA_BUF_SIZE;
-                if (conv_main_len && conv_main_len < prev_remain) {
-                    duck_to_read = 0;
-                    conv_duck_len = prev_remain;
-                } else if (conv_main_len) {
-                    /* How many bytes to read to get out bytes = conv_main_len * 2? */
-                    duck_to_read = ((conv_main_len - prev_remain) * sp.duck->audio_info.sample_rate) / OUT_SAMPLING_RATE;
-                    duck_to_read = (duck_to_read + 3) & ~(int) 0x01; /* Read few extra and make it multiple of 2 */
-                    duck_to_read *= sp.duck->audio_info.channels;
-                }
-
-                duck_read = sp.duck->read_cb(sp.duck->cb_data, duck_buffer, duck_to_read, wait_duck);
-
-                if (duck_read == RB_READER_UNBLOCK && data_read <= 0) {
-                    /* Just a wakeup, simply return */
-                    xSemaphoreGive(sp.duck_lock);
-                    continue;
-                } else if (duck_read < 0) {
-                    conv_duck_len = 0;
-                } else if (duck_read > 0) {
-                    sp.duck->samples_cnt += duck_read;
-                    /* Resample to OUT_SAMPLING_RATE. */
-                    conv_duck_len = audio_resample((short *) duck_buffer, (short *) conv_duck_buf + prev_remain, sp.duck->audio_info.sample_rate, OUT_SAMPLING_RATE,
-                                               duck_read / 2, PB_BUFFER_SIZE - 2 * prev_remain, sp.duck->audio_info.channels, &resample_duck);
-
-                    if (sp.duck->audio_info.channels == 1) {
-                        conv_duck_len = audio_resample_up_channel((short *) conv_duck_buf + prev_remain, (short *) conv_duck_buf + prev_remain, OUT_SAMPLING_RATE, OUT_SAMPLING_RATE,
-                                                              conv_duck_len, PB_BUFFER_SIZE - 2 * prev_remain, &resample_duck);
-                    }
-                }
-                conv_duck_len += prev_remain;
-                prev_remain = 0;
-            }
-            /**** Duck Data Done ****/
-
-            xSemaphoreGive(sp.duck_lock);
-
-            /**** Downmix and write data to downmix_rb ****/
-            if (conv_main_len && conv_duck_len) { /* Mix main and ducked audio */
-                prev_remain = 0;
-                if (conv_main_len > conv_duck_len) {
-                    /**
-                     * Happens only when we are not able to read enough duck audio.
-                     * This should be seldom thing.
-                     */
-                    bzero(conv_duck_buf + 2 * conv_duck_len, 2 * (conv_main_len - conv_duck_len));
-                }
-                /* Otherwise we are anyway handling this properly.! */
-                esp_downmix_process(sp.downmix_handle, conv_main_buf, conv_main_len * 2, conv_duck_buf, conv_main_len * 2, duck_buffer, downmix_status);
-                rb_write(sp.downmix_rb, duck_buffer, conv_main_len * 2, wait);
-                if (conv_duck_len > conv_main_len) {
-                    prev_remain = conv_duck_len - conv_main_len;
-                    memmove(conv_duck_buf, conv_duck_buf + conv_main_len * 2, prev_remain * 2);
-                }
-            } else if (conv_main_len) { /* Just main audio */
-                rb_write(sp.downmix_rb, conv_main_buf, conv_main_len * 2, wait);
-            } else if (conv_duck_len) { /* Only ducked audio! Downmix this with silence. */
-                bzero(conv_main_buf, conv_duck_len * 2); /* Silence. */
-                esp_downmix_process(sp.downmix_handle, conv_main_buf, conv_duck_len * 2, conv_duck_buf, conv_duck_len * 2, duck_buffer, downmix_status);
-                rb_write(sp.downmix_rb, duck_buffer, conv_duck_len * 2, wait);
-            }
         }
     }
 
     /**
      * We never exit the while loop and the task, but let's keep it clean.
      */
-    if (duck_buffer) {
-        esp_audio_mem_free(duck_buffer);
-    }
-    if (conv_main_buf) {
-        esp_audio_mem_free(conv_main_buf);
+    if (acc) {
+        esp_audio_mem_free(acc);
     }
-    if (conv_duck_buf) {
-        esp_audio_mem_free(conv_duck_buf);
+    if (out) {
+        esp_audio_mem_free(out);
     }
+    esp_audio_mem_free(data);
     vTaskDelete(NULL);
-#undef DATA_BUF_SIZE
 }
 
 /**
@@ -261,9 +463,25 @@ static void sys_playback_downmix_consumer_task(void *arg)
     };
 
     while (1) {
-        int bytes_read = rb_read(sp.downmix_rb, (void *) data, read_size, portMAX_DELAY);
-        if (bytes_read > 0) {
-            sys_playback_play_data(&audio_info, data, bytes_read);
+        /**
+         * Wait for a frame, then take whatever else is there. A blocking read of a full chunk would sit on the tail
+         * written when the mixer stops, which is of any length.
+         */
+        int bytes_read = rb_read(sp.downmix_rb, (void *) data, SP_FRAME_SIZE, portMAX_DELAY);
+        if (bytes_read <= 0) {
+            continue;
+        }
+        int more = rb_filled(sp.downmix_rb);
+        more = (more < read_size - bytes_read) ? more : read_size - bytes_read;
+        more -= more % SP_FRAME_SIZE;
+        if (more > 0) {
+            int ret = rb_read(sp.downmix_rb, (void *) (data + bytes_read), more, 0);
+            bytes_read += (ret > 0) ? ret : 0;
+        }
+        sys_playback_play_data(&audio_info, data, bytes_read);
+        sp.downmix_played += bytes_read;
+        if (sp.downmix_played == sp.downmix_written) {
+            xSemaphoreGive(sp.downmix_drained);
         }
     }
 }
@@ -306,15 +524,148 @@ int sys_playback_acquire(sys_playback_requester_t *requester)
     return 0;
 }
 
+/* Wake up the task in case it is blocked on idle main audio */
+static void sys_playback_wakeup_main()
+{
+    sys_playback_requester_t *active = sp.tone ? sp.tone : sp.current;
+    if (active && active->wakeup_reader_cb) {
+        active->wakeup_reader_cb(active->cb_data);
+    }
+}
+
+/* Must be called with mix_lock taken */
+static sp_mix_input_t *sys_playback_mix_find(sys_playback_requester_t *requester)
+{
+    for (int i = 1; i < SP_MAX_MIX_INPUTS; i++) {
+        if (sp.mix[i].requester == requester) {
+            return &sp.mix[i];
+        }
+    }
+    return NULL;
+}
+
+static bool sys_playback_is_mixed(sys_playback_requester_t *requester)
+{
+    xSemaphoreTake(sp.mix_lock, portMAX_DELAY);
+    bool mixed = (sys_playback_mix_find(requester) != NULL);
+    xSemaphoreGive(sp.mix_lock);
+    return mixed;
+}
+
+/* Must be called with mix_lock taken */
+static int sys_playback_mix_attach(sys_playback_requester_t *requester, uint8_t gain)
+{
+    if (!sp.downmix_support) {
+        return ESP_FAIL;
+    }
+    if (sys_playback_mix_find(requester)) {
+        ESP_LOGW(TAG, "Requester already attached to mixer");
+        return ESP_FAIL;
+    }
+    sp_mix_input_t *in = sys_playback_mix_find(NULL);
+    if (!in) {
+        ESP_LOGE(TAG, "No free mixer input. Max %d", SYS_PLAYBACK_MIXER_MAX_INPUTS);
+        return ESP_FAIL;
+    }
+    /* Bound, with a fade in from silence, by the mixer task */
+    in->requester = requester;
+    in->target_gain = SP_GAIN_FROM_PERCENT(gain);
+    in->rebind = true;
+    sp.mix_attached++;
+    return ESP_OK;
+}
+
+/* Must be called with mix_lock taken */
+static int sys_playback_mix_detach(sys_playback_requester_t *requester)
+{
+    sp_mix_input_t *in = sys_playback_mix_find(requester);
+    if (!in) {
+        return ESP_FAIL;
+    }
+    in->requester = NULL;
+    sp.mix_attached--;
+    return ESP_OK;
+}
+
+/**
+ * Wait until the mixer task is done reading from a detached `requester`.
+ *
+ * Must be called without mix_lock. The requester is woken up in case the mixer is blocked on it.
+ */
+static void sys_playback_mix_wait_detached(sys_playback_requester_t *requester)
+{
+    if (requester->wakeup_reader_cb) {
+        requester->wakeup_reader_cb(requester->cb_data);
+    }
+    xSemaphoreTake(sp.fill_lock, portMAX_DELAY);
+    xSemaphoreGive(sp.fill_lock);
+}
+
+int sys_playback_mixer_add_input(sys_playback_requester_t *requester, uint8_t gain)
+{
+    if (!requester || gain > 100) {
+        return ESP_FAIL;
+    }
+    xSemaphoreTake(sp.mix_lock, portMAX_DELAY);
+    int ret = sys_playback_mix_attach(requester, gain);
+    xSemaphoreGive(sp.mix_lock);
+    if (ret == ESP_OK) {
+        sys_playback_wakeup_main();
+    }
+    return ret;
+}
+
+int sys_playback_mixer_remove_input(sys_playback_requester_t *requester)
+{
+    xSemaphoreTake(sp.mix_lock, portMAX_DELAY);
+    if (sp.duck == requester) {
+        sp.duck = NULL;
+    }
+    int ret = sys_playback_mix_detach(requester);
+    xSemaphoreGive(sp.mix_lock);
+    if (ret == ESP_OK) {
+        sys_playback_mix_wait_detached(requester);
+    }
+    return ret;
+}
+
+int sys_playback_mixer_set_gain(sys_playback_requester_t *requester, uint8_t gain)
+{
+    if (gain > 100) {
+        return ESP_FAIL;
+    }
+    int ret = ESP_FAIL;
+    xSemaphoreTake(sp.mix_lock, portMAX_DELAY);
+    sp_mix_input_t *in = sys_playback_mix_find(requester);
+    if (in) {
+        /* Ramped over the next mixed block */
+        in->target_gain = SP_GAIN_FROM_PERCENT(gain);
+        ret = ESP_OK;
+    }
+    xSemaphoreGive(sp.mix_lock);
+    return ret;
+}
+
 /**
  * Register a duck audio. If ducked playback exists, it will simply be replaced with newer one.
  */
 int sys_playback_put_ducked(sys_playback_requester_t *requester)
 {
     ESP_LOGI(TAG, "Duck");
-    xSemaphoreTake(sp.duck_lock, portMAX_DELAY);
+    sys_playback_requester_t *old = NULL;
+    xSemaphoreTake(sp.mix_lock, portMAX_DELAY);
+    if (sp.duck && sys_playback_mix_detach(sp.duck) == ESP_OK) {
+        old = sp.duck;
+    }
     sp.duck = requester;
-    xSemaphoreGive(sp.duck_lock);
+    if (requester) {
+        sys_playback_mix_attach(requester, SP_DUCK_GAIN_PERCENT);
+    }
+    xSemaphoreGive(sp.mix_lock);
+    if (old && old != requester) {
+        sys_playback_mix_wait_detached(old);
+    }
+    sys_playback_wakeup_main();
     return 0;
 }
 
@@ -325,12 +676,17 @@ int sys_playback_put_ducked(sys_playback_requester_t *requester)
  */
 int sys_playback_remove_ducked(sys_playback_requester_t *requester)
 {
-    xSemaphoreTake(sp.duck_lock, portMAX_DELAY);
+    bool detached = false;
+    xSemaphoreTake(sp.mix_lock, portMAX_DELAY);
     if (sp.duck == requester) {
         /* Remove duck only if reuester is same as ducked requester */
+        detached = (sys_playback_mix_detach(sp.duck) == ESP_OK);
         sp.duck = NULL;
     }
-    xSemaphoreGive(sp.duck_lock);
+    xSemaphoreGive(sp.mix_lock);
+    if (detached) {
+        sys_playback_mix_wait_detached(requester);
+    }
     return 0;
 }
 
@@ -366,9 +722,11 @@ static void sys_playback_downmix_deinit() {
         rb_cleanup(sp.downmix_rb);
         sp.downmix_rb = NULL;
     }
-    if (sp.downmix_handle) {
-        esp_downmix_close(sp.downmix_handle);
-        sp.downmix_handle = NULL;
+    for (int i = 0; i < SP_MAX_MIX_INPUTS; i++) {
+        if (sp.mix[i].stage) {
+            esp_audio_mem_free(sp.mix[i].stage);
+            sp.mix[i].stage = NULL;
+        }
     }
 }
 
@@ -376,20 +734,13 @@ static esp_err_t sys_playback_downmix_init(sys_playback_config_t *sys_playback_c
 {
     (void) sys_playback_cfg; /* Unused */
 
-    //init downmix_info structure.
-    esp_downmix_info_t downmix_info;
-    bzero(&downmix_info, sizeof (esp_downmix_info_t));
-    downmix_info.sample_rate = OUT_SAMPLING_RATE;
-    downmix_info.bits_num = 16;
-    downmix_info.dual_2_mono_select_ch = 2;
-    downmix_info.downmix_gain[0].set_dbgain[1] = 0;
-    downmix_info.downmix_gain[1].set_dbgain[1] = -20;
-    downmix_info.channels[0] = 2;
-    downmix_info.channels[1] = 2;
-    sp.downmix_handle = esp_downmix_open(&downmix_info);
-    if (!sp.downmix_handle) {
-        ESP_LOGE(TAG, "Could not open downmix!");
-        return ESP_FAIL;
+    for (int i = 0; i < SP_MAX_MIX_INPUTS; i++) {
+        sp.mix[i].stage = (int16_t *) esp_audio_mem_calloc(SP_MIX_STAGE_FRAMES, SP_FRAME_SIZE);
+        if (!sp.mix[i].stage) {
+            ESP_LOGE(TAG, "failed to allocate mixer stage");
+            sys_playback_downmix_deinit();
+            return ESP_FAIL;
+        }
     }
     sp.downmix_rb = rb_init("downmix_rb", PB_BUFFER_SIZE);
     if (sp.downmix_rb == NULL) {
@@ -397,26 +748,15 @@ static esp_err_t sys_playback_downmix_init(sys_playback_config_t *sys_playback_c
         sys_playback_downmix_deinit();
         return ESP_FAIL;
     }
-#if 0
-    /* Assign default params */
-    hollow_stream_cfg.hollow_stream_stack_sz = PB_DEFAULT_STACK_SIZE;
-    hollow_stream_cfg.hollow_stream_task_priority = PB_DEFAULT_TASK_PRIORITY;
-    hollow_stream_cfg.hollow_stream_buf_size = PB_DEFAULT_BUF_SIZE;
-
-    if (sys_playback_cfg) {
-        /* Overwrite with provided one */
-        if (sys_playback_cfg->stack_size) {
-            hollow_stream_cfg.hollow_stream_stack_sz = sys_playback_cfg->stack_size;
-        }
-        if (!sys_playback_cfg->task_priority) {
-            hollow_stream_cfg.hollow_stream_task_priority = sys_playback_cfg->task_priority;
-        }
-        if (!sys_playback_cfg->buf_size) {
-            hollow_stream_cfg.hollow_stream_buf_size = sys_playback_cfg->buf_size;
-        }
+    if (!sp.downmix_drained) {
+        sp.downmix_drained = xSemaphoreCreateBinary();
     }
-#endif
-    return ESP_OK;;
+    if (sp.downmix_drained == NULL) {
+        ESP_LOGE(TAG, "failed to create downmix semaphore");
+        sys_playback_downmix_deinit();
+        return ESP_FAIL;
+    }
+    return ESP_OK;
 }
 
 int sys_playback_init(sys_playback_config_t *sys_playback_cfg)
@@ -444,7 +784,8 @@ int sys_playback_init(sys_playback_config_t *sys_playback_cfg)
     }
 
     sp.duck = NULL;
-    sp.duck_lock = xSemaphoreCreateMutex();
+    sp.mix_lock = xSemaphoreCreateMutex();
+    sp.fill_lock = xSemaphoreCreateMutex();
 
     if (sp.downmix_support) {
         /* Initialize and create downmix handle */
@@ -9,13 +9,22 @@ typedef int (*read_cb_t)(void *cb_data, void *data, int len, unsigned int wait);
 typedef void (*wakeup_reader_cb_t)(void *cb_data);
 
 typedef struct {
-    uint32_t samples_cnt;
+    /**
+     * Frames (samples per channel, at audio_info.sample_rate) of this requester handed to the output stage.
+     * May be preset by the requester to the start offset of the stream.
+     */
+    uint64_t frames_played;
     read_cb_t read_cb;
     wakeup_reader_cb_t wakeup_reader_cb;
     void *cb_data;
     media_hal_audio_info_t audio_info;
 } sys_playback_requester_t;
 
+/**
+ * Number of inputs that can be mixed with the main audio at a time (ducked audio included).
+ */
+#define SYS_PLAYBACK_MIXER_MAX_INPUTS   3
+
 /**
  * @brief   Put a `requester` in ducked mode
  *
@@ -30,6 +39,31 @@ int sys_playback_put_ducked(sys_playback_requester_t *requester);
  */
 int sys_playback_remove_ducked(sys_playback_requester_t *requester);
 
+/**
+ * @brief   Mix `requester` with the main audio
+ *
+ * `gain` is linear, in percent of full scale (0-100). The input fades in from silence.
+ * Requires downmix support. Alerts, TTS, music etc. can overlap this way.
+ *
+ * @return ESP_OK on success, ESP_FAIL if downmix is not supported or all inputs are in use.
+ */
+int sys_playback_mixer_add_input(sys_playback_requester_t *requester, uint8_t gain);
+
+/**
+ * @brief   Remove `requester` from the mixer
+ *
+ * The requester will not be read from once this returns. Its reader is woken up if the mixer is blocked on it, so
+ * this must not be called from the requester's own read_cb.
+ */
+int sys_playback_mixer_remove_input(sys_playback_requester_t *requester);
+
+/**
+ * @brief   Change gain (0-100) of a mixer input
+ *
+ * The change is ramped over one mixed block to avoid clicks.
+ */
+int sys_playback_mixer_set_gain(sys_playback_requester_t *requester, uint8_t gain);
+
 /** Configuration for playback stream
  *  To be set by the application
  *  If the application does not set these values, then the default values are taken
@@ -38,7 +72,7 @@ typedef struct {
     size_t stack_size;  //Default task stack size is 5000
     int task_priority;  //Default priority is 5
     size_t buf_size;    //Default buffer size is 512 bytes
-    bool downmix_support;   //Default is disabled
+    bool downmix_support;   //Default is disabled. Even if enabled, the mixer is used only while an input is attached.
 } sys_playback_config_t;
 
 /* If downmixing is supported. */
@@ -73,5 +107,15 @@ int sys_playback_play_tone(sys_playback_requester_t *tone);
 
 /**
  * @brief Get offset in milliseconds of registered `requester`.
+ *
+ * This is the audio handed to the output stage, including what is still queued for output.
  */
 uint32_t sys_playback_get_current_offset(sys_playback_requester_t *requester);
+
+/**
+ * @brief Get presentation offset in milliseconds of registered `requester`.
+ *
+ * Like `sys_playback_get_current_offset`, but excluding audio still queued in the downmix ring and the I2S DMA
+ * buffers, i.e. the position actually being heard. Use this for progress reports.
+ */
+uint32_t sys_playback_get_presentation_offset(sys_playback_requester_t *requester);
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdio.h>
+#define ESP_LOGE(tag, fmt, ...) printf("E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)
+#define ESP_LOGI(tag, fmt, ...)
+#define ESP_LOGD(tag, fmt, ...)
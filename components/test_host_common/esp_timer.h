@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include <esp_err.h>
+
+typedef void *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+typedef enum {
+    ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+typedef struct {
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t handle, uint64_t timeout_us);
+esp_err_t esp_timer_delete(esp_timer_handle_t handle);
@@ -0,0 +1,12 @@
+#pragma once
+#include <freertos/FreeRTOS.h>
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(int max_count, int initial_count);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+/* Created given, as on FreeRTOS */
+#define vSemaphoreCreateBinary(sem)     do { (sem) = xSemaphoreCreateBinary(); if (sem) xSemaphoreGive(sem); } while (0)
@@ -0,0 +1,10 @@
+#pragma once
+#include <freertos/FreeRTOS.h>
+
+typedef enum {
+    eSetValueWithOverwrite,
+} eNotifyAction;
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t wait);
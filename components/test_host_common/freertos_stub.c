@@ -0,0 +1,279 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/timers.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <host_stubs.h>
+
+struct host_counters host_cnt;
+
+static int app_task, timer_task;
+const TaskHandle_t host_app_task = &app_task;
+const TaskHandle_t host_timer_task = &timer_task;
+TaskHandle_t host_current_task = &app_task;
+
+int host_timer_start_fails;
+
+static uint32_t notify_value;
+static int mutexes_held;
+
+#define HOST_MAX_TIMERS     16
+#define HOST_MAX_HANDLERS   8
+
+typedef struct {
+    bool mutex;
+    int count;
+    int max_count;
+} host_sem_t;
+
+/* FreeRTOS and esp_timer timers alike */
+typedef struct {
+    esp_timer_cb_t esp_cb;
+    void *arg;
+    TimerCallbackFunction_t cb;
+    bool armed;
+} host_timer_t;
+
+static host_timer_t *timers[HOST_MAX_TIMERS];
+static shutdown_handler_t shutdown_handlers[HOST_MAX_HANDLERS];
+
+static void host_fail(const char *what)
+{
+    printf("Fail\n%s\n", what);
+    exit(-1);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return host_current_task;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    notify_value = value;
+    return pdTRUE;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t wait)
+{
+    *value = notify_value;
+    return pdTRUE;
+}
+
+static SemaphoreHandle_t host_sem_create(bool mutex, int max_count, int initial_count)
+{
+    host_sem_t *sem = calloc(1, sizeof(host_sem_t));
+    sem->mutex = mutex;
+    sem->max_count = max_count;
+    sem->count = initial_count;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return host_sem_create(true, 1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return host_sem_create(false, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(int max_count, int initial_count)
+{
+    return host_sem_create(false, max_count, initial_count);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t wait)
+{
+    host_sem_t *sem = handle;
+    if (sem->count == 0) {
+        if (wait == 0) {
+            return pdFALSE;
+        }
+        /* Nobody else runs: it would never be given */
+        host_fail(sem->mutex ? "lock taken twice" : "semaphore would never be given");
+    }
+    sem->count--;
+    mutexes_held += sem->mutex;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle)
+{
+    host_sem_t *sem = handle;
+    if (sem->count == sem->max_count) {
+        return pdFALSE;
+    }
+    sem->count++;
+    mutexes_held -= sem->mutex;
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t handle)
+{
+    free(handle);
+}
+
+static void host_run_in_timer_task(host_timer_t *t)
+{
+    if (mutexes_held) {
+        /* The timer task would block on the lock held by the waiting task */
+        host_fail("task switch with the lock held");
+    }
+    TaskHandle_t prev = host_current_task;
+    host_current_task = host_timer_task;
+    if (t->esp_cb) {
+        t->esp_cb(t->arg);
+    } else {
+        t->cb(t);
+    }
+    host_current_task = prev;
+}
+
+/* Pended functions run right away "in the timer task" */
+BaseType_t xTimerPendFunctionCall(PendedFunction_t func, void *arg1, uint32_t arg2, TickType_t wait)
+{
+    host_cnt.task_switches++;
+    TaskHandle_t prev = host_current_task;
+    host_current_task = host_timer_task;
+    func(arg1, arg2);
+    host_current_task = prev;
+    return pdTRUE;
+}
+
+static host_timer_t *host_timer_create(void)
+{
+    for (int i = 0; i < HOST_MAX_TIMERS; i++) {
+        if (!timers[i]) {
+            timers[i] = calloc(1, sizeof(host_timer_t));
+            return timers[i];
+        }
+    }
+    return NULL;
+}
+
+static void host_timer_delete(host_timer_t *t)
+{
+    for (int i = 0; i < HOST_MAX_TIMERS; i++) {
+        if (timers[i] == t) {
+            timers[i] = NULL;
+        }
+    }
+    free(t);
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                           TimerCallbackFunction_t cb)
+{
+    host_timer_t *t = host_timer_create();
+    if (t) {
+        t->cb = cb;
+        t->arg = id;
+    }
+    return t;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait)
+{
+    if (host_timer_start_fails) {
+        host_timer_start_fails--;
+        return pdFAIL;
+    }
+    ((host_timer_t *) timer)->armed = true;
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait)
+{
+    ((host_timer_t *) timer)->armed = false;
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return ((host_timer_t *) timer)->armed ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t wait)
+{
+    host_timer_delete(timer);
+    return pdPASS;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    host_timer_t *t = host_timer_create();
+    if (!t) {
+        return ESP_ERR_NO_MEM;
+    }
+    t->esp_cb = args->callback;
+    t->arg = args->arg;
+    *handle = t;
+    return ESP_OK;
+}
+
+/* A 0 timeout runs the callback right away */
+esp_err_t esp_timer_start_once(esp_timer_handle_t handle, uint64_t timeout_us)
+{
+    host_timer_t *t = (host_timer_t *) handle;
+    if (timeout_us == 0) {
+        host_cnt.task_switches++;
+        host_run_in_timer_task(t);
+    } else {
+        t->armed = true;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t handle)
+{
+    host_timer_delete(handle);
+    return ESP_OK;
+}
+
+void host_fire_timers(void)
+{
+    for (int i = 0; i < HOST_MAX_TIMERS; i++) {
+        if (timers[i] && timers[i]->armed) {
+            timers[i]->armed = false;
+            host_run_in_timer_task(timers[i]);
+        }
+    }
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler)
+{
+    for (int i = 0; i < HOST_MAX_HANDLERS; i++) {
+        if (!shutdown_handlers[i]) {
+            shutdown_handlers[i] = handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void host_shutdown(void)
+{
+    for (int i = 0; i < HOST_MAX_HANDLERS && shutdown_handlers[i]; i++) {
+        shutdown_handlers[i]();
+    }
+}
@@ -0,0 +1,70 @@
+/**
+ * Stand-ins shared by the host tests (`<component>/test_host`).
+ *
+ * Everything is single threaded. There is one "application" task and one "timer" task: pended functions and
+ * expired timers run right away, with the current task switched to the timer task. A mutex taken twice, a
+ * semaphore taken that would never be given, or a switch to the timer task with a mutex held would all hang on
+ * the target, so they end the test with a failure.
+ *
+ * A test Makefile adds this directory with -I after its own one (local headers win) and the stand-ins it needs
+ * to its objects, through vpath.
+ */
+#pragma once
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_err.h>
+
+/* What reached the stand-ins. Tests clear it as they see fit. */
+extern struct host_counters {
+    int opens;              /* NVS */
+    int sets;
+    int gets;
+    int commits;
+    int erases;
+    int task_switches;      /* Functions and timers run in the timer task */
+} host_cnt;
+
+/* freertos_stub.c: FreeRTOS, esp_timer and shutdown handlers */
+extern TaskHandle_t host_current_task;
+extern const TaskHandle_t host_app_task;
+extern const TaskHandle_t host_timer_task;
+
+/* Fail this many xTimerStart() calls, as with a full timer command queue */
+extern int host_timer_start_fails;
+/* Let all the armed timers (FreeRTOS and esp_timer) expire */
+void host_fire_timers(void);
+/* What esp_restart() does before restarting: run the shutdown handlers */
+void host_shutdown(void);
+
+/* nvs_stub.c: in-memory NVS. Committed and uncommitted values are not distinguished, only counted. */
+enum {
+    NVS_STUB_FREE,
+    NVS_STUB_I8,
+    NVS_STUB_U16,
+    NVS_STUB_STR,
+    NVS_STUB_BLOB,
+};
+
+/* Value of `key` in flash, NULL if not there. A NULL `namespace` matches any. */
+const void *nvs_stub_get(const char *namespace, const char *key, int type);
+/* Put a value in flash behind the back of the code under test. It is counted as a set. */
+esp_err_t nvs_stub_put(const char *namespace, const char *key, int type, const void *val, size_t len);
+
+/* i2c_stub.c: one device, a register file with an auto-incrementing register pointer */
+typedef struct {
+    uint8_t addr;                               /* 8 bit write address */
+    uint8_t *regs;
+    int nregs;
+    void (*on_write)(int reg, uint8_t val);     /* Optional, after each register write */
+    int nack_at;                                /* NACK this byte of the next transaction (from 1, addresses
+                                                   included): the bytes before it are applied. 0 for none. */
+    struct {
+        int transactions;
+        int bytes;                              /* Addresses included */
+        int writes;                             /* Register writes */
+        int reads;                              /* Register reads */
+        long bits;                              /* SCL periods: start or repeated start, 9 per byte, stop */
+    } cnt;
+} i2c_stub_t;
+
+extern i2c_stub_t i2c_stub;
@@ -0,0 +1,161 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+
+#include <driver/i2c.h>
+#include <host_stubs.h>
+
+#define CMD_LINK_OPS    512
+
+i2c_stub_t i2c_stub;
+
+enum {
+    OP_START,
+    OP_WRITE,
+    OP_READ,
+    OP_STOP,
+};
+
+typedef struct {
+    struct {
+        int type;
+        uint8_t byte;
+        uint8_t *dst;
+    } ops[CMD_LINK_OPS];
+    int len;
+} cmd_link_t;
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t rx_len, size_t tx_len, int flags)
+{
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return calloc(1, sizeof(cmd_link_t));
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd)
+{
+    free(cmd);
+}
+
+static esp_err_t cmd_add(i2c_cmd_handle_t cmd, int type, uint8_t byte, uint8_t *dst)
+{
+    cmd_link_t *c = cmd;
+    if (c->len == CMD_LINK_OPS) {
+        return ESP_FAIL;
+    }
+    c->ops[c->len].type = type;
+    c->ops[c->len].byte = byte;
+    c->ops[c->len].dst = dst;
+    c->len++;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd)
+{
+    return cmd_add(cmd, OP_START, 0, NULL);
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd)
+{
+    return cmd_add(cmd, OP_STOP, 0, NULL);
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en)
+{
+    return cmd_add(cmd, OP_WRITE, data, NULL);
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, uint8_t *data, size_t data_len, bool ack_en)
+{
+    esp_err_t res = ESP_OK;
+    for (size_t i = 0; i < data_len; i++) {
+        res |= cmd_add(cmd, OP_WRITE, data[i], NULL);
+    }
+    return res;
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t *data, int ack)
+{
+    return cmd_add(cmd, OP_READ, 0, data);
+}
+
+/* Play the command link against the device. The register pointer is kept across transactions. */
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, uint32_t ticks_to_wait)
+{
+    static int ptr;
+    cmd_link_t *c = cmd;
+    if (c->len < 3 || c->ops[0].type != OP_START || c->ops[c->len - 1].type != OP_STOP) {
+        return ESP_FAIL;
+    }
+    i2c_stub.cnt.transactions++;
+    int pos = 0, byte = 0;
+    bool reading = false;
+    int nack_at = i2c_stub.nack_at;
+    i2c_stub.nack_at = 0;
+    for (int i = 0; i < c->len; i++) {
+        int type = c->ops[i].type;
+        i2c_stub.cnt.bits += (type == OP_WRITE || type == OP_READ) ? 9 : 1;
+        if (type == OP_START) {
+            pos = 0;
+            continue;
+        }
+        if (type == OP_STOP) {
+            continue;
+        }
+        i2c_stub.cnt.bytes++;
+        if (++byte == nack_at) {
+            return ESP_FAIL;
+        }
+        if (type == OP_WRITE) {
+            if (pos == 0) {
+                if ((c->ops[i].byte & 0xFE) != i2c_stub.addr) {
+                    return ESP_FAIL;
+                }
+                reading = c->ops[i].byte & 0x01;
+            } else if (reading) {
+                return ESP_FAIL;
+            } else if (pos == 1) {
+                ptr = c->ops[i].byte;
+            } else {
+                if (ptr >= i2c_stub.nregs) {
+                    return ESP_FAIL;
+                }
+                i2c_stub.regs[ptr] = c->ops[i].byte;
+                i2c_stub.cnt.writes++;
+                if (i2c_stub.on_write) {
+                    i2c_stub.on_write(ptr, c->ops[i].byte);
+                }
+                ptr++;
+            }
+        } else {
+            if (!reading || pos == 0 || ptr >= i2c_stub.nregs) {
+                return ESP_FAIL;
+            }
+            *c->ops[i].dst = i2c_stub.regs[ptr];
+            i2c_stub.cnt.reads++;
+            ptr++;
+        }
+        pos++;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,187 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <nvs_flash.h>
+#include <host_stubs.h>
+
+#define NVS_ITEMS       64
+#define NVS_NAMESPACES  8
+
+/* A handle is the index of its namespace, plus one */
+static char namespaces[NVS_NAMESPACES][NVS_KEY_NAME_MAX_SIZE];
+
+static struct {
+    nvs_handle handle;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    int type;
+    size_t len;
+    uint8_t data[8192];
+} nvs[NVS_ITEMS];
+
+static int nvs_find(nvs_handle handle, const char *key, int type)
+{
+    for (int i = 0; i < NVS_ITEMS; i++) {
+        if (nvs[i].type == type && (!handle || nvs[i].handle == handle) && strcmp(nvs[i].key, key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static esp_err_t nvs_put(nvs_handle handle, const char *key, int type, const void *val, size_t len)
+{
+    int i = nvs_find(handle, key, type);
+    for (int j = 0; i < 0 && j < NVS_ITEMS; j++) {
+        if (nvs[j].type == NVS_STUB_FREE) {
+            i = j;
+        }
+    }
+    if (i < 0 || len > sizeof(nvs[i].data)) {
+        return ESP_FAIL;
+    }
+    nvs[i].handle = handle;
+    strcpy(nvs[i].key, key);
+    nvs[i].type = type;
+    nvs[i].len = len;
+    memcpy(nvs[i].data, val, len);
+    host_cnt.sets++;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_fetch(nvs_handle handle, const char *key, int type, void *val, size_t *len)
+{
+    host_cnt.gets++;
+    int i = nvs_find(handle, key, type);
+    if (i < 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (val && *len < nvs[i].len) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    if (val) {
+        memcpy(val, nvs[i].data, nvs[i].len);
+    }
+    *len = nvs[i].len;
+    return ESP_OK;
+}
+
+static nvs_handle nvs_namespace(const char *name, bool create)
+{
+    for (int i = 0; i < NVS_NAMESPACES; i++) {
+        if (create && namespaces[i][0] == '\0') {
+            strcpy(namespaces[i], name);
+        }
+        if (strcmp(namespaces[i], name) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+const void *nvs_stub_get(const char *namespace, const char *key, int type)
+{
+    nvs_handle handle = namespace ? nvs_namespace(namespace, false) : 0;
+    if (namespace && !handle) {
+        return NULL;
+    }
+    int i = nvs_find(handle, key, type);
+    return (i < 0) ? NULL : nvs[i].data;
+}
+
+esp_err_t nvs_stub_put(const char *namespace, const char *key, int type, const void *val, size_t len)
+{
+    return nvs_put(nvs_namespace(namespace, true), key, type, val, len);
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle)
+{
+    host_cnt.opens++;
+    *out_handle = nvs_namespace(name, true);
+    return *out_handle ? ESP_OK : ESP_FAIL;
+}
+
+void nvs_close(nvs_handle handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle handle)
+{
+    host_cnt.commits++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_i8(nvs_handle handle, const char *key, int8_t value)
+{
+    return nvs_put(handle, key, NVS_STUB_I8, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u16(nvs_handle handle, const char *key, uint16_t value)
+{
+    return nvs_put(handle, key, NVS_STUB_U16, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_str(nvs_handle handle, const char *key, const char *value)
+{
+    return nvs_put(handle, key, NVS_STUB_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length)
+{
+    return nvs_put(handle, key, NVS_STUB_BLOB, value, length);
+}
+
+esp_err_t nvs_get_i8(nvs_handle handle, const char *key, int8_t *out_value)
+{
+    size_t len = sizeof(*out_value);
+    return nvs_fetch(handle, key, NVS_STUB_I8, out_value, &len);
+}
+
+esp_err_t nvs_get_u16(nvs_handle handle, const char *key, uint16_t *out_value)
+{
+    size_t len = sizeof(*out_value);
+    return nvs_fetch(handle, key, NVS_STUB_U16, out_value, &len);
+}
+
+esp_err_t nvs_get_str(nvs_handle handle, const char *key, char *out_value, size_t *length)
+{
+    return nvs_fetch(handle, key, NVS_STUB_STR, out_value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *out_value, size_t *length)
+{
+    return nvs_fetch(handle, key, NVS_STUB_BLOB, out_value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char *key)
+{
+    int found = 0;
+    for (int i = 0; i < NVS_ITEMS; i++) {
+        if (nvs[i].type != NVS_STUB_FREE && nvs[i].handle == handle && strcmp(nvs[i].key, key) == 0) {
+            nvs[i].type = NVS_STUB_FREE;
+            found = 1;
+        }
+    }
+    host_cnt.erases++;
+    return found ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(nvs, 0, sizeof(nvs));
+    host_cnt.erases++;
+    return ESP_OK;
+}